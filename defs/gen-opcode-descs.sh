@@ -0,0 +1,75 @@
+#!/bin/sh
+# Regenerates the opcode descriptor table from opcode_descs.txt:
+#
+#   sh defs/gen-opcode-descs.sh > src/sm4_opcode_descs.cpp
+#
+# Every line of opcode_descs.txt describes the opcode on the same line of
+# opcodes.txt:
+#
+#   NAME insn [DSTS]
+#   NAME customdata
+#   NAME phase
+#   NAME dcl OPERANDS WORDS [sv|indexable_temp|function_table|interface|unhandled]
+#
+# A declaration reads OPERANDS operands (0 or 1) followed by WORDS 32-bit
+# words, which by default are stored in order into the union of sm4_dcl;
+# the optional last field selects a layout needing special handling.
+# An instruction has DSTS destination operands, 1 by default, which come
+# before its sources.
+
+cd "$(dirname "$0")" || exit 1
+
+awk '
+NR == FNR { names[FNR] = $1; count = FNR; next }
+{
+	if ($1 != names[FNR])
+	{
+		printf "opcode_descs.txt:%d: expected %s, got %s\n", FNR, names[FNR], $1 > "/dev/stderr"
+		failed = 1
+		exit 1
+	}
+	kind = toupper($2)
+	ops = 0
+	words = 0
+	dsts = 0
+	layout = "WORDS"
+	if ($2 == "insn")
+		dsts = NF >= 3 ? $3 : 1
+	if ($2 == "dcl")
+	{
+		ops = $3
+		words = $4
+		if (NF >= 5)
+			layout = toupper($5)
+	}
+	else if ($2 != "insn" && $2 != "customdata" && $2 != "phase")
+	{
+		printf "opcode_descs.txt:%d: unknown kind %s\n", FNR, $2 > "/dev/stderr"
+		failed = 1
+		exit 1
+	}
+	lines[FNR] = sprintf("\t{SM4_OPCODE_KIND_%s, %d, %d, SM4_DCL_LAYOUT_%s, %d}, // %s", kind, ops, words, layout, dsts, $1)
+	described = FNR
+}
+END {
+	if (failed)
+		exit 1
+	if (described != count)
+	{
+		printf "opcode_descs.txt: %d entries for %d opcodes\n", described, count > "/dev/stderr"
+		exit 1
+	}
+	print "/* Generated by defs/gen-opcode-descs.sh from defs/opcode_descs.txt, do not edit */"
+	print ""
+	print "#include \"sm4.h\""
+	print ""
+	print "const sm4_opcode_desc sm4_opcode_descs[] = {"
+	for (i = 1; i <= count; ++i)
+		print lines[i]
+	print "};"
+	print ""
+	print "static_assert(sizeof(sm4_opcode_descs) / sizeof(sm4_opcode_descs[0]) =="
+	print "\t\t\t\t  SM4_OPCODE_COUNT,"
+	print "\t\t\t  \"opcode_descs.txt is out of sync with opcodes.txt\");"
+}
+' opcodes.txt opcode_descs.txt
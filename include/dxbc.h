@@ -28,7 +28,9 @@
 #define DXBC_H_
 
 #include "le32.h"
+#include "text_writer.h"
 #include <iostream>
+#include <limits.h>
 #include <map>
 #include <stdint.h>
 #include <vector>
@@ -207,72 +209,157 @@ struct dxbc_chunk_statistics : public dxbc_chunk_header
 	} optional[];
 };
 
-struct dxbc_container
-{
-	const void* data;
-	std::vector<dxbc_chunk_header*> chunks;
-	std::map<unsigned, unsigned> chunk_map;
-};
+#define DXBC_FIND_INPUT_SIGNATURE 0
+#define DXBC_FIND_OUTPUT_SIGNATURE 1
+#define DXBC_FIND_PATCH_SIGNATURE 2
 
 struct dxbc_container_header
 {
 	unsigned fourcc;
-	uint32_t unk[4];
+	uint32_t unk[4]; /* the checksum, see dxbc_checksum */
 	uint32_t one;
 	uint32_t total_size;
 	uint32_t chunk_count;
 };
 
-dxbc_container* dxbc_parse(const void* data, int size);
+#define DXBC_VIEW_MAX_CHUNKS 64
+#define DXBC_VIEW_HASH_BITS 7
+
+/* also check the checksum stored in the container header */
+#define DXBC_PARSE_VERIFY_CHECKSUM 1
+
+/* Non-owning view of a DXBC container, cheap enough to live on the stack.
+ * init() checks the header, the chunk offsets and the chunk sizes against
+ * the size of the blob once, so that the chunks handed out afterwards are
+ * known to lie within it, and builds a small hash table making FourCC
+ * lookups constant time. When a FourCC occurs several times, the first
+ * chunk wins, like with a linear scan. Only the first DXBC_VIEW_MAX_CHUNKS
+ * chunks go into the table; the rare containers with more have the others
+ * read from, and searched through, the offsets in their header.
+ */
+struct dxbc_view
+{
+	const void* data;
+	unsigned size;
+	unsigned num_chunks;
+	uint32_t offsets[DXBC_VIEW_MAX_CHUNKS];
+	/* chunk index + 1 for each hash bucket, 0 when empty */
+	uint8_t buckets[1 << DXBC_VIEW_HASH_BITS];
+
+	dxbc_view() : data(0), size(0), num_chunks(0) {}
+
+	/* returns NULL on success, or a description of what is wrong; flags
+	 * are DXBC_PARSE_* */
+	const char* init(const void* data, int size, unsigned flags = 0);
+
+	dxbc_chunk_header* chunk(unsigned i) const
+	{
+		if (i >= DXBC_VIEW_MAX_CHUNKS)
+		{
+			const uint32_t* header_offsets =
+				(const uint32_t*)((const dxbc_container_header*)data + 1);
+			return (dxbc_chunk_header*)((char*)data +
+										bswap_le32(header_offsets[i]));
+		}
+		return (dxbc_chunk_header*)((char*)data + offsets[i]);
+	}
+
+	dxbc_chunk_header* find(unsigned fourcc) const
+	{
+		/* at most half full, so the probing always reaches an empty bucket */
+		const unsigned mask = (1 << DXBC_VIEW_HASH_BITS) - 1;
+		for (unsigned h = hash(fourcc);; h = (h + 1) & mask)
+		{
+			if (!buckets[h])
+				return num_chunks > DXBC_VIEW_MAX_CHUNKS
+						   ? find_past_table(fourcc)
+						   : 0;
+			dxbc_chunk_header* c = chunk(buckets[h] - 1);
+			if (bswap_le32(c->fourcc) == fourcc)
+				return c;
+		}
+	}
+
+	dxbc_chunk_header* find_shader_bytecode() const
+	{
+		dxbc_chunk_header* c = find(FOURCC_SHDR);
+		return c ? c : find(FOURCC_SHEX);
+	}
+
+	dxbc_chunk_signature* find_signature(unsigned kind) const;
+
+	/* the chunks that did not fit in the table, in order */
+	dxbc_chunk_header* find_past_table(unsigned fourcc) const;
+
+	static unsigned hash(unsigned fourcc)
+	{
+		return (fourcc * 2654435761u) >> (32 - DXBC_VIEW_HASH_BITS);
+	}
+};
+
+struct dxbc_container
+{
+	const void* data;
+	std::vector<dxbc_chunk_header*> chunks;
+	dxbc_view view;
+};
+
+/* returns NULL for a malformed container, with what is wrong with it in
+ * *error when error is not NULL */
+dxbc_container* dxbc_parse(const void* data, int size, unsigned flags = 0,
+						   const char** error = 0);
+
+/* the parsers take int sizes: returns what is wrong with a buffer too
+ * large for them, such as a multi-gigabyte mapped file, or NULL */
+static inline const char* dxbc_check_size(size_t size)
+{
+	return size > (size_t)INT_MAX ? "Too large for a DXBC container" : 0;
+}
+text_writer& operator<<(text_writer& out, const dxbc_container& container);
+/* dumps the chunks of the container that are understood, skipping those
+ * that are malformed; returns 0, or the error of the first one of them,
+ * whose index is stored in *chunk */
+const char* dxbc_dump(text_writer& out, const dxbc_container& container,
+					  unsigned* chunk = 0);
 std::ostream& operator<<(std::ostream& out, const dxbc_container& container);
 
+/* these validate the container on every call: to look up several chunks,
+ * init a dxbc_view once and use it instead */
 dxbc_chunk_header* dxbc_find_chunk(const void* data, int size, unsigned fourcc);
 
 static inline dxbc_chunk_header* dxbc_find_shader_bytecode(const void* data,
 														   int size)
 {
-	dxbc_chunk_header* chunk;
-	chunk = dxbc_find_chunk(data, size, FOURCC_SHDR);
-	if (!chunk)
-		chunk = dxbc_find_chunk(data, size, FOURCC_SHEX);
-	return chunk;
+	dxbc_view view;
+	if (view.init(data, size))
+		return 0;
+	return view.find_shader_bytecode();
 }
 
-#define DXBC_FIND_INPUT_SIGNATURE 0
-#define DXBC_FIND_OUTPUT_SIGNATURE 1
-#define DXBC_FIND_PATCH_SIGNATURE 2
-
 static inline dxbc_chunk_signature* dxbc_find_signature(const void* data,
 														int size, unsigned kind)
 {
-	unsigned fourcc;
-	switch (kind)
-	{
-	case DXBC_FIND_INPUT_SIGNATURE:
-		fourcc = FOURCC_ISGN;
-		break;
-	case DXBC_FIND_OUTPUT_SIGNATURE:
-		fourcc = FOURCC_OSGN;
-		break;
-	case DXBC_FIND_PATCH_SIGNATURE:
-		fourcc = FOURCC_PCSG;
-		break;
-	default:
-		return NULL;
-	}
-	return (dxbc_chunk_signature*)dxbc_find_chunk(data, size, fourcc);
+	dxbc_view view;
+	if (view.init(data, size))
+		return 0;
+	return view.find_signature(kind);
 }
 
+/* The chunk parsers below check every offset and table they follow against
+ * the size of the chunk, and every name for a terminator within it; they
+ * return 0 or an error message, leaving nothing to free when they fail.
+ * The enumerated values they return are not range checked.
+ */
 struct _D3D11_SIGNATURE_PARAMETER_DESC;
 typedef struct _D3D11_SIGNATURE_PARAMETER_DESC D3D11_SIGNATURE_PARAMETER_DESC;
-int dxbc_parse_signature(dxbc_chunk_signature* sig,
-						 D3D11_SIGNATURE_PARAMETER_DESC** params);
+const char* dxbc_parse_signature(dxbc_chunk_signature* sig, int& count,
+								 D3D11_SIGNATURE_PARAMETER_DESC** params);
 
 struct _D3D11_SHADER_BUFFER_DESC;
 typedef struct _D3D11_SHADER_BUFFER_DESC D3D11_SHADER_BUFFER_DESC;
 struct _D3D11_SHADER_INPUT_BIND_DESC;
 typedef struct _D3D11_SHADER_INPUT_BIND_DESC D3D11_SHADER_INPUT_BIND_DESC;
-void dxbc_parse_resource_definition(dxbc_chunk_resource_definition* rdef,
+const char* dxbc_parse_resource_definition(dxbc_chunk_resource_definition* rdef,
 						 int& buffer_count,
 						 D3D11_SHADER_BUFFER_DESC** buffers,
 						 int& binding_count,
@@ -283,11 +370,40 @@ struct _D3D11_SHADER_TYPE_DESC;
 typedef struct _D3D11_SHADER_TYPE_DESC D3D11_SHADER_TYPE_DESC;
 struct _D3D11_SHADER_VARIABLE_DESC;
 typedef struct _D3D11_SHADER_VARIABLE_DESC D3D11_SHADER_VARIABLE_DESC;
-int dxbc_parse_shader_variables(dxbc_chunk_resource_definition* rdef,
-						 unsigned buffer_index,
+const char* dxbc_parse_shader_variables(dxbc_chunk_resource_definition* rdef,
+						 unsigned buffer_index, int& count,
 						 D3D11_SHADER_TYPE_DESC** types,
 						 D3D11_SHADER_VARIABLE_DESC** variables);
 
+/* Looks for DXBC containers embedded at arbitrary byte offsets of a larger
+ * buffer, such as a game archive or an executable. Returns the offset of the
+ * first container starting in [start, end) whose header, chunk offsets and
+ * chunk sizes agree with each other and fit into the first size bytes, and
+ * stores its total size in *blob_size; returns end if there is none.
+ * Containers found this way need not be 4 byte aligned.
+ */
+size_t dxbc_scan(const void* data, size_t size, size_t start, size_t end,
+				 size_t* blob_size);
+
+/* computes the checksum of a whole container, as stored in the header by
+ * fxc and checked by the runtime; fails if the container is too small or
+ * too large to have one */
+bool dxbc_checksum(const void* data, size_t size, uint32_t checksum[4]);
+
+/* compares the checksum of a container with the one in its header */
+bool dxbc_verify_checksum(const void* data, size_t size);
+
+/* checksums count containers at once, several of them in parallel in SIMD
+ * lanes where available, which is a lot faster than one after the other
+ * when verifying whole shader caches. valid[i], when valid is not NULL,
+ * tells whether dxbc_checksum would have succeeded for container i; the
+ * checksums of those it fails for are zeroed.
+ */
+void dxbc_checksum_multi(unsigned count, const void* const* data,
+						 const size_t* sizes, uint32_t (*checksums)[4],
+						 bool* valid);
+
+/* returns a malloc()ed container the caller frees, checksum included */
 std::pair<void*, size_t> dxbc_assemble(struct dxbc_chunk_header** chunks,
 									   unsigned num_chunks);
 
@@ -299,6 +415,15 @@ extern const char* dxbc_shader_dimension_names[];
 extern const char* dxbc_register_component_type_names[];
 extern const char* dxbc_names[];
 
+/* the sizes of the tables above; the input type count covers both input
+ * type tables, and dxbc_names has null entries */
+extern const unsigned dxbc_shader_type_name_count;
+extern const unsigned dxbc_shader_input_type_name_count;
+extern const unsigned dxbc_shader_return_type_name_count;
+extern const unsigned dxbc_shader_dimension_name_count;
+extern const unsigned dxbc_register_component_type_name_count;
+extern const unsigned dxbc_name_count;
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -0,0 +1,70 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Read-only memory mapped input files */
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <stddef.h>
+
+/* access pattern hints, see mapped_file::advise */
+#define MAPPED_FILE_NORMAL 0
+#define MAPPED_FILE_SEQUENTIAL 1 /* read ahead aggressively */
+#define MAPPED_FILE_WILLNEED 2	 /* start paging in right away */
+#define MAPPED_FILE_DONTNEED 4	 /* drop pages that have been consumed */
+
+/* Maps a whole file read-only, so that its contents can be handed to
+ * dxbc_parse and sm4_parse without copying: the parsed structures point
+ * straight into the mapping, which must therefore outlive them.
+ * Empty files open successfully with data == NULL and size == 0.
+ */
+struct mapped_file
+{
+	const void* data;
+	size_t size;
+
+	mapped_file();
+	~mapped_file() { close(); }
+
+	bool open(const char* path,
+			  unsigned hints = MAPPED_FILE_SEQUENTIAL | MAPPED_FILE_WILLNEED);
+	void close();
+
+	/* applies hints to the byte range [offset, offset + length) */
+	void advise(size_t offset, size_t length, unsigned hints) const;
+
+  private:
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#endif
+
+	mapped_file(const mapped_file&);
+	mapped_file& operator=(const mapped_file&);
+};
+
+#endif /* MAPPED_FILE_H_ */
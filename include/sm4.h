@@ -30,9 +30,10 @@
 #define SM4_H_
 
 #include "le32.h"
+#include "text_writer.h"
 #include <iostream>
 #include <map>
-#include <memory>
+#include <new>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,6 +58,38 @@ enum sm4_opcode_type
 };
 
 extern const sm4_opcode_type sm4_opcode_types[];
+
+enum sm4_opcode_kind
+{
+	SM4_OPCODE_KIND_INSN,
+	SM4_OPCODE_KIND_DCL,
+	SM4_OPCODE_KIND_CUSTOMDATA,
+	SM4_OPCODE_KIND_PHASE
+};
+
+/* how the tokens of a declaration after its operand are decoded */
+enum sm4_dcl_layout
+{
+	SM4_DCL_LAYOUT_WORDS,
+	SM4_DCL_LAYOUT_SV,
+	SM4_DCL_LAYOUT_INDEXABLE_TEMP,
+	SM4_DCL_LAYOUT_FUNCTION_TABLE,
+	SM4_DCL_LAYOUT_INTERFACE,
+	SM4_DCL_LAYOUT_UNHANDLED
+};
+
+/* decoding information for each opcode, generated from defs/opcode_descs.txt
+ * by defs/gen-opcode-descs.sh */
+struct sm4_opcode_desc
+{
+	uint8_t kind;      /* sm4_opcode_kind */
+	uint8_t num_ops;   /* operands of a declaration, 0 or 1 */
+	uint8_t num_words; /* tokens after the operand, for SM4_DCL_LAYOUT_WORDS */
+	uint8_t layout;    /* sm4_dcl_layout */
+	uint8_t num_dsts;  /* leading destination operands of an instruction */
+};
+
+extern const sm4_opcode_desc sm4_opcode_descs[];
 extern const char* sm4_opcode_names[];
 extern const char* sm4_file_names[];
 extern const char* sm4_shortfile_names[];
@@ -65,6 +98,8 @@ extern const char* sm4_interpolation_names[];
 extern const char* sm4_sv_names[];
 extern const char* sm4_primitive_names[];
 extern const char* sm4_primitive_topology_names[];
+extern const unsigned sm4_primitive_name_count;
+extern const unsigned sm4_primitive_topology_name_count;
 
 struct sm4_token_version
 {
@@ -253,7 +288,108 @@ struct sm4_op;
 struct sm4_insn;
 struct sm4_dcl;
 struct sm4_program;
-//std::ostream& operator <<(std::ostream& out, const sm4_op& op);
+
+/* Bump allocator all nodes of a sm4_program are carved from.
+ * Nothing allocated from it is ever destroyed individually: memory is only
+ * returned by reset(), which keeps the blocks around so that the next
+ * program parsed into the same arena does not have to go back to malloc,
+ * or by the destructor.
+ */
+struct sm4_arena
+{
+	explicit sm4_arena(size_t block_size = 64 * 1024)
+		: block_size(block_size), current(0), used(0)
+	{
+	}
+
+	~sm4_arena();
+
+	void* alloc(size_t size, size_t align = 8)
+	{
+		if (current < blocks.size())
+		{
+			size_t offset = (used + align - 1) & ~(align - 1);
+			if (offset + size <= blocks[current].size)
+			{
+				used = offset + size;
+				return blocks[current].base + offset;
+			}
+		}
+		return alloc_slow(size, align);
+	}
+
+	/* only for types that need no destructor */
+	template <typename T> T* create()
+	{
+		return new (alloc(sizeof(T), alignof(T))) T();
+	}
+
+	/* forgets every allocation but keeps the memory for reuse */
+	void reset()
+	{
+		current = 0;
+		used = 0;
+	}
+
+	size_t capacity() const;
+
+  private:
+	struct block
+	{
+		char* base;
+		size_t size;
+	};
+
+	void* alloc_slow(size_t size, size_t align);
+
+	std::vector<block> blocks;
+	size_t block_size;
+	unsigned current;
+	size_t used;
+
+	sm4_arena(const sm4_arena&);
+	sm4_arena& operator=(const sm4_arena&);
+};
+enum sm4_dump_immediates
+{
+	SM4_DUMP_IMMEDIATES_TYPED, /* as the type the instruction operates on */
+	SM4_DUMP_IMMEDIATES_HEX    /* raw bits, e.g. l(0x3f800000) */
+};
+
+/* Formatting options, passed to every printer call rather than kept in a
+ * global so that several threads can dump with different options at once.
+ * The operator<< overloads use the defaults.
+ */
+struct sm4_dump_options
+{
+	/* fxc-like register names (r0, cb0[1]) instead of temp[0] and
+	 * constant_buffer[0][1] */
+	bool short_syntax;
+	unsigned immediates; /* sm4_dump_immediates */
+	/* spaces per nesting level of if/loop/switch bodies */
+	unsigned indent_width;
+
+	sm4_dump_options()
+		: short_syntax(true), immediates(SM4_DUMP_IMMEDIATES_TYPED),
+		  indent_width(2)
+	{
+	}
+};
+
+/* the printers write to a text_writer; the std::ostream overloads wrap
+ * them in a writer flushing into the stream */
+text_writer& dump_op_code(text_writer& out, const sm4_op& op,
+						  const sm4_insn* pInsn,
+						  const sm4_dump_options& options);
+text_writer& sm4_dump(text_writer& out, const sm4_insn& insn,
+					  const sm4_dump_options& options);
+text_writer& sm4_dump(text_writer& out, const sm4_dcl& dcl,
+					  const sm4_dump_options& options);
+text_writer& sm4_dump(text_writer& out, const sm4_program& program,
+					  const sm4_dump_options& options);
+text_writer& operator<<(text_writer& out, const sm4_insn& op);
+text_writer& operator<<(text_writer& out, const sm4_dcl& op);
+text_writer& operator<<(text_writer& out, const sm4_program& op);
 std::ostream& operator<<(std::ostream& out, const sm4_insn& op);
 std::ostream& operator<<(std::ostream& out, const sm4_dcl& op);
 std::ostream& operator<<(std::ostream& out, const sm4_program& op);
@@ -276,12 +412,12 @@ struct sm4_op
 	struct
 	{
 		int64_t disp;
-		std::auto_ptr<sm4_op> reg;
+		sm4_op* reg;
 	} indices[3];
 
 	bool is_index_simple(unsigned i) const
 	{
-		return !indices[i].reg.get() && indices[i].disp >= 0 &&
+		return !indices[i].reg && indices[i].disp >= 0 &&
 			   (int64_t)(int32_t)indices[i].disp == indices[i].disp;
 	}
 
@@ -294,6 +430,9 @@ struct sm4_op
 
 	void dump();
 
+	/* the program builder copies the transient nodes of the decoder */
+	sm4_op& operator=(const sm4_op&) = default;
+
   private:
 	sm4_op(const sm4_op& op) { (void)op; }
 };
@@ -301,6 +440,9 @@ struct sm4_op
 /* for sample_d */
 #define SM4_MAX_OPS 6
 
+/* one of each type: sample controls, resource dimension and return type */
+#define SM4_MAX_EXTENDED_TOKENS 3
+
 struct sm4_insn : public sm4_token_instruction
 {
 	int8_t sample_offset[3];
@@ -309,7 +451,12 @@ struct sm4_insn : public sm4_token_instruction
 
 	unsigned num;
 	unsigned num_ops;
-	std::auto_ptr<sm4_op> ops[SM4_MAX_OPS];
+	sm4_op* ops[SM4_MAX_OPS];
+
+	/* the extended instruction tokens as found in the program, for
+	 * sm4_encode; the fields above take precedence over them */
+	uint32_t extended[SM4_MAX_EXTENDED_TOKENS];
+	unsigned num_extended;
 
 	sm4_insn() { memset(this, 0, sizeof(*this)); }
 
@@ -317,15 +464,21 @@ struct sm4_insn : public sm4_token_instruction
 
 	int indents() const;
 
+	/* the program builder copies the transient nodes of the decoder */
+	sm4_insn& operator=(const sm4_insn&) = default;
+
   private:
 	sm4_insn(const sm4_insn& op) { (void)op; }
 };
 
 struct sm4_dcl : public sm4_token_instruction
 {
-	std::auto_ptr<sm4_op> op;
+	sm4_op* op;
 	union
 	{
+		/* the declaration tokens following the operand, in order,
+		 * for declarations laid out as SM4_DCL_LAYOUT_WORDS */
+		uint32_t words[4];
 		unsigned num;
 		float f32;
 		sm4_sv sv;
@@ -356,14 +509,27 @@ struct sm4_dcl : public sm4_token_instruction
 		} function_table;
 	};
 
+	/* allocated from the program's arena */
 	void* data;
 
+	/* as in sm4_insn */
+	uint32_t extended[SM4_MAX_EXTENDED_TOKENS];
+	unsigned num_extended;
+
+	/* the number of instructions before the declaration in the program:
+	 * hull shader phases have declarations of their own */
+	unsigned insn_num;
+
 	sm4_dcl() { memset(this, 0, sizeof(*this)); }
 
-	~sm4_dcl() { free(data); }
+	/* number of 32-bit words data points to */
+	unsigned data_size() const;
 
 	void dump();
 
+	/* the program builder copies the transient nodes of the decoder */
+	sm4_dcl& operator=(const sm4_dcl&) = default;
+
   private:
 	sm4_dcl(const sm4_dcl& op) { (void)op; }
 };
@@ -388,30 +554,33 @@ struct sm4_program
     * for endifs, the insn number of the if
     * for loops, the insn number of the endloop
     * for endloops, the insn number of the loop
+    * for switches, cases and defaults, the insn number of the next case,
+    * default or endswitch
+    * for endswitches, the insn number of the switch
     * for all others, -1
     */
 	std::vector<int> cf_insn_linked;
 
 	bool labels_found;
+	/* by label index, -1 for the indices without a label */
 	std::vector<int> label_to_insn_num;
 
-	sm4_program()
+	/* all dcls, insns, ops and their data come from here; this is either
+	 * own_arena or one shared with other programs, which the caller resets
+	 * once the program is gone */
+	sm4_arena* arena;
+	sm4_arena own_arena;
+
+	explicit sm4_program(sm4_arena* shared_arena = 0)
 	{
 		memset(&version, 0, sizeof(version));
 		labels_found = false;
 		num_params_in = num_params_out = num_params_patch = 0;
+		arena = shared_arena ? shared_arena : &own_arena;
 	}
 
 	~sm4_program()
 	{
-		for (std::vector<sm4_dcl*>::iterator i = dcls.begin(), e = dcls.end();
-			 i != e; ++i)
-			delete *i;
-		for (std::vector<sm4_insn*>::iterator i = insns.begin(),
-											  e = insns.end();
-			 i != e; ++i)
-			delete *i;
-
 		if (num_params_in)
 			free(params_in);
 		if (num_params_out)
@@ -426,11 +595,830 @@ struct sm4_program
 	sm4_program(const sm4_dcl& op) { (void)op; }
 };
 
-sm4_program* sm4_parse(void* tokens, int size);
+enum sm4_parse_error_code
+{
+	SM4_PARSE_OK,
+	SM4_PARSE_TRUNCATED,		 /* the program header exceeds the chunk */
+	SM4_PARSE_BAD_LENGTH,		 /* zero or exceeding the program */
+	SM4_PARSE_BAD_OPCODE,
+	SM4_PARSE_LENGTH_MISMATCH,	 /* operands not filling the length exactly */
+	SM4_PARSE_BAD_OPERAND,		 /* register file, index, component count... */
+	SM4_PARSE_TOO_MANY_OPERANDS,
+	SM4_PARSE_UNHANDLED_DCL,
+	SM4_PARSE_BAD_DCL,
+	SM4_PARSE_NO_SUCH_ENTRY,	 /* sm4_decode_one past the end of the index */
+	SM4_PARSE_TOO_MANY_EXTENDED, /* more than SM4_MAX_EXTENDED_TOKENS */
+
+	SM4_PARSE_ERROR_COUNT
+};
+
+/* indexed by sm4_parse_error_code */
+extern const char* sm4_parse_error_names[];
+
+/* Where and why decoding failed. The parsers never abort or read outside
+ * the buffer they are given, whatever it contains: malformed programs are
+ * reported through this and can simply be skipped.
+ */
+struct sm4_parse_error
+{
+	unsigned code;	 /* sm4_parse_error_code */
+	unsigned offset; /* in tokens from the version token, of the failing
+					  * declaration or instruction */
+	unsigned opcode; /* its opcode, SM4_OPCODE_COUNT if not known */
+};
+
+/* if arena is not NULL, the program's nodes are allocated from it instead
+ * of from an arena owned by the program; on failure, NULL is returned and
+ * error, if not NULL, is filled in */
+sm4_program* sm4_parse(void* tokens, int size, sm4_arena* arena = 0,
+					   sm4_parse_error* error = 0);
+
+/* Encodes a program back into a SHDR/SHEX token stream, the version and
+ * length tokens included. Unmodified programs come out exactly as parsed.
+ * With tokens NULL, only num_tokens is set, to the size of the stream;
+ * otherwise, tokens holds num_tokens tokens on input and num_tokens is set
+ * to the number written. Returns NULL on success, or an error message.
+ */
+const char* sm4_encode(const sm4_program& program, uint32_t* tokens,
+					   unsigned& num_tokens);
+
+/* Streaming alternative to sm4_parse, for passes that do not need the
+ * whole program: sm4_decode reports the version, then every declaration
+ * and instruction in program order, without allocating anything.
+ * The nodes passed in are decoded into the decoder's own stack buffers and
+ * are only valid for the duration of the call; sm4_dcl::data points
+ * straight into the token stream. Returning false stops decoding early.
+ */
+struct sm4_visitor
+{
+	virtual ~sm4_visitor() {}
+
+	virtual bool visit_version(const sm4_token_version& version)
+	{
+		(void)version;
+		return true;
+	}
+
+	virtual bool visit_dcl(const sm4_dcl& dcl)
+	{
+		(void)dcl;
+		return true;
+	}
+
+	virtual bool visit_insn(const sm4_insn& insn)
+	{
+		(void)insn;
+		return true;
+	}
+};
+
+/* returns NULL on success (including a visitor stopping early), or an
+ * error message; error, if not NULL, is filled in either way */
+const char* sm4_decode(const void* tokens, int size, sm4_visitor& visitor,
+					   sm4_parse_error* error = 0);
+
+/* Two-phase decoding, for passes that look at a few instructions only.
+ * sm4_scan just follows the length field of every instruction token and
+ * records where each declaration and instruction starts, together with its
+ * opcode; sm4_decode_one fully decodes a single entry on demand and reports
+ * it to the visitor like sm4_decode does (hull shader phase markers are
+ * reported as a declaration followed by an instruction).
+ * The index points into the token stream, which must stay alive.
+ */
+struct sm4_token_index
+{
+	sm4_token_version version;
+	const uint32_t* tokens; /* the version token */
+	unsigned length;		/* of the program, in tokens */
+	std::vector<uint32_t> offsets; /* in tokens, relative to tokens */
+	std::vector<uint16_t> opcodes;
+
+	sm4_token_index() : tokens(0), length(0)
+	{
+		memset(&version, 0, sizeof(version));
+	}
+
+	unsigned size() const { return (unsigned)offsets.size(); }
+
+	/* the raw instruction token of entry i */
+	sm4_token_instruction token(unsigned i) const
+	{
+		sm4_token_instruction insntok;
+		uint32_t v = bswap_le32(tokens[offsets[i]]);
+		memcpy(&insntok, &v, sizeof(v));
+		return insntok;
+	}
+
+	/* index of the first entry at or after start with the given opcode,
+	 * or size() */
+	unsigned find(unsigned opcode, unsigned start = 0) const
+	{
+		for (unsigned i = start; i < opcodes.size(); ++i)
+		{
+			if (opcodes[i] == opcode)
+				return i;
+		}
+		return size();
+	}
+};
+
+/* both return NULL on success, or an error message, like sm4_decode */
+const char* sm4_scan(const void* tokens, int size, sm4_token_index& index,
+					 sm4_parse_error* error = 0);
+const char* sm4_decode_one(const sm4_token_index& index, unsigned i,
+						   sm4_visitor& visitor, sm4_parse_error* error = 0);
 
 bool sm4_link_cf_insns(sm4_program& program);
 bool sm4_find_labels(sm4_program& program);
 
+/* Compact, contiguous form of a sm4_program, for passes that walk whole
+ * programs and would otherwise spend their time chasing node pointers.
+ * Instructions are stored as parallel arrays; all operands, including the
+ * relative index registers, live in one pool of fixed size records.
+ */
+
+#define SM4_FLAT_NONE 0xffffffffu
+
+#define SM4_FLAT_OP_NEG 1
+#define SM4_FLAT_OP_ABS 2
+
+struct sm4_flat_op
+{
+	uint8_t file;		 /* sm4_file */
+	uint8_t comps;
+	uint8_t mode;
+	uint8_t mask;
+	uint8_t swizzle;	 /* component i in bits 2 * i and 2 * i + 1 */
+	uint8_t num_indices;
+	uint8_t flags;		 /* SM4_FLAT_OP_* */
+	uint8_t unused;
+	union
+	{
+		struct
+		{
+			int64_t disp[3];
+			/* pool index of the relative register of each index, or
+			 * SM4_FLAT_NONE */
+			uint32_t reg[3];
+		};
+		sm4_any imm_values[4]; /* only for the immediate files */
+	};
+
+	unsigned swizzle_comp(unsigned i) const { return (swizzle >> (i * 2)) & 3; }
+};
+
+struct sm4_flat_insn
+{
+	sm4_token_instruction token;
+	int8_t sample_offset[3];
+	uint8_t resource_target;
+	uint8_t resource_return_type[4];
+	unsigned num;
+};
+
+struct sm4_flat_dcl
+{
+	sm4_token_instruction token;
+	uint32_t op;		  /* pool index, or SM4_FLAT_NONE */
+	uint32_t data_offset; /* index of the payload in data, if any */
+	uint32_t payload[4];  /* the union of sm4_dcl, verbatim */
+};
+
+struct sm4_flat_program
+{
+	sm4_token_version version;
+
+	/* one entry per instruction; the operands of instruction i are
+	 * ops[op_offsets[i]] to ops[op_offsets[i] + num_ops[i] - 1], followed by
+	 * the relative index registers they refer to, up to op_offsets[i + 1] */
+	std::vector<uint16_t> opcodes;
+	std::vector<uint8_t> num_ops;
+	std::vector<uint32_t> op_offsets; /* one more entry than instructions */
+	std::vector<sm4_flat_insn> insn_info;
+
+	std::vector<sm4_flat_dcl> dcls;
+	std::vector<sm4_flat_op> ops;
+	std::vector<uint32_t> data; /* customdata, function and interface tables */
+
+	/* same meaning as in sm4_program */
+	std::vector<int> cf_insn_linked;
+	bool labels_found;
+	std::vector<int> label_to_insn_num;
+
+	sm4_flat_program()
+	{
+		memset(&version, 0, sizeof(version));
+		labels_found = false;
+	}
+
+	unsigned num_insns() const { return (unsigned)opcodes.size(); }
+
+	const sm4_flat_op* insn_ops(unsigned i) const
+	{
+		return ops.data() + op_offsets[i];
+	}
+};
+
+void sm4_flatten(const sm4_program& program, sm4_flat_program& flat);
+text_writer& sm4_dump(text_writer& out, const sm4_flat_program& program,
+					  const sm4_dump_options& options);
+text_writer& operator<<(text_writer& out, const sm4_flat_program& program);
+std::ostream& operator<<(std::ostream& out, const sm4_flat_program& program);
+
+bool sm4_link_cf_insns(sm4_flat_program& program);
+bool sm4_find_labels(sm4_flat_program& program);
+
+/* Serialized form of a sm4_flat_program, meant to be mapped and read in
+ * place by other tools instead of reparsing the disassembly. The image is a
+ * header followed by the arrays of the flat program, each one 8 byte
+ * aligned and referred to by its offset from the start of the image, so
+ * that it can live at any address. The records have the layout of the
+ * sm4_flat_* structures, bitfields included, in the byte order of the host
+ * that assembled the image: the header records it, and init() refuses
+ * images from a host of the other byte order.
+ * Anything that changes the layout of the image or of the records must
+ * bump SM4_IMAGE_FORMAT_VERSION.
+ */
+
+#define SM4_IMAGE_MAGIC 0x42344d53u /* "SM4B" */
+#define SM4_IMAGE_FORMAT_VERSION 2
+#define SM4_IMAGE_BYTE_ORDER 0x01020304u
+
+#define SM4_IMAGE_LABELS_FOUND 1
+
+enum sm4_image_section
+{
+	SM4_IMAGE_DCLS,		  /* sm4_flat_dcl */
+	SM4_IMAGE_INSN_INFO,  /* sm4_flat_insn */
+	SM4_IMAGE_OPCODES,	  /* uint16_t */
+	SM4_IMAGE_NUM_OPS,	  /* uint8_t */
+	SM4_IMAGE_OP_OFFSETS, /* uint32_t, one more than instructions */
+	SM4_IMAGE_OPS,		  /* sm4_flat_op */
+	SM4_IMAGE_DATA,		  /* uint32_t */
+	SM4_IMAGE_CF_LINKS,	  /* int32_t, empty or one per instruction */
+	SM4_IMAGE_LABELS,	  /* int32_t */
+
+	SM4_IMAGE_SECTION_COUNT
+};
+
+struct sm4_image_header
+{
+	uint32_t magic;
+	uint32_t format_version;
+	uint32_t size; /* of the whole image, in bytes */
+	uint32_t flags;
+	sm4_token_version version;
+	uint32_t byte_order; /* SM4_IMAGE_BYTE_ORDER, in the image's order */
+	struct
+	{
+		uint32_t offset; /* in bytes, from the start of the image */
+		uint32_t count;	 /* in records */
+	} sections[SM4_IMAGE_SECTION_COUNT];
+};
+
+/* returns a malloc()ed image the caller frees, and its size */
+std::pair<void*, size_t> sm4_image_assemble(const sm4_flat_program& program);
+
+/* Non-owning view of the arrays of a flat program, either in an image or
+ * in a sm4_flat_program. init() checks the image header, that every
+ * section lies within the image, and every pool index, operand count and
+ * control flow link in it, as well as that no operand is shared between
+ * records, once: after that, the arrays can be walked and
+ * dumped like those of a parsed program, whatever the image contains.
+ */
+struct sm4_image
+{
+	sm4_token_version version;
+	bool labels_found;
+
+	const sm4_flat_dcl* dcls;
+	unsigned num_dcls;
+
+	/* same meaning as in sm4_flat_program */
+	const sm4_flat_insn* insn_info;
+	const uint16_t* opcodes;
+	const uint8_t* num_ops;
+	const uint32_t* op_offsets;
+	unsigned num_insns;
+
+	const sm4_flat_op* ops;
+	unsigned num_pool_ops;
+	const uint32_t* data;
+	unsigned data_size;
+
+	const int32_t* cf_insn_linked; /* NULL if the image has no links */
+	const int32_t* label_to_insn_num;
+	unsigned num_labels;
+
+	sm4_image() { memset(this, 0, sizeof(*this)); }
+
+	/* returns NULL on success, or a description of what is wrong */
+	const char* init(const void* data, size_t size);
+	void init(const sm4_flat_program& program);
+
+	const sm4_flat_op* insn_ops(unsigned i) const
+	{
+		return ops + op_offsets[i];
+	}
+};
+
+text_writer& sm4_dump(text_writer& out, const sm4_image& image,
+					  const sm4_dump_options& options);
+
+/* Control flow graph of a program, as flat arrays.
+ * The instructions are split into basic blocks, numbered in program order.
+ * Each function (the main program, every subroutine from its label on, and
+ * every hull shader phase) is a run of consecutive blocks with a single
+ * entry, the first one, and a virtual exit block without instructions,
+ * placed after all the real blocks, that ret, retc, discard and falling
+ * off the end lead to. Calls end their block and fall through to the next
+ * one: callees are listed in calls instead of being linked by edges, so
+ * that every function is a graph of its own.
+ * The dominator and post-dominator trees of each function are rooted at
+ * its entry and at its exit block respectively.
+ */
+
+#define SM4_CFG_NONE 0xffffffffu
+
+enum sm4_cfg_function_kind
+{
+	SM4_CFG_MAIN,
+	SM4_CFG_SUBROUTINE,
+	SM4_CFG_PHASE /* of a hull shader */
+};
+
+struct sm4_cfg_function
+{
+	unsigned kind;		  /* sm4_cfg_function_kind */
+	unsigned first_insn;  /* the label or phase instruction, 0 for main */
+	unsigned label;		  /* of a subroutine, SM4_CFG_NONE otherwise */
+	unsigned entry;		  /* the exit block if there are no instructions */
+	unsigned end_block;	  /* one past the last real block */
+	unsigned exit;
+};
+
+struct sm4_cfg_call
+{
+	unsigned insn;
+	unsigned block;
+	/* function index, SM4_CFG_NONE for interface calls and missing
+	 * labels */
+	unsigned callee;
+};
+
+struct sm4_cfg
+{
+	/* block b holds instructions block_start[b] to block_start[b + 1] - 1;
+	 * one more entry than blocks, the exit blocks being empty */
+	std::vector<uint32_t> block_start;
+	std::vector<uint32_t> insn_block;	  /* one per instruction */
+	std::vector<uint32_t> block_function; /* index in functions */
+	unsigned num_real_blocks;			  /* the exit blocks follow */
+
+	/* the successors of block b are succs[succ_offsets[b]] to
+	 * succs[succ_offsets[b + 1] - 1], in no particular order; likewise for
+	 * the predecessors */
+	std::vector<uint32_t> succ_offsets;
+	std::vector<uint32_t> succs;
+	std::vector<uint32_t> pred_offsets;
+	std::vector<uint32_t> preds;
+
+	std::vector<sm4_cfg_function> functions;
+	std::vector<sm4_cfg_call> calls; /* in program order */
+
+	/* immediate dominator and post-dominator of each block: SM4_CFG_NONE
+	 * for the roots, for blocks not reachable from the entry and for
+	 * blocks that cannot reach the exit respectively */
+	std::vector<uint32_t> idom;
+	std::vector<uint32_t> ipdom;
+	/* preorder number of each block in the trees, and that of the first
+	 * block following its subtree, for constant time queries; SM4_CFG_NONE
+	 * and 0 for the blocks left out of the tree */
+	std::vector<uint32_t> dom_pre;
+	std::vector<uint32_t> dom_end;
+	std::vector<uint32_t> pdom_pre;
+	std::vector<uint32_t> pdom_end;
+
+	sm4_cfg() : num_real_blocks(0) {}
+
+	unsigned num_blocks() const { return (unsigned)block_start.size() - 1; }
+
+	unsigned num_succs(unsigned b) const
+	{
+		return succ_offsets[b + 1] - succ_offsets[b];
+	}
+
+	unsigned num_preds(unsigned b) const
+	{
+		return pred_offsets[b + 1] - pred_offsets[b];
+	}
+
+	const uint32_t* block_succs(unsigned b) const
+	{
+		return succs.data() + succ_offsets[b];
+	}
+
+	const uint32_t* block_preds(unsigned b) const
+	{
+		return preds.data() + pred_offsets[b];
+	}
+
+	/* whether every path from the entry to b goes through a; a block
+	 * dominates itself */
+	bool dominates(unsigned a, unsigned b) const
+	{
+		return dom_pre[a] <= dom_pre[b] && dom_pre[b] < dom_end[a];
+	}
+
+	/* whether every path from b to the exit goes through a */
+	bool post_dominates(unsigned a, unsigned b) const
+	{
+		return pdom_pre[a] <= pdom_pre[b] && pdom_pre[b] < pdom_end[a];
+	}
+};
+
+/* links the control flow instructions and finds the labels first if that
+ * has not been done yet; returns NULL on success, or an error message */
+const char* sm4_build_cfg(sm4_program& program, sm4_cfg& cfg);
+const char* sm4_build_cfg(sm4_flat_program& program, sm4_cfg& cfg);
+text_writer& sm4_dump(text_writer& out, const sm4_cfg& cfg);
+
+/* Liveness of the temps and indexable temps, per component, over a control
+ * flow graph. Every component of a temp, and of each element of an
+ * indexable temp, is a slot: component c of r# is slot 4 * # + c, and the
+ * elements of the indexable temps follow, 4 slots each. Writes through a
+ * relative index may hit any element, so they do not end the lifetime of
+ * anything; reads through one use every element.
+ * Temps are shared with the subroutines: a call uses whatever is live on
+ * entry to its callee, and the exit of a subroutine sees whatever is live
+ * after any of its calls. Interface calls may reach every subroutine.
+ * Pressure at an instruction counts what is live before or after it and
+ * what it writes, in components and in registers (temps and elements with
+ * at least one live component).
+ */
+
+/* the number of temps and indexable temp elements a program may have */
+#define SM4_MAX_TEMPS 4096
+
+struct sm4_liveness_array
+{
+	unsigned index; /* the # of x# */
+	unsigned first_slot;
+	unsigned size; /* in elements */
+};
+
+struct sm4_liveness_function
+{
+	unsigned declared_temps; /* by dcl_temps */
+	unsigned max_components;
+	unsigned max_registers;
+};
+
+struct sm4_liveness
+{
+	unsigned num_temps;
+	unsigned num_slots;
+	std::vector<sm4_liveness_array> arrays;
+
+	/* the live in and live out sets of every block, words_per_set words
+	 * each */
+	unsigned words_per_set;
+	std::vector<uint64_t> live_in;
+	std::vector<uint64_t> live_out;
+
+	/* pressure at every instruction */
+	std::vector<uint32_t> insn_components;
+	std::vector<uint32_t> insn_registers;
+	/* the highest component pressure of every block */
+	std::vector<uint32_t> block_max_components;
+	/* one per function of the control flow graph */
+	std::vector<sm4_liveness_function> functions;
+
+	unsigned max_components;
+	unsigned max_registers;
+	std::vector<uint32_t> peak_insns; /* at max_components */
+
+	sm4_liveness()
+		: num_temps(0), num_slots(0), words_per_set(0), max_components(0),
+		  max_registers(0)
+	{
+	}
+
+	const uint64_t* block_live_in(unsigned b) const
+	{
+		return live_in.data() + (size_t)b * words_per_set;
+	}
+
+	const uint64_t* block_live_out(unsigned b) const
+	{
+		return live_out.data() + (size_t)b * words_per_set;
+	}
+
+	static bool is_live(const uint64_t* set, unsigned slot)
+	{
+		return (set[slot >> 6] >> (slot & 63)) & 1;
+	}
+};
+
+/* cfg must have been built from program; returns NULL on success, or an
+ * error message */
+const char* sm4_compute_liveness(const sm4_program& program,
+								 const sm4_cfg& cfg, sm4_liveness& liveness);
+/* the program, with the pressure at every instruction, the temps live on
+ * entry to every block and the peaks */
+text_writer& sm4_dump(text_writer& out, const sm4_program& program,
+					  const sm4_cfg& cfg, const sm4_liveness& liveness,
+					  const sm4_dump_options& options);
+
+/* the units a static cost estimate is broken down into */
+enum sm4_cost_unit
+{
+	SM4_COST_NONE, /* declarations, labels and other markers */
+	SM4_COST_ALU,
+	SM4_COST_TRANSCENDENTAL,
+	SM4_COST_SAMPLE, /* texture sampling, gathers and fetches */
+	SM4_COST_LOAD_STORE, /* buffer and UAV accesses, resource queries */
+	SM4_COST_ATOMIC,
+	SM4_COST_FLOW_CONTROL,
+
+	SM4_COST_UNIT_COUNT
+};
+
+extern const char* sm4_cost_unit_names[];
+
+/* Rough relative costs, in units of a simple ALU operation on one
+ * component; what matters is that they stay the same from one build to the
+ * next, so that changes in the estimates point at changes in the shaders */
+struct sm4_opcode_cost
+{
+	uint8_t unit; /* sm4_cost_unit */
+	uint8_t cost;
+	/* the cost is per component written, as on scalar hardware */
+	bool per_component;
+};
+
+extern const sm4_opcode_cost sm4_opcode_costs[];
+
+/* how many times a loop is assumed to run, its bounds being unknown */
+#define SM4_COST_LOOP_ITERATIONS 8
+
+struct sm4_cost_estimate
+{
+	unsigned insns[SM4_COST_UNIT_COUNT]; /* static counts */
+	/* weighted by loop_iterations to the power of the loop nesting */
+	double cost[SM4_COST_UNIT_COUNT];
+	double total;
+	unsigned max_loop_depth;
+};
+
+/* the number of loops around every instruction of the program; returns
+ * NULL on success, or an error message */
+const char* sm4_loop_depths(sm4_program& program,
+							std::vector<unsigned>& depths);
+
+/* every instruction counts once per iteration of the loops around it;
+ * subroutines count once, whatever the number of calls to them. Returns
+ * NULL on success, or an error message. */
+const char* sm4_estimate_cost(
+	sm4_program& program, sm4_cost_estimate& estimate,
+	unsigned loop_iterations = SM4_COST_LOOP_ITERATIONS);
+
+/* The invocations sm4_exec_run runs at once, one per SIMD lane; pixel
+ * shaders see them as 2x2 quads, lane & 1 giving x and lane & 2 giving y
+ * within a quad, for the derivatives */
+#ifndef SM4_EXEC_LANES
+#define SM4_EXEC_LANES 8
+#endif
+
+/* more are taken for a program that does not terminate */
+#define SM4_EXEC_MAX_STEPS (1 << 24)
+
+/* a vec4 register of every lane, stored component by component, so that
+ * the same component of all lanes can be worked on with one SIMD
+ * operation */
+struct sm4_exec_register
+{
+	uint32_t c[4][SM4_EXEC_LANES];
+};
+
+/* A texture, buffer or UAV bound by the host. Typed ones have width by
+ * height elements of 4 words (floats unless the shader reads them as
+ * integers), raw and structured ones are size bytes; the stride of the
+ * latter comes from their declaration. Textures have a single mip level,
+ * at which every sample is taken. */
+struct sm4_exec_resource
+{
+	uint32_t* data;
+	unsigned width;
+	unsigned height;
+	unsigned size;
+};
+
+struct sm4_exec_sampler
+{
+	bool point; /* nearest texel instead of bilinear filtering */
+	bool wrap;	/* texture coordinates wrap instead of being clamped */
+};
+
+struct sm4_exec_constant_buffer
+{
+	const uint32_t* data;
+	unsigned num_vectors; /* of 4 words */
+};
+
+/* what the host provides, by register index; reads past what is bound
+ * return 0 and writes are dropped, as on the GPU */
+struct sm4_exec_bindings
+{
+	std::vector<sm4_exec_register> inputs;	/* v# */
+	std::vector<sm4_exec_register> outputs; /* o# */
+	sm4_exec_register output_depth;			/* oDepth */
+	std::vector<sm4_exec_constant_buffer> constant_buffers;
+	std::vector<sm4_exec_resource> resources; /* t# */
+	std::vector<sm4_exec_resource> uavs;	  /* u# */
+	std::vector<sm4_exec_sampler> samplers;
+	/* the system values, in the .x of scalar ones */
+	sm4_exec_register primitive_id;
+	sm4_exec_register thread_id;
+	sm4_exec_register thread_group_id;
+	sm4_exec_register thread_id_in_group;
+	sm4_exec_register thread_id_in_group_flattened;
+
+	sm4_exec_bindings()
+	{
+		memset(&output_depth, 0, sizeof(output_depth));
+		memset(&primitive_id, 0, sizeof(primitive_id));
+		memset(&thread_id, 0, sizeof(thread_id));
+		memset(&thread_group_id, 0, sizeof(thread_group_id));
+		memset(&thread_id_in_group, 0, sizeof(thread_id_in_group));
+		memset(&thread_id_in_group_flattened, 0,
+			   sizeof(thread_id_in_group_flattened));
+	}
+};
+
+/* What sm4_exec_init learns from a program once, so that it can be run
+ * any number of times, from any number of threads, each with a
+ * sm4_exec_state of its own. */
+struct sm4_exec
+{
+	sm4_program* program;
+	unsigned num_temps;
+	/* by x#: the first element in the indexable temp storage and the
+	 * number of elements, 0 for those not declared */
+	std::vector<unsigned> indexable_first;
+	std::vector<unsigned> indexable_size;
+	unsigned num_indexable;
+	const uint32_t* icb; /* little endian, icb_size vectors */
+	unsigned icb_size;
+	/* by t# and u#: the target of typed ones, the stride of structured
+	 * ones, 0 for raw ones */
+	std::vector<unsigned> resource_targets;
+	std::vector<unsigned> resource_strides;
+	std::vector<unsigned> uav_targets;
+	std::vector<unsigned> uav_strides;
+	/* by g#: the byte offset in the group shared memory, the size and
+	 * the stride */
+	std::vector<unsigned> tgsm_offsets;
+	std::vector<unsigned> tgsm_sizes;
+	std::vector<unsigned> tgsm_strides;
+	unsigned tgsm_size;
+	unsigned thread_group_size[3];
+	bool uses_sync;
+	/* the instruction sm4_exec_init gave up on */
+	unsigned error_insn;
+
+	sm4_exec()
+		: program(0), num_temps(0), num_indexable(0), icb(0), icb_size(0),
+		  tgsm_size(0), uses_sync(false), error_insn(0)
+	{
+		thread_group_size[0] = thread_group_size[1] =
+			thread_group_size[2] = 1;
+	}
+};
+
+/* one level of flow control nesting, for the execution masks */
+struct sm4_exec_frame
+{
+	unsigned kind;
+	unsigned pc; /* the loop, or the instruction a call returns to */
+	uint32_t outer; /* the lanes active on entry */
+	/* ifs: the lanes taking the if branch; loops and switches: those that
+	 * broke out; calls: those that returned */
+	uint32_t lanes;
+	uint32_t continued;
+	uint32_t default_lanes;
+	uint32_t selector[SM4_EXEC_LANES];
+};
+
+/* the registers and memory of the invocations being run, kept between
+ * runs so that they are allocated once */
+struct sm4_exec_state
+{
+	std::vector<sm4_exec_register> temps;
+	std::vector<sm4_exec_register> indexable;
+	std::vector<uint32_t> tgsm;
+	std::vector<sm4_exec_frame> frames;
+};
+
+/* Checks that the program only uses what the interpreter supports
+ * (pixel, vertex and compute shaders, without doubles, geometry shader
+ * streams, interfaces, comparison samplers or append buffers), and lays
+ * out its registers. Returns NULL on success, or an error message, with
+ * exec.error_insn set if an instruction is at fault. */
+const char* sm4_exec_init(sm4_exec& exec, sm4_program& program);
+
+/* Runs the invocations of the lanes set in lanes, with their inputs and
+ * system values in bindings, and their outputs left there. The temps
+ * start out as 0. Returns NULL on success, or an error message; the lanes
+ * that were discarded go to *discarded. */
+const char* sm4_exec_run(const sm4_exec& exec, sm4_exec_bindings& bindings,
+						 sm4_exec_state& state,
+						 uint32_t lanes = (1u << SM4_EXEC_LANES) - 1,
+						 uint32_t* discarded = 0);
+
+/* Runs a compute shader over x by y by z thread groups, SM4_EXEC_LANES
+ * threads at a time, filling in the thread ids; the group shared memory
+ * is cleared for every group. The threads of a group that synchronizes
+ * take turns from one sync to the next. */
+const char* sm4_exec_dispatch(const sm4_exec& exec,
+							  sm4_exec_bindings& bindings,
+							  sm4_exec_state& state, unsigned x, unsigned y,
+							  unsigned z);
+
+/* Writes C++ source running the program, which must be one sm4_exec_init
+ * accepts: a runtime shared by all translated programs, then a function
+ * called name. Registers are arrays of lanes, with a lane per thread of
+ * the group for compute shaders and 8 for the others, so that the
+ * compiler vectorizes every instruction; see the comments of the output
+ * for how it is called. Loops give up after SM4_EXEC_MAX_STEPS iterations
+ * rather than instructions. Returns NULL on success, or an error message with
+ * *error_insn set to the instruction at fault. */
+const char* sm4_translate_cpp(text_writer& out, sm4_program& program,
+							  const char* name, unsigned* error_insn = 0);
+
+/* Hashes of what a declaration or instruction does, from its opcode,
+ * modifiers and operands: encodings that only differ in how the same thing
+ * is written (index representations, .x versus .xxxx, extended tokens an
+ * instruction does not need) hash the same, while declarations keep their
+ * extended tokens, their payload and their data. */
+uint64_t sm4_hash(const sm4_insn& insn);
+uint64_t sm4_hash(const sm4_dcl& dcl);
+
+enum sm4_diff_kind
+{
+	SM4_DIFF_REMOVED,  /* old_insn is gone */
+	SM4_DIFF_INSERTED, /* new_insn is new */
+	/* old_insn became new_insn, with the same opcode but other modifiers
+	 * or operands */
+	SM4_DIFF_CHANGED
+};
+
+/* old_insn and new_insn are where the instruction is, or for an insertion
+ * and a removal would be, in either program */
+struct sm4_diff_edit
+{
+	unsigned kind; /* sm4_diff_kind */
+	unsigned old_insn;
+	unsigned new_insn;
+};
+
+struct sm4_program_diff
+{
+	/* a shortest edit script turning the old instructions into the new
+	 * ones. Its hunks, the edits between two unchanged instructions, come
+	 * in program order; within a hunk, the i-th removal and the i-th
+	 * insertion come together, as one change if their opcodes match or as
+	 * the removal then the insertion, and the surplus removals or
+	 * insertions of the longer side come last */
+	std::vector<sm4_diff_edit> insns;
+	unsigned num_removed;
+	unsigned num_inserted;
+	unsigned num_changed;
+	/* the declarations of either program that the other one lacks, as
+	 * indices in program order; declarations are compared as a multiset */
+	std::vector<unsigned> removed_dcls;
+	std::vector<unsigned> added_dcls;
+	bool version_changed;
+
+	bool empty() const
+	{
+		return insns.empty() && removed_dcls.empty() && added_dcls.empty() &&
+			   !version_changed;
+	}
+};
+
+/* Compares the programs with the linear space variant of Myers' O(ND)
+ * algorithm over the instruction hashes, then pairs up the removals and
+ * insertions between two matches that have the same opcode as changes. */
+void sm4_diff_programs(const sm4_program& old_program,
+					   const sm4_program& new_program, sm4_program_diff& diff);
+
+/* lists the differences, old instructions prefixed with - and < and new
+ * ones with + and >, each with its number in its program */
+text_writer& sm4_dump(text_writer& out, const sm4_program& old_program,
+					  const sm4_program& new_program,
+					  const sm4_program_diff& diff);
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
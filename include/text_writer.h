@@ -0,0 +1,201 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Buffered text output for the disassembly printers */
+
+#ifndef TEXT_WRITER_H_
+#define TEXT_WRITER_H_
+
+#include <ostream>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/* a string with its length known in advance */
+struct text_str
+{
+	const char* str;
+	unsigned length;
+};
+
+/* A table of names, e.g. sm4_opcode_names, whose lengths are computed once
+ * when it is constructed instead of on every write. */
+struct text_names
+{
+	text_names(const char* const* names, unsigned count);
+
+	text_str operator[](unsigned i) const { return strs[i]; }
+	unsigned size() const { return (unsigned)strs.size(); }
+
+  private:
+	std::vector<text_str> strs;
+};
+
+/* Formats text into a growable byte buffer.
+ * Without a sink, everything written is kept in memory and can be fetched
+ * with data()/size(); clear() forgets it but keeps the memory, so a writer
+ * reused for many shaders stops allocating once it has seen the largest.
+ * With a sink, the buffer is handed to it whenever it fills up, so output
+ * reaches the sink in blocks of block_size bytes, and once more on flush()
+ * or destruction.
+ * Numbers are formatted by hand, producing the same text as the default
+ * formatting of std::ostream.
+ */
+struct text_writer
+{
+	typedef void (*sink_func)(void* ctx, const char* data, size_t size);
+
+	explicit text_writer(size_t block_size = 64 * 1024);
+	text_writer(sink_func sink, void* ctx, size_t block_size = 64 * 1024);
+	explicit text_writer(std::ostream& out, size_t block_size = 64 * 1024);
+	explicit text_writer(FILE* out, size_t block_size = 64 * 1024);
+	~text_writer();
+
+	void put(char c)
+	{
+		if (cur == end)
+			make_room(1);
+		*cur++ = c;
+	}
+
+	void write(const char* s, size_t n)
+	{
+		if ((size_t)(end - cur) < n)
+			make_room(n);
+		memcpy(cur, s, n);
+		cur += n;
+	}
+
+	void write(const char* s) { write(s, strlen(s)); }
+	void write(text_str s) { write(s.str, s.length); }
+
+	void write_uint(uint64_t v);
+	void write_int(int64_t v);
+	void write_float(double v);
+
+	/* right-aligned in a field of width characters, like std::setw */
+	void write_uint(uint64_t v, unsigned width, unsigned base = 10);
+	void write_right(const char* s, unsigned width);
+	/* left-aligned, padded with spaces up to width characters */
+	void write_left(const char* s, unsigned width);
+
+	void spaces(unsigned n);
+
+	/* number of bytes written so far, including those already flushed */
+	size_t tell() const { return flushed + (cur - buf); }
+
+	/* the buffered bytes, all of the output if there is no sink */
+	const char* data() const { return buf; }
+	size_t size() const { return cur - buf; }
+	void clear() { cur = buf; }
+
+	/* hands the buffered bytes to the sink, if any */
+	void flush();
+
+  private:
+	void init(sink_func sink, void* ctx, size_t block_size);
+	void make_room(size_t n);
+
+	char* buf;
+	char* cur;
+	char* end;
+	size_t flushed;
+	sink_func sink;
+	void* ctx;
+
+	text_writer(const text_writer&);
+	text_writer& operator=(const text_writer&);
+};
+
+/* lets the printers be written like the ostream ones they replace */
+static inline text_writer& operator<<(text_writer& out, char c)
+{
+	out.put(c);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, const char* s)
+{
+	out.write(s);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, text_str s)
+{
+	out.write(s);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, int v)
+{
+	out.write_int(v);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, long v)
+{
+	out.write_int(v);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, long long v)
+{
+	out.write_int(v);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, unsigned v)
+{
+	out.write_uint(v);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, unsigned long v)
+{
+	out.write_uint(v);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, unsigned long long v)
+{
+	out.write_uint(v);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, float v)
+{
+	out.write_float(v);
+	return out;
+}
+
+static inline text_writer& operator<<(text_writer& out, double v)
+{
+	out.write_float(v);
+	return out;
+}
+
+#endif /* TEXT_WRITER_H_ */
@@ -45,7 +45,7 @@ std::pair<void*, size_t> dxbc_assemble(struct dxbc_chunk_header** chunks,
 	memset(header->unk, 0, sizeof(header->unk));
 	header->one = bswap_le32(1);
 	header->total_size = bswap_le32(total_size);
-	header->chunk_count = num_chunks;
+	header->chunk_count = bswap_le32(num_chunks);
 
 	uint32_t* chunk_offsets = (uint32_t*)(header + 1);
 	uint32_t off =
@@ -59,5 +59,8 @@ std::pair<void*, size_t> dxbc_assemble(struct dxbc_chunk_header** chunks,
 		off += chunk_full_size;
 	}
 
+	/* the checksum covers everything after it, offsets included */
+	dxbc_checksum(header, total_size, header->unk);
+
 	return std::make_pair((void*)header, total_size);
 }
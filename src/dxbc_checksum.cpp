@@ -0,0 +1,366 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* The container checksum: MD5 over everything following the checksum
+ * field, except that the message length is not appended like MD5 does.
+ * Instead, the bit count goes into the first word of the last block and
+ * (bit count / 4) | 1 into its last word, with the 0x80 padding byte in
+ * between. */
+
+#include "dxbc.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DXBC_CHECKSUM_SSE2
+#include <emmintrin.h>
+#endif
+
+/* where the hashed data starts: after the FourCC and the checksum */
+#define DXBC_CHECKSUM_SKIP 20
+
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+/* the 64 steps, shared by the scalar and the vector transform: function,
+ * registers, message word, constant and rotation of each */
+#define MD5_ROUNDS(STEP, F, G, H, I)                                           \
+	STEP(F, a, b, c, d, 0, 0xd76aa478, 7);                                     \
+	STEP(F, d, a, b, c, 1, 0xe8c7b756, 12);                                    \
+	STEP(F, c, d, a, b, 2, 0x242070db, 17);                                    \
+	STEP(F, b, c, d, a, 3, 0xc1bdceee, 22);                                    \
+	STEP(F, a, b, c, d, 4, 0xf57c0faf, 7);                                     \
+	STEP(F, d, a, b, c, 5, 0x4787c62a, 12);                                    \
+	STEP(F, c, d, a, b, 6, 0xa8304613, 17);                                    \
+	STEP(F, b, c, d, a, 7, 0xfd469501, 22);                                    \
+	STEP(F, a, b, c, d, 8, 0x698098d8, 7);                                     \
+	STEP(F, d, a, b, c, 9, 0x8b44f7af, 12);                                    \
+	STEP(F, c, d, a, b, 10, 0xffff5bb1, 17);                                   \
+	STEP(F, b, c, d, a, 11, 0x895cd7be, 22);                                   \
+	STEP(F, a, b, c, d, 12, 0x6b901122, 7);                                    \
+	STEP(F, d, a, b, c, 13, 0xfd987193, 12);                                   \
+	STEP(F, c, d, a, b, 14, 0xa679438e, 17);                                   \
+	STEP(F, b, c, d, a, 15, 0x49b40821, 22);                                   \
+	STEP(G, a, b, c, d, 1, 0xf61e2562, 5);                                     \
+	STEP(G, d, a, b, c, 6, 0xc040b340, 9);                                     \
+	STEP(G, c, d, a, b, 11, 0x265e5a51, 14);                                   \
+	STEP(G, b, c, d, a, 0, 0xe9b6c7aa, 20);                                    \
+	STEP(G, a, b, c, d, 5, 0xd62f105d, 5);                                     \
+	STEP(G, d, a, b, c, 10, 0x02441453, 9);                                    \
+	STEP(G, c, d, a, b, 15, 0xd8a1e681, 14);                                   \
+	STEP(G, b, c, d, a, 4, 0xe7d3fbc8, 20);                                    \
+	STEP(G, a, b, c, d, 9, 0x21e1cde6, 5);                                     \
+	STEP(G, d, a, b, c, 14, 0xc33707d6, 9);                                    \
+	STEP(G, c, d, a, b, 3, 0xf4d50d87, 14);                                    \
+	STEP(G, b, c, d, a, 8, 0x455a14ed, 20);                                    \
+	STEP(G, a, b, c, d, 13, 0xa9e3e905, 5);                                    \
+	STEP(G, d, a, b, c, 2, 0xfcefa3f8, 9);                                     \
+	STEP(G, c, d, a, b, 7, 0x676f02d9, 14);                                    \
+	STEP(G, b, c, d, a, 12, 0x8d2a4c8a, 20);                                   \
+	STEP(H, a, b, c, d, 5, 0xfffa3942, 4);                                     \
+	STEP(H, d, a, b, c, 8, 0x8771f681, 11);                                    \
+	STEP(H, c, d, a, b, 11, 0x6d9d6122, 16);                                   \
+	STEP(H, b, c, d, a, 14, 0xfde5380c, 23);                                   \
+	STEP(H, a, b, c, d, 1, 0xa4beea44, 4);                                     \
+	STEP(H, d, a, b, c, 4, 0x4bdecfa9, 11);                                    \
+	STEP(H, c, d, a, b, 7, 0xf6bb4b60, 16);                                    \
+	STEP(H, b, c, d, a, 10, 0xbebfbc70, 23);                                   \
+	STEP(H, a, b, c, d, 13, 0x289b7ec6, 4);                                    \
+	STEP(H, d, a, b, c, 0, 0xeaa127fa, 11);                                    \
+	STEP(H, c, d, a, b, 3, 0xd4ef3085, 16);                                    \
+	STEP(H, b, c, d, a, 6, 0x04881d05, 23);                                    \
+	STEP(H, a, b, c, d, 9, 0xd9d4d039, 4);                                     \
+	STEP(H, d, a, b, c, 12, 0xe6db99e5, 11);                                   \
+	STEP(H, c, d, a, b, 15, 0x1fa27cf8, 16);                                   \
+	STEP(H, b, c, d, a, 2, 0xc4ac5665, 23);                                    \
+	STEP(I, a, b, c, d, 0, 0xf4292244, 6);                                     \
+	STEP(I, d, a, b, c, 7, 0x432aff97, 10);                                    \
+	STEP(I, c, d, a, b, 14, 0xab9423a7, 15);                                   \
+	STEP(I, b, c, d, a, 5, 0xfc93a039, 21);                                    \
+	STEP(I, a, b, c, d, 12, 0x655b59c3, 6);                                    \
+	STEP(I, d, a, b, c, 3, 0x8f0ccc92, 10);                                    \
+	STEP(I, c, d, a, b, 10, 0xffeff47d, 15);                                   \
+	STEP(I, b, c, d, a, 1, 0x85845dd1, 21);                                    \
+	STEP(I, a, b, c, d, 8, 0x6fa87e4f, 6);                                     \
+	STEP(I, d, a, b, c, 15, 0xfe2ce6e0, 10);                                   \
+	STEP(I, c, d, a, b, 6, 0xa3014314, 15);                                    \
+	STEP(I, b, c, d, a, 13, 0x4e0811a1, 21);                                   \
+	STEP(I, a, b, c, d, 4, 0xf7537e82, 6);                                     \
+	STEP(I, d, a, b, c, 11, 0xbd3af235, 10);                                   \
+	STEP(I, c, d, a, b, 2, 0x2ad7d2bb, 15);                                    \
+	STEP(I, b, c, d, a, 9, 0xeb86d391, 21);
+
+#define MD5_STEP(f, a, b, c, d, k, t, s)                                       \
+	do                                                                         \
+	{                                                                          \
+		(a) += f((b), (c), (d)) + x[k] + (t);                                  \
+		(a) = ((a) << (s)) | ((a) >> (32 - (s)));                              \
+		(a) += (b);                                                            \
+	} while (0)
+
+static inline uint32_t load_le32(const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return bswap_le32(v);
+}
+
+static void md5_transform(uint32_t state[4], const unsigned char* block)
+{
+	uint32_t x[16];
+	for (unsigned i = 0; i < 16; ++i)
+		x[i] = load_le32(block + i * 4);
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	MD5_ROUNDS(MD5_STEP, MD5_F, MD5_G, MD5_H, MD5_I)
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+static inline void store_le32(unsigned char* p, uint32_t v)
+{
+	v = bswap_le32(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static const uint32_t md5_init[4] = {0x67452301, 0xefcdab89, 0x98badcfe,
+									 0x10325476};
+
+/* the hashed part of a container */
+static bool hashed_range(const void* data, size_t size,
+						 const unsigned char*& p, size_t& length)
+{
+	/* the bit count has to fit into 32 bits */
+	if (size < DXBC_CHECKSUM_SKIP || size - DXBC_CHECKSUM_SKIP > 0x1fffffff)
+		return false;
+	p = (const unsigned char*)data + DXBC_CHECKSUM_SKIP;
+	length = size - DXBC_CHECKSUM_SKIP;
+	return true;
+}
+
+/* builds the blocks following the last full one of the message, and
+ * returns how many there are, 1 or 2 */
+static unsigned final_blocks(const unsigned char* p, size_t length,
+							 unsigned char blocks[128])
+{
+	size_t full = length & ~(size_t)63;
+	size_t last = length - full;
+	uint32_t bits = (uint32_t)length * 8;
+	unsigned count = last < 56 ? 1 : 2;
+	memset(blocks, 0, 128);
+	unsigned char* block = blocks;
+	if (count == 1)
+	{
+		store_le32(block, bits);
+		memcpy(block + 4, p + full, last);
+		block[4 + last] = 0x80;
+	}
+	else
+	{
+		memcpy(block, p + full, last);
+		block[last] = 0x80;
+		block += 64;
+		store_le32(block, bits);
+	}
+	store_le32(block + 60, (bits >> 2) | 1);
+	return count;
+}
+
+bool dxbc_checksum(const void* data, size_t size, uint32_t checksum[4])
+{
+	const unsigned char* p;
+	size_t length;
+	if (!hashed_range(data, size, p, length))
+		return false;
+
+	uint32_t state[4];
+	memcpy(state, md5_init, sizeof(state));
+	size_t full = length & ~(size_t)63;
+	for (size_t i = 0; i < full; i += 64)
+		md5_transform(state, p + i);
+
+	unsigned char blocks[128];
+	unsigned count = final_blocks(p, length, blocks);
+	for (unsigned i = 0; i < count; ++i)
+		md5_transform(state, blocks + i * 64);
+
+	for (unsigned i = 0; i < 4; ++i)
+		checksum[i] = bswap_le32(state[i]);
+	return true;
+}
+
+bool dxbc_verify_checksum(const void* data, size_t size)
+{
+	uint32_t checksum[4];
+	if (!dxbc_checksum(data, size, checksum))
+		return false;
+	return !memcmp(checksum, ((const dxbc_container_header*)data)->unk,
+				   sizeof(checksum));
+}
+
+#ifdef DXBC_CHECKSUM_SSE2
+#define MD5_VF(x, y, z)                                                        \
+	_mm_xor_si128((z), _mm_and_si128((x), _mm_xor_si128((y), (z))))
+#define MD5_VG(x, y, z)                                                        \
+	_mm_xor_si128((y), _mm_and_si128((z), _mm_xor_si128((x), (y))))
+#define MD5_VH(x, y, z) _mm_xor_si128(_mm_xor_si128((x), (y)), (z))
+#define MD5_VI(x, y, z)                                                        \
+	_mm_xor_si128((y), _mm_or_si128((x), _mm_xor_si128((z), ones)))
+
+#define MD5_VSTEP(f, a, b, c, d, k, t, s)                                      \
+	do                                                                         \
+	{                                                                          \
+		(a) = _mm_add_epi32(                                                   \
+			_mm_add_epi32((a), f((b), (c), (d))),                              \
+			_mm_add_epi32(x[k], _mm_set1_epi32((int)(t))));                    \
+		(a) = _mm_or_si128(_mm_slli_epi32((a), (s)),                           \
+						   _mm_srli_epi32((a), 32 - (s)));                     \
+		(a) = _mm_add_epi32((a), (b));                                         \
+	} while (0)
+
+/* one block of each of 4 independent messages, lane i of every vector
+ * belonging to message i */
+static void md5_transform_x4(__m128i state[4],
+							 const unsigned char* const blocks[4])
+{
+	const __m128i ones = _mm_set1_epi32(-1);
+	__m128i x[16];
+	for (unsigned i = 0; i < 16; ++i)
+		x[i] = _mm_set_epi32(
+			(int)load_le32(blocks[3] + i * 4), (int)load_le32(blocks[2] + i * 4),
+			(int)load_le32(blocks[1] + i * 4), (int)load_le32(blocks[0] + i * 4));
+
+	__m128i a = state[0], b = state[1], c = state[2], d = state[3];
+	MD5_ROUNDS(MD5_VSTEP, MD5_VF, MD5_VG, MD5_VH, MD5_VI)
+	state[0] = _mm_add_epi32(state[0], a);
+	state[1] = _mm_add_epi32(state[1], b);
+	state[2] = _mm_add_epi32(state[2], c);
+	state[3] = _mm_add_epi32(state[3], d);
+}
+
+/* a message being hashed in one of the lanes */
+struct md5_lane
+{
+	unsigned job;
+	const unsigned char* data;
+	size_t full_blocks;
+	size_t block;
+	unsigned total_blocks;
+	unsigned char tail[128];
+
+	const unsigned char* current() const
+	{
+		return block < full_blocks ? data + block * 64
+								   : tail + (block - full_blocks) * 64;
+	}
+};
+
+void dxbc_checksum_multi(unsigned count, const void* const* data,
+						 const size_t* sizes, uint32_t (*checksums)[4],
+						 bool* valid)
+{
+	/* every lane works on its own message, and picks up the next one as
+	 * soon as it is done, so that messages of different sizes keep all
+	 * the lanes busy until the last few */
+	md5_lane lanes[4];
+	bool active[4] = {false, false, false, false};
+	uint32_t words[4][4]; /* [state word][lane] */
+	static const unsigned char idle_block[64] = {0};
+	unsigned next = 0, num_active = 0;
+
+	for (;;)
+	{
+		for (unsigned l = 0; l < 4; ++l)
+		{
+			while (!active[l] && next < count)
+			{
+				unsigned job = next++;
+				const unsigned char* p;
+				size_t length;
+				bool ok = hashed_range(data[job], sizes[job], p, length);
+				if (valid)
+					valid[job] = ok;
+				if (!ok)
+				{
+					memset(checksums[job], 0, sizeof(checksums[job]));
+					continue;
+				}
+				md5_lane& lane = lanes[l];
+				lane.job = job;
+				lane.data = p;
+				lane.full_blocks = length / 64;
+				lane.block = 0;
+				lane.total_blocks = (unsigned)(
+					lane.full_blocks + final_blocks(p, length, lane.tail));
+				for (unsigned i = 0; i < 4; ++i)
+					words[i][l] = md5_init[i];
+				active[l] = true;
+				++num_active;
+			}
+		}
+		if (!num_active)
+			break;
+
+		const unsigned char* blocks[4];
+		for (unsigned l = 0; l < 4; ++l)
+			blocks[l] = active[l] ? lanes[l].current() : idle_block;
+		__m128i state[4];
+		for (unsigned i = 0; i < 4; ++i)
+			state[i] = _mm_loadu_si128((const __m128i*)words[i]);
+		md5_transform_x4(state, blocks);
+		for (unsigned i = 0; i < 4; ++i)
+			_mm_storeu_si128((__m128i*)words[i], state[i]);
+
+		for (unsigned l = 0; l < 4; ++l)
+		{
+			if (!active[l] || ++lanes[l].block < lanes[l].total_blocks)
+				continue;
+			for (unsigned i = 0; i < 4; ++i)
+				checksums[lanes[l].job][i] = bswap_le32(words[i][l]);
+			active[l] = false;
+			--num_active;
+		}
+	}
+}
+#else
+void dxbc_checksum_multi(unsigned count, const void* const* data,
+						 const size_t* sizes, uint32_t (*checksums)[4],
+						 bool* valid)
+{
+	for (unsigned i = 0; i < count; ++i)
+	{
+		bool ok = dxbc_checksum(data[i], sizes[i], checksums[i]);
+		if (!ok)
+			memset(checksums[i], 0, sizeof(checksums[i]));
+		if (valid)
+			valid[i] = ok;
+	}
+}
+#endif
@@ -25,14 +25,19 @@
  **************************************************************************/
 
 #include "dxbc.h"
-#include <iomanip>
-#include <memory>
+#include <stdio.h>
 #include <string.h>
 #include <d3d11shader.h>
 
-static std::ostream& operator<<(std::ostream& out, const D3D11_SHADER_TYPE_DESC& type)
+/* the values indexing the name tables come straight from the container */
+static const char* lookup_name(const char** names, unsigned count, unsigned i)
 {
-	out << dxbc_shader_type_names[type.Type];
+	return i < count && names[i] ? names[i] : "unknown";
+}
+
+static text_writer& operator<<(text_writer& out, const D3D11_SHADER_TYPE_DESC& type)
+{
+	out << lookup_name(dxbc_shader_type_names, dxbc_shader_type_name_count, type.Type);
 	switch (type.Class)
 	{
 	case D3D_SVC_SCALAR:
@@ -47,13 +52,23 @@ static std::ostream& operator<<(std::ostream& out, const D3D11_SHADER_TYPE_DESC&
 		out << type.Columns << "x" << type.Rows;
 		break;
 	default:
-		assert(!"Unhandled shader variable class");
+		/* objects and structs; the class is not checked by the parser */
 		break;
 	}
 	return out;
 }
 
-std::ostream& operator<<(std::ostream& out, dxbc_chunk_resource_definition& rdef)
+/* writes name followed by suffix, right-aligned in a field of width */
+static void write_suffixed(text_writer& out, const char* name, const char* suffix, unsigned width)
+{
+	unsigned length = (unsigned)(strlen(name) + strlen(suffix));
+	if (width > length)
+		out.spaces(width - length);
+	out << name << suffix;
+}
+
+/* nothing is written when the chunk turns out to be malformed */
+static const char* dump(text_writer& out, dxbc_chunk_resource_definition& rdef)
 {
 	D3D11_SHADER_BUFFER_DESC* buffers = nullptr;
 	D3D11_SHADER_TYPE_DESC* types = nullptr;
@@ -61,7 +76,25 @@ std::ostream& operator<<(std::ostream& out, dxbc_chunk_resource_definition& rdef
 	D3D11_SHADER_INPUT_BIND_DESC* bindings = nullptr;
 	char* creator;
 	int buffer_count, binding_count;
-	dxbc_parse_resource_definition(&rdef, buffer_count, &buffers, binding_count, &bindings, &creator);
+	const char* error = dxbc_parse_resource_definition(&rdef, buffer_count, &buffers, binding_count, &bindings, &creator);
+	if (error)
+		return error;
+	/* the variables are checked up front too, so that no half dumped
+	 * chunk is left behind */
+	for (int j = 0; j < buffer_count && !error; ++j)
+	{
+		int vcount;
+		error = dxbc_parse_shader_variables(&rdef, j, vcount, &types, &vars);
+		free(types);
+		free(vars);
+	}
+	if (error)
+	{
+		free(buffers);
+		free(bindings);
+		return error;
+	}
+
 	out << "// Generated by " << creator << "\n"
 		"//\n";
 
@@ -75,72 +108,38 @@ std::ostream& operator<<(std::ostream& out, dxbc_chunk_resource_definition& rdef
 			out << "// cbuffer cbuf" << j << "\n"
 				"// {\n"
 				"//\n";
-			int vcount = dxbc_parse_shader_variables(&rdef, j, &types, &vars);
+			int vcount;
+			dxbc_parse_shader_variables(&rdef, j, vcount, &types, &vars);
 			for (int k = 0; k < vcount; ++k)
 			{
 				out << "//   ";
-				auto before = out.tellp();
+				size_t before = out.tell();
 				out << types[k] << " " << vars[k].Name;
 				if (types[k].Elements > 1)
 				{
 					out << "[" << types[k].Elements << "]";
 				}
 				out << ";";
-				for (auto l = out.tellp() - before; l < 35; ++l)
-				{
-					out << " ";
-				}
-				out << "// Offset: " << std::setw(4) << std::right << vars[k].StartOffset <<
-					   " Size: " << std::setw(5) << std::right << vars[k].Size <<
-					   //" Flags: " << std::setw(6) << std::right << std::hex << vars[k].uFlags <<
-					   std::setw(0) << std::dec << "\n";
+				size_t length = out.tell() - before;
+				if (length < 35)
+					out.spaces(35 - (unsigned)length);
+				out << "// Offset: ";
+				out.write_uint(vars[k].StartOffset, 4);
+				out << " Size: ";
+				out.write_uint(vars[k].Size, 5);
+				//out << " Flags: ";
+				//out.write_uint(vars[k].uFlags, 6, 16);
+				out << "\n";
 			}
 			out << "//\n"
 				   "// }\n";
 
+			free(types);
 			free(vars);
-			vars = nullptr;
 		}
 	}
 	out << "//\n//\n";
 
-	auto get_binding_format = [](std::ostream& out, D3D11_SHADER_INPUT_BIND_DESC& binding) -> std::ostream&
-	{
-		const char* bare = dxbc_shader_return_type_names[binding.ReturnType];
-		if (binding.uFlags & D3D_SIF_TEXTURE_COMPONENTS)
-		{
-			char* s = new char[strlen(bare) + 2];
-			strcpy(s, bare);
-			strcat(s, "4");
-			out << s;
-			delete s;
-		}
-		else
-		{
-			out << bare;
-		}
-		return out;
-	};
-
-	auto get_binding_dimension = [](std::ostream& out, D3D11_SHADER_INPUT_BIND_DESC& binding) -> std::ostream&
-	{
-		const char* bare = dxbc_shader_dimension_names[binding.Dimension];
-		if (binding.Dimension == D3D_SRV_DIMENSION_TEXTURE2DMS ||
-			binding.Dimension == D3D_SRV_DIMENSION_TEXTURE2DMSARRAY)
-		{
-			assert(binding.NumSamples < 10);
-			char* s = new char[strlen(bare) + 2];
-			sprintf(s, "%s%d", bare, binding.NumSamples);
-			out << s;
-			delete s;
-		}
-		else
-		{
-			out << bare;
-		}
-		return out;
-	};
-
 	if (binding_count > 0)
 	{
 		out << "// Resource Bindings:\n"
@@ -149,27 +148,55 @@ std::ostream& operator<<(std::ostream& out, dxbc_chunk_resource_definition& rdef
 			   "// ------------------------------ ---------- ------- ----------- -------------- ------ ------\n";
 		for (int j = 0; j < binding_count; ++j)
 		{
-			out << "// " << std::setw(30) << std::left << bindings[j].Name << " " <<
-				std::setw(10) << std::right << dxbc_shader_input_type_names[bindings[j].Type] << " " <<
-				std::setw(7) << std::right; get_binding_format(out, bindings[j]) << " " <<
-				std::setw(11) << std::right; get_binding_dimension(out, bindings[j]) << " " <<
-				std::setw(13) << std::right << dxbc_shader_input_type_file_short_names[bindings[j].Type] << bindings[j].BindPoint << " " <<
-				std::setw(6) << std::right << bindings[j].BindCount << " " <<
-				std::setw(6) << std::right << std::hex << bindings[j].uFlags <<
-				std::setw(0) << std::left << std::dec << "\n";
+			D3D11_SHADER_INPUT_BIND_DESC& binding = bindings[j];
+			out << "// ";
+			out.write_left(binding.Name, 30);
+			out << " ";
+			out.write_right(lookup_name(dxbc_shader_input_type_names, dxbc_shader_input_type_name_count, binding.Type), 10);
+			out << " ";
+
+			const char* format = lookup_name(dxbc_shader_return_type_names, dxbc_shader_return_type_name_count, binding.ReturnType);
+			if (binding.uFlags & D3D_SIF_TEXTURE_COMPONENTS)
+				write_suffixed(out, format, "4", 7);
+			else
+				out.write_right(format, 7);
+			out << " ";
+
+			const char* dimension = lookup_name(dxbc_shader_dimension_names, dxbc_shader_dimension_name_count, binding.Dimension);
+			if (binding.Dimension == D3D_SRV_DIMENSION_TEXTURE2DMS ||
+				binding.Dimension == D3D_SRV_DIMENSION_TEXTURE2DMSARRAY)
+			{
+				/* the parser keeps the sample count to two digits */
+				char samples[4];
+				snprintf(samples, sizeof(samples), "%u", binding.NumSamples);
+				write_suffixed(out, dimension, samples, 11);
+			}
+			else
+				out.write_right(dimension, 11);
+			out << " ";
+
+			out.write_right(lookup_name(dxbc_shader_input_type_file_short_names, dxbc_shader_input_type_name_count, binding.Type), 13);
+			out << binding.BindPoint << " ";
+			out.write_uint(binding.BindCount, 6);
+			out << " ";
+			out.write_uint(binding.uFlags, 6, 16);
+			out << "\n";
 		}
 		out << "//\n";
 	}
 
 	free(buffers);
 	free(bindings);
-	return out;
+	return 0;
 }
 
-std::ostream& operator<<(std::ostream& out, dxbc_chunk_signature& sig)
+static const char* dump(text_writer& out, dxbc_chunk_signature& sig)
 {
 	D3D11_SIGNATURE_PARAMETER_DESC* params;
-	int count = dxbc_parse_signature(&sig, &params);
+	int count;
+	const char* error = dxbc_parse_signature(&sig, count, &params);
+	if (error)
+		return error;
 
 	const bool is_output = sig.fourcc == FOURCC_OSGN;
 
@@ -182,15 +209,28 @@ std::ostream& operator<<(std::ostream& out, dxbc_chunk_signature& sig)
 			   "// -------------------- ----- ------ -------- ----------- ------- ------\n";
 		for (int j = 0; j < count; ++j)
 		{
-			out << "// " << std::setw(20) << std::left << params[j].SemanticName << " " <<
-				std::setw(5) << std::right << params[j].SemanticIndex << "   ";
+			out << "// ";
+			out.write_left(params[j].SemanticName, 20);
+			out << " ";
+			out.write_uint(params[j].SemanticIndex, 5);
+			out << "   ";
 			for (unsigned i = 0; i < 4; ++i)
 			{
 				out << (params[j].Mask & (1 << i) ? "xyzw"[i] : ' ');
 			}
-			out << " " << std::setw(8) << std::right << params[j].Register << " " <<
-				   std::setw(11) << std::right << dxbc_names[(is_output ? D3D_NAME_TARGET : 0) + params[j].SystemValueType] << " " <<
-				   std::setw(7) << std::right << dxbc_register_component_type_names[params[j].ComponentType] << "   ";
+			out << " ";
+			out.write_uint(params[j].Register, 8);
+			out << " ";
+			/* outputs are looked up from D3D_NAME_TARGET on */
+			unsigned name = params[j].SystemValueType;
+			if (is_output)
+				name = name < dxbc_name_count - D3D_NAME_TARGET
+						   ? name + D3D_NAME_TARGET
+						   : dxbc_name_count;
+			out.write_right(lookup_name(dxbc_names, dxbc_name_count, name), 11);
+			out << " ";
+			out.write_right(lookup_name(dxbc_register_component_type_names, dxbc_register_component_type_name_count, params[j].ComponentType), 7);
+			out << "   ";
 			for (unsigned i = 0; i < 4; ++i)
 			{
 				out << ((params[j].ReadWriteMask & (1 << i) ^ !!is_output) ? "xyzw"[i] : ' ');
@@ -201,38 +241,64 @@ std::ostream& operator<<(std::ostream& out, dxbc_chunk_signature& sig)
 	}
 
 	free(params);
-	return out;
+	return 0;
 }
 
-std::ostream& operator<<(std::ostream& out, const dxbc_chunk_statistics& stat)
+static text_writer& operator<<(text_writer& out, const dxbc_chunk_statistics& stat)
 {
 	return out << "// Approximately " << bswap_le32(stat.instruction_count) << " instruction slots used\n";
 }
 
-std::ostream& operator<<(std::ostream& out, const dxbc_container& container)
+text_writer& operator<<(text_writer& out, const dxbc_container& container)
+{
+	dxbc_dump(out, container);
+	return out;
+}
+
+const char* dxbc_dump(text_writer& out, const dxbc_container& container,
+					  unsigned* chunk_index)
 {
+	const char* first_error = 0;
 	for (unsigned i = 0; i < container.chunks.size(); ++i)
 	{
 		struct dxbc_chunk_header* chunk = container.chunks[i];
 		char fourcc_str[5];
 		memcpy(fourcc_str, &chunk->fourcc, 4);
 		fourcc_str[4] = 0;
-		out << "// DXBC chunk " << std::setw(2) << i << ": " << fourcc_str
-			<< " offset " << ((char*)chunk - (char*)container.data) << " size "
+		out << "// DXBC chunk ";
+		out.write_uint(i, 2);
+		out << ": " << fourcc_str << " offset " << ((char*)chunk - (char*)container.data) << " size "
 			<< bswap_le32(chunk->size) << "\n";
+		const char* error = 0;
 		switch (chunk->fourcc)
 		{
 		case FOURCC_RDEF:
-			out << *static_cast<dxbc_chunk_resource_definition*>(chunk);
+			error = dump(out, *static_cast<dxbc_chunk_resource_definition*>(chunk));
 			break;
 		case FOURCC_ISGN:
 		case FOURCC_OSGN:
-			out << *static_cast<dxbc_chunk_signature*>(chunk);
+			error = dump(out, *static_cast<dxbc_chunk_signature*>(chunk));
 			break;
 		case FOURCC_STAT:
-			out << *static_cast<dxbc_chunk_statistics*>(chunk);
+			if (bswap_le32(chunk->size) < sizeof(uint32_t))
+				error = "Statistics are truncated";
+			else
+				out << *static_cast<dxbc_chunk_statistics*>(chunk);
 			break;
 		}
+		if (error && !first_error)
+		{
+			first_error = error;
+			if (chunk_index)
+				*chunk_index = i;
+		}
 	}
+	return first_error;
+}
+
+std::ostream& operator<<(std::ostream& out, const dxbc_container& container)
+{
+	text_writer writer(out);
+	writer << container;
 	return out;
 }
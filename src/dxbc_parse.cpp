@@ -28,58 +28,174 @@
 #include <d3d11shader.h>
 #include <d3dcommon.h>
 #include <memory>
+#include <string.h>
 
-dxbc_container* dxbc_parse(const void* data, int size)
+const char* dxbc_view::init(const void* data, int size, unsigned flags)
 {
-	(void)size;
-	std::auto_ptr<dxbc_container> container(new dxbc_container());
-	container->data = data;
-	dxbc_container_header* header = (dxbc_container_header*)data;
-	uint32_t* chunk_offsets = (uint32_t*)(header + 1);
+	this->data = data;
+	this->size = 0;
+	num_chunks = 0;
+	memset(buckets, 0, sizeof(buckets));
+
+	if (size < (int)sizeof(dxbc_container_header))
+		return "Container is truncated";
+	const dxbc_container_header* header = (const dxbc_container_header*)data;
 	if (bswap_le32(header->fourcc) != FOURCC_DXBC)
-		return 0;
-	unsigned num_chunks = bswap_le32(header->chunk_count);
-	for (unsigned i = 0; i < num_chunks; ++i)
+		return "Not a DXBC container";
+	unsigned count = bswap_le32(header->chunk_count);
+	if (count > (size - sizeof(dxbc_container_header)) / sizeof(uint32_t))
+		return "Chunk offsets exceed the container";
+
+	const uint32_t* chunk_offsets = (const uint32_t*)(header + 1);
+	const unsigned mask = (1 << DXBC_VIEW_HASH_BITS) - 1;
+	for (unsigned i = 0; i < count; ++i)
 	{
 		unsigned offset = bswap_le32(chunk_offsets[i]);
-		dxbc_chunk_header* chunk = (dxbc_chunk_header*)((char*)data + offset);
+		if (offset > (unsigned)size - sizeof(dxbc_chunk_header))
+			return "Chunk header exceeds the container";
+		/* as dxbc_scan requires, so that the chunks can be read in place */
+		if (offset & 3)
+			return "Chunk is misaligned";
+		const dxbc_chunk_header* chunk =
+			(const dxbc_chunk_header*)((const char*)data + offset);
+		if (bswap_le32(chunk->size) >
+			(unsigned)size - sizeof(dxbc_chunk_header) - offset)
+			return "Chunk exceeds the container";
+		if (i >= DXBC_VIEW_MAX_CHUNKS)
+			continue;
+		offsets[i] = offset;
+
 		unsigned fourcc = bswap_le32(chunk->fourcc);
-		container->chunk_map[fourcc] = i;
-		container->chunks.push_back(chunk);
+		unsigned h = hash(fourcc);
+		while (buckets[h] &&
+			   bswap_le32(this->chunk(buckets[h] - 1)->fourcc) != fourcc)
+			h = (h + 1) & mask;
+		if (!buckets[h])
+			buckets[h] = (uint8_t)(i + 1);
 	}
-	return container.release();
+	if (flags & DXBC_PARSE_VERIFY_CHECKSUM)
+	{
+		unsigned total_size = bswap_le32(header->total_size);
+		if (total_size > (unsigned)size)
+			return "Container is truncated";
+		if (!dxbc_verify_checksum(data, total_size))
+			return "Checksum mismatch";
+	}
+	this->size = size;
+	num_chunks = count;
+	return 0;
 }
 
-dxbc_chunk_header* dxbc_find_chunk(const void* data, int size, unsigned fourcc)
+dxbc_chunk_header* dxbc_view::find_past_table(unsigned fourcc) const
 {
-	(void)size;
-	dxbc_container_header* header = (dxbc_container_header*)data;
-	uint32_t* chunk_offsets = (uint32_t*)(header + 1);
-	if (bswap_le32(header->fourcc) != FOURCC_DXBC)
-		return 0;
-	unsigned num_chunks = bswap_le32(header->chunk_count);
-	for (unsigned i = 0; i < num_chunks; ++i)
+	for (unsigned i = DXBC_VIEW_MAX_CHUNKS; i < num_chunks; ++i)
 	{
-		unsigned offset = bswap_le32(chunk_offsets[i]);
-		dxbc_chunk_header* chunk = (dxbc_chunk_header*)((char*)data + offset);
-		if (bswap_le32(chunk->fourcc) == fourcc)
-			return chunk;
+		dxbc_chunk_header* c = chunk(i);
+		if (bswap_le32(c->fourcc) == fourcc)
+			return c;
 	}
 	return 0;
 }
 
-int dxbc_parse_signature(dxbc_chunk_signature* sig,
-						 D3D11_SIGNATURE_PARAMETER_DESC** params)
+dxbc_chunk_signature* dxbc_view::find_signature(unsigned kind) const
 {
-	unsigned count = bswap_le32(sig->count);
-	*params = (D3D11_SIGNATURE_PARAMETER_DESC*)malloc(
-		sizeof(D3D11_SIGNATURE_PARAMETER_DESC) * count);
+	switch (kind)
+	{
+	case DXBC_FIND_INPUT_SIGNATURE:
+		return (dxbc_chunk_signature*)find(FOURCC_ISGN);
+	case DXBC_FIND_OUTPUT_SIGNATURE:
+		return (dxbc_chunk_signature*)find(FOURCC_OSGN);
+	case DXBC_FIND_PATCH_SIGNATURE:
+		return (dxbc_chunk_signature*)find(FOURCC_PCSG);
+	default:
+		return NULL;
+	}
+}
 
-	for (unsigned i = 0; i < count; ++i)
+dxbc_container* dxbc_parse(const void* data, int size, unsigned flags,
+						   const char** error)
+{
+	std::unique_ptr<dxbc_container> container(new dxbc_container());
+	container->data = data;
+	const char* view_error = container->view.init(data, size, flags);
+	if (error)
+		*error = view_error;
+	if (view_error)
+		return 0;
+	container->chunks.reserve(container->view.num_chunks);
+	for (unsigned i = 0; i < container->view.num_chunks; ++i)
+		container->chunks.push_back(container->view.chunk(i));
+	return container.release();
+}
+
+dxbc_chunk_header* dxbc_find_chunk(const void* data, int size, unsigned fourcc)
+{
+	dxbc_view view;
+	if (view.init(data, size))
+		return 0;
+	return view.find(fourcc);
+}
+
+/* the offsets inside RDEF, ISGN and OSGN chunks are relative to the end of
+ * the chunk header */
+static char* chunk_data(dxbc_chunk_header* chunk)
+{
+	return (char*)(chunk + 1);
+}
+
+/* the string at offset in the size bytes of a chunk, or null if it does not
+ * end within them */
+static char* chunk_string(dxbc_chunk_header* chunk, uint32_t offset)
+{
+	unsigned size = bswap_le32(chunk->size);
+	if (offset >= size || !memchr(chunk_data(chunk) + offset, 0, size - offset))
+		return 0;
+	return chunk_data(chunk) + offset;
+}
+
+/* whether count entries of entry_size bytes at offset fit into the chunk */
+static bool chunk_range_fits(dxbc_chunk_header* chunk, uint32_t offset,
+							 uint32_t count, size_t entry_size)
+{
+	unsigned size = bswap_le32(chunk->size);
+	return offset <= size && count <= (size - offset) / entry_size;
+}
+
+/* the same for tables of words, which fxc always aligns */
+static bool chunk_table_fits(dxbc_chunk_header* chunk, uint32_t offset,
+							 uint32_t count, size_t entry_size)
+{
+	return !(offset & 3) && chunk_range_fits(chunk, offset, count, entry_size);
+}
+
+/* the most samples a multisampled resource can have in Direct3D 11 */
+#define DXBC_MAX_SAMPLE_COUNT 32
+
+const char* dxbc_parse_signature(dxbc_chunk_signature* sig, int& count,
+								 D3D11_SIGNATURE_PARAMETER_DESC** params)
+{
+	count = 0;
+	*params = nullptr;
+	if (!chunk_table_fits(sig, 0, 2, sizeof(uint32_t)))
+		return "Signature is truncated";
+	unsigned n = bswap_le32(sig->count);
+	if (!chunk_table_fits(sig, 2 * sizeof(uint32_t), n,
+						  sizeof(sig->elements[0])))
+		return "Signature elements exceed the chunk";
+
+	*params = (D3D11_SIGNATURE_PARAMETER_DESC*)malloc(
+		sizeof(D3D11_SIGNATURE_PARAMETER_DESC) * n);
+	for (unsigned i = 0; i < n; ++i)
 	{
 		D3D11_SIGNATURE_PARAMETER_DESC& param = (*params)[i];
 		param.SemanticName =
-			(char*)&sig->count + bswap_le32(sig->elements[i].name_offset);
+			chunk_string(sig, bswap_le32(sig->elements[i].name_offset));
+		if (!param.SemanticName)
+		{
+			free(*params);
+			*params = nullptr;
+			return "Semantic name exceeds the chunk";
+		}
 		param.SemanticIndex = bswap_le32(sig->elements[i].semantic_index);
 		param.SystemValueType =
 			(D3D_NAME)bswap_le32(sig->elements[i].system_value_type);
@@ -90,25 +206,64 @@ int dxbc_parse_signature(dxbc_chunk_signature* sig,
 		param.ReadWriteMask = sig->elements[i].read_write_mask;
 		param.Stream = sig->elements[i].stream;
 	}
-	return count;
+	count = n;
+	return 0;
 }
 
-void dxbc_parse_resource_definition(dxbc_chunk_resource_definition* rdef,
+/* the fixed fields of RDEF, up to creator_offset */
+#define RDEF_HEADER_SIZE (7 * sizeof(uint32_t))
+
+const char* dxbc_parse_resource_definition(dxbc_chunk_resource_definition* rdef,
 						 int& buffer_count,
 						 D3D11_SHADER_BUFFER_DESC** buffers,
 						 int& binding_count,
 						 D3D11_SHADER_INPUT_BIND_DESC** bindings,
 						 char** creator)
 {
+	buffer_count = 0;
+	binding_count = 0;
+	*buffers = nullptr;
+	*bindings = nullptr;
+	if (!chunk_table_fits(rdef, 0, 1, RDEF_HEADER_SIZE))
+		return "Resource definition is truncated";
+
 	unsigned count = bswap_le32(rdef->constant_buffer_count);
+	unsigned offset = bswap_le32(rdef->constant_buffer_offset);
+	if (!chunk_table_fits(rdef, offset, count,
+						  sizeof(dxbc_rdef_constant_buffer)))
+		return "Constant buffers exceed the chunk";
+	const auto* cb = (dxbc_rdef_constant_buffer*)(chunk_data(rdef) + offset);
+	for (unsigned i = 0; i < count; ++i)
+		if (!chunk_string(rdef, bswap_le32(cb[i].name_offset)))
+			return "Constant buffer name exceeds the chunk";
+
+	unsigned num_bindings = bswap_le32(rdef->resource_binding_count);
+	offset = bswap_le32(rdef->resource_binding_offset);
+	if (!chunk_table_fits(rdef, offset, num_bindings,
+						  sizeof(dxbc_rdef_binding)))
+		return "Resource bindings exceed the chunk";
+	auto* rb = (dxbc_rdef_binding*)(chunk_data(rdef) + offset);
+	for (unsigned i = 0; i < num_bindings; ++i)
+	{
+		if (!chunk_string(rdef, bswap_le32(rb[i].name_offset)))
+			return "Resource binding name exceeds the chunk";
+		unsigned dimension = bswap_le32(rb[i].dimension);
+		if ((dimension == D3D_SRV_DIMENSION_TEXTURE2DMS ||
+			 dimension == D3D_SRV_DIMENSION_TEXTURE2DMSARRAY) &&
+			bswap_le32(rb[i].sample_count) > DXBC_MAX_SAMPLE_COUNT)
+			return "Resource binding sample count out of range";
+	}
+
+	char* creator_name = chunk_string(rdef, bswap_le32(rdef->creator_offset));
+	if (creator && !creator_name)
+		return "Creator name exceeds the chunk";
+
 	*buffers = (D3D11_SHADER_BUFFER_DESC*)malloc(
 		sizeof(D3D11_SHADER_BUFFER_DESC) * count);
-	const auto* cb = (dxbc_rdef_constant_buffer*)((char*)&rdef->constant_buffer_count + bswap_le32(rdef->constant_buffer_offset));
-
 	for (unsigned i = 0; i < count; ++i)
 	{
 		D3D11_SHADER_BUFFER_DESC& buffer = (*buffers)[i];
-		buffer.Name = (char*)&rdef->constant_buffer_count + bswap_le32(cb[i].name_offset);
+		buffer.Name = chunk_data(rdef) + bswap_le32(cb[i].name_offset);
 		buffer.Type = (D3D_CBUFFER_TYPE)bswap_le32(cb[i].type);
 		buffer.Variables = bswap_le32(cb[i].variable_count);
 		buffer.Size = bswap_le32(cb[i].size);
@@ -117,15 +272,14 @@ void dxbc_parse_resource_definition(dxbc_chunk_resource_definition* rdef,
 
 	buffer_count = count;
 
-	count = bswap_le32(rdef->resource_binding_count);
+	count = num_bindings;
 	*bindings = (D3D11_SHADER_INPUT_BIND_DESC*)malloc(
 		sizeof(D3D11_SHADER_INPUT_BIND_DESC) * count);
-	auto* rb = (dxbc_rdef_binding*)((char*)&rdef->constant_buffer_count + bswap_le32(rdef->resource_binding_offset));
 	
 	for (unsigned i = 0; i < count; ++i)
 	{
 		D3D11_SHADER_INPUT_BIND_DESC& bind = (*bindings)[i];
-		bind.Name = (char*)&rdef->constant_buffer_count + bswap_le32(rb[i].name_offset);
+		bind.Name = chunk_data(rdef) + bswap_le32(rb[i].name_offset);
 		bind.Type = (D3D_SHADER_INPUT_TYPE)bswap_le32(rb[i].input_type);
 		bind.BindPoint = bswap_le32(rb[i].bind_point);
 		bind.BindCount = bswap_le32(rb[i].bind_count);
@@ -139,36 +293,70 @@ void dxbc_parse_resource_definition(dxbc_chunk_resource_definition* rdef,
 
 	if (creator)
 	{
-		*creator = (char*)&rdef->constant_buffer_count + bswap_le32(rdef->creator_offset);
+		*creator = creator_name;
 	}
+	return 0;
 }
 
-int dxbc_parse_shader_variables(dxbc_chunk_resource_definition* rdef,
-						 unsigned buffer_index,
+const char* dxbc_parse_shader_variables(dxbc_chunk_resource_definition* rdef,
+						 unsigned buffer_index, int& count,
 						 D3D11_SHADER_TYPE_DESC** types,
 						 D3D11_SHADER_VARIABLE_DESC** variables)
 {
-	const auto& cb = ((dxbc_rdef_constant_buffer*)
-		((char*)&rdef->constant_buffer_count
-			+ bswap_le32(rdef->constant_buffer_offset)))
-		[buffer_index];
-	unsigned count = bswap_le32(cb.variable_count);
+	count = 0;
+	*types = nullptr;
+	*variables = nullptr;
+	unsigned offset = bswap_le32(rdef->constant_buffer_offset);
+	if (!chunk_table_fits(rdef, 0, 1, RDEF_HEADER_SIZE) ||
+		buffer_index >= bswap_le32(rdef->constant_buffer_count) ||
+		!chunk_table_fits(rdef, offset, buffer_index + 1,
+						  sizeof(dxbc_rdef_constant_buffer)))
+		return "Constant buffer index out of range";
+	const auto& cb =
+		((dxbc_rdef_constant_buffer*)(chunk_data(rdef) + offset))[buffer_index];
+
+	const bool is_rd1_1 =
+		chunk_table_fits(rdef, RDEF_HEADER_SIZE, 1, sizeof(uint32_t)) &&
+		rdef->optional[0].fourcc == FOURCC('R', 'D', '1', '1');
+	/* the SM5 fields, start_texture to sampler_size, follow each variable */
+	const size_t optional_size = is_rd1_1 ? 4 * sizeof(int32_t) : 0;
+
+	unsigned n = bswap_le32(cb.variable_count);
+	offset = bswap_le32(cb.variable_offset);
+	if (!chunk_table_fits(rdef, offset, n, sizeof(dxbc_rdef_variable)) ||
+		(n && !chunk_table_fits(
+				  rdef,
+				  (uint32_t)(offset + (n - 1) * sizeof(dxbc_rdef_variable)), 1,
+				  sizeof(dxbc_rdef_variable) + optional_size)))
+		return "Variables exceed the chunk";
+	const auto* v = (dxbc_rdef_variable*)(chunk_data(rdef) + offset);
+	for (unsigned i = 0; i < n; ++i)
+	{
+		if (!chunk_string(rdef, bswap_le32(v[i].name_offset)))
+			return "Variable name exceeds the chunk";
+		if (!chunk_table_fits(rdef, bswap_le32(v[i].type_offset), 1,
+							  sizeof(dxbc_rdef_type)))
+			return "Variable type exceeds the chunk";
+	}
+
 	*variables = (D3D11_SHADER_VARIABLE_DESC*)malloc(
-		sizeof(D3D11_SHADER_VARIABLE_DESC) * count);
+		sizeof(D3D11_SHADER_VARIABLE_DESC) * n);
 	*types = (D3D11_SHADER_TYPE_DESC*)malloc(
-		sizeof(D3D11_SHADER_TYPE_DESC) * count);
-	const auto* v = (dxbc_rdef_variable*)((char*)&rdef->constant_buffer_count + bswap_le32(cb.variable_offset));
-
-	const bool is_rd1_1 = rdef->optional[0].fourcc == FOURCC('R', 'D', '1', '1');
+		sizeof(D3D11_SHADER_TYPE_DESC) * n);
 	
-	for (unsigned i = 0; i < count; ++i)
+	for (unsigned i = 0; i < n; ++i)
 	{
 		D3D11_SHADER_VARIABLE_DESC& var = (*variables)[i];
-		var.Name = (char*)&rdef->constant_buffer_count + bswap_le32(v[i].name_offset);
+		var.Name = chunk_data(rdef) + bswap_le32(v[i].name_offset);
 		var.StartOffset = bswap_le32(v[i].start_offset);
 		var.Size = bswap_le32(v[i].size);
 		var.uFlags = bswap_le32(v[i].flags);
-		var.DefaultValue = (char*)&rdef->constant_buffer_count + bswap_le32(v[i].default_value_offset);
+		/* variables without a default value have a zero offset */
+		unsigned default_offset = bswap_le32(v[i].default_value_offset);
+		var.DefaultValue =
+			default_offset && chunk_range_fits(rdef, default_offset, var.Size, 1)
+				? chunk_data(rdef) + default_offset
+				: nullptr;
 		if (is_rd1_1)
 		{
 			var.StartTexture = bswap_le32(v[i].optional->start_texture);
@@ -184,7 +372,7 @@ int dxbc_parse_shader_variables(dxbc_chunk_resource_definition* rdef,
 			var.SamplerSize = 0;
 		}
 
-		const auto& t = *(dxbc_rdef_type*)((char*)&rdef->constant_buffer_count + bswap_le32(v[i].type_offset));
+		const auto& t = *(dxbc_rdef_type*)(chunk_data(rdef) + bswap_le32(v[i].type_offset));
 		D3D11_SHADER_TYPE_DESC& type = (*types)[i];
 		// FIXME: byte swapping on the 6 16-bit values below?
 		type.Class = (D3D_SHADER_VARIABLE_CLASS)t.type_class;
@@ -197,5 +385,6 @@ int dxbc_parse_shader_variables(dxbc_chunk_resource_definition* rdef,
 		type.Name = nullptr;	// FIXME
 	}
 
-	return count;
+	count = n;
+	return 0;
 }
@@ -0,0 +1,156 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "dxbc.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DXBC_SCAN_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+/* the candidates sit at arbitrary byte offsets, so nothing may be read
+ * through a uint32_t pointer here */
+static inline uint32_t load_le32(const unsigned char* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return bswap_le32(v);
+}
+
+#ifdef DXBC_SCAN_SSE2
+static inline unsigned lowest_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, mask);
+	return (unsigned)i;
+#else
+	return (unsigned)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+/* returns the first "DXBC" starting in [p, end), or end; the magic may
+ * extend up to 3 bytes past end, as long as it stays before limit */
+static const unsigned char* find_magic(const unsigned char* p,
+									   const unsigned char* end,
+									   const unsigned char* limit)
+{
+#ifdef DXBC_SCAN_SSE2
+	/* compare 16 positions at once against both the first and the last
+	 * byte of the magic, and only look closer where both match */
+	const __m128i first = _mm_set1_epi8('D');
+	const __m128i last = _mm_set1_epi8('C');
+	while (end - p >= 16 && limit - p >= 16 + 3)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)p);
+		__m128i b = _mm_loadu_si128((const __m128i*)(p + 3));
+		unsigned mask = (unsigned)_mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+		while (mask)
+		{
+			unsigned i = lowest_bit(mask);
+			if (p[i + 1] == 'X' && p[i + 2] == 'B')
+				return p + i;
+			mask &= mask - 1;
+		}
+		p += 16;
+	}
+#endif
+	while (p < end && limit - p >= 4)
+	{
+		p = (const unsigned char*)memchr(p, 'D', end - p);
+		if (!p)
+			return end;
+		if (limit - p >= 4 && !memcmp(p, "DXBC", 4))
+			return p;
+		++p;
+	}
+	return end;
+}
+
+/* Much stricter than dxbc_view::init, since random data is expected to
+ * contain the magic every now and then: the offsets must point past the
+ * offset table, be aligned, and the container must be exactly as described
+ * by its header. */
+static bool check_container(const unsigned char* p, size_t avail,
+							size_t* blob_size)
+{
+	const size_t header_size = sizeof(dxbc_container_header);
+	if (avail < header_size)
+		return false;
+	if (load_le32(p + offsetof(dxbc_container_header, one)) != 1)
+		return false;
+	uint32_t total_size =
+		load_le32(p + offsetof(dxbc_container_header, total_size));
+	uint32_t count = load_le32(p + offsetof(dxbc_container_header, chunk_count));
+	if (!count)
+		return false;
+	if (total_size > avail || total_size < header_size ||
+		count > (total_size - header_size) / sizeof(uint32_t))
+		return false;
+
+	const unsigned char* chunk_offsets = p + header_size;
+	size_t first_chunk = header_size + count * sizeof(uint32_t);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		uint32_t offset = load_le32(chunk_offsets + i * sizeof(uint32_t));
+		if (offset < first_chunk || (offset & 3) ||
+			offset > total_size - sizeof(dxbc_chunk_header))
+			return false;
+		uint32_t size = load_le32(p + offset + offsetof(dxbc_chunk_header, size));
+		if (size > total_size - sizeof(dxbc_chunk_header) - offset)
+			return false;
+	}
+	*blob_size = total_size;
+	return true;
+}
+
+size_t dxbc_scan(const void* data, size_t size, size_t start, size_t end,
+				 size_t* blob_size)
+{
+	const unsigned char* base = (const unsigned char*)data;
+	if (end > size)
+		end = size;
+	while (start < end)
+	{
+		const unsigned char* p =
+			find_magic(base + start, base + end, base + size);
+		start = p - base;
+		if (start >= end)
+			break;
+		if (check_container(p, size - start, blob_size))
+			return start;
+		++start;
+	}
+	return end;
+}
@@ -158,3 +158,19 @@ const char* dxbc_names[] = {
 	"DEPTH_GREATER_EQUAL",
 	"DEPTH_LESS_EQUAL"
 };
+
+const unsigned dxbc_shader_type_name_count =
+	sizeof(dxbc_shader_type_names) / sizeof(dxbc_shader_type_names[0]);
+const unsigned dxbc_shader_input_type_name_count =
+	sizeof(dxbc_shader_input_type_names) /
+	sizeof(dxbc_shader_input_type_names[0]);
+const unsigned dxbc_shader_return_type_name_count =
+	sizeof(dxbc_shader_return_type_names) /
+	sizeof(dxbc_shader_return_type_names[0]);
+const unsigned dxbc_shader_dimension_name_count =
+	sizeof(dxbc_shader_dimension_names) /
+	sizeof(dxbc_shader_dimension_names[0]);
+const unsigned dxbc_register_component_type_name_count =
+	sizeof(dxbc_register_component_type_names) /
+	sizeof(dxbc_register_component_type_names[0]);
+const unsigned dxbc_name_count = sizeof(dxbc_names) / sizeof(dxbc_names[0]);
@@ -0,0 +1,166 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "mapped_file.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file() : data(0), size(0)
+{
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = NULL;
+#endif
+}
+
+#ifdef _WIN32
+bool mapped_file::open(const char* path, unsigned hints)
+{
+	close();
+
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	if (hints & MAPPED_FILE_SEQUENTIAL)
+		flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+							  OPEN_EXISTING, flags, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size))
+	{
+		close();
+		return false;
+	}
+	size = (size_t)file_size.QuadPart;
+	if (!size)
+		return true;
+
+	mapping_handle =
+		CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping_handle)
+	{
+		close();
+		return false;
+	}
+	data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+	data = 0;
+	size = 0;
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = NULL;
+}
+
+void mapped_file::advise(size_t offset, size_t length, unsigned hints) const
+{
+	/* the sequential scan flag has been passed to CreateFileA already */
+	(void)offset;
+	(void)length;
+	(void)hints;
+}
+#else
+bool mapped_file::open(const char* path, unsigned hints)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+	{
+		::close(fd);
+		return false;
+	}
+	if (!st.st_size)
+	{
+		::close(fd);
+		return true;
+	}
+
+	void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* the mapping keeps its own reference to the file */
+	::close(fd);
+	if (p == MAP_FAILED)
+		return false;
+
+	data = p;
+	size = (size_t)st.st_size;
+	advise(0, size, hints);
+	return true;
+}
+
+void mapped_file::close()
+{
+	if (data)
+		munmap((void*)data, size);
+	data = 0;
+	size = 0;
+}
+
+void mapped_file::advise(size_t offset, size_t length, unsigned hints) const
+{
+	if (!data || offset >= size)
+		return;
+	if (length > size - offset)
+		length = size - offset;
+
+	/* madvise wants a page aligned start address */
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t begin = offset & ~(page - 1);
+	char* start = (char*)data + begin;
+	length += offset - begin;
+
+	if (hints & MAPPED_FILE_SEQUENTIAL)
+		madvise(start, length, MADV_SEQUENTIAL);
+	if (hints & MAPPED_FILE_WILLNEED)
+		madvise(start, length, MADV_WILLNEED);
+	if (hints & MAPPED_FILE_DONTNEED)
+		madvise(start, length, MADV_DONTNEED);
+}
+#endif
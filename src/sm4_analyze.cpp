@@ -24,7 +24,7 @@
  *
  **************************************************************************/
 
-#include "sm4.h"
+#include "sm4_insns.h"
 #include <set>
 #include <vector>
 
@@ -35,19 +35,18 @@
 			return false;                                                      \
 	} while (0)
 
-bool sm4_link_cf_insns(sm4_program& program)
+template <typename Insns>
+static bool link_cf_insns(const Insns& insns, std::vector<int>& result)
 {
-	if (program.cf_insn_linked.size())
-		return true;
-
 	std::vector<int> cf_insn_linked;
-	cf_insn_linked.resize(program.insns.size());
-	memset(&cf_insn_linked[0], 0xff, cf_insn_linked.size() * sizeof(int));
+	cf_insn_linked.resize(insns.size());
+	if (cf_insn_linked.size())
+		memset(&cf_insn_linked[0], 0xff, cf_insn_linked.size() * sizeof(int));
 	std::vector<unsigned> cf_stack;
-	for (unsigned insn_num = 0; insn_num < program.insns.size(); ++insn_num)
+	for (unsigned insn_num = 0; insn_num < insns.size(); ++insn_num)
 	{
 		unsigned v;
-		switch (program.insns[insn_num]->opcode)
+		switch (insns.opcode(insn_num))
 		{
 		case SM4_OPCODE_LOOP:
 			cf_stack.push_back(insn_num);
@@ -55,7 +54,7 @@ bool sm4_link_cf_insns(sm4_program& program)
 		case SM4_OPCODE_ENDLOOP:
 			check(!cf_stack.empty());
 			v = cf_stack.back();
-			check(program.insns[v]->opcode == SM4_OPCODE_LOOP);
+			check(insns.opcode(v) == SM4_OPCODE_LOOP);
 			cf_insn_linked[v] = insn_num;
 			cf_insn_linked[insn_num] = v;
 			cf_stack.pop_back();
@@ -67,13 +66,15 @@ bool sm4_link_cf_insns(sm4_program& program)
 			break;
 		case SM4_OPCODE_ELSE:
 		case SM4_OPCODE_CASE:
+		case SM4_OPCODE_DEFAULT:
 			check(!cf_stack.empty());
 			v = cf_stack.back();
-			if (program.insns[insn_num]->opcode == SM4_OPCODE_ELSE)
-				check(program.insns[v]->opcode == SM4_OPCODE_IF);
+			if (insns.opcode(insn_num) == SM4_OPCODE_ELSE)
+				check(insns.opcode(v) == SM4_OPCODE_IF);
 			else
-				check(program.insns[v]->opcode == SM4_OPCODE_SWITCH ||
-					  program.insns[v]->opcode == SM4_OPCODE_CASE);
+				check(insns.opcode(v) == SM4_OPCODE_SWITCH ||
+					  insns.opcode(v) == SM4_OPCODE_CASE ||
+					  insns.opcode(v) == SM4_OPCODE_DEFAULT);
 			cf_insn_linked[insn_num] = cf_insn_linked[v]; // later changed
 			cf_insn_linked[v] = insn_num;
 			cf_stack.back() = insn_num;
@@ -82,12 +83,13 @@ bool sm4_link_cf_insns(sm4_program& program)
 		case SM4_OPCODE_ENDIF:
 			check(!cf_stack.empty());
 			v = cf_stack.back();
-			if (program.insns[insn_num]->opcode == SM4_OPCODE_ENDIF)
-				check(program.insns[v]->opcode == SM4_OPCODE_IF ||
-					  program.insns[v]->opcode == SM4_OPCODE_ELSE);
+			if (insns.opcode(insn_num) == SM4_OPCODE_ENDIF)
+				check(insns.opcode(v) == SM4_OPCODE_IF ||
+					  insns.opcode(v) == SM4_OPCODE_ELSE);
 			else
-				check(program.insns[v]->opcode == SM4_OPCODE_SWITCH ||
-					  program.insns[v]->opcode == SM4_OPCODE_CASE);
+				check(insns.opcode(v) == SM4_OPCODE_SWITCH ||
+					  insns.opcode(v) == SM4_OPCODE_CASE ||
+					  insns.opcode(v) == SM4_OPCODE_DEFAULT);
 			cf_insn_linked[insn_num] = cf_insn_linked[v];
 			cf_insn_linked[v] = insn_num;
 			cf_stack.pop_back();
@@ -95,36 +97,66 @@ bool sm4_link_cf_insns(sm4_program& program)
 		}
 	}
 	check(cf_stack.empty());
-	program.cf_insn_linked.swap(cf_insn_linked);
+	result.swap(cf_insn_linked);
 	return true;
 }
 
-bool sm4_find_labels(sm4_program& program)
+template <typename Insns>
+static void find_labels(const Insns& insns, std::vector<int>& result)
 {
-	if (program.labels_found)
-		return true;
-
 	std::vector<int> labels;
-	for (unsigned insn_num = 0; insn_num < program.insns.size(); ++insn_num)
+	for (unsigned insn_num = 0; insn_num < insns.size(); ++insn_num)
 	{
-		switch (program.insns[insn_num]->opcode)
+		unsigned idx;
+		/* labels are numbered from 0, so an index past the instruction
+		 * count is garbage, not worth a table that large */
+		if (insns.opcode(insn_num) == SM4_OPCODE_LABEL &&
+			insns.label_index(insn_num, idx) && idx < insns.size())
 		{
-		case SM4_OPCODE_LABEL:
-			if (program.insns[insn_num]->num_ops > 0)
-			{
-				sm4_op& op = *program.insns[insn_num]->ops[0];
-				if (op.file == SM4_FILE_LABEL && op.has_simple_index())
-				{
-					unsigned idx = (unsigned)op.indices[0].disp;
-					if (idx >= labels.size())
-						labels.resize(idx + 1);
-					labels[idx] = insn_num;
-				}
-			}
-			break;
+			if (idx >= labels.size())
+				labels.resize(idx + 1, -1);
+			labels[idx] = insn_num;
 		}
 	}
-	program.label_to_insn_num.swap(labels);
+	result.swap(labels);
+}
+
+bool sm4_link_cf_insns(sm4_program& program)
+{
+	if (program.cf_insn_linked.size())
+		return true;
+
+	sm4_program_insns insns = {program};
+	return link_cf_insns(insns, program.cf_insn_linked);
+}
+
+bool sm4_find_labels(sm4_program& program)
+{
+	if (program.labels_found)
+		return true;
+
+	sm4_program_insns insns = {program};
+	find_labels(insns, program.label_to_insn_num);
+	program.labels_found = true;
+	return true;
+}
+
+bool sm4_link_cf_insns(sm4_flat_program& program)
+{
+	if (program.cf_insn_linked.size())
+		return true;
+
+	sm4_flat_program_insns insns = {program};
+	return link_cf_insns(insns, program.cf_insn_linked);
+}
+
+bool sm4_find_labels(sm4_flat_program& program)
+{
+	if (program.labels_found)
+		return true;
+
+	sm4_flat_program_insns insns = {program};
+	find_labels(insns, program.label_to_insn_num);
 	program.labels_found = true;
 	return true;
 }
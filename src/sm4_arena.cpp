@@ -0,0 +1,72 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "sm4.h"
+
+sm4_arena::~sm4_arena()
+{
+	for (unsigned i = 0; i < blocks.size(); ++i)
+		free(blocks[i].base);
+}
+
+void* sm4_arena::alloc_slow(size_t size, size_t align)
+{
+	/* move on to the next block kept from before the last reset(), or
+	 * grow; oversized requests get a block of their own */
+	for (;;)
+	{
+		if (current + 1 < blocks.size())
+			++current;
+		else
+		{
+			size_t new_size = size + align > block_size ? size + align
+														: block_size;
+			block b;
+			b.base = (char*)malloc(new_size);
+			if (!b.base)
+				throw std::bad_alloc();
+			b.size = new_size;
+			blocks.push_back(b);
+			current = (unsigned)blocks.size() - 1;
+		}
+		used = 0;
+
+		size_t offset = (used + align - 1) & ~(align - 1);
+		if (offset + size <= blocks[current].size)
+		{
+			used = offset + size;
+			return blocks[current].base + offset;
+		}
+	}
+}
+
+size_t sm4_arena::capacity() const
+{
+	size_t total = 0;
+	for (unsigned i = 0; i < blocks.size(); ++i)
+		total += blocks[i].size;
+	return total;
+}
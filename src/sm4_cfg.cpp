@@ -0,0 +1,635 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Basic blocks, and dominator and post-dominator trees, over the control
+ * flow links of sm4_analyze.cpp. Everything is built in a handful of
+ * linear passes over flat arrays, to stay cheap on whole corpora. */
+
+#include "sm4_insns.h"
+#include <vector>
+
+#define NONE SM4_CFG_NONE
+
+static bool starts_function(unsigned opcode)
+{
+	switch (opcode)
+	{
+	case SM4_OPCODE_LABEL:
+	case SM4_OPCODE_HS_DECLS:
+	case SM4_OPCODE_HS_CONTROL_POINT_PHASE:
+	case SM4_OPCODE_HS_FORK_PHASE:
+	case SM4_OPCODE_HS_JOIN_PHASE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* instructions after which a new block starts */
+static bool ends_block(unsigned opcode)
+{
+	switch (opcode)
+	{
+	case SM4_OPCODE_IF:
+	case SM4_OPCODE_ELSE:
+	case SM4_OPCODE_ENDLOOP:
+	case SM4_OPCODE_SWITCH:
+	case SM4_OPCODE_BREAK:
+	case SM4_OPCODE_BREAKC:
+	case SM4_OPCODE_CONTINUE:
+	case SM4_OPCODE_CONTINUEC:
+	case SM4_OPCODE_RET:
+	case SM4_OPCODE_RETC:
+	case SM4_OPCODE_DISCARD:
+	case SM4_OPCODE_CALL:
+	case SM4_OPCODE_CALLC:
+	case SM4_OPCODE_INTERFACE_CALL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* instructions that never fall through to the next one */
+static bool is_jump(unsigned opcode)
+{
+	switch (opcode)
+	{
+	case SM4_OPCODE_ELSE:
+	case SM4_OPCODE_ENDLOOP:
+	case SM4_OPCODE_SWITCH:
+	case SM4_OPCODE_BREAK:
+	case SM4_OPCODE_CONTINUE:
+	case SM4_OPCODE_RET:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Lengauer-Tarjan with path compression, on every node reached from the
+ * roots through the out edges. The nodes are handled by DFS number, and
+ * the forest is walked with explicit stacks, so that long chains of blocks
+ * cannot overflow the native one. */
+struct dominator_finder
+{
+	const uint32_t* out_offsets;
+	const uint32_t* out;
+	const uint32_t* in_offsets;
+	const uint32_t* in;
+
+	std::vector<uint32_t> number; /* by node */
+	std::vector<uint32_t> vertex; /* by number, like all the others */
+	std::vector<uint32_t> parent;
+	std::vector<uint32_t> semi;
+	std::vector<uint32_t> label;
+	std::vector<uint32_t> ancestor;
+	std::vector<uint32_t> dom;
+	std::vector<uint32_t> bucket;	   /* first node, by number */
+	std::vector<uint32_t> bucket_next; /* by number */
+	std::vector<uint32_t> stack;
+
+	void search(uint32_t root)
+	{
+		/* pairs of node and next edge to follow */
+		std::vector<uint32_t>& todo = stack;
+		todo.clear();
+		number[root] = (uint32_t)vertex.size();
+		vertex.push_back(root);
+		parent.push_back(NONE);
+		todo.push_back(root);
+		todo.push_back(out_offsets[root]);
+		while (!todo.empty())
+		{
+			uint32_t v = todo[todo.size() - 2];
+			uint32_t& e = todo.back();
+			if (e == out_offsets[v + 1])
+			{
+				todo.resize(todo.size() - 2);
+				continue;
+			}
+			uint32_t w = out[e++];
+			if (number[w] != NONE)
+				continue;
+			number[w] = (uint32_t)vertex.size();
+			vertex.push_back(w);
+			parent.push_back(number[v]);
+			todo.push_back(w);
+			todo.push_back(out_offsets[w]);
+		}
+	}
+
+	void compress(uint32_t v)
+	{
+		stack.clear();
+		while (ancestor[ancestor[v]] != NONE)
+		{
+			stack.push_back(v);
+			v = ancestor[v];
+		}
+		while (!stack.empty())
+		{
+			uint32_t x = stack.back();
+			stack.pop_back();
+			uint32_t a = ancestor[x];
+			if (semi[label[a]] < semi[label[x]])
+				label[x] = label[a];
+			ancestor[x] = ancestor[a];
+		}
+	}
+
+	uint32_t eval(uint32_t v)
+	{
+		if (ancestor[v] == NONE)
+			return v;
+		compress(v);
+		return label[v];
+	}
+
+	void run(unsigned num_nodes, const uint32_t* roots, unsigned num_roots,
+			 std::vector<uint32_t>& idom)
+	{
+		number.assign(num_nodes, NONE);
+		vertex.clear();
+		parent.clear();
+		for (unsigned i = 0; i < num_roots; ++i)
+		{
+			if (number[roots[i]] == NONE)
+				search(roots[i]);
+		}
+
+		unsigned n = (unsigned)vertex.size();
+		semi.resize(n);
+		label.resize(n);
+		for (unsigned i = 0; i < n; ++i)
+			semi[i] = label[i] = i;
+		ancestor.assign(n, NONE);
+		dom.assign(n, NONE);
+		bucket.assign(n, NONE);
+		bucket_next.resize(n);
+
+		for (unsigned w = n; w-- > 0;)
+		{
+			uint32_t p = parent[w];
+			if (p == NONE)
+				continue;
+			uint32_t node = vertex[w];
+			for (uint32_t e = in_offsets[node]; e < in_offsets[node + 1]; ++e)
+			{
+				uint32_t v = number[in[e]];
+				if (v == NONE)
+					continue;
+				uint32_t u = eval(v);
+				if (semi[u] < semi[w])
+					semi[w] = semi[u];
+			}
+			bucket_next[w] = bucket[semi[w]];
+			bucket[semi[w]] = w;
+			ancestor[w] = p;
+
+			for (uint32_t v = bucket[p]; v != NONE; v = bucket_next[v])
+			{
+				uint32_t u = eval(v);
+				dom[v] = semi[u] < semi[v] ? u : p;
+			}
+			bucket[p] = NONE;
+		}
+
+		idom.assign(num_nodes, NONE);
+		for (unsigned w = 0; w < n; ++w)
+		{
+			if (parent[w] == NONE)
+				continue;
+			if (dom[w] != semi[w])
+				dom[w] = dom[dom[w]];
+			idom[vertex[w]] = vertex[dom[w]];
+		}
+	}
+};
+
+/* numbers the trees given by idom in preorder, from the roots */
+static void number_tree(const std::vector<uint32_t>& idom,
+						const uint32_t* roots, unsigned num_roots,
+						std::vector<uint32_t>& pre, std::vector<uint32_t>& end)
+{
+	unsigned n = (unsigned)idom.size();
+	std::vector<uint32_t> child_offsets(n + 1, 0);
+	for (unsigned b = 0; b < n; ++b)
+	{
+		if (idom[b] != NONE)
+			++child_offsets[idom[b] + 1];
+	}
+	for (unsigned b = 0; b < n; ++b)
+		child_offsets[b + 1] += child_offsets[b];
+	std::vector<uint32_t> children(child_offsets[n]);
+	std::vector<uint32_t> fill(child_offsets.begin(), child_offsets.end() - 1);
+	for (unsigned b = 0; b < n; ++b)
+	{
+		if (idom[b] != NONE)
+			children[fill[idom[b]]++] = b;
+	}
+
+	pre.assign(n, NONE);
+	end.assign(n, 0);
+	uint32_t next = 0;
+	std::vector<uint32_t> todo; /* pairs of node and next child */
+	for (unsigned i = 0; i < num_roots; ++i)
+	{
+		if (pre[roots[i]] != NONE)
+			continue;
+		pre[roots[i]] = next++;
+		todo.push_back(roots[i]);
+		todo.push_back(child_offsets[roots[i]]);
+		while (!todo.empty())
+		{
+			uint32_t v = todo[todo.size() - 2];
+			uint32_t& c = todo.back();
+			if (c == child_offsets[v + 1])
+			{
+				end[v] = next;
+				todo.resize(todo.size() - 2);
+				continue;
+			}
+			uint32_t w = children[c++];
+			pre[w] = next++;
+			todo.push_back(w);
+			todo.push_back(child_offsets[w]);
+		}
+	}
+}
+
+template <typename Insns>
+static const char* build_cfg(const Insns& insns,
+							 const std::vector<int>& cf_insn_linked,
+							 const std::vector<int>& labels, sm4_cfg& cfg)
+{
+	unsigned n = insns.size();
+	cfg = sm4_cfg();
+
+	/* functions, and the instruction each one ends before */
+	std::vector<uint32_t> function_end;
+	for (unsigned i = 0; i < n; ++i)
+	{
+		unsigned opcode = insns.opcode(i);
+		if (!starts_function(opcode) && i)
+			continue;
+		sm4_cfg_function f;
+		f.first_insn = i;
+		f.label = NONE;
+		f.kind = SM4_CFG_MAIN;
+		if (opcode == SM4_OPCODE_LABEL)
+		{
+			f.kind = SM4_CFG_SUBROUTINE;
+			if (!insns.label_index(i, f.label))
+				f.label = NONE;
+		}
+		else if (starts_function(opcode))
+			f.kind = SM4_CFG_PHASE;
+		if (!cfg.functions.empty())
+			function_end.push_back(i);
+		cfg.functions.push_back(f);
+	}
+	if (cfg.functions.empty())
+	{
+		sm4_cfg_function f = {SM4_CFG_MAIN, 0, NONE, 0, 0, 0};
+		cfg.functions.push_back(f);
+	}
+	function_end.push_back(n);
+
+	/* where break, continue and the branches of if go */
+	std::vector<uint32_t> target(n, NONE);
+	std::vector<uint8_t> leader(n + 1, 0);
+	struct breakable
+	{
+		uint32_t break_target;
+		uint32_t continue_target;
+	};
+	std::vector<breakable> breakables;
+	unsigned func = 0;
+	for (unsigned i = 0; i < n; ++i)
+	{
+		if (i == function_end[func])
+		{
+			if (!breakables.empty())
+				return "Control flow crosses a function boundary";
+			++func;
+		}
+		unsigned opcode = insns.opcode(i);
+		int linked = cf_insn_linked[i];
+		if (starts_function(opcode) || !i)
+			leader[i] = 1;
+		if (ends_block(opcode))
+			leader[i + 1] = 1;
+		uint32_t t = NONE;
+		breakable b;
+		switch (opcode)
+		{
+		case SM4_OPCODE_IF:
+			t = insns.opcode(linked) == SM4_OPCODE_ELSE ? linked + 1 : linked;
+			break;
+		case SM4_OPCODE_ELSE:
+			t = linked;
+			break;
+		case SM4_OPCODE_ENDIF:
+		case SM4_OPCODE_CASE:
+		case SM4_OPCODE_DEFAULT:
+			leader[i] = 1;
+			break;
+		case SM4_OPCODE_LOOP:
+			leader[i] = 1;
+			b.break_target = linked + 1;
+			b.continue_target = i;
+			breakables.push_back(b);
+			break;
+		case SM4_OPCODE_SWITCH:
+			b.continue_target =
+				breakables.empty() ? NONE : breakables.back().continue_target;
+			while (insns.opcode(linked) != SM4_OPCODE_ENDSWITCH)
+				linked = cf_insn_linked[linked];
+			b.break_target = linked;
+			breakables.push_back(b);
+			break;
+		case SM4_OPCODE_ENDSWITCH:
+			leader[i] = 1;
+			breakables.pop_back();
+			break;
+		case SM4_OPCODE_ENDLOOP:
+			t = linked;
+			breakables.pop_back();
+			break;
+		case SM4_OPCODE_BREAK:
+		case SM4_OPCODE_BREAKC:
+			if (breakables.empty())
+				return "Break outside of a loop or switch";
+			t = breakables.back().break_target;
+			break;
+		case SM4_OPCODE_CONTINUE:
+		case SM4_OPCODE_CONTINUEC:
+			if (breakables.empty() ||
+				breakables.back().continue_target == NONE)
+				return "Continue outside of a loop";
+			t = breakables.back().continue_target;
+			break;
+		}
+		if (t != NONE)
+		{
+			if (t < cfg.functions[func].first_insn || t > function_end[func])
+				return "Control flow crosses a function boundary";
+			target[i] = t;
+			leader[t] = 1;
+		}
+	}
+	if (!breakables.empty())
+		return "Control flow crosses a function boundary";
+
+	/* the real blocks, then one exit block per function */
+	cfg.insn_block.resize(n);
+	unsigned num_functions = (unsigned)cfg.functions.size();
+	func = 0;
+	cfg.functions[0].entry = 0;
+	for (unsigned i = 0; i < n; ++i)
+	{
+		if (i == function_end[func])
+		{
+			cfg.functions[func].end_block = (uint32_t)cfg.block_function.size();
+			cfg.functions[++func].entry = (uint32_t)cfg.block_function.size();
+		}
+		if (leader[i])
+		{
+			cfg.block_start.push_back(i);
+			cfg.block_function.push_back(func);
+		}
+		cfg.insn_block[i] = (uint32_t)cfg.block_function.size() - 1;
+	}
+	cfg.functions[func].end_block = (uint32_t)cfg.block_function.size();
+	cfg.num_real_blocks = (unsigned)cfg.block_function.size();
+	for (unsigned f = 0; f < num_functions; ++f)
+	{
+		sm4_cfg_function& function = cfg.functions[f];
+		function.exit = cfg.num_real_blocks + f;
+		if (function.entry == function.end_block)
+			function.entry = function.exit;
+		cfg.block_start.push_back(n);
+		cfg.block_function.push_back(f);
+	}
+	cfg.block_start.push_back(n);
+	unsigned num_blocks = cfg.num_blocks();
+
+	/* the edges, by looking at the last instruction of every block */
+	cfg.succ_offsets.reserve(num_blocks + 1);
+	cfg.succs.reserve(num_blocks * 2);
+	for (unsigned b = 0; b < num_blocks; ++b)
+	{
+		cfg.succ_offsets.push_back((uint32_t)cfg.succs.size());
+		if (b >= cfg.num_real_blocks)
+			continue;
+		const sm4_cfg_function& function = cfg.functions[cfg.block_function[b]];
+		unsigned end = function_end[cfg.block_function[b]];
+		unsigned i = cfg.block_start[b + 1] - 1;
+		unsigned opcode = insns.opcode(i);
+
+		/* instruction targets to blocks, past the end being the exit */
+		uint32_t targets[2];
+		unsigned num_targets = 0;
+		if (!is_jump(opcode))
+			targets[num_targets++] = i + 1;
+		if (target[i] != NONE)
+			targets[num_targets++] = target[i];
+		for (unsigned k = 0; k < num_targets; ++k)
+		{
+			uint32_t s = targets[k] >= end ? function.exit
+										   : cfg.insn_block[targets[k]];
+			if (!k || cfg.succs.back() != s)
+				cfg.succs.push_back(s);
+		}
+
+		switch (opcode)
+		{
+		case SM4_OPCODE_RET:
+		case SM4_OPCODE_RETC:
+		case SM4_OPCODE_DISCARD:
+			/* the invocation may stop there */
+			if (cfg.succs.size() == cfg.succ_offsets.back() ||
+				cfg.succs.back() != function.exit)
+				cfg.succs.push_back(function.exit);
+			break;
+		case SM4_OPCODE_SWITCH:
+		{
+			bool has_default = false;
+			int c = cf_insn_linked[i];
+			for (; insns.opcode(c) != SM4_OPCODE_ENDSWITCH;
+				 c = cf_insn_linked[c])
+			{
+				uint32_t s = cfg.insn_block[c];
+				if (cfg.succs.size() == cfg.succ_offsets.back() ||
+					cfg.succs.back() != s)
+					cfg.succs.push_back(s);
+				if (insns.opcode(c) == SM4_OPCODE_DEFAULT)
+					has_default = true;
+			}
+			if (!has_default)
+				cfg.succs.push_back(cfg.insn_block[c]);
+			break;
+		}
+		case SM4_OPCODE_CALL:
+		case SM4_OPCODE_CALLC:
+		case SM4_OPCODE_INTERFACE_CALL:
+		{
+			sm4_cfg_call call = {i, b, NONE};
+			unsigned idx;
+			if (opcode != SM4_OPCODE_INTERFACE_CALL &&
+				insns.label_index(i, idx, opcode == SM4_OPCODE_CALLC) &&
+				idx < labels.size())
+			{
+				int callee = labels[idx];
+				unsigned callee_idx;
+				if (callee >= 0 && (unsigned)callee < n &&
+					insns.opcode(callee) == SM4_OPCODE_LABEL &&
+					insns.label_index(callee, callee_idx) && callee_idx == idx)
+					call.callee = cfg.block_function[cfg.insn_block[callee]];
+			}
+			cfg.calls.push_back(call);
+			break;
+		}
+		}
+	}
+	cfg.succ_offsets.push_back((uint32_t)cfg.succs.size());
+
+	/* the predecessors, by counting sort on the edges */
+	cfg.pred_offsets.assign(num_blocks + 1, 0);
+	for (unsigned e = 0; e < cfg.succs.size(); ++e)
+		++cfg.pred_offsets[cfg.succs[e] + 1];
+	for (unsigned b = 0; b < num_blocks; ++b)
+		cfg.pred_offsets[b + 1] += cfg.pred_offsets[b];
+	cfg.preds.resize(cfg.succs.size());
+	std::vector<uint32_t> fill(cfg.pred_offsets.begin(),
+							   cfg.pred_offsets.end() - 1);
+	for (unsigned b = 0; b < num_blocks; ++b)
+	{
+		for (uint32_t e = cfg.succ_offsets[b]; e < cfg.succ_offsets[b + 1]; ++e)
+			cfg.preds[fill[cfg.succs[e]]++] = b;
+	}
+
+	std::vector<uint32_t> entries(num_functions), exits(num_functions);
+	for (unsigned f = 0; f < num_functions; ++f)
+	{
+		entries[f] = cfg.functions[f].entry;
+		exits[f] = cfg.functions[f].exit;
+	}
+	dominator_finder finder;
+	finder.out_offsets = cfg.succ_offsets.data();
+	finder.out = cfg.succs.data();
+	finder.in_offsets = cfg.pred_offsets.data();
+	finder.in = cfg.preds.data();
+	finder.run(num_blocks, entries.data(), num_functions, cfg.idom);
+	number_tree(cfg.idom, entries.data(), num_functions, cfg.dom_pre,
+				cfg.dom_end);
+
+	std::swap(finder.out_offsets, finder.in_offsets);
+	std::swap(finder.out, finder.in);
+	finder.run(num_blocks, exits.data(), num_functions, cfg.ipdom);
+	number_tree(cfg.ipdom, exits.data(), num_functions, cfg.pdom_pre,
+				cfg.pdom_end);
+	return 0;
+}
+
+const char* sm4_build_cfg(sm4_program& program, sm4_cfg& cfg)
+{
+	if (!sm4_link_cf_insns(program))
+		return "Unbalanced control flow";
+	sm4_find_labels(program);
+	sm4_program_insns insns = {program};
+	return build_cfg(insns, program.cf_insn_linked, program.label_to_insn_num,
+					 cfg);
+}
+
+const char* sm4_build_cfg(sm4_flat_program& program, sm4_cfg& cfg)
+{
+	if (!sm4_link_cf_insns(program))
+		return "Unbalanced control flow";
+	sm4_find_labels(program);
+	sm4_flat_program_insns insns = {program};
+	return build_cfg(insns, program.cf_insn_linked, program.label_to_insn_num,
+					 cfg);
+}
+
+static const char* function_kind_names[] = {"main", "subroutine", "phase"};
+
+static void dump_blocks(text_writer& out, const uint32_t* blocks,
+						unsigned count)
+{
+	if (!count)
+		out << " -";
+	for (unsigned i = 0; i < count; ++i)
+		out << ' ' << blocks[i];
+}
+
+static void dump_block(text_writer& out, uint32_t b)
+{
+	if (b == NONE)
+		out << '-';
+	else
+		out << b;
+}
+
+text_writer& sm4_dump(text_writer& out, const sm4_cfg& cfg)
+{
+	for (unsigned f = 0; f < cfg.functions.size(); ++f)
+	{
+		const sm4_cfg_function& function = cfg.functions[f];
+		out << "// function " << f << ": "
+			<< function_kind_names[function.kind];
+		if (function.label != NONE)
+			out << " l" << function.label;
+		out << ", entry " << function.entry << ", exit " << function.exit
+			<< '\n';
+	}
+	for (unsigned b = 0; b < cfg.num_blocks(); ++b)
+	{
+		out << "// block " << b;
+		if (b < cfg.num_real_blocks)
+			out << ": insns " << cfg.block_start[b] << '-'
+				<< cfg.block_start[b + 1] - 1;
+		else
+			out << ": exit";
+		out << ", succs";
+		dump_blocks(out, cfg.block_succs(b), cfg.num_succs(b));
+		out << ", preds";
+		dump_blocks(out, cfg.block_preds(b), cfg.num_preds(b));
+		out << ", idom ";
+		dump_block(out, cfg.idom[b]);
+		out << ", ipdom ";
+		dump_block(out, cfg.ipdom[b]);
+		out << '\n';
+	}
+	for (unsigned i = 0; i < cfg.calls.size(); ++i)
+	{
+		out << "// call at insn " << cfg.calls[i].insn << " to function ";
+		dump_block(out, cfg.calls[i].callee);
+		out << '\n';
+	}
+	return out;
+}
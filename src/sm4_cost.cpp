@@ -0,0 +1,343 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* A static estimate of what a program costs to run, to catch regressions
+ * without a GPU at hand */
+
+#include "sm4.h"
+#include <math.h>
+
+const char* sm4_cost_unit_names[] = {
+	"none",
+	"alu",
+	"transcendental",
+	"sample",
+	"load_store",
+	"atomic",
+	"flow_control",
+};
+
+#define NONE() {SM4_COST_NONE, 0, false}
+#define ALU(n) {SM4_COST_ALU, n, true}
+#define ALU_FIXED(n) {SM4_COST_ALU, n, false}
+#define TRANS(n) {SM4_COST_TRANSCENDENTAL, n, true}
+#define SAMPLE(n) {SM4_COST_SAMPLE, n, false}
+#define LOAD_STORE(n) {SM4_COST_LOAD_STORE, n, false}
+#define ATOMIC(n) {SM4_COST_ATOMIC, n, false}
+#define FLOW(n) {SM4_COST_FLOW_CONTROL, n, false}
+
+/* integer multiplies and doubles run at a quarter rate; dp2-dp4 cost one
+ * operation per component read; div is a rcp followed by a mul */
+const sm4_opcode_cost sm4_opcode_costs[] = {
+	ALU(1), // "add"
+	ALU(1), // "and"
+	FLOW(1), // "break"
+	FLOW(1), // "breakc"
+	FLOW(2), // "call"
+	FLOW(2), // "callc"
+	FLOW(1), // "case"
+	FLOW(1), // "continue"
+	FLOW(1), // "continuec"
+	FLOW(1), // "cut"
+	FLOW(1), // "default"
+	ALU(1), // "deriv_rtx"
+	ALU(1), // "deriv_rty"
+	FLOW(1), // "discard"
+	TRANS(5), // "div"
+	ALU_FIXED(2), // "dp2"
+	ALU_FIXED(3), // "dp3"
+	ALU_FIXED(4), // "dp4"
+	FLOW(1), // "else"
+	FLOW(1), // "emit"
+	FLOW(1), // "emitthencut"
+	FLOW(1), // "endif"
+	FLOW(1), // "endloop"
+	FLOW(1), // "endswitch"
+	ALU(1), // "eq"
+	TRANS(4), // "exp"
+	ALU(1), // "frc"
+	ALU(1), // "ftoi"
+	ALU(1), // "ftou"
+	ALU(1), // "ge"
+	ALU(1), // "iadd"
+	FLOW(1), // "if"
+	ALU(1), // "ieq"
+	ALU(1), // "ige"
+	ALU(1), // "ilt"
+	ALU(4), // "imad"
+	ALU(1), // "imax"
+	ALU(1), // "imin"
+	ALU(4), // "imul"
+	ALU(1), // "ine"
+	ALU(1), // "ineg"
+	ALU(1), // "ishl"
+	ALU(1), // "ishr"
+	ALU(1), // "itof"
+	NONE(), // "label"
+	SAMPLE(2), // "ld"
+	SAMPLE(2), // "ld_ms"
+	TRANS(4), // "log"
+	FLOW(1), // "loop"
+	ALU(1), // "lt"
+	ALU(1), // "mad"
+	ALU(1), // "min"
+	ALU(1), // "max"
+	NONE(), // "customdata"
+	ALU(1), // "mov"
+	ALU(1), // "movc"
+	ALU(1), // "mul"
+	ALU(1), // "ne"
+	NONE(), // "nop"
+	ALU(1), // "not"
+	ALU(1), // "or"
+	LOAD_STORE(1), // "resinfo"
+	FLOW(1), // "ret"
+	FLOW(1), // "retc"
+	ALU(1), // "round_ne"
+	ALU(1), // "round_ni"
+	ALU(1), // "round_pi"
+	ALU(1), // "round_z"
+	TRANS(4), // "rsq"
+	SAMPLE(4), // "sample"
+	SAMPLE(4), // "sample_c"
+	SAMPLE(4), // "sample_c_lz"
+	SAMPLE(4), // "sample_l"
+	SAMPLE(8), // "sample_d"
+	SAMPLE(4), // "sample_b"
+	TRANS(4), // "sqrt"
+	FLOW(1), // "switch"
+	TRANS(8), // "sincos"
+	TRANS(8), // "udiv"
+	ALU(1), // "ult"
+	ALU(1), // "uge"
+	ALU(4), // "umul"
+	ALU(4), // "umad"
+	ALU(1), // "umax"
+	ALU(1), // "umin"
+	ALU(1), // "ushr"
+	ALU(1), // "utof"
+	ALU(1), // "xor"
+	NONE(), // "dcl_resource"
+	NONE(), // "dcl_constant_buffer"
+	NONE(), // "dcl_sampler"
+	NONE(), // "dcl_index_range"
+	NONE(), // "dcl_gs_output_primitive_topology"
+	NONE(), // "dcl_gs_input_primitive"
+	NONE(), // "dcl_max_output_vertex_count"
+	NONE(), // "dcl_input"
+	NONE(), // "dcl_input_sgv"
+	NONE(), // "dcl_input_siv"
+	NONE(), // "dcl_input_ps"
+	NONE(), // "dcl_input_ps_sgv"
+	NONE(), // "dcl_input_ps_siv"
+	NONE(), // "dcl_output"
+	NONE(), // "dcl_output_sgv"
+	NONE(), // "dcl_output_siv"
+	NONE(), // "dcl_temps"
+	NONE(), // "dcl_indexable_temp"
+	NONE(), // "dcl_global_flags"
+	NONE(), // "d3d10_count"
+	SAMPLE(2), // "lod"
+	SAMPLE(4), // "gather4"
+	LOAD_STORE(1), // "sample_pos"
+	LOAD_STORE(1), // "sample_info"
+	NONE(), // "d3d10_1_count"
+	NONE(), // "hs_decls"
+	NONE(), // "hs_control_point_phase"
+	NONE(), // "hs_fork_phase"
+	NONE(), // "hs_join_phase"
+	FLOW(1), // "emit_stream"
+	FLOW(1), // "cut_stream"
+	FLOW(1), // "emitthencut_stream"
+	FLOW(4), // "interface_call"
+	LOAD_STORE(1), // "bufinfo"
+	ALU(1), // "deriv_rtx_coarse"
+	ALU(1), // "deriv_rtx_fine"
+	ALU(1), // "deriv_rty_coarse"
+	ALU(1), // "deriv_rty_fine"
+	SAMPLE(4), // "gather4_c"
+	SAMPLE(4), // "gather4_po"
+	SAMPLE(4), // "gather4_po_c"
+	TRANS(4), // "rcp"
+	ALU(1), // "f32tof16"
+	ALU(1), // "f16tof32"
+	ALU(1), // "uaddc"
+	ALU(1), // "usubb"
+	ALU(1), // "countbits"
+	ALU(1), // "firstbit_hi"
+	ALU(1), // "firstbit_lo"
+	ALU(1), // "firstbit_shi"
+	ALU(1), // "ubfe"
+	ALU(1), // "ibfe"
+	ALU(1), // "bfi"
+	ALU(1), // "bfrev"
+	ALU(1), // "swapc"
+	NONE(), // "dcl_stream"
+	NONE(), // "dcl_function_body"
+	NONE(), // "dcl_function_table"
+	NONE(), // "dcl_interface"
+	NONE(), // "dcl_input_control_point_count"
+	NONE(), // "dcl_output_control_point_count"
+	NONE(), // "dcl_tess_domain"
+	NONE(), // "dcl_tess_partitioning"
+	NONE(), // "dcl_tess_output_primitive"
+	NONE(), // "dcl_hs_max_tessfactor"
+	NONE(), // "dcl_hs_fork_phase_instance_count"
+	NONE(), // "dcl_hs_join_phase_instance_count"
+	NONE(), // "dcl_thread_group"
+	NONE(), // "dcl_unordered_access_view_typed"
+	NONE(), // "dcl_unordered_access_view_raw"
+	NONE(), // "dcl_unordered_access_view_structured"
+	NONE(), // "dcl_thread_group_shared_memory_raw"
+	NONE(), // "dcl_thread_group_shared_memory_structured"
+	NONE(), // "dcl_resource_raw"
+	NONE(), // "dcl_resource_structured"
+	LOAD_STORE(2), // "ld_uav_typed"
+	LOAD_STORE(2), // "store_uav_typed"
+	LOAD_STORE(2), // "ld_raw"
+	LOAD_STORE(2), // "store_raw"
+	LOAD_STORE(2), // "ld_structured"
+	LOAD_STORE(2), // "store_structured"
+	ATOMIC(8), // "atomic_and"
+	ATOMIC(8), // "atomic_or"
+	ATOMIC(8), // "atomic_xor"
+	ATOMIC(8), // "atomic_cmp_store"
+	ATOMIC(8), // "atomic_iadd"
+	ATOMIC(8), // "atomic_imax"
+	ATOMIC(8), // "atomic_imin"
+	ATOMIC(8), // "atomic_umax"
+	ATOMIC(8), // "atomic_umin"
+	ATOMIC(8), // "imm_atomic_alloc"
+	ATOMIC(8), // "imm_atomic_consume"
+	ATOMIC(8), // "imm_atomic_iadd"
+	ATOMIC(8), // "imm_atomic_and"
+	ATOMIC(8), // "imm_atomic_or"
+	ATOMIC(8), // "imm_atomic_xor"
+	ATOMIC(8), // "imm_atomic_exch"
+	ATOMIC(8), // "imm_atomic_cmp_exch"
+	ATOMIC(8), // "imm_atomic_imax"
+	ATOMIC(8), // "imm_atomic_imin"
+	ATOMIC(8), // "imm_atomic_umax"
+	ATOMIC(8), // "imm_atomic_umin"
+	FLOW(4), // "sync"
+	ALU(4), // "dadd"
+	ALU(4), // "dmax"
+	ALU(4), // "dmin"
+	ALU(4), // "dmul"
+	ALU(4), // "deq"
+	ALU(4), // "dge"
+	ALU(4), // "dlt"
+	ALU(4), // "dne"
+	ALU(2), // "dmov"
+	ALU(2), // "dmovc"
+	ALU(4), // "dtof"
+	ALU(4), // "ftod"
+	ALU(2), // "eval_snapped"
+	ALU(2), // "eval_sample_index"
+	ALU(2), // "eval_centroid"
+	NONE(), // "dcl_gs_instance_count"
+};
+
+static_assert(sizeof(sm4_opcode_costs) / sizeof(sm4_opcode_costs[0]) ==
+				  SM4_OPCODE_COUNT,
+			  "sm4_opcode_costs is out of sync with the opcodes");
+
+/* the components written by the destinations of an instruction */
+static unsigned written_components(const sm4_insn& insn)
+{
+	unsigned components = 0;
+	unsigned num_dsts = sm4_opcode_descs[insn.opcode].num_dsts;
+	for (unsigned i = 0; i < num_dsts && i < insn.num_ops; ++i)
+	{
+		const sm4_op& op = *insn.ops[i];
+		if (op.comps == 1)
+			++components;
+		else if (op.comps == 4)
+			components += ((op.mask >> 0) & 1) + ((op.mask >> 1) & 1) +
+						  ((op.mask >> 2) & 1) + ((op.mask >> 3) & 1);
+	}
+	return components ? components : 1;
+}
+
+const char* sm4_loop_depths(sm4_program& program,
+							std::vector<unsigned>& depths)
+{
+	if (!sm4_link_cf_insns(program))
+		return "Unbalanced control flow";
+
+	/* an endloop, which branches back, is inside its loop, but the loop
+	 * instruction is not */
+	unsigned num_insns = (unsigned)program.insns.size();
+	std::vector<int> depth_change(num_insns + 1, 0);
+	for (unsigned i = 0; i < num_insns; ++i)
+	{
+		if (program.insns[i]->opcode == SM4_OPCODE_LOOP)
+		{
+			++depth_change[i + 1];
+			--depth_change[program.cf_insn_linked[i] + 1];
+		}
+	}
+
+	depths.resize(num_insns);
+	int depth = 0;
+	for (unsigned i = 0; i < num_insns; ++i)
+	{
+		depth += depth_change[i];
+		depths[i] = depth;
+	}
+	return 0;
+}
+
+const char* sm4_estimate_cost(sm4_program& program,
+							  sm4_cost_estimate& estimate,
+							  unsigned loop_iterations)
+{
+	memset(&estimate, 0, sizeof(estimate));
+	std::vector<unsigned> depths;
+	const char* error = sm4_loop_depths(program, depths);
+	if (error)
+		return error;
+
+	for (unsigned i = 0; i < depths.size(); ++i)
+	{
+		unsigned depth = depths[i];
+		if (depth > estimate.max_loop_depth)
+			estimate.max_loop_depth = depth;
+
+		const sm4_insn& insn = *program.insns[i];
+		const sm4_opcode_cost& cost = sm4_opcode_costs[insn.opcode];
+		if (cost.unit == SM4_COST_NONE)
+			continue;
+		double weight = pow((double)loop_iterations, (double)depth);
+		double c = cost.cost * weight;
+		if (cost.per_component)
+			c *= written_components(insn);
+		++estimate.insns[cost.unit];
+		estimate.cost[cost.unit] += c;
+		estimate.total += c;
+	}
+	return 0;
+}
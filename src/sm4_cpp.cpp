@@ -0,0 +1,1844 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Translation of programs to C++ that runs them at native speed.
+ *
+ * The output follows the interpreter in sm4_exec.cpp: every register is
+ * an array of lanes per component, every instruction a loop over the
+ * lanes that the compiler vectorizes, and divergent flow control keeps
+ * the lanes still active in a mask of ~0 or 0 per lane. Since the
+ * structure of the program is known, the masks of each if, loop and
+ * switch become variables of their own and their bodies become C++
+ * blocks, skipped when no lane enters them. A compute shader runs its
+ * whole thread group in the lanes, so sync needs no code at all. */
+
+#include "sm4.h"
+#include "text_writer.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+enum operand_type
+{
+	FLOAT,
+	INT
+};
+
+enum
+{
+	FRAME_IF,
+	FRAME_LOOP,
+	FRAME_SWITCH
+};
+
+/* everything the translated code needs, written once per file */
+static const char runtime[] =
+	"#include <math.h>\n"
+	"#include <stdint.h>\n"
+	"#include <string.h>\n"
+	"\n"
+	"#ifndef SM4_CPP_RUNTIME\n"
+	"#define SM4_CPP_RUNTIME\n"
+	"\n"
+	"/* a buffer or texture bound to the shader: constant buffers hold size\n"
+	" * vectors of 4 words, typed resources width by height elements of 4\n"
+	" * words (height 0 for buffers and 1D textures), raw and structured ones\n"
+	" * size bytes */\n"
+	"struct sm4_cpp_resource\n"
+	"{\n"
+	"\tuint32_t* data;\n"
+	"\tunsigned size;\n"
+	"\tunsigned width;\n"
+	"\tunsigned height;\n"
+	"};\n"
+	"\n"
+	"struct sm4_cpp_sampler\n"
+	"{\n"
+	"\tbool point; /* nearest texel instead of bilinear filtering */\n"
+	"\tbool wrap;  /* texture coordinates wrap instead of being clamped */\n"
+	"};\n"
+	"\n"
+	"/* what the host binds, by register index; reads past it return 0 and\n"
+	" * writes are dropped. The inputs and outputs of pixel and vertex\n"
+	" * shaders are laid out [register][component][lane], oDepth and\n"
+	" * vPrim [lane]. */\n"
+	"struct sm4_cpp_bindings\n"
+	"{\n"
+	"\tconst sm4_cpp_resource* constant_buffers;\n"
+	"\tunsigned num_constant_buffers;\n"
+	"\tconst sm4_cpp_resource* resources;\n"
+	"\tunsigned num_resources;\n"
+	"\tconst sm4_cpp_resource* uavs;\n"
+	"\tunsigned num_uavs;\n"
+	"\tconst sm4_cpp_sampler* samplers;\n"
+	"\tunsigned num_samplers;\n"
+	"\tconst uint32_t* inputs;\n"
+	"\tuint32_t* outputs;\n"
+	"\tuint32_t* output_depth;\n"
+	"\tconst uint32_t* primitive_id;\n"
+	"};\n"
+	"\n"
+	"static inline float sm4_f(uint32_t u)\n"
+	"{\n"
+	"\tfloat f;\n"
+	"\tmemcpy(&f, &u, sizeof(f));\n"
+	"\treturn f;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_u(float f)\n"
+	"{\n"
+	"\tuint32_t u;\n"
+	"\tmemcpy(&u, &f, sizeof(u));\n"
+	"\treturn u;\n"
+	"}\n"
+	"\n"
+	"/* NaN becomes 0 */\n"
+	"static inline float sm4_sat(float f)\n"
+	"{\n"
+	"\treturn f > 0.0f ? (f < 1.0f ? f : 1.0f) : 0.0f;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_iabs(uint32_t x)\n"
+	"{\n"
+	"\treturn (int32_t)x < 0 ? 0u - x : x;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_ftoi(float f)\n"
+	"{\n"
+	"\tif (f != f)\n"
+	"\t\treturn 0;\n"
+	"\tif (f >= 2147483647.0f)\n"
+	"\t\treturn 0x7fffffffu;\n"
+	"\tif (f <= -2147483648.0f)\n"
+	"\t\treturn 0x80000000u;\n"
+	"\treturn (uint32_t)(int32_t)f;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_ftou(float f)\n"
+	"{\n"
+	"\tif (!(f > 0.0f))\n"
+	"\t\treturn 0;\n"
+	"\tif (f >= 4294967295.0f)\n"
+	"\t\treturn 0xffffffffu;\n"
+	"\treturn (uint32_t)f;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_f32tof16(uint32_t x)\n"
+	"{\n"
+	"\tuint32_t sign = (x >> 16) & 0x8000;\n"
+	"\tuint32_t exp = (x >> 23) & 0xff;\n"
+	"\tuint32_t mant = x & 0x7fffff;\n"
+	"\tif (exp == 0xff)\n"
+	"\t\treturn sign | 0x7c00 | (mant ? 0x200 : 0);\n"
+	"\tint e = (int)exp - 127 + 15;\n"
+	"\tif (e >= 31)\n"
+	"\t\treturn sign | 0x7c00;\n"
+	"\tuint32_t half, rem, halfway;\n"
+	"\tif (e <= 0)\n"
+	"\t{\n"
+	"\t\tif (e < -10)\n"
+	"\t\t\treturn sign;\n"
+	"\t\tmant |= 0x800000;\n"
+	"\t\tunsigned shift = 14 - e;\n"
+	"\t\thalf = mant >> shift;\n"
+	"\t\trem = mant & ((1u << shift) - 1);\n"
+	"\t\thalfway = 1u << (shift - 1);\n"
+	"\t}\n"
+	"\telse\n"
+	"\t{\n"
+	"\t\thalf = ((uint32_t)e << 10) | (mant >> 13);\n"
+	"\t\trem = mant & 0x1fff;\n"
+	"\t\thalfway = 0x1000;\n"
+	"\t}\n"
+	"\tif (rem > halfway || (rem == halfway && (half & 1)))\n"
+	"\t\t++half;\n"
+	"\treturn sign | half;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_f16tof32(uint32_t h)\n"
+	"{\n"
+	"\tuint32_t sign = (h & 0x8000) << 16;\n"
+	"\tint e = (h >> 10) & 0x1f;\n"
+	"\tuint32_t mant = h & 0x3ff;\n"
+	"\tif (e == 31)\n"
+	"\t\treturn sign | 0x7f800000 | (mant << 13);\n"
+	"\tif (!e)\n"
+	"\t{\n"
+	"\t\tif (!mant)\n"
+	"\t\t\treturn sign;\n"
+	"\t\te = 1;\n"
+	"\t\twhile (!(mant & 0x400))\n"
+	"\t\t{\n"
+	"\t\t\tmant <<= 1;\n"
+	"\t\t\t--e;\n"
+	"\t\t}\n"
+	"\t\tmant &= 0x3ff;\n"
+	"\t}\n"
+	"\treturn sign | ((uint32_t)(e + 112) << 23) | (mant << 13);\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_countbits(uint32_t v)\n"
+	"{\n"
+	"\tv = v - ((v >> 1) & 0x55555555);\n"
+	"\tv = (v & 0x33333333) + ((v >> 2) & 0x33333333);\n"
+	"\treturn (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_firstbit_hi(uint32_t v)\n"
+	"{\n"
+	"\tif (!v)\n"
+	"\t\treturn 0xffffffffu;\n"
+	"\tuint32_t n = 0;\n"
+	"\tfor (; !(v & 0x80000000u); v <<= 1)\n"
+	"\t\t++n;\n"
+	"\treturn n;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_firstbit_lo(uint32_t v)\n"
+	"{\n"
+	"\tif (!v)\n"
+	"\t\treturn 0xffffffffu;\n"
+	"\tuint32_t n = 0;\n"
+	"\tfor (; !(v & 1); v >>= 1)\n"
+	"\t\t++n;\n"
+	"\treturn n;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_bfrev(uint32_t v)\n"
+	"{\n"
+	"\tv = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);\n"
+	"\tv = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);\n"
+	"\tv = ((v >> 4) & 0x0f0f0f0f) | ((v & 0x0f0f0f0f) << 4);\n"
+	"\tv = ((v >> 8) & 0x00ff00ff) | ((v & 0x00ff00ff) << 8);\n"
+	"\treturn (v >> 16) | (v << 16);\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_bfe(uint32_t width, uint32_t offset, uint32_t v,\n"
+	"\t\t\t\t\t\t\t   bool is_signed)\n"
+	"{\n"
+	"\twidth &= 31;\n"
+	"\toffset &= 31;\n"
+	"\tif (!width)\n"
+	"\t\treturn 0;\n"
+	"\tif (width + offset < 32)\n"
+	"\t{\n"
+	"\t\tv <<= 32 - width - offset;\n"
+	"\t\treturn is_signed ? (uint32_t)((int32_t)v >> (32 - width))\n"
+	"\t\t\t\t\t\t : v >> (32 - width);\n"
+	"\t}\n"
+	"\treturn is_signed ? (uint32_t)((int32_t)v >> offset) : v >> offset;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_bfi(uint32_t width, uint32_t offset,\n"
+	"\t\t\t\t\t\t\t   uint32_t insert, uint32_t base)\n"
+	"{\n"
+	"\twidth &= 31;\n"
+	"\toffset &= 31;\n"
+	"\tuint32_t mask = ((1u << width) - 1) << offset;\n"
+	"\treturn ((insert << offset) & mask) | (base & ~mask);\n"
+	"}\n"
+	"\n"
+	"static inline bool sm4_any(const uint32_t* mask, unsigned lanes)\n"
+	"{\n"
+	"\tuint32_t any = 0;\n"
+	"\tfor (unsigned l = 0; l < lanes; ++l)\n"
+	"\t\tany |= mask[l];\n"
+	"\treturn any != 0;\n"
+	"}\n"
+	"\n"
+	"static inline const sm4_cpp_resource* sm4_bound(\n"
+	"\tconst sm4_cpp_resource* resources, unsigned num, uint32_t slot)\n"
+	"{\n"
+	"\treturn slot < num && resources[slot].data ? &resources[slot] : 0;\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_cb(const sm4_cpp_bindings& b, uint32_t slot,\n"
+	"\t\t\t\t\t\t\t  uint32_t index, unsigned c)\n"
+	"{\n"
+	"\tconst sm4_cpp_resource* cb =\n"
+	"\t\tsm4_bound(b.constant_buffers, b.num_constant_buffers, slot);\n"
+	"\treturn cb && index < cb->size ? cb->data[index * 4 + c] : 0;\n"
+	"}\n"
+	"\n"
+	"/* the word at a byte offset of a raw or structured buffer, or NULL */\n"
+	"static inline uint32_t* sm4_word(const sm4_cpp_resource* r, uint32_t offset)\n"
+	"{\n"
+	"\tif (!r || offset >= r->size || r->size - offset < 4)\n"
+	"\t\treturn 0;\n"
+	"\treturn r->data + (offset >> 2);\n"
+	"}\n"
+	"\n"
+	"static inline uint32_t sm4_load(const sm4_cpp_resource* r, uint32_t offset)\n"
+	"{\n"
+	"\tconst uint32_t* w = sm4_word(r, offset);\n"
+	"\treturn w ? *w : 0;\n"
+	"}\n"
+	"\n"
+	"/* the element of a typed resource, or NULL */\n"
+	"static inline uint32_t* sm4_texel(const sm4_cpp_resource* r, uint32_t x,\n"
+	"\t\t\t\t\t\t\t\t  uint32_t y)\n"
+	"{\n"
+	"\tif (!r || x >= r->width || y >= (r->height ? r->height : 1))\n"
+	"\t\treturn 0;\n"
+	"\treturn r->data + ((size_t)y * r->width + x) * 4;\n"
+	"}\n"
+	"\n"
+	"static inline int sm4_address(int x, int size, bool wrap)\n"
+	"{\n"
+	"\tif (wrap)\n"
+	"\t{\n"
+	"\t\tx %= size;\n"
+	"\t\treturn x < 0 ? x + size : x;\n"
+	"\t}\n"
+	"\treturn x < 0 ? 0 : x >= size ? size - 1 : x;\n"
+	"}\n"
+	"\n"
+	"/* at the only mip level, 0 outside of the texture */\n"
+	"static inline void sm4_sample(const sm4_cpp_resource* r,\n"
+	"\t\t\t\t\t\t\t  const sm4_cpp_bindings& b, uint32_t slot,\n"
+	"\t\t\t\t\t\t\t  float u, float v, uint32_t* result)\n"
+	"{\n"
+	"\tsm4_cpp_sampler sampler = {false, false};\n"
+	"\tif (slot < b.num_samplers)\n"
+	"\t\tsampler = b.samplers[slot];\n"
+	"\tresult[0] = result[1] = result[2] = result[3] = 0;\n"
+	"\tif (!r || !r->width)\n"
+	"\t\treturn;\n"
+	"\tint width = (int)r->width, height = r->height ? (int)r->height : 1;\n"
+	"\tu *= width;\n"
+	"\tv = r->height ? v * height : 0.5f;\n"
+	"\tif (!(u == u) || !(v == v) || fabsf(u) > 1e9f || fabsf(v) > 1e9f)\n"
+	"\t\treturn;\n"
+	"\tif (sampler.point)\n"
+	"\t{\n"
+	"\t\tint x = sm4_address((int)floorf(u), width, sampler.wrap);\n"
+	"\t\tint y = sm4_address((int)floorf(v), height, sampler.wrap);\n"
+	"\t\tmemcpy(result, r->data + ((size_t)y * width + x) * 4, 16);\n"
+	"\t\treturn;\n"
+	"\t}\n"
+	"\tu -= 0.5f;\n"
+	"\tv -= 0.5f;\n"
+	"\tfloat x0f = floorf(u), y0f = floorf(v);\n"
+	"\tfloat fx = u - x0f, fy = v - y0f;\n"
+	"\tint x0 = sm4_address((int)x0f, width, sampler.wrap);\n"
+	"\tint x1 = sm4_address((int)x0f + 1, width, sampler.wrap);\n"
+	"\tint y0 = sm4_address((int)y0f, height, sampler.wrap);\n"
+	"\tint y1 = sm4_address((int)y0f + 1, height, sampler.wrap);\n"
+	"\tconst uint32_t* t00 = r->data + ((size_t)y0 * width + x0) * 4;\n"
+	"\tconst uint32_t* t10 = r->data + ((size_t)y0 * width + x1) * 4;\n"
+	"\tconst uint32_t* t01 = r->data + ((size_t)y1 * width + x0) * 4;\n"
+	"\tconst uint32_t* t11 = r->data + ((size_t)y1 * width + x1) * 4;\n"
+	"\tfor (unsigned c = 0; c < 4; ++c)\n"
+	"\t{\n"
+	"\t\tfloat top = sm4_f(t00[c]) + (sm4_f(t10[c]) - sm4_f(t00[c])) * fx;\n"
+	"\t\tfloat bottom = sm4_f(t01[c]) + (sm4_f(t11[c]) - sm4_f(t01[c])) * fx;\n"
+	"\t\tresult[c] = sm4_u(top + (bottom - top) * fy);\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"#endif /* SM4_CPP_RUNTIME */\n";
+
+static std::string num(uint64_t v)
+{
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v);
+	return buf;
+}
+
+/* small integers in decimal, anything else as bits */
+static std::string hex(uint32_t v)
+{
+	char buf[16];
+	snprintf(buf, sizeof(buf), v < 0x10000 ? "%uu" : "0x%08xu", v);
+	return buf;
+}
+
+static unsigned source_component(const sm4_op& op, unsigned c)
+{
+	if (op.comps == 1)
+		return 0;
+	if (op.mode == SM4_OPERAND_MODE_MASK)
+		return c;
+	return op.swizzle[c];
+}
+
+static unsigned write_mask(const sm4_op& op)
+{
+	if (op.comps == 1)
+		return 1;
+	return op.comps ? op.mask : 0;
+}
+
+static bool is_typed(unsigned target)
+{
+	return target != SM4_TARGET_RAW_BUFFER &&
+		   target != SM4_TARGET_STRUCTURED_BUFFER;
+}
+
+struct frame
+{
+	unsigned kind;
+	unsigned id;
+};
+
+struct translator
+{
+	text_writer& out;
+	sm4_program& program;
+	const sm4_exec& exec;
+	std::string name;
+	std::string lanes; /* the name of the lane count */
+	unsigned num_lanes;
+	unsigned num_inputs;
+	unsigned num_outputs;
+	bool is_compute;
+	std::vector<frame> frames;
+	unsigned next_id;
+	bool in_subroutine;
+	unsigned depth; /* of the C++ blocks */
+
+	translator(text_writer& out, sm4_program& program, const sm4_exec& exec,
+			   const char* name)
+		: out(out), program(program), exec(exec), name(name),
+		  lanes(std::string(name) + "_lanes"), num_lanes(8), num_inputs(0),
+		  num_outputs(0), is_compute(program.version.type == 5), next_id(0),
+		  in_subroutine(false), depth(1)
+	{
+	}
+
+	void line(const std::string& s)
+	{
+		for (unsigned i = 0; i < depth; ++i)
+			out << '\t';
+		out.write(s.data(), s.size());
+		out << '\n';
+	}
+
+	void open(const std::string& s = std::string())
+	{
+		if (!s.empty())
+			line(s);
+		line("{");
+		++depth;
+	}
+
+	void close()
+	{
+		--depth;
+		line("}");
+	}
+
+	std::string lane_loop() const
+	{
+		return "for (unsigned l = 0; l < " + lanes + "; ++l)";
+	}
+
+	std::string index(const sm4_op& op, unsigned i)
+	{
+		if (!op.indices[i].reg)
+			return num((uint32_t)op.indices[i].disp);
+		std::string rel = src(*op.indices[i].reg, 0, INT);
+		if (!op.indices[i].disp)
+			return rel;
+		return "(uint32_t)(" + num((uint32_t)op.indices[i].disp) + "u + " +
+			   rel + ")";
+	}
+
+	/* an array of count registers of a lane each, with the registers of
+	 * the operand at index i; a relative access checks its bounds */
+	std::string element(const sm4_op& op, unsigned i, unsigned count,
+						const std::string& array, const std::string& rest,
+						bool& checked, std::string& bound)
+	{
+		checked = op.indices[i].reg != 0;
+		std::string idx = index(op, i);
+		if (!checked && (uint64_t)op.indices[i].disp >= count)
+		{
+			bound = "false";
+			return "";
+		}
+		bound = idx + " < " + num(count) + "u";
+		return array + "[" + idx + "]" + rest;
+	}
+
+	/* the lvalue or rvalue of component c of a register of the operand,
+	 * with bound set to what must hold for it to exist when it may not */
+	std::string location(const sm4_op& op, unsigned c, std::string& bound)
+	{
+		std::string comp = "[" + num(c) + "][l]";
+		bool checked = false;
+		std::string loc;
+		bound.clear();
+		switch (op.file)
+		{
+		case SM4_FILE_TEMP:
+			loc = element(op, 0, exec.num_temps, "s.r", comp, checked, bound);
+			break;
+		case SM4_FILE_INDEXABLE_TEMP:
+		{
+			unsigned x = (unsigned)op.indices[0].disp;
+			loc = element(op, 1, exec.indexable_size[x], "s.x" + num(x),
+						  comp, checked, bound);
+			break;
+		}
+		case SM4_FILE_INPUT:
+		case SM4_FILE_OUTPUT:
+		{
+			bool input = op.file == SM4_FILE_INPUT;
+			std::string idx = index(op, 0);
+			unsigned count = input ? num_inputs : num_outputs;
+			checked = op.indices[0].reg != 0;
+			if (!checked && (uint64_t)op.indices[0].disp >= count)
+			{
+				bound = "false";
+				return "";
+			}
+			bound = idx + " < " + num(count) + "u";
+			loc = std::string(input ? "b.inputs" : "b.outputs") + "[(" + idx +
+				  " * 4 + " + num(c) + ") * " + lanes + " + l]";
+			break;
+		}
+		case SM4_FILE_OUTPUT_DEPTH:
+			return "b.output_depth[l]";
+		case SM4_FILE_INPUT_PRIMITIVEID:
+			return "b.primitive_id[l]";
+		case SM4_FILE_INPUT_THREAD_ID:
+			return "s.thread_id" + comp;
+		case SM4_FILE_INPUT_THREAD_GROUP_ID:
+			return "s.thread_group_id" + comp;
+		case SM4_FILE_INPUT_THREAD_ID_IN_GROUP:
+			return "s.thread_id_in_group" + comp;
+		case SM4_FILE_INPUT_THREAD_ID_IN_GROUP_FLATTENED:
+			return "s.thread_id_in_group_flattened[l]";
+		default:
+			loc.clear();
+			break;
+		}
+		if (loc.empty())
+			bound = "false";
+		else if (!checked)
+			bound.clear();
+		return loc;
+	}
+
+	/* component c of the operand, swizzled, as a uint32_t */
+	std::string value(const sm4_op& op, unsigned c)
+	{
+		unsigned s = source_component(op, c);
+		switch (op.file)
+		{
+		case SM4_FILE_IMMEDIATE32:
+			return hex((uint32_t)op.imm_values[op.comps == 1 ? 0 : c].u32);
+		case SM4_FILE_CONSTANT_BUFFER:
+			return "sm4_cb(b, " + num((uint32_t)op.indices[0].disp) + ", " +
+				   index(op, 1) + ", " + num(s) + ")";
+		case SM4_FILE_IMMEDIATE_CONSTANT_BUFFER:
+		{
+			std::string idx = index(op, 0);
+			std::string loc = name + "_icb[" + idx + " * 4 + " + num(s) + "]";
+			if (!op.indices[0].reg)
+				return (uint64_t)op.indices[0].disp < exec.icb_size ? loc
+																	 : "0u";
+			if (!exec.icb_size)
+				return "0u";
+			return "(" + idx + " < " + num(exec.icb_size) + "u ? " + loc +
+				   " : 0u)";
+		}
+		default:
+			break;
+		}
+		std::string bound;
+		std::string loc = location(op, s, bound);
+		if (bound == "false")
+			return "0u";
+		if (bound.empty())
+			return loc;
+		return "(" + bound + " ? " + loc + " : 0u)";
+	}
+
+	/* component c of a source, with its modifiers */
+	std::string src(const sm4_op& op, unsigned c, operand_type type)
+	{
+		std::string v = value(op, c);
+		if (type == FLOAT)
+		{
+			v = "sm4_f(" + v + ")";
+			if (op.abs)
+				v = "fabsf(" + v + ")";
+			if (op.neg)
+				v = "-" + v;
+			return v;
+		}
+		if (op.abs)
+			v = "sm4_iabs(" + v + ")";
+		if (op.neg)
+			v = "(0u - " + v + ")";
+		return v;
+	}
+
+	/* the lanes of the active ones passing the test of the instruction */
+	std::string test(const sm4_insn& insn, const sm4_op& op)
+	{
+		return "m[l] & (" + src(op, 0, INT) +
+			   (insn.insn.test_nz ? " != 0u" : " == 0u") + " ? ~0u : 0u)";
+	}
+
+	/* stores the values of the active lanes d0..d3 into the destination */
+	void write(const sm4_op& op, const std::string& prefix = "d")
+	{
+		/* the inputs are read only, and null takes nothing */
+		bool writable =
+			op.file == SM4_FILE_TEMP || op.file == SM4_FILE_INDEXABLE_TEMP ||
+			op.file == SM4_FILE_OUTPUT || op.file == SM4_FILE_OUTPUT_DEPTH;
+		unsigned mask = write_mask(op);
+		for (unsigned c = 0; c < 4; ++c)
+		{
+			if (!(mask & (1 << c)))
+				continue;
+			std::string v = prefix + num(c);
+			std::string bound;
+			std::string loc = writable ? location(op, c, bound) : "";
+			if (loc.empty())
+			{
+				line("(void)" + v + ";");
+				continue;
+			}
+			std::string blend = loc + " = (" + v + " & m[l]) | (" + loc +
+								" & ~m[l]);";
+			if (bound.empty())
+				line(blend);
+			else
+			{
+				line("if (" + bound + ")");
+				++depth;
+				line(blend);
+				--depth;
+			}
+		}
+	}
+
+	/* what the lanes leaving a construct nested in the innermost frame go
+	 * back to: the outer ones, but for those that left since */
+	std::string restore(const std::string& outer)
+	{
+		std::string s = outer + " & s.alive[l]";
+		if (in_subroutine)
+			s += " & ~ret[l]";
+		bool found_loop = false, found_break = false;
+		for (size_t i = frames.size(); i-- > 0;)
+		{
+			const frame& f = frames[i];
+			if (f.kind == FRAME_LOOP && !found_loop)
+			{
+				s += " & ~continued" + num(f.id) + "[l]";
+				found_loop = true;
+			}
+			if (f.kind != FRAME_IF && !found_break)
+			{
+				s += " & ~broken" + num(f.id) + "[l]";
+				found_break = true;
+			}
+		}
+		return s;
+	}
+
+	const frame* innermost(bool loop_only) const
+	{
+		for (size_t i = frames.size(); i-- > 0;)
+		{
+			if (frames[i].kind == FRAME_LOOP ||
+				(frames[i].kind == FRAME_SWITCH && !loop_only))
+				return &frames[i];
+		}
+		return 0;
+	}
+
+	std::string array(const std::string& name) const
+	{
+		return "uint32_t " + name + "[" + lanes + "];";
+	}
+
+	std::string copy(const std::string& to, const std::string& from) const
+	{
+		return "memcpy(" + to + ", " + from + ", sizeof(" + to + "));";
+	}
+
+	std::string clear(const std::string& what) const
+	{
+		return "memset(" + what + ", 0, sizeof(" + what + "));";
+	}
+
+	/* takes the lanes passing the test out of the active ones, into
+	 * mask when given */
+	void leave(const sm4_insn& insn, bool conditional,
+			   const std::string& mask)
+	{
+		open(lane_loop());
+		line(std::string("uint32_t t = ") +
+			 (conditional ? test(insn, *insn.ops[0]) : "m[l]") + ";");
+		if (!mask.empty())
+			line(mask + "[l] |= t;");
+		line("m[l] &= ~t;");
+		close();
+	}
+
+	const char* flow_control(const sm4_insn& insn, unsigned pc)
+	{
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_IF:
+		{
+			frame f = {FRAME_IF, next_id++};
+			std::string id = num(f.id);
+			line(array("outer" + id) + " " + array("taken" + id));
+			line(copy("outer" + id, "m"));
+			open(lane_loop());
+			line("taken" + id + "[l] = " + test(insn, *insn.ops[0]) + ";");
+			line("m[l] = taken" + id + "[l];");
+			close();
+			frames.push_back(f);
+			open("if (sm4_any(m, " + lanes + "))");
+			break;
+		}
+		case SM4_OPCODE_ELSE:
+		{
+			std::string id = num(frames.back().id);
+			close();
+			line(lane_loop());
+			line("\tm[l] = outer" + id + "[l] & ~taken" + id + "[l];");
+			open("if (sm4_any(m, " + lanes + "))");
+			break;
+		}
+		case SM4_OPCODE_ENDIF:
+		{
+			std::string id = num(frames.back().id);
+			close();
+			frames.pop_back();
+			line(lane_loop());
+			line("\tm[l] = " + restore("outer" + id + "[l]") + ";");
+			break;
+		}
+		case SM4_OPCODE_LOOP:
+		{
+			frame f = {FRAME_LOOP, next_id++};
+			std::string id = num(f.id);
+			line(array("outer" + id) + " " + array("broken" + id) + " " +
+				 array("continued" + id));
+			line(copy("outer" + id, "m"));
+			line(clear("broken" + id));
+			frames.push_back(f);
+			open("for (;;)");
+			line(clear("continued" + id));
+			break;
+		}
+		case SM4_OPCODE_ENDLOOP:
+		{
+			std::string id = num(frames.back().id);
+			std::string again = "outer" + id + "[l] & s.alive[l] & ~broken" + id +
+								"[l]";
+			if (in_subroutine)
+				again += " & ~ret[l]";
+			line(lane_loop());
+			line("\tm[l] = " + again + ";");
+			line("if (!sm4_any(m, " + lanes + "))");
+			line("\tbreak;");
+			line("if (++s.iterations > " + num(SM4_EXEC_MAX_STEPS) + "u)");
+			open();
+			line("s.error = \"Too many loop iterations\";");
+			line("return;");
+			close();
+			close();
+			frames.pop_back();
+			line(lane_loop());
+			line("\tm[l] = " + restore("outer" + id + "[l]") + ";");
+			break;
+		}
+		case SM4_OPCODE_BREAK:
+		case SM4_OPCODE_BREAKC:
+		{
+			const frame* f = innermost(false);
+			if (!f)
+				return "Break outside of a loop or switch";
+			leave(insn, insn.opcode == SM4_OPCODE_BREAKC, "broken" + num(f->id));
+			break;
+		}
+		case SM4_OPCODE_CONTINUE:
+		case SM4_OPCODE_CONTINUEC:
+		{
+			const frame* f = innermost(true);
+			if (!f)
+				return "Continue outside of a loop";
+			leave(insn, insn.opcode == SM4_OPCODE_CONTINUEC,
+				  "continued" + num(f->id));
+			break;
+		}
+		case SM4_OPCODE_SWITCH:
+		{
+			frame f = {FRAME_SWITCH, next_id++};
+			std::string id = num(f.id);
+			std::string matched;
+			for (int c = program.cf_insn_linked[pc];
+				 c >= 0 && program.insns[c]->opcode != SM4_OPCODE_ENDSWITCH;
+				 c = program.cf_insn_linked[c])
+			{
+				const sm4_insn& label = *program.insns[c];
+				if (label.opcode != SM4_OPCODE_CASE)
+					continue;
+				if (label.ops[0]->file != SM4_FILE_IMMEDIATE32)
+					return "Unsupported operand";
+				matched += std::string(matched.empty() ? "" : " || ") +
+						   "selector" +
+						   id + "[l] == " +
+						   hex((uint32_t)label.ops[0]->imm_values[0].u32);
+			}
+			line(array("outer" + id) + " " + array("broken" + id) + " " +
+				 array("selector" + id) + " " + array("defaults" + id));
+			line(copy("outer" + id, "m"));
+			line(clear("broken" + id));
+			open(lane_loop());
+			line("selector" + id + "[l] = " + src(*insn.ops[0], 0, INT) + ";");
+			line("defaults" + id + "[l] = " +
+				 (matched.empty() ? std::string("~0u")
+								  : "(" + matched + ") ? 0u : ~0u") +
+				 ";");
+			line("m[l] = 0;");
+			close();
+			frames.push_back(f);
+			break;
+		}
+		case SM4_OPCODE_CASE:
+		case SM4_OPCODE_DEFAULT:
+		{
+			std::string id = num(frames.back().id);
+			std::string lanes_in =
+				insn.opcode == SM4_OPCODE_DEFAULT
+					? "defaults" + id + "[l]"
+					: "(selector" + id + "[l] == " +
+						  hex((uint32_t)insn.ops[0]->imm_values[0].u32) +
+						  " ? ~0u : 0u)";
+			/* falling through from the case above */
+			line(lane_loop());
+			line("\tm[l] |= " + restore("outer" + id + "[l] & " + lanes_in) + ";");
+			break;
+		}
+		case SM4_OPCODE_ENDSWITCH:
+		{
+			std::string id = num(frames.back().id);
+			frames.pop_back();
+			line(lane_loop());
+			line("\tm[l] = " + restore("outer" + id + "[l]") + ";");
+			break;
+		}
+		case SM4_OPCODE_DISCARD:
+			open(lane_loop());
+			line("uint32_t t = " + test(insn, *insn.ops[0]) + ";");
+			line("s.alive[l] &= ~t;");
+			line("s.discarded[l] |= t;");
+			line("m[l] &= ~t;");
+			close();
+			break;
+		case SM4_OPCODE_RET:
+		case SM4_OPCODE_RETC:
+		{
+			bool conditional = insn.opcode == SM4_OPCODE_RETC;
+			if (!conditional && frames.empty())
+			{
+				line("return;");
+				break;
+			}
+			if (in_subroutine)
+				leave(insn, conditional, "ret");
+			else
+			{
+				open(lane_loop());
+				line(std::string("uint32_t t = ") +
+					 (conditional ? test(insn, *insn.ops[0]) : "m[l]") + ";");
+				line("s.alive[l] &= ~t;");
+				line("m[l] &= ~t;");
+				close();
+			}
+			break;
+		}
+		case SM4_OPCODE_CALL:
+		case SM4_OPCODE_CALLC:
+		{
+			bool conditional = insn.opcode == SM4_OPCODE_CALLC;
+			unsigned label = (unsigned)insn.ops[conditional]->indices[0].disp;
+			open();
+			line(array("entry"));
+			line(lane_loop());
+			line(std::string("\tentry[l] = ") +
+				 (conditional ? test(insn, *insn.ops[0]) : "m[l]") + ";");
+			open("if (sm4_any(entry, " + lanes + "))");
+			/* as deep as the hardware goes */
+			open("if (s.calls == 32)");
+			line("s.error = \"Subroutine calls nested too deep\";");
+			line("return;");
+			close();
+			line("++s.calls;");
+			line(name + "_label" + num(label) + "(b, s, entry);");
+			line("--s.calls;");
+			line("if (s.error)");
+			line("\treturn;");
+			close();
+			close();
+			line(lane_loop());
+			line("\tm[l] &= s.alive[l];");
+			break;
+		}
+		case SM4_OPCODE_LABEL:
+		{
+			if (!frames.empty())
+				return "Unbalanced control flow";
+			close();
+			out << "\n";
+			start_function((unsigned)insn.ops[0]->indices[0].disp);
+			break;
+		}
+		default:
+			break;
+		}
+		return 0;
+	}
+
+	void start_function(unsigned label)
+	{
+		in_subroutine = true;
+		out << "static void " << name.c_str() << "_label" << label
+			<< "(const sm4_cpp_bindings& b, " << name.c_str()
+			<< "_state& s, const uint32_t* entry)\n{\n";
+		depth = 1;
+		line(array("m") + " " + array("ret"));
+		/* not every function reads the bindings */
+		line("(void)b;");
+		line("memcpy(m, entry, sizeof(m));");
+		line(clear("ret"));
+	}
+
+	/* values computed for all lanes before any is written, since the
+	 * destination may be a source too */
+	void alu(const sm4_insn& insn)
+	{
+		unsigned n = sm4_opcode_descs[insn.opcode].num_dsts;
+		const sm4_op* const* ops = insn.ops;
+		unsigned mask = write_mask(*ops[0]);
+		bool sat = insn.insn.sat;
+		auto f = [&](unsigned k, unsigned c) {
+			return src(*ops[n + k], c, FLOAT);
+		};
+		auto u = [&](unsigned k, unsigned c) {
+			return src(*ops[n + k], c, INT);
+		};
+		auto fop = [&](const std::string& e) {
+			return "sm4_u(" + (sat ? "sm4_sat(" + e + ")" : e) + ")";
+		};
+		auto cmp = [&](const std::string& e) {
+			return "(" + e + " ? ~0u : 0u)";
+		};
+
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_DERIV_RTX:
+		case SM4_OPCODE_DERIV_RTX_COARSE:
+		case SM4_OPCODE_DERIV_RTX_FINE:
+		case SM4_OPCODE_DERIV_RTY:
+		case SM4_OPCODE_DERIV_RTY_COARSE:
+		case SM4_OPCODE_DERIV_RTY_FINE:
+			derivative(insn);
+			return;
+		default:
+			break;
+		}
+
+		/* the second destination of those with two */
+		unsigned mask2 = n == 2 ? write_mask(*ops[1]) : 0;
+		open(lane_loop());
+		for (unsigned c = 0; c < 4; ++c)
+		{
+			bool first = (mask & (1 << c)) != 0;
+			bool second = (mask2 & (1 << c)) != 0;
+			if (!first && !second)
+				continue;
+			std::string e, e2;
+			std::string x = num(c);
+			switch (insn.opcode)
+			{
+			case SM4_OPCODE_MOV:
+				e = sat ? fop(f(0, c)) : u(0, c);
+				break;
+			case SM4_OPCODE_MOVC:
+				e = "(" + u(0, c) + " ? " + (sat ? fop(f(1, c)) : u(1, c)) +
+					" : " + (sat ? fop(f(2, c)) : u(2, c)) + ")";
+				break;
+			case SM4_OPCODE_ADD:
+				e = fop(f(0, c) + " + " + f(1, c));
+				break;
+			case SM4_OPCODE_MUL:
+				e = fop(f(0, c) + " * " + f(1, c));
+				break;
+			case SM4_OPCODE_DIV:
+				e = fop(f(0, c) + " / " + f(1, c));
+				break;
+			case SM4_OPCODE_MIN:
+				e = fop("fminf(" + f(0, c) + ", " + f(1, c) + ")");
+				break;
+			case SM4_OPCODE_MAX:
+				e = fop("fmaxf(" + f(0, c) + ", " + f(1, c) + ")");
+				break;
+			case SM4_OPCODE_MAD:
+				e = fop(f(0, c) + " * " + f(1, c) + " + " + f(2, c));
+				break;
+			case SM4_OPCODE_DP2:
+			case SM4_OPCODE_DP3:
+			case SM4_OPCODE_DP4:
+			{
+				unsigned count = insn.opcode - SM4_OPCODE_DP2 + 2;
+				for (unsigned k = 0; k < count; ++k)
+					e += (k ? " + " : "") + f(0, k) + " * " + f(1, k);
+				e = fop(e);
+				break;
+			}
+			case SM4_OPCODE_EQ:
+				e = cmp(f(0, c) + " == " + f(1, c));
+				break;
+			case SM4_OPCODE_NE:
+				e = cmp(f(0, c) + " != " + f(1, c));
+				break;
+			case SM4_OPCODE_LT:
+				e = cmp(f(0, c) + " < " + f(1, c));
+				break;
+			case SM4_OPCODE_GE:
+				e = cmp(f(0, c) + " >= " + f(1, c));
+				break;
+			case SM4_OPCODE_EXP:
+				e = fop("exp2f(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_LOG:
+				e = fop("log2f(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_FRC:
+				e = fop(f(0, c) + " - floorf(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_ROUND_NE:
+				e = fop("nearbyintf(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_ROUND_NI:
+				e = fop("floorf(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_ROUND_PI:
+				e = fop("ceilf(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_ROUND_Z:
+				e = fop("truncf(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_RSQ:
+				e = fop("1.0f / sqrtf(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_SQRT:
+				e = fop("sqrtf(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_RCP:
+				e = fop("1.0f / " + f(0, c));
+				break;
+			case SM4_OPCODE_FTOI:
+				e = "sm4_ftoi(" + f(0, c) + ")";
+				break;
+			case SM4_OPCODE_FTOU:
+				e = "sm4_ftou(" + f(0, c) + ")";
+				break;
+			case SM4_OPCODE_ITOF:
+				e = fop("(float)(int32_t)" + u(0, c));
+				break;
+			case SM4_OPCODE_UTOF:
+				e = fop("(float)" + u(0, c));
+				break;
+			case SM4_OPCODE_F32TOF16:
+				e = "sm4_f32tof16(" + u(0, c) + ")";
+				break;
+			case SM4_OPCODE_F16TOF32:
+				e = sat ? fop("sm4_f(sm4_f16tof32(" + u(0, c) + "))")
+						: "sm4_f16tof32(" + u(0, c) + ")";
+				break;
+			case SM4_OPCODE_SINCOS:
+				e = fop("sinf(" + f(0, c) + ")");
+				e2 = fop("cosf(" + f(0, c) + ")");
+				break;
+			case SM4_OPCODE_IADD:
+				e = "(" + u(0, c) + " + " + u(1, c) + ")";
+				break;
+			case SM4_OPCODE_AND:
+				e = "(" + u(0, c) + " & " + u(1, c) + ")";
+				break;
+			case SM4_OPCODE_OR:
+				e = "(" + u(0, c) + " | " + u(1, c) + ")";
+				break;
+			case SM4_OPCODE_XOR:
+				e = "(" + u(0, c) + " ^ " + u(1, c) + ")";
+				break;
+			case SM4_OPCODE_NOT:
+				e = "~" + u(0, c);
+				break;
+			case SM4_OPCODE_INEG:
+				e = "(0u - " + u(0, c) + ")";
+				break;
+			case SM4_OPCODE_ISHL:
+				e = "(" + u(0, c) + " << (" + u(1, c) + " & 31))";
+				break;
+			case SM4_OPCODE_ISHR:
+				e = "(uint32_t)((int32_t)" + u(0, c) + " >> (" + u(1, c) +
+					" & 31))";
+				break;
+			case SM4_OPCODE_USHR:
+				e = "(" + u(0, c) + " >> (" + u(1, c) + " & 31))";
+				break;
+			case SM4_OPCODE_IEQ:
+				e = cmp(u(0, c) + " == " + u(1, c));
+				break;
+			case SM4_OPCODE_INE:
+				e = cmp(u(0, c) + " != " + u(1, c));
+				break;
+			case SM4_OPCODE_ILT:
+				e = cmp("(int32_t)" + u(0, c) + " < (int32_t)" + u(1, c));
+				break;
+			case SM4_OPCODE_IGE:
+				e = cmp("(int32_t)" + u(0, c) + " >= (int32_t)" + u(1, c));
+				break;
+			case SM4_OPCODE_ULT:
+				e = cmp(u(0, c) + " < " + u(1, c));
+				break;
+			case SM4_OPCODE_UGE:
+				e = cmp(u(0, c) + " >= " + u(1, c));
+				break;
+			case SM4_OPCODE_IMAX:
+			case SM4_OPCODE_IMIN:
+			case SM4_OPCODE_UMAX:
+			case SM4_OPCODE_UMIN:
+			{
+				bool is_signed = insn.opcode == SM4_OPCODE_IMAX ||
+								 insn.opcode == SM4_OPCODE_IMIN;
+				bool is_max = insn.opcode == SM4_OPCODE_IMAX ||
+							  insn.opcode == SM4_OPCODE_UMAX;
+				std::string cast = is_signed ? "(int32_t)" : "";
+				line("uint32_t a" + x + " = " + u(0, c) + ", b" + x + " = " +
+					 u(1, c) + ";");
+				e = "(" + cast + "a" + x + (is_max ? " > " : " < ") + cast +
+					"b" + x + " ? a" + x + " : b" + x + ")";
+				break;
+			}
+			case SM4_OPCODE_IMAD:
+			case SM4_OPCODE_UMAD:
+				e = "(" + u(0, c) + " * " + u(1, c) + " + " + u(2, c) + ")";
+				break;
+			case SM4_OPCODE_COUNTBITS:
+				e = "sm4_countbits(" + u(0, c) + ")";
+				break;
+			case SM4_OPCODE_FIRSTBIT_HI:
+				e = "sm4_firstbit_hi(" + u(0, c) + ")";
+				break;
+			case SM4_OPCODE_FIRSTBIT_LO:
+				e = "sm4_firstbit_lo(" + u(0, c) + ")";
+				break;
+			case SM4_OPCODE_FIRSTBIT_SHI:
+				line("uint32_t a" + x + " = " + u(0, c) + ";");
+				e = "sm4_firstbit_hi((int32_t)a" + x + " < 0 ? ~a" + x +
+					" : a" + x + ")";
+				break;
+			case SM4_OPCODE_UBFE:
+			case SM4_OPCODE_IBFE:
+				e = "sm4_bfe(" + u(0, c) + ", " + u(1, c) + ", " + u(2, c) +
+					(insn.opcode == SM4_OPCODE_IBFE ? ", true)" : ", false)");
+				break;
+			case SM4_OPCODE_BFI:
+				e = "sm4_bfi(" + u(0, c) + ", " + u(1, c) + ", " + u(2, c) +
+					", " + u(3, c) + ")";
+				break;
+			case SM4_OPCODE_BFREV:
+				e = "sm4_bfrev(" + u(0, c) + ")";
+				break;
+			case SM4_OPCODE_IMUL:
+			case SM4_OPCODE_UMUL:
+			{
+				std::string p = "p" + x;
+				if (insn.opcode == SM4_OPCODE_IMUL)
+					line("uint64_t " + p + " = (uint64_t)((int64_t)(int32_t)" +
+						 u(0, c) + " * (int32_t)" + u(1, c) + ");");
+				else
+					line("uint64_t " + p + " = (uint64_t)" + u(0, c) + " * " +
+						 u(1, c) + ";");
+				e = "(uint32_t)(" + p + " >> 32)";
+				e2 = "(uint32_t)" + p;
+				break;
+			}
+			case SM4_OPCODE_UDIV:
+				line("uint32_t a" + x + " = " + u(0, c) + ", b" + x + " = " +
+					 u(1, c) + ";");
+				e = "(b" + x + " ? a" + x + " / b" + x + " : ~0u)";
+				e2 = "(b" + x + " ? a" + x + " % b" + x + " : ~0u)";
+				break;
+			case SM4_OPCODE_UADDC:
+				line("uint32_t a" + x + " = " + u(0, c) + ", b" + x + " = " +
+					 u(1, c) + ";");
+				e = "(a" + x + " + b" + x + ")";
+				e2 = "(uint32_t)(a" + x + " + b" + x + " < a" + x + ")";
+				break;
+			case SM4_OPCODE_USUBB:
+				line("uint32_t a" + x + " = " + u(0, c) + ", b" + x + " = " +
+					 u(1, c) + ";");
+				e = "(a" + x + " - b" + x + ")";
+				e2 = "(uint32_t)(a" + x + " < b" + x + ")";
+				break;
+			case SM4_OPCODE_SWAPC:
+				line("uint32_t a" + x + " = " + u(0, c) + ", b" + x + " = " +
+					 u(1, c) + ", c" + x + " = " + u(2, c) + ";");
+				e = "(a" + x + " ? c" + x + " : b" + x + ")";
+				e2 = "(a" + x + " ? b" + x + " : c" + x + ")";
+				break;
+			default:
+				e = "0u";
+				break;
+			}
+			if (n == 2)
+			{
+				/* the first destination may be a source of the second */
+				line("uint32_t d" + x + " = " + (first ? e : "0u") + ";");
+				line("uint32_t e" + x + " = " + (second ? e2 : "0u") + ";");
+			}
+			else
+				line("uint32_t d" + x + " = " + e + ";");
+		}
+		write(*ops[0]);
+		if (n == 2)
+			write(*ops[1], "e");
+		close();
+	}
+
+	/* the lanes go by quads of 2 by 2 pixels, as in the interpreter */
+	void derivative(const sm4_insn& insn)
+	{
+		bool y = insn.opcode == SM4_OPCODE_DERIV_RTY ||
+				 insn.opcode == SM4_OPCODE_DERIV_RTY_COARSE ||
+				 insn.opcode == SM4_OPCODE_DERIV_RTY_FINE;
+		bool fine = insn.opcode == SM4_OPCODE_DERIV_RTX_FINE ||
+					insn.opcode == SM4_OPCODE_DERIV_RTY_FINE;
+		unsigned mask = write_mask(*insn.ops[0]);
+		std::string step = y ? "2" : "1";
+		std::string base = fine ? "(l & ~" + step + "u)" : "(l & ~3u)";
+		open();
+		line("float t[4][" + lanes + "];");
+		open(lane_loop());
+		for (unsigned c = 0; c < 4; ++c)
+			if (mask & (1 << c))
+				line("t[" + num(c) + "][l] = " + src(*insn.ops[1], c, FLOAT) +
+					 ";");
+		close();
+		open(lane_loop());
+		for (unsigned c = 0; c < 4; ++c)
+		{
+			if (!(mask & (1 << c)))
+				continue;
+			std::string t = "t[" + num(c) + "]";
+			std::string e =
+				t + "[" + base + " + " + step + "] - " + t + "[" + base + "]";
+			line("uint32_t d" + num(c) + " = sm4_u(" +
+				 (insn.insn.sat ? "sm4_sat(" + e + ")" : e) + ");");
+		}
+		write(*insn.ops[0]);
+		close();
+		close();
+	}
+
+	/* a pointer to the buffer of a t#, u# or g# register, declared as
+	 * name before the lane loop; false for a register sm4_exec_init did
+	 * not lay out */
+	bool bind(const sm4_op& op, const std::string& var, unsigned& target,
+			  unsigned& stride)
+	{
+		uint64_t slot = (uint64_t)op.indices[0].disp;
+		target = SM4_TARGET_RAW_BUFFER;
+		stride = 0;
+		switch (op.file)
+		{
+		case SM4_FILE_RESOURCE:
+			if (slot >= exec.resource_targets.size() ||
+				slot >= exec.resource_strides.size())
+				return false;
+			target = exec.resource_targets[slot];
+			stride = exec.resource_strides[slot];
+			line("const sm4_cpp_resource* " + var +
+				 " = sm4_bound(b.resources, b.num_resources, " + num(slot) +
+				 ");");
+			break;
+		case SM4_FILE_UNORDERED_ACCESS_VIEW:
+			if (slot >= exec.uav_targets.size() ||
+				slot >= exec.uav_strides.size())
+				return false;
+			target = exec.uav_targets[slot];
+			stride = exec.uav_strides[slot];
+			line("const sm4_cpp_resource* " + var +
+				 " = sm4_bound(b.uavs, b.num_uavs, " + num(slot) + ");");
+			break;
+		case SM4_FILE_THREAD_GROUP_SHARED_MEMORY:
+			if (slot >= exec.tgsm_sizes.size())
+				return false;
+			stride = exec.tgsm_strides[slot];
+			line("sm4_cpp_resource " + var + "_g = {s.g + " +
+				 num(exec.tgsm_offsets[slot] / 4) + ", " +
+				 num(exec.tgsm_sizes[slot]) + ", 0, 0};");
+			line("const sm4_cpp_resource* " + var + " = &" + var + "_g;");
+			break;
+		default:
+			return false;
+		}
+		if (target == SM4_TARGET_STRUCTURED_BUFFER && !stride)
+			stride = 4;
+		return true;
+	}
+
+	/* the byte offset of a raw or structured access */
+	std::string address(const sm4_op& a, const sm4_op* b, unsigned stride)
+	{
+		if (!b)
+			return u(a, 0);
+		return "(" + u(a, 0) + " * " + num(stride) + "u + " + u(*b, 0) + ")";
+	}
+
+	std::string u(const sm4_op& op, unsigned c) { return src(op, c, INT); }
+
+	/* the resource operand selects the components of the result */
+	void swizzled_result(const sm4_op& res, const std::string& t,
+						 unsigned mask)
+	{
+		for (unsigned c = 0; c < 4; ++c)
+		{
+			if (!(mask & (1 << c)))
+				continue;
+			unsigned s = res.comps == 4 && res.mode == SM4_OPERAND_MODE_SWIZZLE
+							 ? res.swizzle[c]
+							 : c;
+			line("uint32_t d" + num(c) + " = " + t + "[" + num(s) + "];");
+		}
+	}
+
+	const char* resource(const sm4_insn& insn)
+	{
+		const sm4_op* const* ops = insn.ops;
+		unsigned target, stride;
+		open();
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_SAMPLE:
+		case SM4_OPCODE_SAMPLE_L:
+		case SM4_OPCODE_SAMPLE_B:
+		case SM4_OPCODE_SAMPLE_D:
+		{
+			if (!bind(*ops[2], "res", target, stride))
+				return "Unsupported memory operand";
+			open(lane_loop());
+			line("uint32_t t[4];");
+			line("sm4_sample(res, b, " + num((uint32_t)ops[3]->indices[0].disp) +
+				 ", " + src(*ops[1], 0, FLOAT) + ", " +
+				 src(*ops[1], 1, FLOAT) + ", t);");
+			swizzled_result(*ops[2], "t", write_mask(*ops[0]));
+			if (insn.insn.sat)
+				for (unsigned c = 0; c < 4; ++c)
+					if (write_mask(*ops[0]) & (1 << c))
+						line("d" + num(c) + " = sm4_u(sm4_sat(sm4_f(d" +
+							 num(c) + ")));");
+			write(*ops[0]);
+			close();
+			break;
+		}
+		case SM4_OPCODE_LD:
+		case SM4_OPCODE_LD_UAV_TYPED:
+		{
+			if (!bind(*ops[2], "res", target, stride))
+				return "Unsupported memory operand";
+			open(lane_loop());
+			bool is_2d = target == SM4_TARGET_TEXTURE2D;
+			line("uint32_t t[4] = {0, 0, 0, 0};");
+			std::string texel = "sm4_texel(res, " + u(*ops[1], 0) + ", " +
+								(is_2d ? u(*ops[1], 1) : std::string("0")) +
+								")";
+			/* there is only mip level 0 */
+			if (insn.opcode == SM4_OPCODE_LD && target != SM4_TARGET_BUFFER)
+				texel = "(" + u(*ops[1], is_2d ? 3 : 1) + " ? 0 : " + texel +
+						")";
+			line("if (const uint32_t* p = " + texel + ")");
+			line("\tmemcpy(t, p, sizeof(t));");
+			swizzled_result(*ops[2], "t", write_mask(*ops[0]));
+			write(*ops[0]);
+			close();
+			break;
+		}
+		case SM4_OPCODE_STORE_UAV_TYPED:
+		{
+			if (!bind(*ops[0], "res", target, stride))
+				return "Unsupported memory operand";
+			bool is_2d = target == SM4_TARGET_TEXTURE2D;
+			open(lane_loop());
+			line("uint32_t* p = m[l] ? sm4_texel(res, " + u(*ops[1], 0) +
+				 ", " + (is_2d ? u(*ops[1], 1) : std::string("0")) +
+				 ") : 0;");
+			open("if (p)");
+			unsigned mask = write_mask(*ops[0]);
+			for (unsigned c = 0; c < 4; ++c)
+				if (mask & (1 << c))
+					line("p[" + num(c) + "] = " + u(*ops[2], c) + ";");
+			close();
+			close();
+			break;
+		}
+		case SM4_OPCODE_RESINFO:
+		{
+			if (!bind(*ops[2], "res", target, stride))
+				return "Unsupported memory operand";
+			bool is_2d = target == SM4_TARGET_TEXTURE2D;
+			open(lane_loop());
+			line("uint32_t mip = " + u(*ops[1], 0) + ";");
+			line("uint32_t t[4] = {0, 0, 0, res ? 1u : 0u};");
+			open("if (res && !mip)");
+			line("t[0] = res->width;");
+			if (is_2d)
+				line("t[1] = res->height;");
+			close();
+			swizzled_result(*ops[2], "t", write_mask(*ops[0]));
+			for (unsigned c = 0; c < 4; ++c)
+			{
+				if (!(write_mask(*ops[0]) & (1 << c)))
+					continue;
+				std::string d = "d" + num(c);
+				switch (insn.insn.resinfo_return_type)
+				{
+				case 0:
+					line(d + " = sm4_u((float)" + d + ");");
+					break;
+				case 1: /* rcpfloat, but for the mip count */
+					line(d + " = sm4_u(" +
+						 (ops[2]->comps == 4 &&
+								  ops[2]->mode == SM4_OPERAND_MODE_SWIZZLE &&
+								  ops[2]->swizzle[c] == 3
+							  ? "(float)" + d
+							  : "1.0f / " + d) +
+						 ");");
+					break;
+				default:
+					break;
+				}
+			}
+			write(*ops[0]);
+			close();
+			break;
+		}
+		case SM4_OPCODE_BUFINFO:
+		{
+			if (!bind(*ops[1], "res", target, stride))
+				return "Unsupported memory operand";
+			std::string elements =
+				is_typed(target) ? "res->width"
+				: stride		 ? "res->size / " + num(stride) + "u"
+								 : "res->size";
+			open(lane_loop());
+			for (unsigned c = 0; c < 4; ++c)
+				line("uint32_t d" + num(c) + " = res ? " + elements +
+					 " : 0u;");
+			write(*ops[0]);
+			close();
+			break;
+		}
+		case SM4_OPCODE_LD_RAW:
+		case SM4_OPCODE_LD_STRUCTURED:
+		{
+			bool raw = insn.opcode == SM4_OPCODE_LD_RAW;
+			const sm4_op& res = *ops[raw ? 2 : 3];
+			if (!bind(res, "res", target, stride))
+				return "Unsupported memory operand";
+			open(lane_loop());
+			line("uint32_t a = " + address(*ops[1], raw ? 0 : ops[2], stride) +
+				 ";");
+			unsigned mask = write_mask(*ops[0]);
+			for (unsigned c = 0; c < 4; ++c)
+				if (mask & (1 << c))
+					line("uint32_t d" + num(c) + " = sm4_load(res, a + " +
+						 num(source_component(res, c) * 4) + ");");
+			write(*ops[0]);
+			close();
+			break;
+		}
+		case SM4_OPCODE_STORE_RAW:
+		case SM4_OPCODE_STORE_STRUCTURED:
+		{
+			bool raw = insn.opcode == SM4_OPCODE_STORE_RAW;
+			if (!bind(*ops[0], "res", target, stride))
+				return "Unsupported memory operand";
+			open(lane_loop());
+			open("if (m[l])");
+			line("uint32_t a = " + address(*ops[1], raw ? 0 : ops[2], stride) +
+				 ";");
+			unsigned mask = write_mask(*ops[0]);
+			for (unsigned c = 0; c < 4; ++c)
+			{
+				if (!(mask & (1 << c)))
+					continue;
+				line("if (uint32_t* p = sm4_word(res, a + " + num(c * 4) +
+					 "))");
+				line("\t*p = " + u(*ops[raw ? 2 : 3], c) + ";");
+			}
+			close();
+			close();
+			break;
+		}
+		default:
+		{
+			const char* error = atomic(insn);
+			if (error)
+				return error;
+			break;
+		}
+		}
+		close();
+		return 0;
+	}
+
+	/* one lane after the other, in order */
+	const char* atomic(const sm4_insn& insn)
+	{
+		bool imm = insn.opcode >= SM4_OPCODE_IMM_ATOMIC_ALLOC;
+		unsigned first = imm ? 1 : 0;
+		const sm4_op& dst = *insn.ops[first];
+		unsigned target, stride;
+		if (!bind(dst, "res", target, stride))
+			return "Unsupported memory operand";
+		bool typed = dst.file != SM4_FILE_THREAD_GROUP_SHARED_MEMORY &&
+					 is_typed(target);
+		open(lane_loop());
+		if (imm)
+			line("uint32_t d0 = 0;");
+		open("if (m[l])");
+		const sm4_op& addr = *insn.ops[first + 1];
+		if (typed)
+			line("uint32_t* p = sm4_texel(res, " + u(addr, 0) + ", " +
+				 (target == SM4_TARGET_TEXTURE2D ? u(addr, 1)
+												 : std::string("0")) +
+				 ");");
+		else
+			line("uint32_t* p = sm4_word(res, " +
+				 (stride ? "(" + u(addr, 0) + " * " + num(stride) + "u + " +
+							   u(addr, 1) + ")"
+						 : u(addr, 0)) +
+				 ");");
+		open("if (p)");
+		line("uint32_t old = *p, a = " + u(*insn.ops[first + 2], 0) + ";");
+		std::string v;
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_ATOMIC_AND:
+		case SM4_OPCODE_IMM_ATOMIC_AND:
+			v = "old & a";
+			break;
+		case SM4_OPCODE_ATOMIC_OR:
+		case SM4_OPCODE_IMM_ATOMIC_OR:
+			v = "old | a";
+			break;
+		case SM4_OPCODE_ATOMIC_XOR:
+		case SM4_OPCODE_IMM_ATOMIC_XOR:
+			v = "old ^ a";
+			break;
+		case SM4_OPCODE_ATOMIC_IADD:
+		case SM4_OPCODE_IMM_ATOMIC_IADD:
+			v = "old + a";
+			break;
+		case SM4_OPCODE_ATOMIC_IMAX:
+		case SM4_OPCODE_IMM_ATOMIC_IMAX:
+			v = "(int32_t)old > (int32_t)a ? old : a";
+			break;
+		case SM4_OPCODE_ATOMIC_IMIN:
+		case SM4_OPCODE_IMM_ATOMIC_IMIN:
+			v = "(int32_t)old < (int32_t)a ? old : a";
+			break;
+		case SM4_OPCODE_ATOMIC_UMAX:
+		case SM4_OPCODE_IMM_ATOMIC_UMAX:
+			v = "old > a ? old : a";
+			break;
+		case SM4_OPCODE_ATOMIC_UMIN:
+		case SM4_OPCODE_IMM_ATOMIC_UMIN:
+			v = "old < a ? old : a";
+			break;
+		case SM4_OPCODE_IMM_ATOMIC_EXCH:
+			v = "a";
+			break;
+		/* a is the value compared, the next one that stored */
+		case SM4_OPCODE_ATOMIC_CMP_STORE:
+		case SM4_OPCODE_IMM_ATOMIC_CMP_EXCH:
+			v = "old == a ? " + u(*insn.ops[first + 3], 0) + " : old";
+			break;
+		default:
+			v = "old";
+			break;
+		}
+		line("*p = " + v + ";");
+		if (imm)
+			line("d0 = old;");
+		close();
+		close();
+		if (imm)
+		{
+			unsigned mask = write_mask(*insn.ops[0]);
+			for (unsigned c = 1; c < 4; ++c)
+				if (mask & (1 << c))
+					line("uint32_t d" + num(c) + " = d0;");
+			write(*insn.ops[0]);
+		}
+		close();
+		return 0;
+	}
+
+	void count_registers(const sm4_op& op)
+	{
+		for (unsigned i = 0; i < op.num_indices && i < 3; ++i)
+			if (op.indices[i].reg)
+				count_registers(*op.indices[i].reg);
+		if (op.num_indices < 1 || !op.is_index_simple(0) ||
+			op.indices[0].disp >= SM4_MAX_TEMPS)
+			return;
+		unsigned r = (unsigned)op.indices[0].disp + 1;
+		if (op.file == SM4_FILE_INPUT)
+			num_inputs = std::max(num_inputs, r);
+		else if (op.file == SM4_FILE_OUTPUT)
+			num_outputs = std::max(num_outputs, r);
+	}
+
+	void declare_state()
+	{
+		out << "/* the registers of " << num_lanes
+			<< " invocations, component by component */\n";
+		out << "struct " << name.c_str() << "_state\n{\n";
+		out << "\tuint32_t alive[" << lanes.c_str() << "];\n";
+		/* alive also loses the lanes that returned from the main program */
+		out << "\tuint32_t discarded[" << lanes.c_str() << "];\n";
+		if (exec.num_temps)
+			out << "\tuint32_t r[" << exec.num_temps << "][4]["
+				<< lanes.c_str() << "];\n";
+		for (unsigned x = 0; x < exec.indexable_size.size(); ++x)
+			if (exec.indexable_size[x])
+				out << "\tuint32_t x" << x << "[" << exec.indexable_size[x]
+					<< "][4][" << lanes.c_str() << "];\n";
+		if (exec.tgsm_size)
+			out << "\tuint32_t g[" << exec.tgsm_size / 4 << "];\n";
+		/* 0 outside of compute shaders */
+		out << "\tuint32_t thread_id[4][" << lanes.c_str() << "];\n";
+		out << "\tuint32_t thread_group_id[4][" << lanes.c_str() << "];\n";
+		out << "\tuint32_t thread_id_in_group[4][" << lanes.c_str() << "];\n";
+		out << "\tuint32_t thread_id_in_group_flattened[" << lanes.c_str()
+			<< "];\n";
+		out << "\tunsigned iterations;\n";
+		out << "\tunsigned calls;\n";
+		out << "\tconst char* error;\n";
+		out << "};\n\n";
+	}
+
+	void declare_icb()
+	{
+		if (!exec.icb_size)
+			return;
+		out << "static const uint32_t " << name.c_str() << "_icb["
+			<< exec.icb_size * 4 << "] = {";
+		for (unsigned i = 0; i < exec.icb_size * 4; ++i)
+		{
+			out << (i % 6 ? " " : "\n\t");
+			std::string h = hex(bswap_le32(exec.icb[i]));
+			out.write(h.data(), h.size());
+			if (i + 1 < exec.icb_size * 4)
+				out << ',';
+		}
+		out << "\n};\n\n";
+	}
+
+	void entry_point()
+	{
+		const char* n = name.c_str();
+		const char* l = lanes.c_str();
+		if (is_compute)
+		{
+			const unsigned* size = exec.thread_group_size;
+			out << "/* runs x by y by z thread groups; returns NULL, or why it "
+				   "stopped */\n";
+			out << "const char* " << n
+				<< "(const sm4_cpp_bindings& b, unsigned x, unsigned y, "
+				   "unsigned z)\n{\n";
+			out << "\t" << n << "_state* s = new " << n << "_state;\n";
+			out << "\tconst char* error = 0;\n";
+			out << "\tfor (unsigned gz = 0; gz < z && !error; ++gz)\n";
+			out << "\tfor (unsigned gy = 0; gy < y && !error; ++gy)\n";
+			out << "\tfor (unsigned gx = 0; gx < x && !error; ++gx)\n";
+			out << "\t{\n";
+			out << "\t\tmemset(s, 0, sizeof(*s));\n";
+			out << "\t\tconst unsigned group[3] = {gx, gy, gz};\n";
+			out << "\t\tfor (unsigned l = 0; l < " << l << "; ++l)\n";
+			out << "\t\t{\n";
+			out << "\t\t\tconst unsigned id[3] = {l % " << size[0] << "u, l / "
+				<< size[0] << "u % " << size[1] << "u, l / "
+				<< size[0] * size[1] << "u};\n";
+			out << "\t\t\tfor (unsigned c = 0; c < 3; ++c)\n";
+			out << "\t\t\t{\n";
+			out << "\t\t\t\ts->thread_id_in_group[c][l] = id[c];\n";
+			out << "\t\t\t\ts->thread_group_id[c][l] = group[c];\n";
+			out << "\t\t\t\ts->thread_id[c][l] = group[c] * " << n
+				<< "_group_size[c] + id[c];\n";
+			out << "\t\t\t}\n";
+			out << "\t\t\ts->thread_id_in_group_flattened[l] = l;\n";
+			out << "\t\t\ts->alive[l] = ~0u;\n";
+			out << "\t\t}\n";
+			out << "\t\t" << n << "_main(b, *s);\n";
+			out << "\t\terror = s->error;\n";
+			out << "\t}\n";
+			out << "\tdelete s;\n";
+			out << "\treturn error;\n";
+			out << "}\n";
+			return;
+		}
+		out << "/* runs the invocations of the lanes set in lanes; returns "
+			   "NULL, or why it\n * stopped, and the lanes that were "
+			   "discarded in *discarded */\n";
+		out << "const char* " << n
+			<< "(const sm4_cpp_bindings& b, uint32_t lanes, uint32_t* "
+			   "discarded)\n{\n";
+		out << "\t" << n << "_state* s = new " << n << "_state;\n";
+		out << "\tmemset(s, 0, sizeof(*s));\n";
+		out << "\tfor (unsigned l = 0; l < " << l << "; ++l)\n";
+		out << "\t\ts->alive[l] = (lanes >> l) & 1 ? ~0u : 0u;\n";
+		out << "\t" << n << "_main(b, *s);\n";
+		out << "\tuint32_t gone = 0;\n";
+		out << "\tfor (unsigned l = 0; l < " << l << "; ++l)\n";
+		out << "\t\tgone |= (s->discarded[l] & 1u) << l;\n";
+		out << "\tif (discarded)\n";
+		out << "\t\t*discarded = lanes & gone;\n";
+		out << "\tconst char* error = s->error;\n";
+		out << "\tdelete s;\n";
+		out << "\treturn error;\n";
+		out << "}\n";
+	}
+
+	const char* translate(unsigned& error_insn)
+	{
+		const char* n = name.c_str();
+		if (is_compute)
+		{
+			const unsigned* size = exec.thread_group_size;
+			uint64_t threads = (uint64_t)size[0] * size[1] * size[2];
+			if (!threads || threads > 1024)
+				return "Bad thread group size";
+			num_lanes = (unsigned)threads;
+		}
+		for (unsigned i = 0; i < program.dcls.size(); ++i)
+			if (program.dcls[i]->op)
+				count_registers(*program.dcls[i]->op);
+		for (unsigned i = 0; i < program.insns.size(); ++i)
+			for (unsigned k = 0; k < program.insns[i]->num_ops; ++k)
+				count_registers(*program.insns[i]->ops[k]);
+
+		const char* types = "pvghdc";
+		out << "/* Translated from " << types[program.version.type] << "s_"
+			<< (unsigned)program.version.major << "_"
+			<< (unsigned)program.version.minor << " by fxdis */\n\n";
+		out << runtime << "\n";
+		out << "static const unsigned " << lanes.c_str() << " = " << num_lanes
+			<< ";\n";
+		if (is_compute)
+			out << "static const unsigned " << n << "_group_size[3] = {"
+				<< exec.thread_group_size[0] << ", "
+				<< exec.thread_group_size[1] << ", "
+				<< exec.thread_group_size[2] << "};\n";
+		else
+			out << "/* the input and output registers bound */\n"
+				<< "static const unsigned " << n
+				<< "_num_inputs = " << num_inputs << ";\n"
+				<< "static const unsigned " << n
+				<< "_num_outputs = " << num_outputs << ";\n";
+		out << "\n";
+		declare_state();
+		declare_icb();
+
+		for (unsigned i = 0; i < program.label_to_insn_num.size(); ++i)
+			if (program.label_to_insn_num[i] >= 0)
+				out << "static void " << n << "_label" << i
+					<< "(const sm4_cpp_bindings& b, " << n
+					<< "_state& s, const uint32_t* entry);\n";
+		out << "\nstatic void " << n << "_main(const sm4_cpp_bindings& b, "
+			<< n << "_state& s)\n{\n";
+		line(array("m"));
+		line("(void)b;");
+		line(copy("m", "s.alive"));
+
+		sm4_dump_options options;
+		text_writer text;
+		for (unsigned pc = 0; pc < program.insns.size(); ++pc)
+		{
+			const sm4_insn& insn = *program.insns[pc];
+			error_insn = pc;
+			text.clear();
+			sm4_dump(text, insn, options);
+			if (insn.opcode != SM4_OPCODE_LABEL)
+			{
+				out << '\n';
+				line("/* " + std::string(text.data(), text.size()) + " */");
+			}
+			unsigned unit = sm4_opcode_costs[insn.opcode].unit;
+			const char* error = 0;
+			if (unit == SM4_COST_FLOW_CONTROL ||
+				insn.opcode == SM4_OPCODE_LABEL)
+				error = flow_control(insn, pc);
+			else if (unit == SM4_COST_ALU || unit == SM4_COST_TRANSCENDENTAL)
+				alu(insn);
+			else if (unit == SM4_COST_SAMPLE || unit == SM4_COST_LOAD_STORE ||
+					 unit == SM4_COST_ATOMIC)
+				error = resource(insn);
+			if (error)
+				return error;
+		}
+		if (!frames.empty())
+			return "Unbalanced control flow";
+		out << "}\n\n";
+		entry_point();
+		error_insn = 0;
+		return 0;
+	}
+};
+
+const char* sm4_translate_cpp(text_writer& out, sm4_program& program,
+							  const char* name, unsigned* error_insn)
+{
+	sm4_exec exec;
+	const char* error = sm4_exec_init(exec, program);
+	unsigned insn = exec.error_insn;
+	if (!error)
+	{
+		translator t(out, program, exec, name);
+		error = t.translate(insn);
+	}
+	if (error_insn)
+		*error_insn = insn;
+	return error;
+}
@@ -0,0 +1,393 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Structural comparison of two programs: every declaration and instruction
+ * is reduced to a hash of what it does, and the instruction hashes are
+ * diffed like the lines of two text files */
+
+#include "sm4.h"
+#include <algorithm>
+#include <vector>
+
+static inline uint64_t mix(uint64_t h, uint64_t v)
+{
+	h = (h ^ v) * 0x9e3779b97f4a7c15ull;
+	return h ^ (h >> 32);
+}
+
+static uint64_t hash_op(const sm4_op& op)
+{
+	uint64_t h = mix(0x6f70, op.file | op.comps << 8 | op.num_indices << 16 |
+								 op.neg << 24 | op.abs << 25);
+	/* a scalar selection reads the same as that component replicated */
+	if (op.comps == 4 && op.mode == SM4_OPERAND_MODE_MASK)
+		h = mix(h, op.mask);
+	else if (op.comps == 4)
+		h = mix(h, 0x100 | op.swizzle[0] | op.swizzle[1] << 2 |
+					   op.swizzle[2] << 4 | op.swizzle[3] << 6);
+	for (unsigned i = 0; i < op.num_indices && i < 3; ++i)
+	{
+		h = mix(h, (uint64_t)op.indices[i].disp);
+		h = mix(h, op.indices[i].reg ? hash_op(*op.indices[i].reg) : 0);
+	}
+	if (op.file == SM4_FILE_IMMEDIATE32)
+	{
+		for (unsigned i = 0; i < op.comps; ++i)
+			h = mix(h, (uint32_t)op.imm_values[i].i32);
+	}
+	else if (op.file == SM4_FILE_IMMEDIATE64)
+	{
+		for (unsigned i = 0; i < op.comps; ++i)
+			h = mix(h, op.imm_values[i].u64);
+	}
+	return h;
+}
+
+/* the opcode and its modifiers, without the length and extended bits */
+static uint32_t token_bits(const sm4_token_instruction& token)
+{
+	uint32_t bits;
+	memcpy(&bits, &token, sizeof(bits));
+	return bits & 0xffffff;
+}
+
+uint64_t sm4_hash(const sm4_insn& insn)
+{
+	uint64_t h = mix(0x696e, token_bits(insn));
+	h = mix(h, (uint8_t)insn.sample_offset[0] |
+				   (uint8_t)insn.sample_offset[1] << 8 |
+				   (uint8_t)insn.sample_offset[2] << 16 |
+				   (uint64_t)insn.resource_target << 24);
+	h = mix(h, insn.resource_return_type[0] |
+				   insn.resource_return_type[1] << 8 |
+				   insn.resource_return_type[2] << 16 |
+				   (uint64_t)insn.resource_return_type[3] << 24);
+	h = mix(h, insn.num_ops);
+	for (unsigned i = 0; i < insn.num_ops && i < SM4_MAX_OPS; ++i)
+		h = mix(h, insn.ops[i] ? hash_op(*insn.ops[i]) : 0);
+	return h;
+}
+
+uint64_t sm4_hash(const sm4_dcl& dcl)
+{
+	uint64_t h;
+	if (dcl.opcode == SM4_OPCODE_CUSTOMDATA)
+	{
+		/* the rest of the token is the class of the data */
+		uint32_t bits;
+		memcpy(&bits, (const sm4_token_instruction*)&dcl, sizeof(bits));
+		h = mix(0x6364, bits);
+	}
+	else
+		h = mix(0x6463, token_bits(dcl));
+	for (unsigned i = 0; i < 4; ++i)
+		h = mix(h, dcl.words[i]);
+	h = mix(h, dcl.op ? hash_op(*dcl.op) : 0);
+	for (unsigned i = 0; i < dcl.num_extended && i < SM4_MAX_EXTENDED_TOKENS;
+		 ++i)
+		h = mix(h, dcl.extended[i]);
+	if (dcl.data)
+	{
+		const uint32_t* data = (const uint32_t*)dcl.data;
+		unsigned size = dcl.data_size();
+		for (unsigned i = 0; i < size; ++i)
+			h = mix(h, data[i]);
+	}
+	return h;
+}
+
+/* Myers' divide and conquer: the middle of a shortest edit path is found by
+ * searching from both ends at once, and both halves are diffed on their
+ * own, so that only two diagonal vectors are needed however far apart the
+ * sequences are. */
+struct myers_diff
+{
+	const uint64_t* a;
+	const uint64_t* b;
+	std::vector<int> forward;
+	std::vector<int> backward;
+	std::vector<sm4_diff_edit>& edits;
+
+	myers_diff(const uint64_t* a, const uint64_t* b,
+			   std::vector<sm4_diff_edit>& edits)
+		: a(a), b(b), edits(edits)
+	{
+	}
+
+	void edit(unsigned kind, unsigned old_insn, unsigned new_insn)
+	{
+		sm4_diff_edit e = {kind, old_insn, new_insn};
+		edits.push_back(e);
+	}
+
+	void diff(int a0, int a1, int b0, int b1)
+	{
+		while (a0 < a1 && b0 < b1 && a[a0] == b[b0])
+			++a0, ++b0;
+		while (a0 < a1 && b0 < b1 && a[a1 - 1] == b[b1 - 1])
+			--a1, --b1;
+		if (a0 == a1 || b0 == b1)
+		{
+			for (int i = a0; i < a1; ++i)
+				edit(SM4_DIFF_REMOVED, i, b0);
+			for (int j = b0; j < b1; ++j)
+				edit(SM4_DIFF_INSERTED, a1, j);
+			return;
+		}
+
+		int x, y;
+		if (!bisect(a0, a1, b0, b1, x, y))
+		{
+			/* nothing in common */
+			for (int i = a0; i < a1; ++i)
+				edit(SM4_DIFF_REMOVED, i, b0);
+			for (int j = b0; j < b1; ++j)
+				edit(SM4_DIFF_INSERTED, a1, j);
+			return;
+		}
+		diff(a0, a0 + x, b0, b0 + y);
+		diff(a0 + x, a1, b0 + y, b1);
+	}
+
+	/* finds a point (x, y), relative to (a0, b0), that a shortest edit
+	 * path goes through, where the paths from either end meet; the
+	 * diagonals that have run off the edit graph are dropped from the
+	 * search */
+	bool bisect(int a0, int a1, int b0, int b1, int& x, int& y)
+	{
+		int n = a1 - a0, m = b1 - b0;
+		int max_d = (n + m + 1) / 2;
+		int offset = max_d + 1;
+		int size = 2 * offset + 1;
+		forward.assign(size, -1);
+		backward.assign(size, -1);
+		forward[offset + 1] = 0;
+		backward[offset + 1] = 0;
+		int delta = n - m;
+		/* with an odd delta the forward paths reach the backward ones
+		 * first */
+		bool front = (delta & 1) != 0;
+		int k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+		for (int d = 0; d < max_d; ++d)
+		{
+			for (int k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2)
+			{
+				int i = offset + k1;
+				int x1 = k1 == -d || (k1 != d && forward[i - 1] < forward[i + 1])
+							 ? forward[i + 1]
+							 : forward[i - 1] + 1;
+				int y1 = x1 - k1;
+				while (x1 < n && y1 < m && a[a0 + x1] == b[b0 + y1])
+					++x1, ++y1;
+				forward[i] = x1;
+				if (x1 > n)
+					k1_end += 2;
+				else if (y1 > m)
+					k1_start += 2;
+				else if (front)
+				{
+					int j = offset + delta - k1;
+					if (j >= 0 && j < size && backward[j] != -1 &&
+						x1 >= n - backward[j])
+					{
+						x = x1;
+						y = y1;
+						return true;
+					}
+				}
+			}
+
+			for (int k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2)
+			{
+				int j = offset + k2;
+				int x2 =
+					k2 == -d || (k2 != d && backward[j - 1] < backward[j + 1])
+						? backward[j + 1]
+						: backward[j - 1] + 1;
+				int y2 = x2 - k2;
+				while (x2 < n && y2 < m &&
+					   a[a1 - x2 - 1] == b[b1 - y2 - 1])
+					++x2, ++y2;
+				backward[j] = x2;
+				if (x2 > n)
+					k2_end += 2;
+				else if (y2 > m)
+					k2_start += 2;
+				else if (!front)
+				{
+					int i = offset + delta - k2;
+					if (i >= 0 && i < size && forward[i] != -1 &&
+						forward[i] >= n - x2)
+					{
+						x = forward[i];
+						y = offset + x - i;
+						return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+};
+
+/* indices of the entries of a that b lacks, with repeated hashes counted */
+static void missing(const std::vector<uint64_t>& a,
+					const std::vector<uint64_t>& b, std::vector<unsigned>& out)
+{
+	std::vector<std::pair<uint64_t, unsigned> > sorted_a(a.size());
+	for (unsigned i = 0; i < a.size(); ++i)
+		sorted_a[i] = std::make_pair(a[i], i);
+	std::sort(sorted_a.begin(), sorted_a.end());
+	std::vector<uint64_t> sorted_b(b);
+	std::sort(sorted_b.begin(), sorted_b.end());
+
+	out.clear();
+	unsigned j = 0;
+	for (unsigned i = 0; i < sorted_a.size(); ++i)
+	{
+		while (j < sorted_b.size() && sorted_b[j] < sorted_a[i].first)
+			++j;
+		if (j < sorted_b.size() && sorted_b[j] == sorted_a[i].first)
+			++j;
+		else
+			out.push_back(sorted_a[i].second);
+	}
+	std::sort(out.begin(), out.end());
+}
+
+void sm4_diff_programs(const sm4_program& old_program,
+					   const sm4_program& new_program, sm4_program_diff& diff)
+{
+	diff.insns.clear();
+	diff.num_removed = diff.num_inserted = diff.num_changed = 0;
+	diff.version_changed =
+		memcmp(&old_program.version, &new_program.version,
+			   sizeof(old_program.version)) != 0;
+
+	std::vector<uint64_t> old_hashes(old_program.dcls.size());
+	std::vector<uint64_t> new_hashes(new_program.dcls.size());
+	for (unsigned i = 0; i < old_hashes.size(); ++i)
+		old_hashes[i] = sm4_hash(*old_program.dcls[i]);
+	for (unsigned i = 0; i < new_hashes.size(); ++i)
+		new_hashes[i] = sm4_hash(*new_program.dcls[i]);
+	missing(old_hashes, new_hashes, diff.removed_dcls);
+	missing(new_hashes, old_hashes, diff.added_dcls);
+
+	old_hashes.resize(old_program.insns.size());
+	new_hashes.resize(new_program.insns.size());
+	for (unsigned i = 0; i < old_hashes.size(); ++i)
+		old_hashes[i] = sm4_hash(*old_program.insns[i]);
+	for (unsigned i = 0; i < new_hashes.size(); ++i)
+		new_hashes[i] = sm4_hash(*new_program.insns[i]);
+	std::vector<sm4_diff_edit> script;
+	myers_diff(old_hashes.data(), new_hashes.data(), script)
+		.diff(0, (int)old_hashes.size(), 0, (int)new_hashes.size());
+
+	/* every run of edits between two matches removes before it inserts;
+	 * its removals and insertions are paired up in order */
+	for (unsigned first = 0, last; first < script.size(); first = last)
+	{
+		unsigned removed = first;
+		while (removed < script.size() &&
+			   script[removed].kind == SM4_DIFF_REMOVED &&
+			   (removed == first ||
+				script[removed].old_insn == script[removed - 1].old_insn + 1))
+			++removed;
+		last = removed;
+		while (last < script.size() && script[last].kind == SM4_DIFF_INSERTED &&
+			   script[last].old_insn == script[first].old_insn +
+											(removed - first) &&
+			   (last == removed ||
+				script[last].new_insn == script[last - 1].new_insn + 1))
+			++last;
+
+		unsigned num_removed = removed - first, num_inserted = last - removed;
+		for (unsigned i = 0; i < std::max(num_removed, num_inserted); ++i)
+		{
+			const sm4_diff_edit* r = i < num_removed ? &script[first + i] : 0;
+			const sm4_diff_edit* s =
+				i < num_inserted ? &script[removed + i] : 0;
+			if (r && s &&
+				old_program.insns[r->old_insn]->opcode ==
+					new_program.insns[s->new_insn]->opcode)
+			{
+				sm4_diff_edit e = {SM4_DIFF_CHANGED, r->old_insn, s->new_insn};
+				diff.insns.push_back(e);
+				++diff.num_changed;
+				continue;
+			}
+			if (r)
+			{
+				diff.insns.push_back(*r);
+				++diff.num_removed;
+			}
+			if (s)
+			{
+				diff.insns.push_back(*s);
+				++diff.num_inserted;
+			}
+		}
+	}
+}
+
+static void dump_version(text_writer& out, const sm4_program& program)
+{
+	out << (program.version.type < 6 ? "pvghdc"[program.version.type] : '?')
+		<< "s_" << program.version.major << "_" << program.version.minor;
+}
+
+text_writer& sm4_dump(text_writer& out, const sm4_program& old_program,
+					  const sm4_program& new_program,
+					  const sm4_program_diff& diff)
+{
+	if (diff.version_changed)
+	{
+		out << '-';
+		dump_version(out, old_program);
+		out << "\n+";
+		dump_version(out, new_program);
+		out << '\n';
+	}
+	for (unsigned i = 0; i < diff.removed_dcls.size(); ++i)
+		out << '-' << *old_program.dcls[diff.removed_dcls[i]] << '\n';
+	for (unsigned i = 0; i < diff.added_dcls.size(); ++i)
+		out << '+' << *new_program.dcls[diff.added_dcls[i]] << '\n';
+	for (unsigned i = 0; i < diff.insns.size(); ++i)
+	{
+		const sm4_diff_edit& e = diff.insns[i];
+		if (e.kind != SM4_DIFF_INSERTED)
+			out << (e.kind == SM4_DIFF_CHANGED ? '<' : '-') << e.old_insn
+				<< ": " << *old_program.insns[e.old_insn] << '\n';
+		if (e.kind != SM4_DIFF_REMOVED)
+			out << (e.kind == SM4_DIFF_CHANGED ? '>' : '+') << e.new_insn
+				<< ": " << *new_program.insns[e.new_insn] << '\n';
+	}
+	out << "// " << diff.num_removed << " removed, " << diff.num_inserted
+		<< " inserted, " << diff.num_changed << " changed instructions; "
+		<< (unsigned)diff.removed_dcls.size() << " removed, "
+		<< (unsigned)diff.added_dcls.size() << " added declarations\n";
+	return out;
+}
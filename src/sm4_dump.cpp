@@ -26,12 +26,33 @@
 
 #include "sm4.h"
 
-// TODO: we should fix this to output the same syntax as fxc, if sm4_dump_short_syntax is set
+// TODO: we should fix this to output the same syntax as fxc, if sm4_dump_options::short_syntax is set
 
-bool sm4_dump_short_syntax = true;
+static const sm4_dump_options default_options;
 
-std::ostream& dump_op_code(std::ostream& out, const sm4_op& op,
-						   const sm4_insn* pInsn)
+static const text_names opcode_names(sm4_opcode_names, SM4_OPCODE_COUNT);
+static const text_names file_names(sm4_file_names, SM4_FILE_COUNT);
+static const text_names shortfile_names(sm4_shortfile_names, SM4_FILE_COUNT);
+
+/* malformed programs can hold any value in the fields naming things */
+static const char* lookup_name(const char** names, unsigned count, unsigned i)
+{
+	return i < count ? names[i] : "unknown";
+}
+
+static void write_hex(text_writer& out, uint64_t v, unsigned digits)
+{
+	char s[18];
+	s[0] = '0';
+	s[1] = 'x';
+	for (unsigned i = digits; i > 0; --i, v >>= 4)
+		s[1 + i] = "0123456789abcdef"[v & 0xf];
+	out.write(s, 2 + digits);
+}
+
+text_writer& dump_op_code(text_writer& out, const sm4_op& op,
+						   const sm4_insn* pInsn,
+						   const sm4_dump_options& options)
 {
 	sm4_opcode_type opCodeType = SM4_OPCODE_TYPE_FLOAT;
 	if (pInsn)
@@ -49,7 +70,9 @@ std::ostream& dump_op_code(std::ostream& out, const sm4_op& op,
 			if (i)
 				out << ", ";
 
-			if (opCodeType == SM4_OPCODE_TYPE_INT)
+			if (options.immediates == SM4_DUMP_IMMEDIATES_HEX)
+				write_hex(out, op.imm_values[i].u32, 8);
+			else if (opCodeType == SM4_OPCODE_TYPE_INT)
 				out << op.imm_values[i].i32;
 			else if (opCodeType == SM4_OPCODE_TYPE_UINT)
 				out << op.imm_values[i].u32;
@@ -66,7 +89,9 @@ std::ostream& dump_op_code(std::ostream& out, const sm4_op& op,
 			if (i)
 				out << ", ";
 
-			if (opCodeType == SM4_OPCODE_TYPE_INT)
+			if (options.immediates == SM4_DUMP_IMMEDIATES_HEX)
+				write_hex(out, op.imm_values[i].u64, 16);
+			else if (opCodeType == SM4_OPCODE_TYPE_INT)
 				out << op.imm_values[i].i64;
 			else if (opCodeType == SM4_OPCODE_TYPE_UINT)
 				out << op.imm_values[i].u64;
@@ -79,7 +104,7 @@ std::ostream& dump_op_code(std::ostream& out, const sm4_op& op,
 	else
 	{
 		bool naked = false;
-		if (sm4_dump_short_syntax)
+		if (options.short_syntax)
 		{
 			switch (op.file)
 			{
@@ -100,19 +125,18 @@ std::ostream& dump_op_code(std::ostream& out, const sm4_op& op,
 			}
 		}
 
-		out << (sm4_dump_short_syntax ? sm4_shortfile_names
-									  : sm4_file_names)[op.file];
+		out << (options.short_syntax ? shortfile_names : file_names)[op.file];
 
-		if (op.indices[0].reg.get())
+		if (op.indices[0].reg)
 			naked = false;
 
 		for (unsigned i = 0; i < op.num_indices; ++i)
 		{
 			if (!naked || i)
 				out << '[';
-			if (op.indices[i].reg.get())
+			if (op.indices[i].reg)
 			{
-				dump_op_code(out, *op.indices[i].reg, pInsn);
+				dump_op_code(out, *op.indices[i].reg, pInsn, options);
 				if (op.indices[i].disp)
 					out << '+' << op.indices[i].disp;
 			}
@@ -126,7 +150,7 @@ std::ostream& dump_op_code(std::ostream& out, const sm4_op& op,
 			switch (op.mode)
 			{
 			case SM4_OPERAND_MODE_MASK:
-				out << (sm4_dump_short_syntax ? '.' : '!');
+				out << (options.short_syntax ? '.' : '!');
 				for (unsigned i = 0; i < op.comps; ++i)
 				{
 					if (op.mask & (1 << i))
@@ -139,7 +163,7 @@ std::ostream& dump_op_code(std::ostream& out, const sm4_op& op,
 					out << "xyzw"[op.swizzle[i]];
 				break;
 			case SM4_OPERAND_MODE_SCALAR:
-				out << (sm4_dump_short_syntax ? '.' : ':');
+				out << (options.short_syntax ? '.' : ':');
 				out << "xyzw"[op.swizzle[0]];
 				break;
 			}
@@ -150,9 +174,10 @@ std::ostream& dump_op_code(std::ostream& out, const sm4_op& op,
 	return out;
 }
 
-std::ostream& operator<<(std::ostream& out, const sm4_dcl& dcl)
+text_writer& sm4_dump(text_writer& out, const sm4_dcl& dcl,
+					  const sm4_dump_options& options)
 {
-	out << sm4_opcode_names[dcl.opcode];
+	out << opcode_names[dcl.opcode];
 	switch (dcl.opcode)
 	{
 	case SM4_OPCODE_DCL_RESOURCE:
@@ -180,7 +205,9 @@ std::ostream& operator<<(std::ostream& out, const sm4_dcl& dcl)
 	case SM4_OPCODE_DCL_INPUT_PS:
 	case SM4_OPCODE_DCL_INPUT_PS_SIV:
 	case SM4_OPCODE_DCL_INPUT_PS_SGV:
-		out << ' ' << sm4_interpolation_names[dcl.dcl_input_ps.interpolation];
+		out << ' '
+			<< lookup_name(sm4_interpolation_names, SM4_INTERPOLATION_COUNT,
+						   dcl.dcl_input_ps.interpolation);
 		break;
 	case SM4_OPCODE_DCL_TEMPS:
 		out << ' ' << dcl.num;
@@ -191,17 +218,24 @@ std::ostream& operator<<(std::ostream& out, const sm4_dcl& dcl)
 		out << ", " << dcl.indexable_temp.comps;
 		break;
 	case SM4_OPCODE_DCL_GS_INPUT_PRIMITIVE:
-		out << ' ' << sm4_primitive_names[dcl.dcl_gs_input_primitive.primitive];
+		out << ' '
+			<< lookup_name(sm4_primitive_names, sm4_primitive_name_count,
+						   dcl.dcl_gs_input_primitive.primitive);
 		break;
 	case SM4_OPCODE_DCL_GS_OUTPUT_PRIMITIVE_TOPOLOGY:
 		out << ' '
-			<< sm4_primitive_topology_names[dcl.dcl_gs_output_primitive_topology
-												.primitive_topology];
+			<< lookup_name(
+				   sm4_primitive_topology_names,
+				   sm4_primitive_topology_name_count,
+				   dcl.dcl_gs_output_primitive_topology.primitive_topology);
 		break;
 	case SM4_OPCODE_DCL_MAX_OUTPUT_VERTEX_COUNT:
 		out << ' ' << dcl.num;
 		break;
 	case SM4_OPCODE_DCL_FUNCTION_BODY:
+	case SM4_OPCODE_DCL_GS_INSTANCE_COUNT:
+	case SM4_OPCODE_DCL_HS_FORK_PHASE_INSTANCE_COUNT:
+	case SM4_OPCODE_DCL_HS_JOIN_PHASE_INSTANCE_COUNT:
 		out << ' ' << dcl.num;
 		break;
 	case SM4_OPCODE_DCL_FUNCTION_TABLE:
@@ -229,10 +263,10 @@ std::ostream& operator<<(std::ostream& out, const sm4_dcl& dcl)
 	default:
 		break;
 	}
-	if (dcl.op.get())
+	if (dcl.op)
 	{
 		out << ' ';
-		dump_op_code(out, *dcl.op, NULL);
+		dump_op_code(out, *dcl.op, NULL, options);
 	}
 	switch (dcl.opcode)
 	{
@@ -247,7 +281,9 @@ std::ostream& operator<<(std::ostream& out, const sm4_dcl& dcl)
 	case SM4_OPCODE_DCL_OUTPUT_SGV:
 	case SM4_OPCODE_DCL_INPUT_PS_SIV:
 	case SM4_OPCODE_DCL_INPUT_PS_SGV:
-		out << ", " << sm4_sv_names[dcl.num];
+		/* the upper half of the word is reserved */
+		out << ", "
+			<< lookup_name(sm4_sv_names, SM4_SV_COUNT, dcl.num & 0xffff);
 		break;
 	case SM4_OPCODE_DCL_SAMPLER:
 		out << ", mode_"
@@ -260,9 +296,10 @@ std::ostream& operator<<(std::ostream& out, const sm4_dcl& dcl)
 	return out;
 }
 
-std::ostream& operator<<(std::ostream& out, const sm4_insn& insn)
+text_writer& sm4_dump(text_writer& out, const sm4_insn& insn,
+					  const sm4_dump_options& options)
 {
-	out << sm4_opcode_names[insn.opcode];
+	out << opcode_names[insn.opcode];
 	if (insn.insn.sat)
 		out << "_sat";
 	switch (insn.opcode)
@@ -292,19 +329,24 @@ std::ostream& operator<<(std::ostream& out, const sm4_insn& insn)
 			if (i)
 				out << ',';
 			out << ' ';
-			dump_op_code(out, *insn.ops[i], &insn);
+			dump_op_code(out, *insn.ops[i], &insn, options);
 		}
 		break;
 	}
 	return out;
 }
 
-std::ostream& operator<<(std::ostream& out, const sm4_program& program)
+text_writer& sm4_dump(text_writer& out, const sm4_program& program,
+					  const sm4_dump_options& options)
 {
-	out << "pvghdc"[program.version.type] << "s_" << program.version.major
-		<< "_" << program.version.minor << "\n";
+	out << (program.version.type < 6 ? "pvghdc"[program.version.type] : '?')
+		<< "s_" << program.version.major
+		<< "_" << program.version.minor << '\n';
 	for (unsigned i = 0; i < program.dcls.size(); ++i)
-		out << *program.dcls[i] << "\n";
+	{
+		sm4_dump(out, *program.dcls[i], options);
+		out << '\n';
+	}
 
 	int indent = 0;
 	for (unsigned i = 0; i < program.insns.size(); ++i)
@@ -312,18 +354,64 @@ std::ostream& operator<<(std::ostream& out, const sm4_program& program)
 		int new_indent = program.insns[i]->indents();
 		if (new_indent < 0)
 			indent += new_indent;
-		for (int j = 0; j < indent; ++j)
-			out << "  ";
-		out << *program.insns[i] << "\n";
+		/* unbalanced in malformed programs */
+		if (indent > 0)
+			out.spaces(options.indent_width * indent);
+		sm4_dump(out, *program.insns[i], options);
+		out << '\n';
 		if (new_indent > 0)
 			indent += new_indent;
 	}
 	return out;
 }
 
-void sm4_op::dump() { dump_op_code(std::cout, *this, NULL); }
+text_writer& operator<<(text_writer& out, const sm4_insn& insn)
+{
+	return sm4_dump(out, insn, default_options);
+}
+
+text_writer& operator<<(text_writer& out, const sm4_dcl& dcl)
+{
+	return sm4_dump(out, dcl, default_options);
+}
 
-void sm4_insn::dump() { std::cout << *this; }
+text_writer& operator<<(text_writer& out, const sm4_program& program)
+{
+	return sm4_dump(out, program, default_options);
+}
+
+std::ostream& operator<<(std::ostream& out, const sm4_insn& insn)
+{
+	text_writer writer(out);
+	writer << insn;
+	return out;
+}
+
+std::ostream& operator<<(std::ostream& out, const sm4_dcl& dcl)
+{
+	text_writer writer(out);
+	writer << dcl;
+	return out;
+}
+
+std::ostream& operator<<(std::ostream& out, const sm4_program& program)
+{
+	text_writer writer(out);
+	writer << program;
+	return out;
+}
+
+void sm4_op::dump()
+{
+	text_writer out(stdout);
+	dump_op_code(out, *this, NULL, default_options);
+}
+
+void sm4_insn::dump()
+{
+	text_writer out(stdout);
+	out << *this;
+}
 
 int sm4_insn::indents() const
 {
@@ -342,6 +430,14 @@ int sm4_insn::indents() const
 	}
 }
 
-void sm4_dcl::dump() { std::cout << *this; }
+void sm4_dcl::dump()
+{
+	text_writer out(stdout);
+	out << *this;
+}
 
-void sm4_program::dump() { std::cout << *this; }
+void sm4_program::dump()
+{
+	text_writer out(stdout);
+	out << *this;
+}
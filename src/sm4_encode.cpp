@@ -0,0 +1,393 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "sm4.h"
+
+#define fail(msg) throw(const char*)(msg)
+
+/* the length field of the instruction token has 7 bits */
+#define SM4_ENCODER_MAX_INSN_LENGTH 127
+
+static bool fits_int32(int64_t v) { return (int64_t)(int32_t)v == v; }
+
+template <typename T> static uint32_t to_token(const T& tok)
+{
+	uint32_t v;
+	memcpy(&v, &tok, sizeof(v));
+	return v;
+}
+
+template <typename T> static T from_token(uint32_t v)
+{
+	T tok;
+	memcpy(&tok, &v, sizeof(v));
+	return tok;
+}
+
+/* The tokens are rebuilt from the decoded fields, which passes are
+ * expected to modify, on top of the original tokens, so that the bits the
+ * parser does not interpret survive: a program that is not modified comes
+ * out exactly as it went in. With tokens NULL, the encoder only counts.
+ */
+struct sm4_encoder
+{
+	uint32_t* tokens;
+	unsigned capacity;
+	unsigned pos;
+
+	sm4_encoder(uint32_t* tokens, unsigned capacity)
+		: tokens(tokens), capacity(capacity), pos(0)
+	{
+	}
+
+	void write32(uint32_t v)
+	{
+		if (tokens)
+		{
+			if (pos >= capacity)
+				fail("Buffer is too small");
+			tokens[pos] = bswap_le32(v);
+		}
+		++pos;
+	}
+
+	void write64(uint64_t v)
+	{
+		write32((uint32_t)v);
+		write32((uint32_t)(v >> 32));
+	}
+
+	void patch(unsigned at, uint32_t v)
+	{
+		if (tokens)
+			tokens[at] = bswap_le32(v);
+	}
+
+	static unsigned index_repr(const sm4_op& op, unsigned i)
+	{
+		int64_t disp = op.indices[i].disp;
+		unsigned repr = i == 0	 ? op.token.index0_repr
+						: i == 1 ? op.token.index1_repr
+								 : op.token.index2_repr;
+		bool wide = repr == SM4_OPERAND_INDEX_REPR_IMM64 ||
+					repr == SM4_OPERAND_INDEX_REPR_REG_IMM64 ||
+					!fits_int32(disp);
+		if (!op.indices[i].reg)
+			return wide ? SM4_OPERAND_INDEX_REPR_IMM64
+						: SM4_OPERAND_INDEX_REPR_IMM32;
+		if (repr == SM4_OPERAND_INDEX_REPR_REG && !disp)
+			return SM4_OPERAND_INDEX_REPR_REG;
+		return wide ? SM4_OPERAND_INDEX_REPR_REG_IMM64
+					: SM4_OPERAND_INDEX_REPR_REG_IMM32;
+	}
+
+	void write_op(const sm4_op& op)
+	{
+		sm4_token_operand tok = op.token;
+		tok.file = op.file;
+		tok.num_indices = op.num_indices;
+		switch (op.comps)
+		{
+		case 0:
+			tok.comps_enum = SM4_OPERAND_COMPNUM_0;
+			break;
+		case 1:
+			tok.comps_enum = SM4_OPERAND_COMPNUM_1;
+			break;
+		case 4:
+			tok.comps_enum = SM4_OPERAND_COMPNUM_4;
+			tok.mode = op.mode;
+			switch (op.mode)
+			{
+			case SM4_OPERAND_MODE_MASK:
+				tok.sel = (tok.sel & ~0xf) | (op.mask & 0xf);
+				break;
+			case SM4_OPERAND_MODE_SWIZZLE:
+				tok.sel = (op.swizzle[0] & 3) | ((op.swizzle[1] & 3) << 2) |
+						  ((op.swizzle[2] & 3) << 4) |
+						  ((op.swizzle[3] & 3) << 6);
+				break;
+			case SM4_OPERAND_MODE_SCALAR:
+				tok.sel = (tok.sel & ~3) | (op.swizzle[0] & 3);
+				break;
+			}
+			break;
+		default:
+			fail("Invalid operand component count");
+		}
+		if (op.num_indices > 0)
+			tok.index0_repr = index_repr(op, 0);
+		if (op.num_indices > 1)
+			tok.index1_repr = index_repr(op, 1);
+		if (op.num_indices > 2)
+			tok.index2_repr = index_repr(op, 2);
+
+		sm4_token_operand_extended ext = op.extended_token;
+		bool extended = op.has_extended_token;
+		if (extended && ext.type == 1)
+		{
+			ext.neg = op.neg;
+			ext.abs = op.abs;
+		}
+		else if (!extended && (op.neg || op.abs))
+		{
+			ext = from_token<sm4_token_operand_extended>(0);
+			ext.type = 1;
+			ext.neg = op.neg;
+			ext.abs = op.abs;
+			extended = true;
+		}
+		tok.extended = extended;
+		write32(to_token(tok));
+		if (extended)
+			write32(to_token(ext));
+
+		for (unsigned i = 0; i < op.num_indices; ++i)
+		{
+			switch (index_repr(op, i))
+			{
+			case SM4_OPERAND_INDEX_REPR_IMM32:
+			case SM4_OPERAND_INDEX_REPR_REG_IMM32:
+				write32((uint32_t)op.indices[i].disp);
+				break;
+			case SM4_OPERAND_INDEX_REPR_IMM64:
+			case SM4_OPERAND_INDEX_REPR_REG_IMM64:
+				write64((uint64_t)op.indices[i].disp);
+				break;
+			}
+			if (op.indices[i].reg)
+				write_op(*op.indices[i].reg);
+		}
+
+		if (op.file == SM4_FILE_IMMEDIATE32)
+		{
+			for (unsigned i = 0; i < op.comps; ++i)
+				write32((uint32_t)op.imm_values[i].i32);
+		}
+		else if (op.file == SM4_FILE_IMMEDIATE64)
+		{
+			for (unsigned i = 0; i < op.comps; ++i)
+				write64((uint64_t)op.imm_values[i].i64);
+		}
+	}
+
+	/* fills in the length and extended bits of the token at start */
+	void finish(unsigned start, sm4_token_instruction tok, bool extended)
+	{
+		unsigned length = pos - start;
+		if (length > SM4_ENCODER_MAX_INSN_LENGTH)
+			fail("Instruction is too long");
+		tok.length = length;
+		tok.extended = extended;
+		patch(start, to_token(tok));
+	}
+
+	void write_extended(const uint32_t* ext, unsigned count)
+	{
+		for (unsigned i = 0; i < count; ++i)
+		{
+			sm4_token_instruction_extended tok =
+				from_token<sm4_token_instruction_extended>(ext[i]);
+			tok.extended = i + 1 < count;
+			write32(to_token(tok));
+		}
+	}
+
+	void write_insn(const sm4_insn& insn)
+	{
+		/* the sample offsets, resource dimension and return type go into
+		 * the extended tokens they came from, or new ones */
+		uint32_t ext[SM4_MAX_EXTENDED_TOKENS];
+		unsigned num_ext = 0;
+		if (insn.num_extended > SM4_MAX_EXTENDED_TOKENS)
+			fail("Too many extended tokens");
+		bool has_type[SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_COUNT] = {};
+		for (unsigned i = 0; i < insn.num_extended; ++i)
+		{
+			sm4_token_instruction_extended tok =
+				from_token<sm4_token_instruction_extended>(insn.extended[i]);
+			if (tok.type < SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_COUNT)
+				has_type[tok.type] = true;
+			ext[num_ext++] = to_token(tok);
+		}
+		if (!has_type[SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_SAMPLE_CONTROLS] &&
+			(insn.sample_offset[0] || insn.sample_offset[1] ||
+			 insn.sample_offset[2]) &&
+			num_ext < SM4_MAX_EXTENDED_TOKENS)
+			ext[num_ext++] = SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_SAMPLE_CONTROLS;
+		if (!has_type[SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_DIM] &&
+			insn.resource_target && num_ext < SM4_MAX_EXTENDED_TOKENS)
+			ext[num_ext++] = SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_DIM;
+		if (!has_type
+				[SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_RETURN_TYPE] &&
+			(insn.resource_return_type[0] || insn.resource_return_type[1] ||
+			 insn.resource_return_type[2] || insn.resource_return_type[3]) &&
+			num_ext < SM4_MAX_EXTENDED_TOKENS)
+			ext[num_ext++] =
+				SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_RETURN_TYPE;
+		for (unsigned i = 0; i < num_ext; ++i)
+		{
+			sm4_token_instruction_extended tok =
+				from_token<sm4_token_instruction_extended>(ext[i]);
+			switch (tok.type)
+			{
+			case SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_SAMPLE_CONTROLS:
+				tok.sample_controls.offset_u = insn.sample_offset[0];
+				tok.sample_controls.offset_v = insn.sample_offset[1];
+				tok.sample_controls.offset_w = insn.sample_offset[2];
+				break;
+			case SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_DIM:
+				tok.resource_target.target = insn.resource_target;
+				break;
+			case SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_RETURN_TYPE:
+				tok.resource_return_type.x = insn.resource_return_type[0];
+				tok.resource_return_type.y = insn.resource_return_type[1];
+				tok.resource_return_type.z = insn.resource_return_type[2];
+				tok.resource_return_type.w = insn.resource_return_type[3];
+				break;
+			}
+			ext[i] = to_token(tok);
+		}
+
+		unsigned start = pos;
+		write32(0);
+		write_extended(ext, num_ext);
+		if (insn.opcode == SM4_OPCODE_INTERFACE_CALL)
+			write32(insn.num);
+		if (insn.num_ops > SM4_MAX_OPS)
+			fail("Too many operands");
+		for (unsigned i = 0; i < insn.num_ops; ++i)
+			write_op(*insn.ops[i]);
+		finish(start, insn, num_ext > 0);
+	}
+
+	void write_data(const sm4_dcl& dcl, unsigned count)
+	{
+		if (count && !dcl.data)
+			fail("Declaration data is missing");
+		for (unsigned i = 0; i < count; ++i)
+			write32(((const uint32_t*)dcl.data)[i]);
+	}
+
+	void write_dcl(const sm4_dcl& dcl)
+	{
+		if (dcl.opcode >= SM4_OPCODE_COUNT)
+			fail("Invalid opcode");
+		const sm4_opcode_desc& desc = sm4_opcode_descs[dcl.opcode];
+		/* phase markers are written by their instruction */
+		if (desc.kind == SM4_OPCODE_KIND_PHASE)
+			return;
+		if (desc.kind == SM4_OPCODE_KIND_CUSTOMDATA)
+		{
+			write32(to_token((const sm4_token_instruction&)dcl));
+			write32(dcl.num + 2);
+			write_data(dcl, dcl.num);
+			return;
+		}
+		if (desc.kind != SM4_OPCODE_KIND_DCL)
+			fail("Not a declaration");
+
+		unsigned start = pos;
+		write32(0);
+		if (dcl.num_extended > SM4_MAX_EXTENDED_TOKENS)
+			fail("Too many extended tokens");
+		write_extended(dcl.extended, dcl.num_extended);
+		if (desc.num_ops)
+		{
+			if (!dcl.op)
+				fail("Declaration operand is missing");
+			write_op(*dcl.op);
+		}
+
+		switch (desc.layout)
+		{
+		case SM4_DCL_LAYOUT_WORDS:
+			for (unsigned i = 0; i < desc.num_words; ++i)
+				write32(dcl.words[i]);
+			break;
+		case SM4_DCL_LAYOUT_SV:
+			write32(dcl.words[0]);
+			break;
+		case SM4_DCL_LAYOUT_INDEXABLE_TEMP:
+			write32(dcl.indexable_temp.index);
+			write32(dcl.indexable_temp.num);
+			write32(dcl.indexable_temp.comps);
+			break;
+		case SM4_DCL_LAYOUT_FUNCTION_TABLE:
+			write32(dcl.function_table.id);
+			write32(dcl.function_table.num);
+			write_data(dcl, dcl.function_table.num);
+			break;
+		case SM4_DCL_LAYOUT_INTERFACE:
+			write32(dcl.intf.id);
+			write32(dcl.intf.expected_function_table_length);
+			write32((dcl.intf.table_length & 0xffff) |
+					(dcl.intf.array_length << 16));
+			write_data(dcl, dcl.intf.table_length);
+			break;
+		default:
+			fail("Unhandled declaration");
+		}
+		finish(start, dcl, dcl.num_extended > 0);
+	}
+
+	void write_program(const sm4_program& program)
+	{
+		write32(to_token(program.version));
+		write32(0);
+		/* declarations go before the instruction they preceded */
+		unsigned d = 0;
+		for (unsigned i = 0; i < program.insns.size(); ++i)
+		{
+			for (; d < program.dcls.size() && program.dcls[d]->insn_num <= i;
+				 ++d)
+				write_dcl(*program.dcls[d]);
+			write_insn(*program.insns[i]);
+		}
+		for (; d < program.dcls.size(); ++d)
+			write_dcl(*program.dcls[d]);
+		patch(1, pos);
+	}
+
+  private:
+	sm4_encoder& operator=(const sm4_encoder&);
+};
+
+const char* sm4_encode(const sm4_program& program, uint32_t* tokens,
+					   unsigned& num_tokens)
+{
+	sm4_encoder encoder(tokens, num_tokens);
+	try
+	{
+		encoder.write_program(program);
+	}
+	catch (const char* error)
+	{
+		return error;
+	}
+	num_tokens = encoder.pos;
+	return 0;
+}
@@ -0,0 +1,2196 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* A SIMD interpreter: every instruction is run for all the lanes at once,
+ * registers being kept component by component so that the inner loops
+ * over the lanes vectorize. Divergent flow control is handled with masks
+ * of the lanes still active, as on the GPU. */
+
+#include "sm4.h"
+#include <algorithm>
+#include <math.h>
+
+#define LANES SM4_EXEC_LANES
+#define ALL_LANES ((1u << LANES) - 1)
+
+static_assert(LANES >= 4 && LANES <= 16 && !(LANES & (LANES - 1)),
+			  "SM4_EXEC_LANES must be 4, 8 or 16");
+
+#define for_lanes(l) for (unsigned l = 0; l < LANES; ++l)
+#define for_comps(c) for (unsigned c = 0; c < 4; ++c)
+
+union lanes4
+{
+	uint32_t u[4][LANES];
+	int32_t i[4][LANES];
+	float f[4][LANES];
+};
+
+enum
+{
+	FRAME_IF,
+	FRAME_LOOP,
+	FRAME_SWITCH,
+	FRAME_CALL
+};
+
+/* how source modifiers apply */
+enum operand_type
+{
+	FLOAT,
+	INT
+};
+
+static inline float as_float(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+static inline uint32_t as_uint(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static uint32_t f32_to_f16(uint32_t x)
+{
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t exp = (x >> 23) & 0xff;
+	uint32_t mant = x & 0x7fffff;
+	if (exp == 0xff)
+		return sign | 0x7c00 | (mant ? 0x200 : 0);
+	int e = (int)exp - 127 + 15;
+	if (e >= 31)
+		return sign | 0x7c00;
+	uint32_t half, rem, halfway;
+	if (e <= 0)
+	{
+		if (e < -10)
+			return sign;
+		mant |= 0x800000;
+		unsigned shift = 14 - e;
+		half = mant >> shift;
+		rem = mant & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	}
+	else
+	{
+		half = ((uint32_t)e << 10) | (mant >> 13);
+		rem = mant & 0x1fff;
+		halfway = 0x1000;
+	}
+	/* to nearest even, a carry into the exponent being what it should */
+	if (rem > halfway || (rem == halfway && (half & 1)))
+		++half;
+	return sign | half;
+}
+
+static uint32_t f16_to_f32(uint32_t h)
+{
+	uint32_t sign = (h & 0x8000) << 16;
+	int e = (h >> 10) & 0x1f;
+	uint32_t mant = h & 0x3ff;
+	if (e == 31)
+		return sign | 0x7f800000 | (mant << 13);
+	if (!e)
+	{
+		if (!mant)
+			return sign;
+		e = 1;
+		while (!(mant & 0x400))
+		{
+			mant <<= 1;
+			--e;
+		}
+		mant &= 0x3ff;
+	}
+	return sign | ((uint32_t)(e + 112) << 23) | (mant << 13);
+}
+
+static inline int32_t float_to_int(float f)
+{
+	if (f != f)
+		return 0;
+	if (f >= 2147483647.0f)
+		return INT32_MAX;
+	if (f <= -2147483648.0f)
+		return INT32_MIN;
+	return (int32_t)f;
+}
+
+static inline uint32_t float_to_uint(float f)
+{
+	if (!(f > 0.0f))
+		return 0;
+	if (f >= 4294967295.0f)
+		return UINT32_MAX;
+	return (uint32_t)f;
+}
+
+static inline unsigned count_bits(uint32_t v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+/* the bit index of the highest bit set, counted from the top */
+static inline uint32_t first_bit_high(uint32_t v)
+{
+	if (!v)
+		return UINT32_MAX;
+	uint32_t n = 0;
+	while (!(v & 0x80000000u))
+	{
+		v <<= 1;
+		++n;
+	}
+	return n;
+}
+
+static inline uint32_t first_bit_low(uint32_t v)
+{
+	if (!v)
+		return UINT32_MAX;
+	uint32_t n = 0;
+	while (!(v & 1))
+	{
+		v >>= 1;
+		++n;
+	}
+	return n;
+}
+
+static inline uint32_t reverse_bits(uint32_t v)
+{
+	v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+	v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+	v = ((v >> 4) & 0x0f0f0f0f) | ((v & 0x0f0f0f0f) << 4);
+	v = ((v >> 8) & 0x00ff00ff) | ((v & 0x00ff00ff) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+static inline uint32_t bitfield_extract(uint32_t width, uint32_t offset,
+										uint32_t v, bool is_signed)
+{
+	width &= 31;
+	offset &= 31;
+	if (!width)
+		return 0;
+	if (width + offset < 32)
+	{
+		v <<= 32 - width - offset;
+		return is_signed ? (uint32_t)((int32_t)v >> (32 - width))
+						 : v >> (32 - width);
+	}
+	return is_signed ? (uint32_t)((int32_t)v >> offset) : v >> offset;
+}
+
+static inline uint32_t bitfield_insert(uint32_t width, uint32_t offset,
+									   uint32_t insert, uint32_t base)
+{
+	width &= 31;
+	offset &= 31;
+	uint32_t mask = (((1u << width) - 1) << offset);
+	return ((insert << offset) & mask) | (base & ~mask);
+}
+
+static inline uint32_t atomic_op(unsigned opcode, uint32_t old, uint32_t a,
+								 uint32_t b)
+{
+	switch (opcode)
+	{
+	case SM4_OPCODE_ATOMIC_AND:
+	case SM4_OPCODE_IMM_ATOMIC_AND:
+		return old & a;
+	case SM4_OPCODE_ATOMIC_OR:
+	case SM4_OPCODE_IMM_ATOMIC_OR:
+		return old | a;
+	case SM4_OPCODE_ATOMIC_XOR:
+	case SM4_OPCODE_IMM_ATOMIC_XOR:
+		return old ^ a;
+	case SM4_OPCODE_ATOMIC_IADD:
+	case SM4_OPCODE_IMM_ATOMIC_IADD:
+		return old + a;
+	case SM4_OPCODE_ATOMIC_IMAX:
+	case SM4_OPCODE_IMM_ATOMIC_IMAX:
+		return (int32_t)old > (int32_t)a ? old : a;
+	case SM4_OPCODE_ATOMIC_IMIN:
+	case SM4_OPCODE_IMM_ATOMIC_IMIN:
+		return (int32_t)old < (int32_t)a ? old : a;
+	case SM4_OPCODE_ATOMIC_UMAX:
+	case SM4_OPCODE_IMM_ATOMIC_UMAX:
+		return old > a ? old : a;
+	case SM4_OPCODE_ATOMIC_UMIN:
+	case SM4_OPCODE_IMM_ATOMIC_UMIN:
+		return old < a ? old : a;
+	case SM4_OPCODE_IMM_ATOMIC_EXCH:
+		return a;
+	/* a is the value compared, b the one stored */
+	case SM4_OPCODE_ATOMIC_CMP_STORE:
+	case SM4_OPCODE_IMM_ATOMIC_CMP_EXCH:
+		return old == a ? b : old;
+	default:
+		return old;
+	}
+}
+
+/* a span of words of a raw or structured resource, UAV or group shared
+ * memory */
+struct memory
+{
+	uint32_t* words;
+	unsigned size; /* bytes */
+	unsigned stride;
+
+	uint32_t* word(uint32_t byte_offset) const
+	{
+		if (byte_offset >= size || size - byte_offset < 4)
+			return 0;
+		return words + (byte_offset >> 2);
+	}
+};
+
+struct executor
+{
+	const sm4_exec& exec;
+	const sm4_program& program;
+	sm4_exec_bindings& bindings;
+	sm4_exec_state& state;
+	uint32_t active; /* the lanes running the current instruction */
+	uint32_t alive;	 /* those that neither returned from main nor discarded */
+	uint32_t discarded;
+	uint32_t lane_masks[LANES]; /* ~0 for the active lanes */
+	uint32_t* tgsm;
+	unsigned pc;
+	unsigned steps;
+	bool stop_at_sync;
+	bool at_sync;
+	const char* error;
+
+	executor(const sm4_exec& exec, sm4_exec_bindings& bindings,
+			 sm4_exec_state& state)
+		: exec(exec), program(*exec.program), bindings(bindings),
+		  state(state), active(0), alive(0), discarded(0), tgsm(0), pc(0),
+		  steps(0), stop_at_sync(false), at_sync(false), error(0)
+	{
+	}
+
+	void set_active(uint32_t lanes)
+	{
+		active = lanes;
+		for_lanes(l) lane_masks[l] = (lanes >> l) & 1 ? ~0u : 0;
+	}
+
+	/* where the registers of a file stored lane by lane are, or NULL for
+	 * the files stored once for all lanes */
+	sm4_exec_register* lane_registers(const sm4_op& op, unsigned& count,
+									  unsigned& index)
+	{
+		index = 0;
+		switch (op.file)
+		{
+		case SM4_FILE_TEMP:
+			count = (unsigned)state.temps.size();
+			return state.temps.data();
+		case SM4_FILE_INPUT:
+			count = (unsigned)bindings.inputs.size();
+			return bindings.inputs.data();
+		case SM4_FILE_OUTPUT:
+			count = (unsigned)bindings.outputs.size();
+			return bindings.outputs.data();
+		case SM4_FILE_INDEXABLE_TEMP:
+		{
+			/* sm4_exec_init checked x# */
+			unsigned x = (unsigned)op.indices[0].disp;
+			count = exec.indexable_size[x];
+			index = 1;
+			return state.indexable.data() + exec.indexable_first[x];
+		}
+		default:
+			break;
+		}
+		count = 1;
+		index = 3; /* none */
+		switch (op.file)
+		{
+		case SM4_FILE_OUTPUT_DEPTH:
+			return &bindings.output_depth;
+		case SM4_FILE_INPUT_PRIMITIVEID:
+			return &bindings.primitive_id;
+		case SM4_FILE_INPUT_THREAD_ID:
+			return &bindings.thread_id;
+		case SM4_FILE_INPUT_THREAD_GROUP_ID:
+			return &bindings.thread_group_id;
+		case SM4_FILE_INPUT_THREAD_ID_IN_GROUP:
+			return &bindings.thread_id_in_group;
+		case SM4_FILE_INPUT_THREAD_ID_IN_GROUP_FLATTENED:
+			return &bindings.thread_id_in_group_flattened;
+		default:
+			return 0;
+		}
+	}
+
+	/* the register index of every lane, for relative addressing */
+	void lane_indices(const sm4_op& op, unsigned i, int64_t* indices)
+	{
+		lanes4 rel;
+		read(*op.indices[i].reg, rel, INT);
+		for_lanes(l) indices[l] = op.indices[i].disp + (int32_t)rel.u[0][l];
+	}
+
+	static unsigned source_component(const sm4_op& op, unsigned c)
+	{
+		if (op.comps == 1)
+			return 0;
+		if (op.mode == SM4_OPERAND_MODE_MASK)
+			return c;
+		return op.swizzle[c];
+	}
+
+	void read_register(const sm4_op& op, lanes4& value)
+	{
+		unsigned count, index;
+		sm4_exec_register* regs = lane_registers(op, count, index);
+		if (regs)
+		{
+			if (index == 3 || !op.indices[index].reg)
+			{
+				uint64_t r = index == 3 ? 0 : (uint64_t)op.indices[index].disp;
+				if (r >= count)
+				{
+					memset(&value, 0, sizeof(value));
+					return;
+				}
+				for_comps(c)
+				{
+					unsigned s = source_component(op, c);
+					for_lanes(l) value.u[c][l] = regs[r].c[s][l];
+				}
+				return;
+			}
+			int64_t indices[LANES];
+			lane_indices(op, index, indices);
+			for_lanes(l)
+			{
+				bool in = indices[l] >= 0 && indices[l] < count;
+				for_comps(c)
+					value.u[c][l] =
+						in ? regs[indices[l]].c[source_component(op, c)][l]
+						   : 0;
+			}
+			return;
+		}
+
+		/* stored once for all lanes */
+		const uint32_t* data = 0;
+		bool little_endian = false;
+		switch (op.file)
+		{
+		case SM4_FILE_IMMEDIATE32:
+			for_comps(c)
+			{
+				uint32_t v = (uint32_t)op.imm_values[op.comps == 1 ? 0 : c].i32;
+				for_lanes(l) value.u[c][l] = v;
+			}
+			return;
+		case SM4_FILE_CONSTANT_BUFFER:
+		{
+			uint64_t slot = (uint64_t)op.indices[0].disp;
+			if (slot < bindings.constant_buffers.size())
+			{
+				data = bindings.constant_buffers[slot].data;
+				count = bindings.constant_buffers[slot].num_vectors;
+			}
+			index = 1;
+			break;
+		}
+		case SM4_FILE_IMMEDIATE_CONSTANT_BUFFER:
+			data = exec.icb;
+			count = exec.icb_size;
+			little_endian = true;
+			index = 0;
+			break;
+		default:
+			break;
+		}
+		if (!data)
+		{
+			memset(&value, 0, sizeof(value));
+			return;
+		}
+		int64_t indices[LANES];
+		if (op.indices[index].reg)
+			lane_indices(op, index, indices);
+		else
+			for_lanes(l) indices[l] = op.indices[index].disp;
+		for_lanes(l)
+		{
+			bool in = indices[l] >= 0 && indices[l] < count;
+			for_comps(c)
+			{
+				uint32_t v =
+					in ? data[indices[l] * 4 + source_component(op, c)] : 0;
+				value.u[c][l] = little_endian ? bswap_le32(v) : v;
+			}
+		}
+	}
+
+	void read(const sm4_op& op, lanes4& value, operand_type type)
+	{
+		read_register(op, value);
+		if (type == FLOAT)
+		{
+			uint32_t clear = op.abs ? 0x7fffffffu : ~0u;
+			uint32_t flip = op.neg ? 0x80000000u : 0;
+			if (op.abs || op.neg)
+				for_comps(c) for_lanes(l) value.u[c][l] =
+					(value.u[c][l] & clear) ^ flip;
+		}
+		else
+		{
+			if (op.abs)
+				for_comps(c) for_lanes(l) value.i[c][l] =
+					value.i[c][l] < 0 ? -value.i[c][l] : value.i[c][l];
+			if (op.neg)
+				for_comps(c) for_lanes(l) value.u[c][l] =
+					0u - value.u[c][l];
+		}
+	}
+
+	static unsigned write_mask(const sm4_op& op)
+	{
+		if (op.comps == 1)
+			return 1;
+		return op.comps ? op.mask : 0;
+	}
+
+	/* only into the active lanes, saturated if the instruction says so */
+	void write(const sm4_insn& insn, const sm4_op& op, lanes4& value,
+			   bool is_float = true)
+	{
+		if (op.file == SM4_FILE_NULL)
+			return;
+		unsigned mask = write_mask(op);
+		if (insn.insn.sat && is_float)
+			for_comps(c) for_lanes(l)
+			{
+				float f = value.f[c][l];
+				/* NaN becomes 0 */
+				value.f[c][l] = f > 0.0f ? (f < 1.0f ? f : 1.0f) : 0.0f;
+			}
+
+		unsigned count, index;
+		sm4_exec_register* regs = lane_registers(op, count, index);
+		if (!regs)
+			return;
+		if (index == 3 || !op.indices[index].reg)
+		{
+			uint64_t r = index == 3 ? 0 : (uint64_t)op.indices[index].disp;
+			if (r >= count)
+				return;
+			for_comps(c) if (mask & (1 << c)) for_lanes(l)
+				regs[r].c[c][l] = (value.u[c][l] & lane_masks[l]) |
+								  (regs[r].c[c][l] & ~lane_masks[l]);
+			return;
+		}
+		int64_t indices[LANES];
+		lane_indices(op, index, indices);
+		for_lanes(l)
+		{
+			if (!(active & (1 << l)) || indices[l] < 0 || indices[l] >= count)
+				continue;
+			for_comps(c) if (mask & (1 << c)) regs[indices[l]].c[c][l] =
+				value.u[c][l];
+		}
+	}
+
+	/* the lanes whose condition operand passes the test of insn */
+	uint32_t test(const sm4_insn& insn, const sm4_op& op)
+	{
+		lanes4 v;
+		read(op, v, INT);
+		uint32_t lanes = 0;
+		for_lanes(l) if ((v.u[0][l] != 0) == (bool)insn.insn.test_nz) lanes |=
+			1u << l;
+		return lanes & active;
+	}
+
+	/* the lanes still running in the current function: neither returned
+	 * from it nor discarded */
+	uint32_t alive_in_function() const
+	{
+		uint32_t lanes = alive;
+		for (size_t i = state.frames.size(); i-- > 0;)
+		{
+			if (state.frames[i].kind == FRAME_CALL)
+			{
+				lanes &= ~state.frames[i].lanes;
+				break;
+			}
+		}
+		return lanes;
+	}
+
+	/* of outer, the lanes that did not leave the innermost loop or switch
+	 * since, once a construct nested in it is done */
+	uint32_t restore(uint32_t outer) const
+	{
+		uint32_t lanes = outer & alive;
+		bool found_loop = false, found_break = false;
+		for (size_t i = state.frames.size(); i-- > 0;)
+		{
+			const sm4_exec_frame& frame = state.frames[i];
+			if (frame.kind == FRAME_CALL)
+			{
+				lanes &= ~frame.lanes;
+				break;
+			}
+			if (frame.kind == FRAME_LOOP && !found_loop)
+			{
+				lanes &= ~frame.continued;
+				found_loop = true;
+			}
+			if ((frame.kind == FRAME_LOOP || frame.kind == FRAME_SWITCH) &&
+				!found_break)
+			{
+				lanes &= ~frame.lanes;
+				found_break = true;
+			}
+		}
+		return lanes;
+	}
+
+	sm4_exec_frame* innermost(bool loop_only)
+	{
+		for (size_t i = state.frames.size(); i-- > 0;)
+		{
+			sm4_exec_frame& frame = state.frames[i];
+			if (frame.kind == FRAME_CALL)
+				return 0;
+			if (frame.kind == FRAME_LOOP ||
+				(frame.kind == FRAME_SWITCH && !loop_only))
+				return &frame;
+		}
+		return 0;
+	}
+
+	sm4_exec_frame& push(unsigned kind)
+	{
+		state.frames.resize(state.frames.size() + 1);
+		sm4_exec_frame& frame = state.frames.back();
+		frame.kind = kind;
+		frame.pc = pc;
+		frame.outer = active;
+		frame.lanes = frame.continued = frame.default_lanes = 0;
+		return frame;
+	}
+
+	bool in_call() const
+	{
+		for (size_t i = 0; i < state.frames.size(); ++i)
+			if (state.frames[i].kind == FRAME_CALL)
+				return true;
+		return false;
+	}
+
+	/* returns from the innermost call, or ends the program */
+	void leave_function()
+	{
+		while (!state.frames.empty() && state.frames.back().kind != FRAME_CALL)
+			state.frames.pop_back();
+		if (state.frames.empty())
+		{
+			pc = (unsigned)program.insns.size();
+			set_active(0);
+			return;
+		}
+		sm4_exec_frame frame = state.frames.back();
+		state.frames.pop_back();
+		pc = frame.pc;
+		set_active(restore(frame.outer));
+	}
+
+	/* whether insn i is the last of a function */
+	bool ends_function(unsigned i) const
+	{
+		return i + 1 >= program.insns.size() ||
+			   program.insns[i + 1]->opcode == SM4_OPCODE_LABEL;
+	}
+
+	/* the lanes going through a return or discard, conditional or not */
+	uint32_t taken(const sm4_insn& insn)
+	{
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_BREAKC:
+		case SM4_OPCODE_CONTINUEC:
+		case SM4_OPCODE_RETC:
+		case SM4_OPCODE_CALLC:
+		case SM4_OPCODE_DISCARD:
+			return test(insn, *insn.ops[0]);
+		default:
+			return active;
+		}
+	}
+
+	/* returns false when the program is done */
+	bool flow_control(const sm4_insn& insn)
+	{
+		const std::vector<int>& linked = program.cf_insn_linked;
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_IF:
+		{
+			uint32_t lanes = test(insn, *insn.ops[0]);
+			sm4_exec_frame& frame = push(FRAME_IF);
+			frame.lanes = lanes;
+			set_active(lanes);
+			/* straight to the else or endif */
+			if (!lanes)
+				pc = linked[pc] - 1;
+			break;
+		}
+		case SM4_OPCODE_ELSE:
+		{
+			sm4_exec_frame& frame = state.frames.back();
+			set_active(frame.outer & ~frame.lanes);
+			if (!active)
+				pc = linked[pc] - 1;
+			break;
+		}
+		case SM4_OPCODE_ENDIF:
+		{
+			uint32_t outer = state.frames.back().outer;
+			state.frames.pop_back();
+			set_active(restore(outer));
+			break;
+		}
+		case SM4_OPCODE_LOOP:
+			push(FRAME_LOOP);
+			break;
+		case SM4_OPCODE_ENDLOOP:
+		{
+			sm4_exec_frame& frame = state.frames.back();
+			uint32_t lanes = frame.outer & alive_in_function() & ~frame.lanes;
+			if (lanes && active | frame.continued)
+			{
+				frame.continued = 0;
+				set_active(lanes);
+				pc = frame.pc;
+			}
+			else
+			{
+				uint32_t outer = frame.outer;
+				state.frames.pop_back();
+				set_active(restore(outer));
+			}
+			break;
+		}
+		case SM4_OPCODE_BREAK:
+		case SM4_OPCODE_BREAKC:
+		{
+			uint32_t lanes = taken(insn);
+			innermost(false)->lanes |= lanes;
+			set_active(active & ~lanes);
+			break;
+		}
+		case SM4_OPCODE_CONTINUE:
+		case SM4_OPCODE_CONTINUEC:
+		{
+			uint32_t lanes = taken(insn);
+			innermost(true)->continued |= lanes;
+			set_active(active & ~lanes);
+			break;
+		}
+		case SM4_OPCODE_SWITCH:
+		{
+			lanes4 v;
+			read(*insn.ops[0], v, INT);
+			sm4_exec_frame& frame = push(FRAME_SWITCH);
+			memcpy(frame.selector, v.u[0], sizeof(frame.selector));
+			uint32_t matched = 0;
+			for (int c = linked[pc]; program.insns[c]->opcode != SM4_OPCODE_ENDSWITCH;
+				 c = linked[c])
+			{
+				const sm4_insn& label = *program.insns[c];
+				if (label.opcode != SM4_OPCODE_CASE)
+					continue;
+				lanes4 value;
+				read(*label.ops[0], value, INT);
+				for_lanes(l) if (v.u[0][l] == value.u[0][0]) matched |= 1u << l;
+			}
+			frame.default_lanes = ~matched;
+			set_active(0);
+			break;
+		}
+		case SM4_OPCODE_CASE:
+		case SM4_OPCODE_DEFAULT:
+		{
+			sm4_exec_frame& frame = state.frames.back();
+			uint32_t lanes = frame.default_lanes;
+			if (insn.opcode == SM4_OPCODE_CASE)
+			{
+				lanes4 value;
+				read(*insn.ops[0], value, INT);
+				lanes = 0;
+				for_lanes(l) if (frame.selector[l] == value.u[0][0]) lanes |=
+					1u << l;
+			}
+			/* fall through from the case above */
+			set_active(active | (lanes & frame.outer & restore(~0u)));
+			break;
+		}
+		case SM4_OPCODE_ENDSWITCH:
+		{
+			uint32_t outer = state.frames.back().outer;
+			state.frames.pop_back();
+			set_active(restore(outer));
+			break;
+		}
+		case SM4_OPCODE_DISCARD:
+		{
+			uint32_t lanes = taken(insn);
+			discarded |= lanes;
+			alive &= ~lanes;
+			set_active(active & ~lanes);
+			break;
+		}
+		case SM4_OPCODE_RET:
+		case SM4_OPCODE_RETC:
+		{
+			uint32_t lanes = taken(insn);
+			bool last = insn.opcode == SM4_OPCODE_RET && ends_function(pc);
+			if (in_call())
+			{
+				if (last)
+				{
+					leave_function();
+					return true;
+				}
+				for (size_t i = state.frames.size(); i-- > 0;)
+				{
+					if (state.frames[i].kind == FRAME_CALL)
+					{
+						state.frames[i].lanes |= lanes;
+						break;
+					}
+				}
+			}
+			else
+				alive &= ~lanes;
+			set_active(active & ~lanes);
+			if (!alive)
+				return false;
+			break;
+		}
+		case SM4_OPCODE_CALL:
+		case SM4_OPCODE_CALLC:
+		{
+			uint32_t lanes = taken(insn);
+			if (!lanes)
+				break;
+			unsigned depth = 0;
+			for (size_t i = 0; i < state.frames.size(); ++i)
+				depth += state.frames[i].kind == FRAME_CALL;
+			/* the limit of the hardware */
+			if (depth >= 32)
+			{
+				error = "Subroutine calls nested too deep";
+				return false;
+			}
+			sm4_exec_frame& frame = push(FRAME_CALL);
+			frame.pc = pc + 1;
+			set_active(lanes);
+			/* sm4_exec_init checked the label */
+			unsigned label =
+				(unsigned)insn.ops[insn.opcode == SM4_OPCODE_CALLC]->indices[0].disp;
+			pc = program.label_to_insn_num[label];
+			break;
+		}
+		case SM4_OPCODE_LABEL:
+			/* falling into the next function */
+			if (!in_call())
+				return false;
+			leave_function();
+			return true;
+		default:
+			break;
+		}
+		++pc;
+		return true;
+	}
+
+	/* the address of a raw or structured access: src holds the byte
+	 * offset, or the element index and byte offset */
+	static uint32_t address(const memory& mem, const lanes4& src, unsigned l)
+	{
+		if (mem.stride)
+			return src.u[0][l] * mem.stride + src.u[1][l];
+		return src.u[0][l];
+	}
+
+	bool memory_of(const sm4_op& op, memory& mem)
+	{
+		uint64_t slot = (uint64_t)op.indices[0].disp;
+		mem.words = 0;
+		mem.size = mem.stride = 0;
+		switch (op.file)
+		{
+		case SM4_FILE_RESOURCE:
+			if (slot >= bindings.resources.size() ||
+				slot >= exec.resource_strides.size())
+				return false;
+			mem.words = bindings.resources[slot].data;
+			mem.size = bindings.resources[slot].size;
+			mem.stride = exec.resource_strides[slot];
+			break;
+		case SM4_FILE_UNORDERED_ACCESS_VIEW:
+			if (slot >= bindings.uavs.size() ||
+				slot >= exec.uav_strides.size())
+				return false;
+			mem.words = bindings.uavs[slot].data;
+			mem.size = bindings.uavs[slot].size;
+			mem.stride = exec.uav_strides[slot];
+			break;
+		case SM4_FILE_THREAD_GROUP_SHARED_MEMORY:
+			if (slot >= exec.tgsm_sizes.size())
+				return false;
+			mem.words = tgsm + exec.tgsm_offsets[slot] / 4;
+			mem.size = exec.tgsm_sizes[slot];
+			mem.stride = exec.tgsm_strides[slot];
+			break;
+		default:
+			return false;
+		}
+		return mem.words != 0;
+	}
+
+	/* typed resources and UAVs */
+	const sm4_exec_resource* typed(const sm4_op& op, unsigned& target)
+	{
+		uint64_t slot = (uint64_t)op.indices[0].disp;
+		const std::vector<sm4_exec_resource>& bound =
+			op.file == SM4_FILE_RESOURCE ? bindings.resources : bindings.uavs;
+		const std::vector<unsigned>& targets =
+			op.file == SM4_FILE_RESOURCE ? exec.resource_targets
+										 : exec.uav_targets;
+		if (slot >= bound.size() || slot >= targets.size() ||
+			!bound[slot].data)
+			return 0;
+		target = targets[slot];
+		return &bound[slot];
+	}
+
+	/* the element of a typed resource at integer coordinates, or NULL */
+	static uint32_t* texel(const sm4_exec_resource& res, unsigned target,
+						   const lanes4& coord, unsigned l)
+	{
+		uint32_t x = coord.u[0][l], y = 0;
+		if (target == SM4_TARGET_TEXTURE2D)
+			y = coord.u[1][l];
+		if (x >= res.width || y >= (res.height ? res.height : 1))
+			return 0;
+		return res.data + ((size_t)y * res.width + x) * 4;
+	}
+
+	static int address_texel(int x, int size, bool wrap)
+	{
+		if (wrap)
+		{
+			x %= size;
+			return x < 0 ? x + size : x;
+		}
+		return x < 0 ? 0 : x >= size ? size - 1 : x;
+	}
+
+	void sample(const sm4_exec_resource& res, unsigned target,
+				const sm4_exec_sampler& sampler, const lanes4& coord,
+				lanes4& result)
+	{
+		int width = (int)res.width;
+		int height = target == SM4_TARGET_TEXTURE2D && res.height
+						 ? (int)res.height
+						 : 1;
+		for_lanes(l)
+		{
+			float u = coord.f[0][l] * width;
+			float v = target == SM4_TARGET_TEXTURE2D ? coord.f[1][l] * height
+													 : 0.5f;
+			if (!(active & (1u << l)) || !(u == u) || !(v == v) ||
+				fabsf(u) > 1e9f || fabsf(v) > 1e9f)
+			{
+				for_comps(c) result.u[c][l] = 0;
+				continue;
+			}
+			if (sampler.point)
+			{
+				int x = address_texel((int)floorf(u), width, sampler.wrap);
+				int y = address_texel((int)floorf(v), height, sampler.wrap);
+				const uint32_t* t = res.data + ((size_t)y * width + x) * 4;
+				for_comps(c) result.u[c][l] = t[c];
+				continue;
+			}
+			u -= 0.5f;
+			v -= 0.5f;
+			float x0f = floorf(u), y0f = floorf(v);
+			float fx = u - x0f, fy = v - y0f;
+			int x0 = address_texel((int)x0f, width, sampler.wrap);
+			int x1 = address_texel((int)x0f + 1, width, sampler.wrap);
+			int y0 = address_texel((int)y0f, height, sampler.wrap);
+			int y1 = address_texel((int)y0f + 1, height, sampler.wrap);
+			const uint32_t* t00 = res.data + ((size_t)y0 * width + x0) * 4;
+			const uint32_t* t10 = res.data + ((size_t)y0 * width + x1) * 4;
+			const uint32_t* t01 = res.data + ((size_t)y1 * width + x0) * 4;
+			const uint32_t* t11 = res.data + ((size_t)y1 * width + x1) * 4;
+			for_comps(c)
+			{
+				float top = as_float(t00[c]) +
+							(as_float(t10[c]) - as_float(t00[c])) * fx;
+				float bottom = as_float(t01[c]) +
+							   (as_float(t11[c]) - as_float(t01[c])) * fx;
+				result.f[c][l] = top + (bottom - top) * fy;
+			}
+		}
+	}
+
+	/* the resource operand selects the components of the result */
+	static void swizzle_result(const sm4_op& res, lanes4& value)
+	{
+		if (res.comps != 4 || res.mode != SM4_OPERAND_MODE_SWIZZLE)
+			return;
+		lanes4 v = value;
+		for_comps(c) for_lanes(l) value.u[c][l] = v.u[res.swizzle[c]][l];
+	}
+
+	void resource(const sm4_insn& insn)
+	{
+		const sm4_op* const* ops = insn.ops;
+		lanes4 a, b, result;
+		memset(&result, 0, sizeof(result));
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_SAMPLE:
+		case SM4_OPCODE_SAMPLE_L:
+		case SM4_OPCODE_SAMPLE_B:
+		case SM4_OPCODE_SAMPLE_D:
+		{
+			unsigned target;
+			const sm4_exec_resource* res = typed(*ops[2], target);
+			uint64_t s = (uint64_t)ops[3]->indices[0].disp;
+			sm4_exec_sampler sampler = {false, false};
+			if (s < bindings.samplers.size())
+				sampler = bindings.samplers[s];
+			read(*ops[1], a, FLOAT);
+			if (res && res->width)
+				sample(*res, target, sampler, a, result);
+			swizzle_result(*ops[2], result);
+			write(insn, *ops[0], result);
+			break;
+		}
+		case SM4_OPCODE_LD:
+		case SM4_OPCODE_LD_UAV_TYPED:
+		{
+			unsigned target;
+			const sm4_exec_resource* res = typed(*ops[2], target);
+			read(*ops[1], a, INT);
+			if (res)
+			{
+				for_lanes(l)
+				{
+					/* the mip level, of which there is only one */
+					unsigned mip = target == SM4_TARGET_TEXTURE2D ? 3 : 1;
+					if (insn.opcode == SM4_OPCODE_LD &&
+						target != SM4_TARGET_BUFFER && a.u[mip][l])
+						continue;
+					const uint32_t* t = texel(*res, target, a, l);
+					if (t)
+						for_comps(c) result.u[c][l] = t[c];
+				}
+			}
+			swizzle_result(*ops[2], result);
+			write(insn, *ops[0], result, false);
+			break;
+		}
+		case SM4_OPCODE_STORE_UAV_TYPED:
+		{
+			unsigned target;
+			const sm4_exec_resource* res = typed(*ops[0], target);
+			read(*ops[1], a, INT);
+			read(*ops[2], b, INT);
+			if (!res)
+				break;
+			unsigned mask = write_mask(*ops[0]);
+			for_lanes(l)
+			{
+				uint32_t* t = active & (1u << l) ? texel(*res, target, a, l)
+												 : 0;
+				if (t)
+					for_comps(c) if (mask & (1 << c)) t[c] = b.u[c][l];
+			}
+			break;
+		}
+		case SM4_OPCODE_RESINFO:
+		{
+			unsigned target = SM4_TARGET_UNKNOWN;
+			const sm4_exec_resource* res = typed(*ops[2], target);
+			read(*ops[1], a, INT);
+			uint32_t dims[4] = {0, 0, 0, 0};
+			if (res)
+			{
+				dims[0] = res->width;
+				dims[1] = target == SM4_TARGET_TEXTURE2D ? res->height : 0;
+				dims[3] = 1;
+			}
+			for_lanes(l)
+			{
+				uint32_t mip = a.u[0][l];
+				for_comps(c)
+				{
+					uint32_t d = c < 3 ? (mip ? 0 : dims[c]) : dims[3];
+					switch (insn.insn.resinfo_return_type)
+					{
+					case 0: /* float */
+						result.f[c][l] = (float)d;
+						break;
+					case 1: /* rcpfloat, but for the mip count */
+						result.f[c][l] = c < 3 ? 1.0f / d : (float)d;
+						break;
+					default:
+						result.u[c][l] = d;
+					}
+				}
+			}
+			swizzle_result(*ops[2], result);
+			write(insn, *ops[0], result, false);
+			break;
+		}
+		case SM4_OPCODE_BUFINFO:
+		{
+			memory mem;
+			uint32_t elements = 0;
+			unsigned target;
+			if (memory_of(*ops[1], mem) && (mem.stride || !target_typed(*ops[1])))
+				elements = mem.stride ? mem.size / mem.stride : mem.size;
+			else if (const sm4_exec_resource* res = typed(*ops[1], target))
+				elements = res->width;
+			for_comps(c) for_lanes(l) result.u[c][l] = elements;
+			write(insn, *ops[0], result, false);
+			break;
+		}
+		case SM4_OPCODE_LD_RAW:
+		case SM4_OPCODE_LD_STRUCTURED:
+		{
+			const sm4_op& src = *ops[insn.opcode == SM4_OPCODE_LD_RAW ? 2 : 3];
+			memory mem;
+			if (insn.opcode == SM4_OPCODE_LD_RAW)
+				read(*ops[1], a, INT);
+			else
+			{
+				read(*ops[1], a, INT);
+				read(*ops[2], b, INT);
+				for_lanes(l) a.u[1][l] = b.u[0][l];
+			}
+			if (memory_of(src, mem))
+			{
+				for_lanes(l)
+				{
+					uint32_t addr = address(mem, a, l);
+					for_comps(c)
+					{
+						unsigned s = source_component(src, c);
+						const uint32_t* w = mem.word(addr + s * 4);
+						result.u[c][l] = w ? *w : 0;
+					}
+				}
+			}
+			write(insn, *ops[0], result, false);
+			break;
+		}
+		case SM4_OPCODE_STORE_RAW:
+		case SM4_OPCODE_STORE_STRUCTURED:
+		{
+			const sm4_op& dst = *ops[0];
+			unsigned value_op = insn.opcode == SM4_OPCODE_STORE_RAW ? 2 : 3;
+			memory mem;
+			read(*ops[1], a, INT);
+			if (insn.opcode == SM4_OPCODE_STORE_STRUCTURED)
+			{
+				read(*ops[2], b, INT);
+				for_lanes(l) a.u[1][l] = b.u[0][l];
+			}
+			read(*ops[value_op], b, INT);
+			if (!memory_of(dst, mem))
+				break;
+			unsigned mask = write_mask(dst);
+			for_lanes(l)
+			{
+				if (!(active & (1u << l)))
+					continue;
+				uint32_t addr = address(mem, a, l);
+				for_comps(c)
+				{
+					uint32_t* w = mask & (1 << c) ? mem.word(addr + c * 4) : 0;
+					if (w)
+						*w = b.u[c][l];
+				}
+			}
+			break;
+		}
+		default:
+			atomic(insn);
+			break;
+		}
+	}
+
+	bool target_typed(const sm4_op& op) const
+	{
+		uint64_t slot = (uint64_t)op.indices[0].disp;
+		const std::vector<unsigned>& targets =
+			op.file == SM4_FILE_RESOURCE ? exec.resource_targets
+										 : exec.uav_targets;
+		return op.file != SM4_FILE_THREAD_GROUP_SHARED_MEMORY &&
+			   slot < targets.size() && targets[slot] != SM4_TARGET_RAW_BUFFER &&
+			   targets[slot] != SM4_TARGET_STRUCTURED_BUFFER;
+	}
+
+	/* one lane after the other, in order */
+	void atomic(const sm4_insn& insn)
+	{
+		bool imm = insn.opcode >= SM4_OPCODE_IMM_ATOMIC_ALLOC;
+		unsigned first = imm ? 1 : 0;
+		const sm4_op& dst = *insn.ops[first];
+		lanes4 addr, a, b, result;
+		read(*insn.ops[first + 1], addr, INT);
+		read(*insn.ops[first + 2], a, INT);
+		bool compare = insn.opcode == SM4_OPCODE_ATOMIC_CMP_STORE ||
+					   insn.opcode == SM4_OPCODE_IMM_ATOMIC_CMP_EXCH;
+		if (compare)
+			read(*insn.ops[first + 3], b, INT);
+		memset(&result, 0, sizeof(result));
+
+		memory mem;
+		unsigned target = SM4_TARGET_UNKNOWN;
+		const sm4_exec_resource* res = 0;
+		bool raw = memory_of(dst, mem) && !target_typed(dst);
+		if (!raw)
+			res = typed(dst, target);
+		for_lanes(l)
+		{
+			if (!(active & (1u << l)))
+				continue;
+			uint32_t* w = raw ? mem.word(address(mem, addr, l))
+							  : res ? texel(*res, target, addr, l) : 0;
+			if (!w)
+				continue;
+			result.u[0][l] = *w;
+			*w = atomic_op(insn.opcode, *w, a.u[0][l], compare ? b.u[0][l] : 0);
+		}
+		if (imm)
+		{
+			for (unsigned c = 1; c < 4; ++c)
+				for_lanes(l) result.u[c][l] = result.u[0][l];
+			write(insn, *insn.ops[0], result, false);
+		}
+	}
+
+	/* lanes go by quads of 2 by 2 pixels, in rows; step is 1 across and 2
+	 * down. Coarse derivatives are those of the first row or column of the
+	 * quad, fine ones those of the row or column of the lane. */
+	void derivative(const lanes4& v, lanes4& result, unsigned step,
+					bool fine)
+	{
+		for_lanes(l)
+		{
+			unsigned base = fine ? l & ~step : l & ~3u;
+			for_comps(c) result.f[c][l] =
+				v.f[c][base + step] - v.f[c][base];
+		}
+	}
+
+	void alu(const sm4_insn& insn)
+	{
+		const sm4_op* const* ops = insn.ops;
+		lanes4 a, b, c3, r, r2;
+		unsigned dst = 0;
+		unsigned n = sm4_opcode_descs[insn.opcode].num_dsts;
+
+#define SRC(k, type) read(*ops[n + (k)], k == 0 ? a : k == 1 ? b : c3, type)
+#define FLOAT_OP1(expr)                                                        \
+	SRC(0, FLOAT);                                                             \
+	for_comps(c) for_lanes(l)                                                  \
+	{                                                                          \
+		float x = a.f[c][l];                                                   \
+		r.f[c][l] = (expr);                                                    \
+	}                                                                          \
+	break
+#define FLOAT_OP2(expr)                                                        \
+	SRC(0, FLOAT);                                                             \
+	SRC(1, FLOAT);                                                             \
+	for_comps(c) for_lanes(l)                                                  \
+	{                                                                          \
+		float x = a.f[c][l], y = b.f[c][l];                                    \
+		r.f[c][l] = (expr);                                                    \
+	}                                                                          \
+	break
+#define FLOAT_CMP(expr)                                                        \
+	SRC(0, FLOAT);                                                             \
+	SRC(1, FLOAT);                                                             \
+	for_comps(c) for_lanes(l)                                                  \
+	{                                                                          \
+		float x = a.f[c][l], y = b.f[c][l];                                    \
+		r.u[c][l] = (expr) ? ~0u : 0;                                          \
+	}                                                                          \
+	integer = true;                                                            \
+	break
+#define INT_OP1(expr)                                                          \
+	SRC(0, INT);                                                               \
+	for_comps(c) for_lanes(l)                                                  \
+	{                                                                          \
+		uint32_t x = a.u[c][l];                                                \
+		r.u[c][l] = (expr);                                                    \
+	}                                                                          \
+	integer = true;                                                            \
+	break
+#define INT_OP2(expr)                                                          \
+	SRC(0, INT);                                                               \
+	SRC(1, INT);                                                               \
+	for_comps(c) for_lanes(l)                                                  \
+	{                                                                          \
+		uint32_t x = a.u[c][l], y = b.u[c][l];                                 \
+		r.u[c][l] = (expr);                                                    \
+	}                                                                          \
+	integer = true;                                                            \
+	break
+#define INT_OP3(expr)                                                          \
+	SRC(0, INT);                                                               \
+	SRC(1, INT);                                                               \
+	SRC(2, INT);                                                               \
+	for_comps(c) for_lanes(l)                                                  \
+	{                                                                          \
+		uint32_t x = a.u[c][l], y = b.u[c][l], z = c3.u[c][l];                 \
+		r.u[c][l] = (expr);                                                    \
+	}                                                                          \
+	integer = true;                                                            \
+	break
+
+		bool integer = false;
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_MOV:
+			SRC(0, FLOAT);
+			r = a;
+			/* a plain copy, which may well be of integers */
+			integer = !insn.insn.sat;
+			break;
+		case SM4_OPCODE_MOVC:
+			SRC(0, INT);
+			SRC(1, FLOAT);
+			SRC(2, FLOAT);
+			for_comps(c) for_lanes(l) r.u[c][l] =
+				a.u[c][l] ? b.u[c][l] : c3.u[c][l];
+			integer = !insn.insn.sat;
+			break;
+		case SM4_OPCODE_ADD:
+			FLOAT_OP2(x + y);
+		case SM4_OPCODE_MUL:
+			FLOAT_OP2(x * y);
+		case SM4_OPCODE_DIV:
+			FLOAT_OP2(x / y);
+		case SM4_OPCODE_MIN:
+			FLOAT_OP2(fminf(x, y));
+		case SM4_OPCODE_MAX:
+			FLOAT_OP2(fmaxf(x, y));
+		case SM4_OPCODE_MAD:
+			SRC(0, FLOAT);
+			SRC(1, FLOAT);
+			SRC(2, FLOAT);
+			for_comps(c) for_lanes(l) r.f[c][l] =
+				a.f[c][l] * b.f[c][l] + c3.f[c][l];
+			break;
+		case SM4_OPCODE_DP2:
+		case SM4_OPCODE_DP3:
+		case SM4_OPCODE_DP4:
+		{
+			SRC(0, FLOAT);
+			SRC(1, FLOAT);
+			unsigned num = insn.opcode - SM4_OPCODE_DP2 + 2;
+			for_lanes(l)
+			{
+				float sum = 0.0f;
+				for (unsigned c = 0; c < num; ++c)
+					sum += a.f[c][l] * b.f[c][l];
+				for_comps(c) r.f[c][l] = sum;
+			}
+			break;
+		}
+		case SM4_OPCODE_EQ:
+			FLOAT_CMP(x == y);
+		case SM4_OPCODE_NE:
+			FLOAT_CMP(x != y);
+		case SM4_OPCODE_LT:
+			FLOAT_CMP(x < y);
+		case SM4_OPCODE_GE:
+			FLOAT_CMP(x >= y);
+		case SM4_OPCODE_EXP:
+			FLOAT_OP1(exp2f(x));
+		case SM4_OPCODE_LOG:
+			FLOAT_OP1(log2f(x));
+		case SM4_OPCODE_FRC:
+			FLOAT_OP1(x - floorf(x));
+		case SM4_OPCODE_ROUND_NE:
+			FLOAT_OP1(nearbyintf(x));
+		case SM4_OPCODE_ROUND_NI:
+			FLOAT_OP1(floorf(x));
+		case SM4_OPCODE_ROUND_PI:
+			FLOAT_OP1(ceilf(x));
+		case SM4_OPCODE_ROUND_Z:
+			FLOAT_OP1(truncf(x));
+		case SM4_OPCODE_RSQ:
+			FLOAT_OP1(1.0f / sqrtf(x));
+		case SM4_OPCODE_SQRT:
+			FLOAT_OP1(sqrtf(x));
+		case SM4_OPCODE_RCP:
+			FLOAT_OP1(1.0f / x);
+		case SM4_OPCODE_FTOI:
+			SRC(0, FLOAT);
+			for_comps(c) for_lanes(l) r.i[c][l] = float_to_int(a.f[c][l]);
+			integer = true;
+			break;
+		case SM4_OPCODE_FTOU:
+			SRC(0, FLOAT);
+			for_comps(c) for_lanes(l) r.u[c][l] = float_to_uint(a.f[c][l]);
+			integer = true;
+			break;
+		case SM4_OPCODE_ITOF:
+			SRC(0, INT);
+			for_comps(c) for_lanes(l) r.f[c][l] = (float)a.i[c][l];
+			break;
+		case SM4_OPCODE_UTOF:
+			SRC(0, INT);
+			for_comps(c) for_lanes(l) r.f[c][l] = (float)a.u[c][l];
+			break;
+		case SM4_OPCODE_F32TOF16:
+			SRC(0, FLOAT);
+			for_comps(c) for_lanes(l) r.u[c][l] = f32_to_f16(a.u[c][l]);
+			integer = true;
+			break;
+		case SM4_OPCODE_F16TOF32:
+			SRC(0, INT);
+			for_comps(c) for_lanes(l) r.u[c][l] = f16_to_f32(a.u[c][l]);
+			break;
+		case SM4_OPCODE_DERIV_RTX:
+		case SM4_OPCODE_DERIV_RTX_COARSE:
+		case SM4_OPCODE_DERIV_RTX_FINE:
+		case SM4_OPCODE_DERIV_RTY:
+		case SM4_OPCODE_DERIV_RTY_COARSE:
+		case SM4_OPCODE_DERIV_RTY_FINE:
+		{
+			SRC(0, FLOAT);
+			bool y = insn.opcode == SM4_OPCODE_DERIV_RTY ||
+					 insn.opcode == SM4_OPCODE_DERIV_RTY_COARSE ||
+					 insn.opcode == SM4_OPCODE_DERIV_RTY_FINE;
+			bool fine = insn.opcode == SM4_OPCODE_DERIV_RTX_FINE ||
+						insn.opcode == SM4_OPCODE_DERIV_RTY_FINE;
+			derivative(a, r, y ? 2 : 1, fine);
+			break;
+		}
+		case SM4_OPCODE_SINCOS:
+			SRC(0, FLOAT);
+			for_comps(c) for_lanes(l)
+			{
+				r.f[c][l] = sinf(a.f[c][l]);
+				r2.f[c][l] = cosf(a.f[c][l]);
+			}
+			write(insn, *ops[0], r);
+			write(insn, *ops[1], r2);
+			return;
+
+		case SM4_OPCODE_IADD:
+			INT_OP2(x + y);
+		case SM4_OPCODE_AND:
+			INT_OP2(x & y);
+		case SM4_OPCODE_OR:
+			INT_OP2(x | y);
+		case SM4_OPCODE_XOR:
+			INT_OP2(x ^ y);
+		case SM4_OPCODE_NOT:
+			INT_OP1(~x);
+		case SM4_OPCODE_INEG:
+			INT_OP1(0u - x);
+		case SM4_OPCODE_ISHL:
+			INT_OP2(x << (y & 31));
+		case SM4_OPCODE_ISHR:
+			INT_OP2((uint32_t)((int32_t)x >> (y & 31)));
+		case SM4_OPCODE_USHR:
+			INT_OP2(x >> (y & 31));
+		case SM4_OPCODE_IEQ:
+			INT_OP2(x == y ? ~0u : 0);
+		case SM4_OPCODE_INE:
+			INT_OP2(x != y ? ~0u : 0);
+		case SM4_OPCODE_ILT:
+			INT_OP2((int32_t)x < (int32_t)y ? ~0u : 0);
+		case SM4_OPCODE_IGE:
+			INT_OP2((int32_t)x >= (int32_t)y ? ~0u : 0);
+		case SM4_OPCODE_ULT:
+			INT_OP2(x < y ? ~0u : 0);
+		case SM4_OPCODE_UGE:
+			INT_OP2(x >= y ? ~0u : 0);
+		case SM4_OPCODE_IMAX:
+			INT_OP2((int32_t)x > (int32_t)y ? x : y);
+		case SM4_OPCODE_IMIN:
+			INT_OP2((int32_t)x < (int32_t)y ? x : y);
+		case SM4_OPCODE_UMAX:
+			INT_OP2(x > y ? x : y);
+		case SM4_OPCODE_UMIN:
+			INT_OP2(x < y ? x : y);
+		case SM4_OPCODE_IMAD:
+		case SM4_OPCODE_UMAD:
+			INT_OP3(x * y + z);
+		case SM4_OPCODE_COUNTBITS:
+			INT_OP1(count_bits(x));
+		case SM4_OPCODE_FIRSTBIT_HI:
+			INT_OP1(first_bit_high(x));
+		case SM4_OPCODE_FIRSTBIT_LO:
+			INT_OP1(first_bit_low(x));
+		case SM4_OPCODE_FIRSTBIT_SHI:
+			INT_OP1(first_bit_high((int32_t)x < 0 ? ~x : x));
+		case SM4_OPCODE_UBFE:
+			INT_OP3(bitfield_extract(x, y, z, false));
+		case SM4_OPCODE_IBFE:
+			INT_OP3(bitfield_extract(x, y, z, true));
+		case SM4_OPCODE_BFI:
+		{
+			lanes4 d;
+			SRC(0, INT);
+			SRC(1, INT);
+			SRC(2, INT);
+			read(*ops[n + 3], d, INT);
+			for_comps(c) for_lanes(l) r.u[c][l] = bitfield_insert(
+				a.u[c][l], b.u[c][l], c3.u[c][l], d.u[c][l]);
+			integer = true;
+			break;
+		}
+		case SM4_OPCODE_BFREV:
+			INT_OP1(reverse_bits(x));
+
+		/* two destinations */
+		case SM4_OPCODE_IMUL:
+		case SM4_OPCODE_UMUL:
+			SRC(0, INT);
+			SRC(1, INT);
+			for_comps(c) for_lanes(l)
+			{
+				uint64_t p =
+					insn.opcode == SM4_OPCODE_IMUL
+						? (uint64_t)((int64_t)a.i[c][l] * b.i[c][l])
+						: (uint64_t)a.u[c][l] * b.u[c][l];
+				r.u[c][l] = (uint32_t)(p >> 32);
+				r2.u[c][l] = (uint32_t)p;
+			}
+			write(insn, *ops[0], r, false);
+			write(insn, *ops[1], r2, false);
+			return;
+		case SM4_OPCODE_UDIV:
+			SRC(0, INT);
+			SRC(1, INT);
+			for_comps(c) for_lanes(l)
+			{
+				uint32_t x = a.u[c][l], y = b.u[c][l];
+				r.u[c][l] = y ? x / y : ~0u;
+				r2.u[c][l] = y ? x % y : ~0u;
+			}
+			write(insn, *ops[0], r, false);
+			write(insn, *ops[1], r2, false);
+			return;
+		case SM4_OPCODE_UADDC:
+		case SM4_OPCODE_USUBB:
+			SRC(0, INT);
+			SRC(1, INT);
+			for_comps(c) for_lanes(l)
+			{
+				uint32_t x = a.u[c][l], y = b.u[c][l];
+				bool add = insn.opcode == SM4_OPCODE_UADDC;
+				r.u[c][l] = add ? x + y : x - y;
+				r2.u[c][l] = add ? x + y < x : x < y;
+			}
+			write(insn, *ops[0], r, false);
+			write(insn, *ops[1], r2, false);
+			return;
+		case SM4_OPCODE_SWAPC:
+			SRC(0, INT);
+			SRC(1, FLOAT);
+			SRC(2, FLOAT);
+			for_comps(c) for_lanes(l)
+			{
+				r.u[c][l] = a.u[c][l] ? c3.u[c][l] : b.u[c][l];
+				r2.u[c][l] = a.u[c][l] ? b.u[c][l] : c3.u[c][l];
+			}
+			write(insn, *ops[0], r, false);
+			write(insn, *ops[1], r2, false);
+			return;
+		default:
+			return;
+		}
+		write(insn, *ops[dst], r, !integer);
+
+#undef SRC
+#undef FLOAT_OP1
+#undef FLOAT_OP2
+#undef FLOAT_CMP
+#undef INT_OP1
+#undef INT_OP2
+#undef INT_OP3
+	}
+
+	void start(uint32_t lanes)
+	{
+		size_t num_temps = exec.num_temps;
+		state.temps.resize(num_temps);
+		if (num_temps)
+			memset(state.temps.data(), 0, num_temps * sizeof(sm4_exec_register));
+		state.indexable.resize(exec.num_indexable);
+		if (exec.num_indexable)
+			memset(state.indexable.data(), 0,
+				   exec.num_indexable * sizeof(sm4_exec_register));
+		if (!tgsm)
+		{
+			if (state.tgsm.size() < exec.tgsm_size / 4)
+				state.tgsm.resize(exec.tgsm_size / 4, 0);
+			tgsm = state.tgsm.data();
+		}
+		state.frames.clear();
+
+		alive = lanes & ALL_LANES;
+		set_active(alive);
+		pc = steps = 0;
+	}
+
+	/* runs until the end of the program, or past the next sync if
+	 * stop_at_sync, leaving at_sync set */
+	const char* resume()
+	{
+		unsigned num_insns = (unsigned)program.insns.size();
+		at_sync = false;
+		for (; pc < num_insns; ++steps)
+		{
+			if (steps >= SM4_EXEC_MAX_STEPS)
+				return "Too many instructions executed";
+			const sm4_insn& insn = *program.insns[pc];
+			if (sm4_opcode_costs[insn.opcode].unit == SM4_COST_FLOW_CONTROL ||
+				insn.opcode == SM4_OPCODE_LABEL)
+			{
+				if (insn.opcode == SM4_OPCODE_SYNC)
+				{
+					++pc;
+					/* the other threads of the group catch up */
+					if (stop_at_sync)
+					{
+						at_sync = true;
+						return 0;
+					}
+					continue;
+				}
+				if (!flow_control(insn))
+					break;
+				continue;
+			}
+			++pc;
+			/* nothing to do until a frame ends */
+			if (!active)
+				continue;
+			switch (sm4_opcode_costs[insn.opcode].unit)
+			{
+			case SM4_COST_ALU:
+			case SM4_COST_TRANSCENDENTAL:
+				alu(insn);
+				break;
+			case SM4_COST_SAMPLE:
+			case SM4_COST_LOAD_STORE:
+			case SM4_COST_ATOMIC:
+				resource(insn);
+				break;
+			default:
+				break;
+			}
+		}
+		return error;
+	}
+};
+
+/* what the interpreter knows how to run; resources are checked against
+ * their targets at sm4_exec_init */
+static bool is_supported(unsigned opcode)
+{
+	switch (opcode)
+	{
+	case SM4_OPCODE_SAMPLE_C:
+	case SM4_OPCODE_SAMPLE_C_LZ:
+	case SM4_OPCODE_LD_MS:
+	case SM4_OPCODE_LOD:
+	case SM4_OPCODE_GATHER4:
+	case SM4_OPCODE_GATHER4_C:
+	case SM4_OPCODE_GATHER4_PO:
+	case SM4_OPCODE_GATHER4_PO_C:
+	case SM4_OPCODE_SAMPLE_POS:
+	case SM4_OPCODE_SAMPLE_INFO:
+	case SM4_OPCODE_EMIT:
+	case SM4_OPCODE_EMITTHENCUT:
+	case SM4_OPCODE_CUT:
+	case SM4_OPCODE_EMIT_STREAM:
+	case SM4_OPCODE_CUT_STREAM:
+	case SM4_OPCODE_EMITTHENCUT_STREAM:
+	case SM4_OPCODE_INTERFACE_CALL:
+	case SM4_OPCODE_IMM_ATOMIC_ALLOC:
+	case SM4_OPCODE_IMM_ATOMIC_CONSUME:
+	case SM4_OPCODE_EVAL_SNAPPED:
+	case SM4_OPCODE_EVAL_SAMPLE_INDEX:
+	case SM4_OPCODE_EVAL_CENTROID:
+	case SM4_OPCODE_HS_DECLS:
+	case SM4_OPCODE_HS_CONTROL_POINT_PHASE:
+	case SM4_OPCODE_HS_FORK_PHASE:
+	case SM4_OPCODE_HS_JOIN_PHASE:
+		return false;
+	default:
+		/* no doubles */
+		return opcode < SM4_OPCODE_DADD || opcode > SM4_OPCODE_FTOD;
+	}
+}
+
+/* the operands the interpreter reads */
+static unsigned num_operands(unsigned opcode)
+{
+	switch (opcode)
+	{
+	case SM4_OPCODE_BREAK:
+	case SM4_OPCODE_CONTINUE:
+	case SM4_OPCODE_RET:
+	case SM4_OPCODE_ELSE:
+	case SM4_OPCODE_ENDIF:
+	case SM4_OPCODE_LOOP:
+	case SM4_OPCODE_ENDLOOP:
+	case SM4_OPCODE_ENDSWITCH:
+	case SM4_OPCODE_DEFAULT:
+	case SM4_OPCODE_SYNC:
+	case SM4_OPCODE_NOP:
+		return 0;
+	case SM4_OPCODE_IF:
+	case SM4_OPCODE_BREAKC:
+	case SM4_OPCODE_CONTINUEC:
+	case SM4_OPCODE_RETC:
+	case SM4_OPCODE_DISCARD:
+	case SM4_OPCODE_SWITCH:
+	case SM4_OPCODE_CASE:
+	case SM4_OPCODE_CALL:
+	case SM4_OPCODE_LABEL:
+		return 1;
+	case SM4_OPCODE_ADD:
+	case SM4_OPCODE_MUL:
+	case SM4_OPCODE_DIV:
+	case SM4_OPCODE_MIN:
+	case SM4_OPCODE_MAX:
+	case SM4_OPCODE_DP2:
+	case SM4_OPCODE_DP3:
+	case SM4_OPCODE_DP4:
+	case SM4_OPCODE_EQ:
+	case SM4_OPCODE_NE:
+	case SM4_OPCODE_LT:
+	case SM4_OPCODE_GE:
+	case SM4_OPCODE_IADD:
+	case SM4_OPCODE_AND:
+	case SM4_OPCODE_OR:
+	case SM4_OPCODE_XOR:
+	case SM4_OPCODE_ISHL:
+	case SM4_OPCODE_ISHR:
+	case SM4_OPCODE_USHR:
+	case SM4_OPCODE_IEQ:
+	case SM4_OPCODE_INE:
+	case SM4_OPCODE_ILT:
+	case SM4_OPCODE_IGE:
+	case SM4_OPCODE_ULT:
+	case SM4_OPCODE_UGE:
+	case SM4_OPCODE_IMAX:
+	case SM4_OPCODE_IMIN:
+	case SM4_OPCODE_UMAX:
+	case SM4_OPCODE_UMIN:
+	case SM4_OPCODE_SINCOS:
+	case SM4_OPCODE_LD:
+	case SM4_OPCODE_LD_UAV_TYPED:
+	case SM4_OPCODE_STORE_UAV_TYPED:
+	case SM4_OPCODE_LD_RAW:
+	case SM4_OPCODE_STORE_RAW:
+	case SM4_OPCODE_RESINFO:
+	case SM4_OPCODE_ATOMIC_AND:
+	case SM4_OPCODE_ATOMIC_OR:
+	case SM4_OPCODE_ATOMIC_XOR:
+	case SM4_OPCODE_ATOMIC_IADD:
+	case SM4_OPCODE_ATOMIC_IMAX:
+	case SM4_OPCODE_ATOMIC_IMIN:
+	case SM4_OPCODE_ATOMIC_UMAX:
+	case SM4_OPCODE_ATOMIC_UMIN:
+		return 3;
+	case SM4_OPCODE_MAD:
+	case SM4_OPCODE_MOVC:
+	case SM4_OPCODE_IMAD:
+	case SM4_OPCODE_UMAD:
+	case SM4_OPCODE_UBFE:
+	case SM4_OPCODE_IBFE:
+	case SM4_OPCODE_SAMPLE:
+	case SM4_OPCODE_LD_STRUCTURED:
+	case SM4_OPCODE_STORE_STRUCTURED:
+	case SM4_OPCODE_IMUL:
+	case SM4_OPCODE_UMUL:
+	case SM4_OPCODE_UDIV:
+	case SM4_OPCODE_UADDC:
+	case SM4_OPCODE_USUBB:
+	case SM4_OPCODE_ATOMIC_CMP_STORE:
+	case SM4_OPCODE_IMM_ATOMIC_AND:
+	case SM4_OPCODE_IMM_ATOMIC_OR:
+	case SM4_OPCODE_IMM_ATOMIC_XOR:
+	case SM4_OPCODE_IMM_ATOMIC_EXCH:
+	case SM4_OPCODE_IMM_ATOMIC_IADD:
+	case SM4_OPCODE_IMM_ATOMIC_IMAX:
+	case SM4_OPCODE_IMM_ATOMIC_IMIN:
+	case SM4_OPCODE_IMM_ATOMIC_UMAX:
+	case SM4_OPCODE_IMM_ATOMIC_UMIN:
+		return 4;
+	case SM4_OPCODE_BFI:
+	case SM4_OPCODE_SWAPC:
+	case SM4_OPCODE_SAMPLE_L:
+	case SM4_OPCODE_SAMPLE_B:
+	case SM4_OPCODE_IMM_ATOMIC_CMP_EXCH:
+		return 5;
+	case SM4_OPCODE_SAMPLE_D:
+		return 6;
+	default:
+		/* callc, bufinfo and the unary ones */
+		return 2;
+	}
+}
+
+/* the t#, u# or g# operand a resource instruction accesses, or -1 */
+static int memory_operand(unsigned opcode)
+{
+	switch (sm4_opcode_costs[opcode].unit)
+	{
+	case SM4_COST_SAMPLE:
+	case SM4_COST_LOAD_STORE:
+		break;
+	case SM4_COST_ATOMIC:
+		return opcode >= SM4_OPCODE_IMM_ATOMIC_ALLOC ? 1 : 0;
+	default:
+		return -1;
+	}
+	switch (opcode)
+	{
+	case SM4_OPCODE_STORE_UAV_TYPED:
+	case SM4_OPCODE_STORE_RAW:
+	case SM4_OPCODE_STORE_STRUCTURED:
+		return 0;
+	case SM4_OPCODE_BUFINFO:
+		return 1;
+	case SM4_OPCODE_LD_STRUCTURED:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+static bool is_supported(const sm4_op& op)
+{
+	for (unsigned i = 0; i < op.num_indices && i < 3; ++i)
+	{
+		if (op.indices[i].reg && !is_supported(*op.indices[i].reg))
+			return false;
+	}
+	switch (op.file)
+	{
+	case SM4_FILE_TEMP:
+	case SM4_FILE_INPUT:
+	case SM4_FILE_OUTPUT:
+		return op.num_indices == 1;
+	case SM4_FILE_INDEXABLE_TEMP:
+		return op.num_indices == 2 && op.is_index_simple(0);
+	case SM4_FILE_CONSTANT_BUFFER:
+		return op.num_indices == 2 && op.is_index_simple(0);
+	case SM4_FILE_IMMEDIATE_CONSTANT_BUFFER:
+		return op.num_indices == 1;
+	case SM4_FILE_SAMPLER:
+	case SM4_FILE_RESOURCE:
+	case SM4_FILE_UNORDERED_ACCESS_VIEW:
+	case SM4_FILE_THREAD_GROUP_SHARED_MEMORY:
+	case SM4_FILE_LABEL:
+		return op.num_indices == 1 && op.is_index_simple(0);
+	case SM4_FILE_IMMEDIATE32:
+	case SM4_FILE_NULL:
+	case SM4_FILE_OUTPUT_DEPTH:
+	case SM4_FILE_INPUT_PRIMITIVEID:
+	case SM4_FILE_INPUT_THREAD_ID:
+	case SM4_FILE_INPUT_THREAD_GROUP_ID:
+	case SM4_FILE_INPUT_THREAD_ID_IN_GROUP:
+	case SM4_FILE_INPUT_THREAD_ID_IN_GROUP_FLATTENED:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void grow(std::vector<unsigned>& v, size_t size, unsigned value)
+{
+	if (v.size() < size)
+		v.resize(size, value);
+}
+
+const char* sm4_exec_init(sm4_exec& exec, sm4_program& program)
+{
+	exec = sm4_exec();
+	exec.program = &program;
+	/* vertex, pixel and compute shaders */
+	if (program.version.type != 0 && program.version.type != 1 &&
+		program.version.type != 5)
+		return "Unsupported shader type";
+	if (!sm4_link_cf_insns(program))
+		return "Unbalanced control flow";
+	sm4_find_labels(program);
+
+	for (unsigned i = 0; i < program.dcls.size(); ++i)
+	{
+		const sm4_dcl& dcl = *program.dcls[i];
+		uint64_t slot = dcl.op && dcl.op->num_indices
+							? (uint64_t)dcl.op->indices[0].disp
+							: 0;
+		if (slot >= SM4_MAX_TEMPS)
+			return "Register index out of range";
+		switch (dcl.opcode)
+		{
+		case SM4_OPCODE_DCL_TEMPS:
+			if (dcl.num > SM4_MAX_TEMPS)
+				return "Too many temps";
+			exec.num_temps = std::max(exec.num_temps, dcl.num);
+			break;
+		case SM4_OPCODE_DCL_INDEXABLE_TEMP:
+		{
+			unsigned x = dcl.indexable_temp.index;
+			if (x >= SM4_MAX_TEMPS || dcl.indexable_temp.num > SM4_MAX_TEMPS ||
+				exec.num_indexable + dcl.indexable_temp.num > SM4_MAX_TEMPS)
+				return "Too many temps";
+			grow(exec.indexable_first, x + 1, 0);
+			grow(exec.indexable_size, x + 1, 0);
+			exec.indexable_first[x] = exec.num_indexable;
+			exec.indexable_size[x] = dcl.indexable_temp.num;
+			exec.num_indexable += dcl.indexable_temp.num;
+			break;
+		}
+		case SM4_OPCODE_CUSTOMDATA:
+		{
+			uint32_t token;
+			memcpy(&token, (const sm4_token_instruction*)&dcl, sizeof(token));
+			/* the class of immediate constant buffers */
+			if (token >> 11 == 3)
+			{
+				exec.icb = (const uint32_t*)dcl.data;
+				exec.icb_size = dcl.num / 4;
+			}
+			break;
+		}
+		case SM4_OPCODE_DCL_RESOURCE:
+			grow(exec.resource_targets, slot + 1, SM4_TARGET_UNKNOWN);
+			grow(exec.resource_strides, slot + 1, 0);
+			exec.resource_targets[slot] = dcl.dcl_resource.target;
+			break;
+		case SM4_OPCODE_DCL_RESOURCE_RAW:
+		case SM4_OPCODE_DCL_RESOURCE_STRUCTURED:
+			grow(exec.resource_targets, slot + 1, SM4_TARGET_UNKNOWN);
+			grow(exec.resource_strides, slot + 1, 0);
+			exec.resource_targets[slot] =
+				dcl.opcode == SM4_OPCODE_DCL_RESOURCE_RAW
+					? SM4_TARGET_RAW_BUFFER
+					: SM4_TARGET_STRUCTURED_BUFFER;
+			if (dcl.opcode == SM4_OPCODE_DCL_RESOURCE_STRUCTURED)
+				exec.resource_strides[slot] = dcl.structured.stride;
+			break;
+		case SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_TYPED:
+		case SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_RAW:
+		case SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_STRUCTURED:
+			grow(exec.uav_targets, slot + 1, SM4_TARGET_UNKNOWN);
+			grow(exec.uav_strides, slot + 1, 0);
+			if (dcl.opcode == SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_TYPED)
+				exec.uav_targets[slot] = dcl.dcl_resource.target;
+			else if (dcl.opcode == SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_RAW)
+				exec.uav_targets[slot] = SM4_TARGET_RAW_BUFFER;
+			else
+			{
+				exec.uav_targets[slot] = SM4_TARGET_STRUCTURED_BUFFER;
+				exec.uav_strides[slot] = dcl.structured.stride;
+			}
+			break;
+		case SM4_OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_RAW:
+		case SM4_OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_STRUCTURED:
+		{
+			bool raw =
+				dcl.opcode == SM4_OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_RAW;
+			uint64_t size = raw ? (uint64_t)dcl.words[0]
+								: (uint64_t)dcl.structured.stride *
+									  dcl.structured.count;
+			/* the most a thread group may have */
+			if (size > 32768 || exec.tgsm_size + size > 32768)
+				return "Too much group shared memory";
+			grow(exec.tgsm_offsets, slot + 1, 0);
+			grow(exec.tgsm_sizes, slot + 1, 0);
+			grow(exec.tgsm_strides, slot + 1, 0);
+			exec.tgsm_offsets[slot] = exec.tgsm_size;
+			exec.tgsm_sizes[slot] = (unsigned)size;
+			exec.tgsm_strides[slot] = raw ? 0 : dcl.structured.stride;
+			exec.tgsm_size += ((unsigned)size + 3) & ~3u;
+			break;
+		}
+		case SM4_OPCODE_DCL_THREAD_GROUP:
+			for (unsigned k = 0; k < 3; ++k)
+				exec.thread_group_size[k] = dcl.thread_group_size[k];
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* the loops (true) and switches around each instruction, within its
+	 * function, which breaks and continues leave */
+	std::vector<bool> breakables;
+	for (unsigned i = 0; i < program.insns.size(); ++i)
+	{
+		const sm4_insn& insn = *program.insns[i];
+		exec.error_insn = i;
+		if (!is_supported(insn.opcode))
+			return "Unsupported instruction";
+		switch (insn.opcode)
+		{
+		case SM4_OPCODE_LABEL:
+			breakables.clear();
+			break;
+		case SM4_OPCODE_LOOP:
+		case SM4_OPCODE_SWITCH:
+			breakables.push_back(insn.opcode == SM4_OPCODE_LOOP);
+			break;
+		case SM4_OPCODE_ENDLOOP:
+		case SM4_OPCODE_ENDSWITCH:
+			if (!breakables.empty())
+				breakables.pop_back();
+			break;
+		case SM4_OPCODE_BREAK:
+		case SM4_OPCODE_BREAKC:
+			if (breakables.empty())
+				return "Break outside of a loop or switch";
+			break;
+		case SM4_OPCODE_CONTINUE:
+		case SM4_OPCODE_CONTINUEC:
+			if (std::find(breakables.begin(), breakables.end(), true) ==
+				breakables.end())
+				return "Continue outside of a loop";
+			break;
+		}
+		for (unsigned k = 0; k < insn.num_ops; ++k)
+		{
+			const sm4_op& op = *insn.ops[k];
+			if (!is_supported(op))
+				return "Unsupported operand";
+			if (op.file == SM4_FILE_INDEXABLE_TEMP &&
+				(op.indices[0].disp >= (int64_t)exec.indexable_size.size() ||
+				 !exec.indexable_size[(size_t)op.indices[0].disp]))
+				return "Undeclared indexable temp";
+			if (op.file == SM4_FILE_TEMP && !op.indices[0].reg &&
+				op.indices[0].disp >= exec.num_temps)
+			{
+				if (op.indices[0].disp >= SM4_MAX_TEMPS)
+					return "Too many temps";
+				exec.num_temps = (unsigned)op.indices[0].disp + 1;
+			}
+			if (op.file == SM4_FILE_RESOURCE || op.file == SM4_FILE_UNORDERED_ACCESS_VIEW)
+			{
+				uint64_t slot = (uint64_t)op.indices[0].disp;
+				const std::vector<unsigned>& targets =
+					op.file == SM4_FILE_RESOURCE ? exec.resource_targets
+												 : exec.uav_targets;
+				if (slot >= targets.size() ||
+					targets[slot] == SM4_TARGET_UNKNOWN)
+					return "Undeclared resource";
+				unsigned target = targets[slot];
+				if (target != SM4_TARGET_BUFFER &&
+					target != SM4_TARGET_TEXTURE1D &&
+					target != SM4_TARGET_TEXTURE2D &&
+					target != SM4_TARGET_RAW_BUFFER &&
+					target != SM4_TARGET_STRUCTURED_BUFFER)
+					return "Unsupported resource dimension";
+			}
+			if (op.file == SM4_FILE_THREAD_GROUP_SHARED_MEMORY &&
+				((uint64_t)op.indices[0].disp >= exec.tgsm_sizes.size() ||
+				 !exec.tgsm_sizes[(size_t)op.indices[0].disp]))
+				return "Undeclared group shared memory";
+			if (op.file == SM4_FILE_LABEL)
+			{
+				uint64_t label = (uint64_t)op.indices[0].disp;
+				if (label >= program.label_to_insn_num.size() ||
+					program.label_to_insn_num[label] < 0)
+					return "Call to a missing label";
+			}
+		}
+		if (insn.num_ops < num_operands(insn.opcode))
+			return "Missing operands";
+		int memory = memory_operand(insn.opcode);
+		if (memory >= 0 && memory < (int)insn.num_ops)
+		{
+			unsigned file = insn.ops[memory]->file;
+			if (file != SM4_FILE_RESOURCE &&
+				file != SM4_FILE_UNORDERED_ACCESS_VIEW &&
+				file != SM4_FILE_THREAD_GROUP_SHARED_MEMORY)
+				return "Unsupported memory operand";
+		}
+		if (insn.opcode == SM4_OPCODE_SYNC)
+			exec.uses_sync = true;
+	}
+	exec.error_insn = 0;
+	return 0;
+}
+
+const char* sm4_exec_run(const sm4_exec& exec, sm4_exec_bindings& bindings,
+						 sm4_exec_state& state, uint32_t lanes,
+						 uint32_t* discarded)
+{
+	executor e(exec, bindings, state);
+	e.start(lanes);
+	const char* error = e.resume();
+	if (discarded)
+		*discarded = e.discarded;
+	return error;
+}
+
+/* the ids of the threads of a group from first on, and the lanes they are
+ * run in */
+static uint32_t set_thread_ids(sm4_exec_bindings& bindings,
+							   const unsigned* size, const unsigned* group,
+							   uint64_t threads, uint64_t first)
+{
+	uint32_t lanes = 0;
+	for_lanes(l)
+	{
+		uint64_t t = first + l;
+		if (t >= threads)
+			break;
+		lanes |= 1u << l;
+		uint32_t id[3] = {(uint32_t)(t % size[0]),
+						  (uint32_t)(t / size[0] % size[1]),
+						  (uint32_t)(t / size[0] / size[1])};
+		for (unsigned c = 0; c < 3; ++c)
+		{
+			bindings.thread_id_in_group.c[c][l] = id[c];
+			bindings.thread_group_id.c[c][l] = group[c];
+			bindings.thread_id.c[c][l] = group[c] * size[c] + id[c];
+		}
+		bindings.thread_id_in_group.c[3][l] = 0;
+		bindings.thread_group_id.c[3][l] = 0;
+		bindings.thread_id.c[3][l] = 0;
+		for (unsigned c = 0; c < 4; ++c)
+			bindings.thread_id_in_group_flattened.c[c][l] = (uint32_t)t;
+	}
+	return lanes;
+}
+
+const char* sm4_exec_dispatch(const sm4_exec& exec,
+							  sm4_exec_bindings& bindings,
+							  sm4_exec_state& state, unsigned x, unsigned y,
+							  unsigned z)
+{
+	const unsigned* size = exec.thread_group_size;
+	uint64_t threads = (uint64_t)size[0] * size[1] * size[2];
+	/* the most a thread group may have */
+	if (!threads || threads > 1024)
+		return "Bad thread group size";
+	unsigned num_chunks = (unsigned)((threads + LANES - 1) / LANES);
+
+	/* for groups that synchronize, every chunk of lanes has registers
+	 * and thread ids of its own, and they take turns between syncs */
+	std::vector<sm4_exec_state> states;
+	std::vector<sm4_exec_bindings> chunk_bindings;
+	std::vector<executor> executors;
+	bool lock_step = exec.uses_sync && num_chunks > 1;
+	if (lock_step)
+	{
+		states.resize(num_chunks);
+		chunk_bindings.resize(num_chunks, bindings);
+		executors.reserve(num_chunks);
+		for (unsigned i = 0; i < num_chunks; ++i)
+		{
+			executors.push_back(executor(exec, chunk_bindings[i], states[i]));
+			executors.back().stop_at_sync = true;
+		}
+	}
+
+	unsigned group[3];
+	for (group[2] = 0; group[2] < z; ++group[2])
+	for (group[1] = 0; group[1] < y; ++group[1])
+	for (group[0] = 0; group[0] < x; ++group[0])
+	{
+		state.tgsm.assign(exec.tgsm_size / 4, 0);
+		if (!lock_step)
+		{
+			for (unsigned i = 0; i < num_chunks; ++i)
+			{
+				uint32_t lanes = set_thread_ids(bindings, size, group,
+												threads, (uint64_t)i * LANES);
+				const char* error = sm4_exec_run(exec, bindings, state, lanes);
+				if (error)
+					return error;
+			}
+			continue;
+		}
+
+		for (unsigned i = 0; i < num_chunks; ++i)
+		{
+			executor& e = executors[i];
+			e.tgsm = state.tgsm.data();
+			e.start(set_thread_ids(chunk_bindings[i], size, group, threads,
+								   (uint64_t)i * LANES));
+		}
+		/* until all have run to the end */
+		for (unsigned running = num_chunks; running;)
+		{
+			running = 0;
+			for (unsigned i = 0; i < num_chunks; ++i)
+			{
+				executor& e = executors[i];
+				if (e.steps && !e.at_sync)
+					continue;
+				const char* error = e.resume();
+				if (error)
+					return error;
+				running += e.at_sync;
+			}
+		}
+	}
+	return 0;
+}
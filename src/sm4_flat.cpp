@@ -0,0 +1,282 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "sm4.h"
+
+static void flatten_op(std::vector<sm4_flat_op>& ops, uint32_t slot,
+					   const sm4_op& op)
+{
+	sm4_flat_op f;
+	memset(&f, 0, sizeof(f));
+	f.file = (uint8_t)op.file;
+	f.comps = op.comps;
+	f.mode = op.mode;
+	f.mask = op.mask;
+	f.swizzle = (uint8_t)(op.swizzle[0] | (op.swizzle[1] << 2) |
+						  (op.swizzle[2] << 4) | (op.swizzle[3] << 6));
+	f.num_indices = op.num_indices;
+	f.flags = (op.neg ? SM4_FLAT_OP_NEG : 0) | (op.abs ? SM4_FLAT_OP_ABS : 0);
+	if (op.file == SM4_FILE_IMMEDIATE32 || op.file == SM4_FILE_IMMEDIATE64)
+		memcpy(f.imm_values, op.imm_values, sizeof(f.imm_values));
+	else
+	{
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			f.disp[i] = op.indices[i].disp;
+			f.reg[i] = SM4_FLAT_NONE;
+		}
+	}
+	ops[slot] = f;
+
+	for (unsigned i = 0; i < op.num_indices; ++i)
+	{
+		if (!op.indices[i].reg)
+			continue;
+		uint32_t reg_slot = (uint32_t)ops.size();
+		ops.push_back(sm4_flat_op());
+		flatten_op(ops, reg_slot, *op.indices[i].reg);
+		ops[slot].reg[i] = reg_slot;
+	}
+}
+
+void sm4_flatten(const sm4_program& program, sm4_flat_program& flat)
+{
+	flat.version = program.version;
+	flat.opcodes.clear();
+	flat.num_ops.clear();
+	flat.op_offsets.clear();
+	flat.insn_info.clear();
+	flat.dcls.clear();
+	flat.ops.clear();
+	flat.data.clear();
+	flat.cf_insn_linked = program.cf_insn_linked;
+	flat.labels_found = program.labels_found;
+	flat.label_to_insn_num = program.label_to_insn_num;
+
+	unsigned num_insns = (unsigned)program.insns.size();
+	flat.opcodes.reserve(num_insns);
+	flat.num_ops.reserve(num_insns);
+	flat.op_offsets.reserve(num_insns + 1);
+	flat.insn_info.reserve(num_insns);
+	flat.dcls.reserve(program.dcls.size());
+	flat.ops.reserve(num_insns * 3 + program.dcls.size());
+
+	for (unsigned i = 0; i < program.dcls.size(); ++i)
+	{
+		const sm4_dcl& dcl = *program.dcls[i];
+		sm4_flat_dcl f;
+		f.token = dcl;
+		memcpy(f.payload, &dcl.num, sizeof(f.payload));
+		f.op = SM4_FLAT_NONE;
+		if (dcl.op)
+		{
+			f.op = (uint32_t)flat.ops.size();
+			flat.ops.push_back(sm4_flat_op());
+			flatten_op(flat.ops, f.op, *dcl.op);
+		}
+		f.data_offset = SM4_FLAT_NONE;
+		unsigned data_size = dcl.data_size();
+		if (data_size && dcl.data)
+		{
+			f.data_offset = (uint32_t)flat.data.size();
+			flat.data.insert(flat.data.end(), (const uint32_t*)dcl.data,
+							 (const uint32_t*)dcl.data + data_size);
+		}
+		flat.dcls.push_back(f);
+	}
+
+	for (unsigned i = 0; i < num_insns; ++i)
+	{
+		const sm4_insn& insn = *program.insns[i];
+		flat.opcodes.push_back((uint16_t)insn.opcode);
+		flat.num_ops.push_back((uint8_t)insn.num_ops);
+
+		sm4_flat_insn info;
+		info.token = insn;
+		memcpy(info.sample_offset, insn.sample_offset,
+			   sizeof(info.sample_offset));
+		info.resource_target = insn.resource_target;
+		memcpy(info.resource_return_type, insn.resource_return_type,
+			   sizeof(info.resource_return_type));
+		info.num = insn.num;
+		flat.insn_info.push_back(info);
+
+		/* the instruction's own operands first, then whatever relative
+		 * index registers they pull in */
+		uint32_t first = (uint32_t)flat.ops.size();
+		flat.op_offsets.push_back(first);
+		flat.ops.resize(first + insn.num_ops);
+		for (unsigned j = 0; j < insn.num_ops; ++j)
+			flatten_op(flat.ops, first + j, *insn.ops[j]);
+	}
+	flat.op_offsets.push_back((uint32_t)flat.ops.size());
+}
+
+/* The printers work on sm4_op, sm4_insn and sm4_dcl; rather than having a
+ * second copy of them, pool records are expanded into short-lived nodes,
+ * one declaration or instruction at a time. The nodes of a record are
+ * counted before it is expanded, and the buffer only grows. */
+struct sm4_flat_expander
+{
+	const sm4_flat_op* ops;
+	sm4_op* nodes;
+	unsigned capacity;
+	unsigned used;
+
+	explicit sm4_flat_expander(const sm4_flat_op* ops)
+		: ops(ops), nodes(0), capacity(0), used(0)
+	{
+	}
+
+	~sm4_flat_expander() { delete[] nodes; }
+
+	/* the nodes an operand expands to, relative index registers included */
+	unsigned count(uint32_t index) const
+	{
+		if (index == SM4_FLAT_NONE)
+			return 0;
+		const sm4_flat_op& f = ops[index];
+		unsigned n = 1;
+		if (f.file != SM4_FILE_IMMEDIATE32 && f.file != SM4_FILE_IMMEDIATE64)
+			for (unsigned i = 0; i < f.num_indices; ++i)
+				n += count(f.reg[i]);
+		return n;
+	}
+
+	void start(unsigned num_nodes)
+	{
+		used = 0;
+		if (num_nodes <= capacity)
+			return;
+		delete[] nodes;
+		nodes = new sm4_op[num_nodes];
+		capacity = num_nodes;
+	}
+
+	sm4_op* expand(uint32_t index)
+	{
+		if (index == SM4_FLAT_NONE)
+			return 0;
+		const sm4_flat_op& f = ops[index];
+		sm4_op& op = nodes[used++];
+		op = sm4_op();
+		op.file = (sm4_file)f.file;
+		op.comps = f.comps;
+		op.mode = f.mode;
+		op.mask = f.mask;
+		for (unsigned i = 0; i < 4; ++i)
+			op.swizzle[i] = (uint8_t)f.swizzle_comp(i);
+		op.num_indices = f.num_indices;
+		op.neg = !!(f.flags & SM4_FLAT_OP_NEG);
+		op.abs = !!(f.flags & SM4_FLAT_OP_ABS);
+		if (f.file == SM4_FILE_IMMEDIATE32 || f.file == SM4_FILE_IMMEDIATE64)
+			memcpy(op.imm_values, f.imm_values, sizeof(op.imm_values));
+		else
+		{
+			for (unsigned i = 0; i < f.num_indices; ++i)
+			{
+				op.indices[i].disp = f.disp[i];
+				op.indices[i].reg = expand(f.reg[i]);
+			}
+		}
+		return &op;
+	}
+};
+
+text_writer& sm4_dump(text_writer& out, const sm4_image& program,
+					  const sm4_dump_options& options)
+{
+	out << (program.version.type < 6 ? "pvghdc"[program.version.type] : '?')
+		<< "s_" << program.version.major
+		<< "_" << program.version.minor << '\n';
+	sm4_flat_expander expander(program.ops);
+	for (unsigned i = 0; i < program.num_dcls; ++i)
+	{
+		const sm4_flat_dcl& f = program.dcls[i];
+		expander.start(expander.count(f.op));
+		sm4_dcl dcl;
+		(sm4_token_instruction&)dcl = f.token;
+		memcpy(&dcl.num, f.payload, sizeof(f.payload));
+		dcl.op = expander.expand(f.op);
+		if (f.data_offset != SM4_FLAT_NONE)
+			dcl.data = (void*)&program.data[f.data_offset];
+		sm4_dump(out, dcl, options);
+		out << '\n';
+	}
+
+	int indent = 0;
+	for (unsigned i = 0; i < program.num_insns; ++i)
+	{
+		const sm4_flat_insn& info = program.insn_info[i];
+		sm4_insn insn;
+		(sm4_token_instruction&)insn = info.token;
+		memcpy(insn.sample_offset, info.sample_offset,
+			   sizeof(insn.sample_offset));
+		insn.resource_target = info.resource_target;
+		memcpy(insn.resource_return_type, info.resource_return_type,
+			   sizeof(insn.resource_return_type));
+		insn.num = info.num;
+		insn.num_ops = program.num_ops[i];
+		unsigned num_nodes = 0;
+		for (unsigned j = 0; j < insn.num_ops; ++j)
+			num_nodes += expander.count(program.op_offsets[i] + j);
+		expander.start(num_nodes);
+		for (unsigned j = 0; j < insn.num_ops; ++j)
+			insn.ops[j] = expander.expand(program.op_offsets[i] + j);
+
+		int new_indent = insn.indents();
+		if (new_indent < 0)
+			indent += new_indent;
+		/* unbalanced in malformed programs */
+		if (indent > 0)
+			out.spaces(options.indent_width * indent);
+		sm4_dump(out, insn, options);
+		out << '\n';
+		if (new_indent > 0)
+			indent += new_indent;
+	}
+	return out;
+}
+
+text_writer& sm4_dump(text_writer& out, const sm4_flat_program& program,
+					  const sm4_dump_options& options)
+{
+	sm4_image image;
+	image.init(program);
+	return sm4_dump(out, image, options);
+}
+
+text_writer& operator<<(text_writer& out, const sm4_flat_program& program)
+{
+	return sm4_dump(out, program, sm4_dump_options());
+}
+
+std::ostream& operator<<(std::ostream& out, const sm4_flat_program& program)
+{
+	text_writer writer(out);
+	writer << program;
+	return out;
+}
@@ -0,0 +1,287 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "sm4.h"
+
+static_assert(sizeof(sm4_token_version) == 4, "sm4_token_version is a token");
+static_assert(sizeof(sm4_token_instruction) == 4,
+			  "sm4_token_instruction is a token");
+static_assert(sizeof(sm4_flat_dcl) == 28, "the image layout changed");
+static_assert(sizeof(sm4_flat_insn) == 16, "the image layout changed");
+static_assert(sizeof(sm4_flat_op) == 48, "the image layout changed");
+static_assert(sizeof(sm4_image_header) == 24 + 8 * SM4_IMAGE_SECTION_COUNT,
+			  "the image layout changed");
+
+static const size_t section_record_sizes[SM4_IMAGE_SECTION_COUNT] = {
+	sizeof(sm4_flat_dcl), sizeof(sm4_flat_insn), sizeof(uint16_t),
+	sizeof(uint8_t),	  sizeof(uint32_t),		 sizeof(sm4_flat_op),
+	sizeof(uint32_t),	  sizeof(int32_t),		 sizeof(int32_t),
+};
+
+static size_t align8(size_t size) { return (size + 7) & ~(size_t)7; }
+
+std::pair<void*, size_t> sm4_image_assemble(const sm4_flat_program& program)
+{
+	struct
+	{
+		const void* data;
+		size_t count;
+	} sections[SM4_IMAGE_SECTION_COUNT] = {
+		{program.dcls.data(), program.dcls.size()},
+		{program.insn_info.data(), program.insn_info.size()},
+		{program.opcodes.data(), program.opcodes.size()},
+		{program.num_ops.data(), program.num_ops.size()},
+		{program.op_offsets.data(), program.op_offsets.size()},
+		{program.ops.data(), program.ops.size()},
+		{program.data.data(), program.data.size()},
+		{program.cf_insn_linked.data(), program.cf_insn_linked.size()},
+		{program.label_to_insn_num.data(), program.label_to_insn_num.size()},
+	};
+
+	size_t size = sizeof(sm4_image_header);
+	for (unsigned i = 0; i < SM4_IMAGE_SECTION_COUNT; ++i)
+		size = align8(size) + sections[i].count * section_record_sizes[i];
+	size = align8(size);
+	if (size > 0xffffffffu)
+		return std::make_pair((void*)0, (size_t)0);
+
+	/* zeroed, so that the padding between sections is deterministic */
+	char* image = (char*)calloc(1, size);
+	if (!image)
+		return std::make_pair((void*)0, (size_t)0);
+
+	sm4_image_header& header = *(sm4_image_header*)image;
+	header.magic = SM4_IMAGE_MAGIC;
+	header.format_version = SM4_IMAGE_FORMAT_VERSION;
+	header.byte_order = SM4_IMAGE_BYTE_ORDER;
+	header.size = (uint32_t)size;
+	header.flags = program.labels_found ? SM4_IMAGE_LABELS_FOUND : 0;
+	header.version = program.version;
+
+	size_t offset = sizeof(sm4_image_header);
+	for (unsigned i = 0; i < SM4_IMAGE_SECTION_COUNT; ++i)
+	{
+		offset = align8(offset);
+		size_t bytes = sections[i].count * section_record_sizes[i];
+		header.sections[i].offset = (uint32_t)offset;
+		header.sections[i].count = (uint32_t)sections[i].count;
+		if (bytes)
+			memcpy(image + offset, sections[i].data, bytes);
+		offset += bytes;
+	}
+	return std::make_pair((void*)image, size);
+}
+
+void sm4_image::init(const sm4_flat_program& program)
+{
+	version = program.version;
+	labels_found = program.labels_found;
+	dcls = program.dcls.data();
+	num_dcls = (unsigned)program.dcls.size();
+	insn_info = program.insn_info.data();
+	opcodes = program.opcodes.data();
+	num_ops = program.num_ops.data();
+	op_offsets = program.op_offsets.data();
+	num_insns = program.num_insns();
+	ops = program.ops.data();
+	num_pool_ops = (unsigned)program.ops.size();
+	data = program.data.data();
+	data_size = (unsigned)program.data.size();
+	cf_insn_linked = program.cf_insn_linked.empty()
+						 ? 0
+						 : (const int32_t*)program.cf_insn_linked.data();
+	label_to_insn_num = (const int32_t*)program.label_to_insn_num.data();
+	num_labels = (unsigned)program.label_to_insn_num.size();
+}
+
+/* operands may only refer to relative index registers stored after them,
+ * which also rules out cycles */
+static bool check_op(const sm4_flat_op& op, uint32_t index, uint32_t pool_size)
+{
+	if (op.file >= SM4_FILE_COUNT || op.comps > 4 || op.num_indices > 3)
+		return false;
+	if (op.file == SM4_FILE_IMMEDIATE32 || op.file == SM4_FILE_IMMEDIATE64)
+		return true;
+	for (unsigned i = 0; i < op.num_indices; ++i)
+	{
+		if (op.reg[i] != SM4_FLAT_NONE &&
+			(op.reg[i] <= index || op.reg[i] >= pool_size))
+			return false;
+	}
+	return true;
+}
+
+/* marks a pool operand as referred to, false if it already was */
+static bool claim_op(std::vector<bool>& claimed, uint32_t index)
+{
+	if (claimed[index])
+		return false;
+	claimed[index] = true;
+	return true;
+}
+
+static bool check_insn_num(int32_t num, unsigned num_insns)
+{
+	return num >= -1 && num < (int32_t)num_insns;
+}
+
+const char* sm4_image::init(const void* image, size_t size)
+{
+	*this = sm4_image();
+
+	/* the records are read in place */
+	if ((uintptr_t)image & 7)
+		return "Image is misaligned";
+	if (size < sizeof(sm4_image_header))
+		return "Image is truncated";
+	const sm4_image_header& header = *(const sm4_image_header*)image;
+	/* an image from the other byte order has its magic swapped too */
+	if (header.magic != SM4_IMAGE_MAGIC && header.byte_order != 0x04030201u)
+		return "Not a SM4 image";
+	if (header.byte_order != SM4_IMAGE_BYTE_ORDER)
+		return "Image has the byte order of another host";
+	if (header.format_version != SM4_IMAGE_FORMAT_VERSION)
+		return "Unsupported image format version";
+	if (header.size > size || header.size < sizeof(sm4_image_header))
+		return "Image is truncated";
+
+	const void* sections[SM4_IMAGE_SECTION_COUNT];
+	for (unsigned i = 0; i < SM4_IMAGE_SECTION_COUNT; ++i)
+	{
+		uint32_t offset = header.sections[i].offset;
+		uint64_t bytes =
+			(uint64_t)header.sections[i].count * section_record_sizes[i];
+		if ((offset & 7) || offset < sizeof(sm4_image_header) ||
+			offset > header.size || bytes > header.size - offset)
+			return "Section exceeds the image";
+		sections[i] = (const char*)image + offset;
+	}
+
+	unsigned insns = header.sections[SM4_IMAGE_INSN_INFO].count;
+	if (header.sections[SM4_IMAGE_OPCODES].count != insns ||
+		header.sections[SM4_IMAGE_NUM_OPS].count != insns ||
+		header.sections[SM4_IMAGE_OP_OFFSETS].count != insns + 1 ||
+		(header.sections[SM4_IMAGE_CF_LINKS].count &&
+		 header.sections[SM4_IMAGE_CF_LINKS].count != insns))
+		return "Instruction arrays differ in length";
+
+	const sm4_flat_insn* info =
+		(const sm4_flat_insn*)sections[SM4_IMAGE_INSN_INFO];
+	const uint16_t* codes = (const uint16_t*)sections[SM4_IMAGE_OPCODES];
+	const uint8_t* counts = (const uint8_t*)sections[SM4_IMAGE_NUM_OPS];
+	const uint32_t* offsets = (const uint32_t*)sections[SM4_IMAGE_OP_OFFSETS];
+	const sm4_flat_op* pool = (const sm4_flat_op*)sections[SM4_IMAGE_OPS];
+	uint32_t pool_size = header.sections[SM4_IMAGE_OPS].count;
+	for (unsigned i = 0; i < insns; ++i)
+	{
+		if (codes[i] >= SM4_OPCODE_COUNT || info[i].token.opcode != codes[i])
+			return "Bad instruction opcode";
+		if (counts[i] > SM4_MAX_OPS || offsets[i] > offsets[i + 1] ||
+			counts[i] > offsets[i + 1] - offsets[i])
+			return "Bad instruction operands";
+	}
+	if (offsets[insns] > pool_size)
+		return "Bad instruction operands";
+	for (uint32_t i = 0; i < pool_size; ++i)
+	{
+		if (!check_op(pool[i], i, pool_size))
+			return "Bad operand";
+	}
+
+	const sm4_flat_dcl* decls = (const sm4_flat_dcl*)sections[SM4_IMAGE_DCLS];
+	uint32_t words = header.sections[SM4_IMAGE_DATA].count;
+	for (unsigned i = 0; i < header.sections[SM4_IMAGE_DCLS].count; ++i)
+	{
+		const sm4_flat_dcl& f = decls[i];
+		if (f.token.opcode >= SM4_OPCODE_COUNT)
+			return "Bad declaration opcode";
+		if (f.op != SM4_FLAT_NONE && f.op >= pool_size)
+			return "Bad declaration operand";
+		sm4_dcl dcl;
+		(sm4_token_instruction&)dcl = f.token;
+		memcpy(&dcl.num, f.payload, sizeof(f.payload));
+		unsigned needed = dcl.data_size();
+		if (needed && (f.data_offset == SM4_FLAT_NONE ||
+					   f.data_offset > words || needed > words - f.data_offset))
+			return "Declaration data exceeds the image";
+	}
+
+	/* every operand belongs to a single declaration or instruction, as
+	 * sm4_flatten lays them out, so that expanding them all for printing
+	 * takes no more nodes than the pool has */
+	std::vector<bool> claimed(pool_size);
+	for (unsigned i = 0; i < insns; ++i)
+	{
+		for (unsigned j = 0; j < counts[i]; ++j)
+			if (!claim_op(claimed, offsets[i] + j))
+				return "Bad instruction operands";
+	}
+	for (unsigned i = 0; i < header.sections[SM4_IMAGE_DCLS].count; ++i)
+	{
+		if (decls[i].op != SM4_FLAT_NONE && !claim_op(claimed, decls[i].op))
+			return "Bad declaration operand";
+	}
+	for (uint32_t i = 0; i < pool_size; ++i)
+	{
+		const sm4_flat_op& op = pool[i];
+		if (op.file == SM4_FILE_IMMEDIATE32 || op.file == SM4_FILE_IMMEDIATE64)
+			continue;
+		for (unsigned k = 0; k < op.num_indices; ++k)
+			if (op.reg[k] != SM4_FLAT_NONE && !claim_op(claimed, op.reg[k]))
+				return "Bad operand";
+	}
+
+	const int32_t* links = (const int32_t*)sections[SM4_IMAGE_CF_LINKS];
+	for (unsigned i = 0; i < header.sections[SM4_IMAGE_CF_LINKS].count; ++i)
+	{
+		if (!check_insn_num(links[i], insns))
+			return "Bad control flow link";
+	}
+	const int32_t* labels = (const int32_t*)sections[SM4_IMAGE_LABELS];
+	for (unsigned i = 0; i < header.sections[SM4_IMAGE_LABELS].count; ++i)
+	{
+		if (!check_insn_num(labels[i], insns))
+			return "Bad label";
+	}
+
+	version = header.version;
+	labels_found = !!(header.flags & SM4_IMAGE_LABELS_FOUND);
+	dcls = decls;
+	num_dcls = header.sections[SM4_IMAGE_DCLS].count;
+	insn_info = info;
+	opcodes = codes;
+	num_ops = counts;
+	op_offsets = offsets;
+	num_insns = insns;
+	ops = pool;
+	num_pool_ops = pool_size;
+	data = (const uint32_t*)sections[SM4_IMAGE_DATA];
+	data_size = words;
+	cf_insn_linked = header.sections[SM4_IMAGE_CF_LINKS].count ? links : 0;
+	label_to_insn_num = labels;
+	num_labels = header.sections[SM4_IMAGE_LABELS].count;
+	return 0;
+}
@@ -0,0 +1,80 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Uniform access to the instructions of the program representations, so
+ * that the analysis passes are written once */
+
+#ifndef SM4_INSNS_H_
+#define SM4_INSNS_H_
+
+#include "sm4.h"
+
+/* sm4_program and sm4_flat_program only differ in how the instructions are
+ * reached; the passes are written against these accessors */
+struct sm4_program_insns
+{
+	const sm4_program& program;
+
+	unsigned size() const { return (unsigned)program.insns.size(); }
+
+	unsigned opcode(unsigned i) const { return program.insns[i]->opcode; }
+
+	/* the index of operand n of instruction i, if it is a label */
+	bool label_index(unsigned i, unsigned& idx, unsigned n = 0) const
+	{
+		if (program.insns[i]->num_ops <= n)
+			return false;
+		const sm4_op& op = *program.insns[i]->ops[n];
+		if (op.file != SM4_FILE_LABEL || !op.has_simple_index())
+			return false;
+		idx = (unsigned)op.indices[0].disp;
+		return true;
+	}
+};
+
+struct sm4_flat_program_insns
+{
+	const sm4_flat_program& program;
+
+	unsigned size() const { return program.num_insns(); }
+
+	unsigned opcode(unsigned i) const { return program.opcodes[i]; }
+
+	bool label_index(unsigned i, unsigned& idx, unsigned n = 0) const
+	{
+		if (program.num_ops[i] <= n)
+			return false;
+		const sm4_flat_op& op = program.insn_ops(i)[n];
+		if (op.file != SM4_FILE_LABEL || op.num_indices != 1 ||
+			op.reg[0] != SM4_FLAT_NONE || op.disp[0] < 0 ||
+			(int64_t)(int32_t)op.disp[0] != op.disp[0])
+			return false;
+		idx = (unsigned)op.disp[0];
+		return true;
+	}
+};
+
+#endif /* SM4_INSNS_H_ */
@@ -0,0 +1,530 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Backward dataflow over the blocks of a sm4_cfg, with one bit per temp
+ * component, and the register pressure it implies */
+
+#include "sm4.h"
+#include <algorithm>
+#include <vector>
+
+static inline unsigned count_bits(uint64_t v)
+{
+	v = v - ((v >> 1) & 0x5555555555555555ull);
+	v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+	v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (unsigned)((v * 0x0101010101010101ull) >> 56);
+}
+
+/* registers with at least one live component among the 16 of a word */
+static inline unsigned count_registers(uint64_t v)
+{
+	return count_bits((v | (v >> 1) | (v >> 2) | (v >> 3)) &
+					  0x1111111111111111ull);
+}
+
+/* the components of count consecutive registers an operand touches */
+struct sm4_access
+{
+	uint32_t first_reg;
+	uint32_t num_regs;
+	uint8_t mask;
+	bool write;
+	/* a write known to replace the components, ending their lifetime */
+	bool kills;
+};
+
+struct liveness_builder
+{
+	const sm4_program& program;
+	const sm4_cfg& cfg;
+	sm4_liveness& liveness;
+	/* by x#, index in liveness.arrays or -1 */
+	std::vector<int> array_of_index;
+	std::vector<sm4_access> accesses;
+	const char* error;
+
+	liveness_builder(const sm4_program& program, const sm4_cfg& cfg,
+					 sm4_liveness& liveness)
+		: program(program), cfg(cfg), liveness(liveness), error(0)
+	{
+	}
+
+	static uint8_t read_mask(const sm4_op& op)
+	{
+		if (!op.comps)
+			return 0;
+		if (op.comps == 1)
+			return 1;
+		if (op.mode == SM4_OPERAND_MODE_MASK)
+			return op.mask;
+		return (uint8_t)((1 << op.swizzle[0]) | (1 << op.swizzle[1]) |
+						 (1 << op.swizzle[2]) | (1 << op.swizzle[3]));
+	}
+
+	static uint8_t write_mask(const sm4_op& op)
+	{
+		if (!op.comps)
+			return 0;
+		return op.comps == 1 ? 1 : op.mask;
+	}
+
+	void add(uint32_t first_reg, uint32_t num_regs, uint8_t mask, bool write,
+			 bool kills)
+	{
+		if (!mask || !num_regs)
+			return;
+		sm4_access a = {first_reg, num_regs, mask, write, kills};
+		accesses.push_back(a);
+	}
+
+	void collect(const sm4_op& op, bool write)
+	{
+		for (unsigned i = 0; i < op.num_indices && i < 3; ++i)
+		{
+			if (op.indices[i].reg)
+				collect(*op.indices[i].reg, false);
+		}
+		uint8_t mask = write ? write_mask(op) : read_mask(op);
+		if (op.file == SM4_FILE_TEMP && op.num_indices == 1)
+		{
+			if (op.indices[0].reg)
+				add(0, liveness.num_temps, mask, write, false);
+			else if (op.is_index_simple(0) &&
+					 op.indices[0].disp < liveness.num_temps)
+				add((uint32_t)op.indices[0].disp, 1, mask, write, true);
+			else
+				error = "Temp index out of range";
+		}
+		else if (op.file == SM4_FILE_INDEXABLE_TEMP && op.num_indices == 2)
+		{
+			if (!op.is_index_simple(0) ||
+				op.indices[0].disp >= (int64_t)array_of_index.size() ||
+				array_of_index[(size_t)op.indices[0].disp] < 0)
+			{
+				error = "Undeclared indexable temp";
+				return;
+			}
+			const sm4_liveness_array& array =
+				liveness.arrays[array_of_index[(size_t)op.indices[0].disp]];
+			uint32_t first = array.first_slot / 4;
+			if (op.indices[1].reg)
+				add(first, array.size, mask, write, false);
+			else if (op.indices[1].disp >= 0 &&
+					 op.indices[1].disp < array.size)
+				add(first + (uint32_t)op.indices[1].disp, 1, mask, write,
+					true);
+			else
+				error = "Indexable temp element out of range";
+		}
+	}
+
+	void collect(const sm4_insn& insn)
+	{
+		accesses.clear();
+		unsigned num_dsts = sm4_opcode_descs[insn.opcode].num_dsts;
+		for (unsigned i = 0; i < insn.num_ops; ++i)
+			collect(*insn.ops[i], i < num_dsts);
+	}
+
+	bool layout()
+	{
+		unsigned num_temps = 0;
+		array_of_index.clear();
+		for (unsigned i = 0; i < program.dcls.size(); ++i)
+		{
+			const sm4_dcl& dcl = *program.dcls[i];
+			if (dcl.opcode == SM4_OPCODE_DCL_TEMPS)
+			{
+				if (dcl.num > SM4_MAX_TEMPS)
+					return fail("Too many temps");
+				num_temps = std::max(num_temps, dcl.num);
+			}
+			else if (dcl.opcode == SM4_OPCODE_DCL_INDEXABLE_TEMP)
+			{
+				unsigned index = dcl.indexable_temp.index;
+				unsigned size = dcl.indexable_temp.num;
+				if (index >= SM4_MAX_TEMPS || size > SM4_MAX_TEMPS)
+					return fail("Too many temps");
+				if (index >= array_of_index.size())
+					array_of_index.resize(index + 1, -1);
+				/* every phase of a hull shader has its own */
+				int a = array_of_index[index];
+				if (a < 0)
+				{
+					sm4_liveness_array array = {index, 0, size};
+					array_of_index[index] = (int)liveness.arrays.size();
+					liveness.arrays.push_back(array);
+				}
+				else if (liveness.arrays[a].size < size)
+					liveness.arrays[a].size = size;
+			}
+		}
+
+		/* fxc declares all it uses, but nothing checks that */
+		for (unsigned i = 0; i < program.insns.size(); ++i)
+		{
+			const sm4_insn& insn = *program.insns[i];
+			for (unsigned k = 0; k < insn.num_ops; ++k)
+			{
+				const sm4_op& op = *insn.ops[k];
+				if (op.file == SM4_FILE_TEMP && op.num_indices == 1 &&
+					op.is_index_simple(0))
+				{
+					if (op.indices[0].disp >= SM4_MAX_TEMPS)
+						return fail("Temp index out of range");
+					num_temps =
+						std::max(num_temps, (unsigned)op.indices[0].disp + 1);
+				}
+			}
+		}
+
+		unsigned num_regs = num_temps;
+		for (unsigned a = 0; a < liveness.arrays.size(); ++a)
+		{
+			liveness.arrays[a].first_slot = num_regs * 4;
+			num_regs += liveness.arrays[a].size;
+		}
+		if (num_regs > SM4_MAX_TEMPS)
+			return fail("Too many temps");
+		liveness.num_temps = num_temps;
+		liveness.num_slots = num_regs * 4;
+		liveness.words_per_set = (liveness.num_slots + 63) / 64;
+		return true;
+	}
+
+	bool fail(const char* message)
+	{
+		error = message;
+		return false;
+	}
+
+	void apply(uint64_t* set, const sm4_access& a, bool value)
+	{
+		for (uint32_t r = a.first_reg; r < a.first_reg + a.num_regs; ++r)
+		{
+			uint64_t bits = (uint64_t)a.mask << ((r * 4) & 63);
+			if (value)
+				set[(r * 4) >> 6] |= bits;
+			else
+				set[(r * 4) >> 6] &= ~bits;
+		}
+	}
+
+	/* live = (live - killed) + used, for the accesses collected */
+	void step(uint64_t* live)
+	{
+		for (unsigned k = 0; k < accesses.size(); ++k)
+		{
+			if (accesses[k].kills)
+				apply(live, accesses[k], false);
+		}
+		for (unsigned k = 0; k < accesses.size(); ++k)
+		{
+			if (!accesses[k].write)
+				apply(live, accesses[k], true);
+		}
+	}
+
+	bool run()
+	{
+		liveness.arrays.clear();
+		if (!layout())
+			return false;
+
+		unsigned n = cfg.num_blocks();
+		unsigned words = liveness.words_per_set;
+		size_t total = (size_t)n * words;
+		std::vector<uint64_t> gen(total, 0), kill(total, 0);
+		liveness.live_in.assign(total, 0);
+		liveness.live_out.assign(total, 0);
+
+		/* what every block uses before writing it, and what it replaces */
+		for (unsigned b = 0; b < cfg.num_real_blocks; ++b)
+		{
+			uint64_t* g = gen.data() + (size_t)b * words;
+			uint64_t* k = kill.data() + (size_t)b * words;
+			for (unsigned i = cfg.block_start[b + 1]; i-- > cfg.block_start[b];)
+			{
+				collect(*program.insns[i]);
+				if (error)
+					return false;
+				step(g);
+				for (unsigned a = 0; a < accesses.size(); ++a)
+				{
+					if (accesses[a].kills)
+						apply(k, accesses[a], true);
+				}
+			}
+		}
+
+		/* the extra edges through the subroutines: from a call to the
+		 * entries of its callees, and from their exits back to the block
+		 * following the call */
+		std::vector<std::vector<uint32_t>> extra(n);
+		for (unsigned c = 0; c < cfg.calls.size(); ++c)
+		{
+			const sm4_cfg_call& call = cfg.calls[c];
+			if (!cfg.num_succs(call.block))
+				continue;
+			uint32_t after = cfg.block_succs(call.block)[0];
+			for (unsigned f = 0; f < cfg.functions.size(); ++f)
+			{
+				if (call.callee == SM4_CFG_NONE
+						? cfg.functions[f].kind != SM4_CFG_SUBROUTINE
+						: call.callee != f)
+					continue;
+				extra[call.block].push_back(cfg.functions[f].entry);
+				extra[cfg.functions[f].exit].push_back(after);
+			}
+		}
+
+		std::vector<uint64_t> out(words);
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+			for (unsigned b = n; b-- > 0;)
+			{
+				for (unsigned w = 0; w < words; ++w)
+					out[w] = 0;
+				const uint32_t* succs = cfg.block_succs(b);
+				for (unsigned s = 0; s < cfg.num_succs(b); ++s)
+				{
+					const uint64_t* in = liveness.block_live_in(succs[s]);
+					for (unsigned w = 0; w < words; ++w)
+						out[w] |= in[w];
+				}
+				for (unsigned s = 0; s < extra[b].size(); ++s)
+				{
+					const uint64_t* in = liveness.block_live_in(extra[b][s]);
+					for (unsigned w = 0; w < words; ++w)
+						out[w] |= in[w];
+				}
+				uint64_t* live_out = liveness.live_out.data() + (size_t)b * words;
+				uint64_t* live_in = liveness.live_in.data() + (size_t)b * words;
+				const uint64_t* g = gen.data() + (size_t)b * words;
+				const uint64_t* k = kill.data() + (size_t)b * words;
+				for (unsigned w = 0; w < words; ++w)
+				{
+					uint64_t in = g[w] | (out[w] & ~k[w]);
+					if (in != live_in[w] || out[w] != live_out[w])
+						changed = true;
+					live_out[w] = out[w];
+					live_in[w] = in;
+				}
+			}
+		}
+
+		pressure();
+		return true;
+	}
+
+	void pressure()
+	{
+		unsigned n = cfg.num_blocks();
+		unsigned words = liveness.words_per_set;
+		unsigned num_insns = (unsigned)program.insns.size();
+		liveness.insn_components.assign(num_insns, 0);
+		liveness.insn_registers.assign(num_insns, 0);
+		liveness.block_max_components.assign(n, 0);
+		liveness.functions.clear();
+		liveness.functions.resize(cfg.functions.size());
+		for (unsigned f = 0; f < cfg.functions.size(); ++f)
+		{
+			sm4_liveness_function& function = liveness.functions[f];
+			function.declared_temps = 0;
+			function.max_components = 0;
+			function.max_registers = 0;
+		}
+		liveness.max_components = liveness.max_registers = 0;
+		liveness.peak_insns.clear();
+
+		std::vector<uint64_t> live(words), across(words);
+		for (unsigned b = 0; b < cfg.num_real_blocks; ++b)
+		{
+			const uint64_t* out = liveness.block_live_out(b);
+			live.assign(out, out + words);
+			unsigned block_max = 0;
+			for (unsigned i = cfg.block_start[b + 1]; i-- > cfg.block_start[b];)
+			{
+				collect(*program.insns[i]);
+				across = live;
+				for (unsigned a = 0; a < accesses.size(); ++a)
+					apply(across.data(), accesses[a], true);
+				unsigned components = 0, registers = 0;
+				for (unsigned w = 0; w < words; ++w)
+				{
+					components += count_bits(across[w]);
+					registers += count_registers(across[w]);
+				}
+				liveness.insn_components[i] = components;
+				liveness.insn_registers[i] = registers;
+				block_max = std::max(block_max, components);
+				step(live.data());
+
+				sm4_liveness_function& function =
+					liveness.functions[cfg.block_function[b]];
+				function.max_components =
+					std::max(function.max_components, components);
+				function.max_registers =
+					std::max(function.max_registers, registers);
+			}
+			liveness.block_max_components[b] = block_max;
+		}
+
+		for (unsigned i = 0; i < num_insns; ++i)
+		{
+			liveness.max_registers =
+				std::max(liveness.max_registers, liveness.insn_registers[i]);
+			if (liveness.insn_components[i] > liveness.max_components)
+			{
+				liveness.max_components = liveness.insn_components[i];
+				liveness.peak_insns.clear();
+			}
+			if (liveness.insn_components[i] == liveness.max_components &&
+				liveness.max_components)
+				liveness.peak_insns.push_back(i);
+		}
+
+		/* declarations belong to the function of the instruction following
+		 * them */
+		for (unsigned i = 0; i < program.dcls.size(); ++i)
+		{
+			const sm4_dcl& dcl = *program.dcls[i];
+			if (dcl.opcode != SM4_OPCODE_DCL_TEMPS)
+				continue;
+			unsigned f = 0;
+			while (f + 1 < cfg.functions.size() &&
+				   cfg.functions[f + 1].first_insn <= dcl.insn_num)
+				++f;
+			liveness.functions[f].declared_temps = dcl.num;
+		}
+	}
+};
+
+const char* sm4_compute_liveness(const sm4_program& program,
+								 const sm4_cfg& cfg, sm4_liveness& liveness)
+{
+	if (cfg.insn_block.size() != program.insns.size())
+		return "Control flow graph of another program";
+	liveness_builder builder(program, cfg, liveness);
+	if (!builder.run())
+		return builder.error;
+	return 0;
+}
+
+static void dump_live(text_writer& out, const sm4_liveness& liveness,
+					  const uint64_t* set)
+{
+	static const char comps[] = "xyzw";
+	unsigned array = 0;
+	bool any = false;
+	for (unsigned reg = 0; reg < liveness.num_slots / 4; ++reg)
+	{
+		unsigned mask = (unsigned)(set[(reg * 4) >> 6] >> ((reg * 4) & 63)) & 15;
+		if (!mask)
+			continue;
+		any = true;
+		out << ' ';
+		if (reg < liveness.num_temps)
+			out << 'r' << reg;
+		else
+		{
+			while (liveness.arrays[array].first_slot / 4 +
+					   liveness.arrays[array].size <=
+				   reg)
+				++array;
+			const sm4_liveness_array& a = liveness.arrays[array];
+			out << 'x' << a.index << '[' << reg - a.first_slot / 4 << ']';
+		}
+		out << '.';
+		for (unsigned c = 0; c < 4; ++c)
+		{
+			if (mask & (1 << c))
+				out << comps[c];
+		}
+	}
+	if (!any)
+		out << " -";
+}
+
+text_writer& sm4_dump(text_writer& out, const sm4_program& program,
+					  const sm4_cfg& cfg, const sm4_liveness& liveness,
+					  const sm4_dump_options& options)
+{
+	out << "// temps: at most " << liveness.max_registers << " registers, "
+		<< liveness.max_components << " components live";
+	if (!liveness.peak_insns.empty())
+		out << ", first peak at insn " << liveness.peak_insns[0] << " of "
+			<< (unsigned)liveness.peak_insns.size();
+	out << '\n';
+	for (unsigned f = 0; f < liveness.functions.size(); ++f)
+	{
+		const sm4_liveness_function& function = liveness.functions[f];
+		out << "// function " << f << ": " << function.declared_temps
+			<< " temps declared, at most " << function.max_registers
+			<< " registers, " << function.max_components
+			<< " components live\n";
+	}
+
+	out << (program.version.type < 6 ? "pvghdc"[program.version.type] : '?')
+		<< "s_" << program.version.major << "_" << program.version.minor
+		<< '\n';
+	for (unsigned i = 0; i < program.dcls.size(); ++i)
+	{
+		sm4_dump(out, *program.dcls[i], options);
+		out << '\n';
+	}
+
+	int indent = 0;
+	for (unsigned i = 0; i < program.insns.size(); ++i)
+	{
+		unsigned b = cfg.insn_block[i];
+		if (cfg.block_start[b] == i)
+		{
+			out << "// block " << b << ", at most "
+				<< liveness.block_max_components[b]
+				<< " components live, live in:";
+			dump_live(out, liveness, liveness.block_live_in(b));
+			out << '\n';
+		}
+		int new_indent = program.insns[i]->indents();
+		if (new_indent < 0)
+			indent += new_indent;
+		if (indent > 0)
+			out.spaces(options.indent_width * indent);
+		sm4_dump(out, *program.insns[i], options);
+		out << " // " << liveness.insn_registers[i] << " registers, "
+			<< liveness.insn_components[i] << " components";
+		if (liveness.insn_components[i] == liveness.max_components &&
+			liveness.max_components)
+			out << ", peak";
+		out << '\n';
+		if (new_indent > 0)
+			indent += new_indent;
+	}
+	return out;
+}
@@ -0,0 +1,217 @@
+/* Generated by defs/gen-opcode-descs.sh from defs/opcode_descs.txt, do not edit */
+
+#include "sm4.h"
+
+const sm4_opcode_desc sm4_opcode_descs[] = {
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // add
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // and
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // break
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // breakc
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // call
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // callc
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // case
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // continue
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // continuec
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // cut
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // default
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // deriv_rtx
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // deriv_rty
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // discard
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // div
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dp2
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dp3
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dp4
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // else
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // emit
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // emitthencut
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // endif
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // endloop
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // endswitch
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // eq
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // exp
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // frc
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ftoi
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ftou
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ge
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // iadd
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // if
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ieq
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ige
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ilt
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // imad
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // imax
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // imin
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imul
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ine
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ineg
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ishl
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ishr
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // itof
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // label
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ld
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ld_ms
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // log
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // loop
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // lt
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // mad
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // min
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // max
+	{SM4_OPCODE_KIND_CUSTOMDATA, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // customdata
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // mov
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // movc
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // mul
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ne
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // nop
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // not
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // or
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // resinfo
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // ret
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // retc
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // round_ne
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // round_ni
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // round_pi
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // round_z
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // rsq
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sample
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sample_c
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sample_c_lz
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sample_l
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sample_d
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sample_b
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sqrt
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // switch
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // sincos
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // udiv
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ult
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // uge
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // umul
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // umad
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // umax
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // umin
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ushr
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // utof
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // xor
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_resource
+	{SM4_OPCODE_KIND_DCL, 1, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_constant_buffer
+	{SM4_OPCODE_KIND_DCL, 1, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_sampler
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_index_range
+	{SM4_OPCODE_KIND_DCL, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_gs_output_primitive_topology
+	{SM4_OPCODE_KIND_DCL, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_gs_input_primitive
+	{SM4_OPCODE_KIND_DCL, 0, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_max_output_vertex_count
+	{SM4_OPCODE_KIND_DCL, 1, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_input
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_SV, 0}, // dcl_input_sgv
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_SV, 0}, // dcl_input_siv
+	{SM4_OPCODE_KIND_DCL, 1, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_input_ps
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_SV, 0}, // dcl_input_ps_sgv
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_SV, 0}, // dcl_input_ps_siv
+	{SM4_OPCODE_KIND_DCL, 1, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_output
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_SV, 0}, // dcl_output_sgv
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_SV, 0}, // dcl_output_siv
+	{SM4_OPCODE_KIND_DCL, 0, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_temps
+	{SM4_OPCODE_KIND_DCL, 0, 3, SM4_DCL_LAYOUT_INDEXABLE_TEMP, 0}, // dcl_indexable_temp
+	{SM4_OPCODE_KIND_DCL, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_global_flags
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // d3d10_count
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // lod
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // gather4
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sample_pos
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // sample_info
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // d3d10_1_count
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // hs_decls
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // hs_control_point_phase
+	{SM4_OPCODE_KIND_PHASE, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // hs_fork_phase
+	{SM4_OPCODE_KIND_PHASE, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // hs_join_phase
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // emit_stream
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // cut_stream
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // emitthencut_stream
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // interface_call
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // bufinfo
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // deriv_rtx_coarse
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // deriv_rtx_fine
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // deriv_rty_coarse
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // deriv_rty_fine
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // gather4_c
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // gather4_po
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // gather4_po_c
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // rcp
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // f32tof16
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // f16tof32
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // uaddc
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // usubb
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // countbits
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // firstbit_hi
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // firstbit_lo
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // firstbit_shi
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ubfe
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ibfe
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // bfi
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // bfrev
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // swapc
+	{SM4_OPCODE_KIND_DCL, 1, 0, SM4_DCL_LAYOUT_UNHANDLED, 0}, // dcl_stream
+	{SM4_OPCODE_KIND_DCL, 0, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_function_body
+	{SM4_OPCODE_KIND_DCL, 0, 2, SM4_DCL_LAYOUT_FUNCTION_TABLE, 0}, // dcl_function_table
+	{SM4_OPCODE_KIND_DCL, 0, 3, SM4_DCL_LAYOUT_INTERFACE, 0}, // dcl_interface
+	{SM4_OPCODE_KIND_DCL, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_input_control_point_count
+	{SM4_OPCODE_KIND_DCL, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_output_control_point_count
+	{SM4_OPCODE_KIND_DCL, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_tess_domain
+	{SM4_OPCODE_KIND_DCL, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_tess_partitioning
+	{SM4_OPCODE_KIND_DCL, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_tess_output_primitive
+	{SM4_OPCODE_KIND_DCL, 0, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_hs_max_tessfactor
+	{SM4_OPCODE_KIND_DCL, 0, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_hs_fork_phase_instance_count
+	{SM4_OPCODE_KIND_DCL, 0, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_hs_join_phase_instance_count
+	{SM4_OPCODE_KIND_DCL, 0, 3, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_thread_group
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_unordered_access_view_typed
+	{SM4_OPCODE_KIND_DCL, 1, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_unordered_access_view_raw
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_unordered_access_view_structured
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_thread_group_shared_memory_raw
+	{SM4_OPCODE_KIND_DCL, 1, 2, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_thread_group_shared_memory_structured
+	{SM4_OPCODE_KIND_DCL, 1, 0, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_resource_raw
+	{SM4_OPCODE_KIND_DCL, 1, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_resource_structured
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ld_uav_typed
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // store_uav_typed
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ld_raw
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // store_raw
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ld_structured
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // store_structured
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_and
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_or
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_xor
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_cmp_store
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_iadd
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_imax
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_imin
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_umax
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // atomic_umin
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_alloc
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_consume
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_iadd
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_and
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_or
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_xor
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_exch
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_cmp_exch
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_imax
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_imin
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_umax
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 2}, // imm_atomic_umin
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 0}, // sync
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dadd
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dmax
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dmin
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dmul
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // deq
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dge
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dlt
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dne
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dmov
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dmovc
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // dtof
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // ftod
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // eval_snapped
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // eval_sample_index
+	{SM4_OPCODE_KIND_INSN, 0, 0, SM4_DCL_LAYOUT_WORDS, 1}, // eval_centroid
+	{SM4_OPCODE_KIND_DCL, 0, 1, SM4_DCL_LAYOUT_WORDS, 0}, // dcl_gs_instance_count
+};
+
+static_assert(sizeof(sm4_opcode_descs) / sizeof(sm4_opcode_descs[0]) ==
+				  SM4_OPCODE_COUNT,
+			  "opcode_descs.txt is out of sync with opcodes.txt");
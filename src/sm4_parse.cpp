@@ -27,45 +27,84 @@
 #include "sm4.h"
 #include "utils.h"
 
-#if 1
-#define check(x) assert(x)
-#define fail(x) assert(0 && (x))
-#else
-#define check(x)                                                               \
+const char* sm4_parse_error_names[] = {
+	"No error",
+	"Program is truncated",
+	"Invalid instruction length",
+	"Invalid opcode",
+	"Operands do not match the instruction length",
+	"Invalid operand",
+	"Too many operands",
+	"Unhandled declaration",
+	"Invalid declaration",
+	"No such declaration or instruction",
+	"Too many extended instruction tokens",
+};
+
+#define check(x, code)                                                         \
 	do                                                                         \
 	{                                                                          \
 		if (!(x))                                                              \
-			throw(#x);                                                         \
+			throw(sm4_parse_error_code)(code);                                 \
 	} while (0)
-#define fail(x) throw(x)
-#endif
+#define fail(code) throw(sm4_parse_error_code)(code)
+
+/* operands of one declaration or instruction, relative index registers
+ * included */
+#define SM4_PARSER_MAX_OPS 32
+
+/* The operand tokens are read without a bounds check on every token.
+ * Instead, the length of each instruction is validated against the program
+ * once, and read_op checks against the end of the instruction whenever it
+ * starts or finishes an operand: in between, it reads at most 16 tokens
+ * (operand and extended tokens, three 64-bit indices, four 64-bit
+ * immediates). So an instruction can be decoded in place as long as that
+ * many tokens follow it in the program; the last ones are decoded from a
+ * zero padded copy instead.
+ */
+#define SM4_PARSER_SLACK 16
+#define SM4_PARSER_MAX_INSN_LENGTH 127
 
 struct sm4_parser
 {
 	unsigned* tokens;
 	unsigned* tokens_end;
-	sm4_program& program;
-
-	sm4_parser(sm4_program& program, void* p_tokens, unsigned size)
-		: program(program)
+	unsigned* program;
+	sm4_visitor& visitor;
+
+	/* the declaration or instruction being decoded, for error reports */
+	unsigned* insn_start;
+	unsigned insn_opcode;
+	/* its end, which operands must not cross */
+	unsigned* limit;
+	unsigned padded[SM4_PARSER_MAX_INSN_LENGTH + SM4_PARSER_SLACK];
+
+	/* the nodes handed to the visitor are decoded in place here */
+	unsigned num_ops;
+	union
 	{
-		tokens = (unsigned*)p_tokens;
-		tokens_end = (unsigned*)((char*)p_tokens + size);
-	}
+		int64_t align;
+		char bytes[sizeof(sm4_op) * SM4_PARSER_MAX_OPS];
+	} op_storage;
 
-	uint32_t read32()
+	sm4_parser(sm4_visitor& visitor, const void* p_tokens, unsigned size)
+		: visitor(visitor), insn_start(0), insn_opcode(SM4_OPCODE_COUNT),
+		  num_ops(0)
 	{
-		check(tokens < tokens_end);
-		return bswap_le32(*tokens++);
+		program = tokens = (unsigned*)p_tokens;
+		tokens_end = tokens + size / sizeof(uint32_t);
+		limit = tokens_end;
 	}
 
-	float read32f()
+	sm4_op* alloc_op()
 	{
-		check(tokens < tokens_end);
-		uint32_t u32 = bswap_le32(*tokens++);
-		return *reinterpret_cast<float*>(&u32);
+		check(num_ops < SM4_PARSER_MAX_OPS, SM4_PARSE_TOO_MANY_OPERANDS);
+		return new (op_storage.bytes + sizeof(sm4_op) * num_ops++) sm4_op();
 	}
 
+	/* unchecked, see SM4_PARSER_SLACK */
+	uint32_t read32() { return bswap_le32(*tokens++); }
+
 	template <typename T> void read_token(T* tok)
 	{
 		*(unsigned*)tok = read32();
@@ -78,14 +117,20 @@ struct sm4_parser
 		return (uint64_t)a | ((uint64_t)b << 32);
 	}
 
-	void skip(unsigned toskip) { tokens += toskip; }
+	void skip(unsigned toskip)
+	{
+		check(tokens <= limit && toskip <= (unsigned)(limit - tokens),
+			  SM4_PARSE_LENGTH_MISMATCH);
+		tokens += toskip;
+	}
 
 	void read_op(sm4_op* pop)
 	{
+		check(tokens < limit, SM4_PARSE_LENGTH_MISMATCH);
 		sm4_op& op = *pop;
 		sm4_token_operand optok;
 		read_token(&optok);
-		assert(optok.file < SM4_FILE_COUNT);
+		check(optok.file < SM4_FILE_COUNT, SM4_PARSE_BAD_OPERAND);
 		op.token = optok;
 		op.has_extended_token = false;
 		op.swizzle[0] = 0;
@@ -123,7 +168,7 @@ struct sm4_parser
 			}
 			break;
 		case SM4_OPERAND_COMPNUM_N:
-			fail("Unhandled operand component type");
+			fail(SM4_PARSE_BAD_OPERAND);
 		}
 		op.file = (sm4_file)optok.file;
 		op.num_indices = optok.num_indices;
@@ -143,7 +188,7 @@ struct sm4_parser
 				op.abs = optokext.abs;
 			}
 			else
-				fail("Unhandled extended operand token type");
+				fail(SM4_PARSE_BAD_OPERAND);
 		}
 
 		for (unsigned i = 0; i < op.num_indices; ++i)
@@ -156,7 +201,7 @@ struct sm4_parser
 			else if (i == 2)
 				repr = optok.index2_repr;
 			else
-				fail("Unhandled operand index representation");
+				fail(SM4_PARSE_BAD_OPERAND);
 			op.indices[i].disp = 0;
 			// TODO: is disp supposed to be signed here??
 			switch (repr)
@@ -169,8 +214,8 @@ struct sm4_parser
 				break;
 			case SM4_OPERAND_INDEX_REPR_REG:
 			relative:
-				op.indices[i].reg.reset(new sm4_op());
-				read_op(&*op.indices[i].reg);
+				op.indices[i].reg = alloc_op();
+				read_op(op.indices[i].reg);
 				break;
 			case SM4_OPERAND_INDEX_REPR_REG_IMM32:
 				op.indices[i].disp = (int32_t)read32();
@@ -178,6 +223,8 @@ struct sm4_parser
 			case SM4_OPERAND_INDEX_REPR_REG_IMM64:
 				op.indices[i].disp = read64();
 				goto relative;
+			default:
+				fail(SM4_PARSE_BAD_OPERAND);
 			}
 		}
 
@@ -191,274 +238,263 @@ struct sm4_parser
 			for (unsigned i = 0; i < op.comps; ++i)
 				op.imm_values[i].i64 = read64();
 		}
+		check(tokens <= limit, SM4_PARSE_LENGTH_MISMATCH);
 	}
 
-	void do_parse()
+	/* returns false if the visitor asked to stop */
+	bool do_parse()
 	{
-		read_token(&program.version);
+		check(tokens_end - tokens >= 2, SM4_PARSE_TRUNCATED);
+		sm4_token_version version;
+		read_token(&version);
+		if (!visitor.visit_version(version))
+			return false;
 
 		unsigned lentok = read32();
-		tokens_end = tokens - 2 + lentok;
+		check(lentok >= 2 && lentok <= (unsigned)(tokens_end - program),
+			  SM4_PARSE_TRUNCATED);
+		tokens_end = program + lentok;
 
 		while (tokens != tokens_end)
 		{
-			sm4_token_instruction insntok;
-			read_token(&insntok);
-			unsigned* insn_end = tokens - 1 + insntok.length;
-			sm4_opcode opcode = (sm4_opcode)insntok.opcode;
-			check(opcode < SM4_OPCODE_COUNT);
+			if (!parse_one())
+				return false;
+		}
+		return true;
+	}
 
-			if (opcode == SM4_OPCODE_CUSTOMDATA)
-			{
-				// immediate constant buffer data
-				unsigned customlen = read32() - 2;
+	/* decodes the declaration or instruction at tokens */
+	bool parse_one()
+	{
+		insn_start = tokens;
+		insn_opcode = SM4_OPCODE_COUNT;
+		unsigned remaining = (unsigned)(tokens_end - tokens);
+		sm4_token_instruction insntok;
+		read_token(&insntok);
+		sm4_opcode opcode = (sm4_opcode)insntok.opcode;
+		insn_opcode = opcode;
+		check(opcode < SM4_OPCODE_COUNT, SM4_PARSE_BAD_OPCODE);
+		num_ops = 0;
+
+		const sm4_opcode_desc& desc = sm4_opcode_descs[opcode];
+		if (desc.kind == SM4_OPCODE_KIND_CUSTOMDATA)
+		{
+			// immediate constant buffer data
+			check(remaining >= 2, SM4_PARSE_BAD_LENGTH);
+			unsigned length = read32();
+			check(length >= 2 && length <= remaining, SM4_PARSE_BAD_LENGTH);
+
+			sm4_dcl dcl;
+			/* the rest of the token is the class of the data */
+			(sm4_token_instruction&)dcl = insntok;
+			dcl.num = length - 2;
+			dcl.data = tokens;
+
+			tokens = insn_start + length;
+			return visitor.visit_dcl(dcl);
+		}
 
-				sm4_dcl& dcl = *new sm4_dcl;
-				program.dcls.push_back(&dcl);
+		unsigned length = insntok.length;
+		check(length && length <= remaining, SM4_PARSE_BAD_LENGTH);
+		unsigned* next = insn_start + length;
+		if (remaining - length < SM4_PARSER_SLACK)
+		{
+			memcpy(padded, insn_start, length * sizeof(uint32_t));
+			memset(padded + length, 0, SM4_PARSER_SLACK * sizeof(uint32_t));
+			tokens = padded + (tokens - insn_start);
+			limit = padded + length;
+		}
+		else
+			limit = next;
+		unsigned* decoded = tokens - 1;
 
-				dcl.opcode = SM4_OPCODE_CUSTOMDATA;
-				dcl.num = customlen;
-				dcl.data = malloc(customlen * sizeof(tokens[0]));
+		if (desc.kind == SM4_OPCODE_KIND_PHASE)
+		{
+			// need to interleave these with the declarations or we cannot
+			// assign fork/join phase instance counts to phases
+			sm4_dcl dcl;
+			dcl.opcode = opcode;
+			if (!visitor.visit_dcl(dcl))
+				return false;
+		}
 
-				memcpy(dcl.data, &tokens[0], customlen * sizeof(tokens[0]));
+		if (desc.kind == SM4_OPCODE_KIND_DCL)
+		{
+			sm4_dcl dcl;
+			(sm4_token_instruction&)dcl = insntok;
 
-				skip(customlen);
-				continue;
+			sm4_token_instruction_extended exttok;
+			memcpy(&exttok, &insntok, sizeof(exttok));
+			while (exttok.extended)
+			{
+				check(tokens < limit, SM4_PARSE_LENGTH_MISMATCH);
+				check(dcl.num_extended < SM4_MAX_EXTENDED_TOKENS,
+					  SM4_PARSE_TOO_MANY_EXTENDED);
+				read_token(&exttok);
+				memcpy(&dcl.extended[dcl.num_extended++], &exttok,
+					   sizeof(exttok));
 			}
 
-			if (opcode == SM4_OPCODE_HS_FORK_PHASE ||
-				opcode == SM4_OPCODE_HS_JOIN_PHASE)
+			if (desc.num_ops)
 			{
-				// need to interleave these with the declarations or we cannot
-				// assign fork/join phase instance counts to phases
-				sm4_dcl& dcl = *new sm4_dcl;
-				program.dcls.push_back(&dcl);
-				dcl.opcode = opcode;
+				dcl.op = alloc_op();
+				read_op(dcl.op);
 			}
 
-			if ((opcode >= SM4_OPCODE_DCL_RESOURCE &&
-				 opcode <= SM4_OPCODE_DCL_GLOBAL_FLAGS) ||
-				(opcode >= SM4_OPCODE_DCL_STREAM &&
-				 opcode <= SM4_OPCODE_DCL_RESOURCE_STRUCTURED))
+			switch (desc.layout)
 			{
-				sm4_dcl& dcl = *new sm4_dcl;
-				program.dcls.push_back(&dcl);
-				(sm4_token_instruction&)dcl = insntok;
-
-				sm4_token_instruction_extended exttok;
-				memcpy(&exttok, &insntok, sizeof(exttok));
-				while (exttok.extended)
+			case SM4_DCL_LAYOUT_WORDS:
+				for (unsigned i = 0; i < desc.num_words; ++i)
+					dcl.words[i] = read32();
+				break;
+			case SM4_DCL_LAYOUT_SV:
+				/* verbatim, the upper half is reserved */
+				dcl.words[0] = read32();
+				break;
+			case SM4_DCL_LAYOUT_INDEXABLE_TEMP:
+				dcl.indexable_temp.index = read32();
+				dcl.indexable_temp.num = read32();
+				dcl.indexable_temp.comps = read32();
+				break;
+			case SM4_DCL_LAYOUT_FUNCTION_TABLE:
+				dcl.function_table.id = read32();
+				dcl.function_table.num = read32();
+				dcl.data = insn_start + (tokens - decoded);
+				skip(dcl.function_table.num);
+				break;
+			case SM4_DCL_LAYOUT_INTERFACE:
+				dcl.intf.id = read32();
+				dcl.intf.expected_function_table_length = read32();
 				{
-					read_token(&exttok);
+					uint32_t v = read32();
+					dcl.intf.table_length = v & 0xffff;
+					dcl.intf.array_length = v >> 16;
 				}
+				dcl.data = insn_start + (tokens - decoded);
+				skip(dcl.intf.table_length);
+				break;
+			default:
+				/* TODO: dcl_stream is undocumented: what is it? */
+				fail(SM4_PARSE_UNHANDLED_DCL);
+			}
 
-#define READ_OP_ANY                                                            \
-	dcl.op.reset(new sm4_op());                                                \
-	read_op(&*dcl.op);
-#define READ_OP(FILE) READ_OP_ANY
-				//check(dcl.op->file == SM4_FILE_##FILE);
+			if (opcode == SM4_OPCODE_DCL_INDEX_RANGE)
+				check(dcl.op->file == SM4_FILE_INPUT ||
+						  dcl.op->file == SM4_FILE_OUTPUT,
+					  SM4_PARSE_BAD_DCL);
 
-				switch (opcode)
-				{
-				case SM4_OPCODE_DCL_GLOBAL_FLAGS:
-					break;
-				case SM4_OPCODE_DCL_RESOURCE:
-					READ_OP(RESOURCE);
-					read_token(&dcl.rrt);
-					break;
-				case SM4_OPCODE_DCL_SAMPLER:
-					READ_OP(SAMPLER);
-					break;
-				case SM4_OPCODE_DCL_INPUT:
-				case SM4_OPCODE_DCL_INPUT_PS:
-					READ_OP(INPUT);
-					break;
-				case SM4_OPCODE_DCL_INPUT_SIV:
-				case SM4_OPCODE_DCL_INPUT_SGV:
-				case SM4_OPCODE_DCL_INPUT_PS_SIV:
-				case SM4_OPCODE_DCL_INPUT_PS_SGV:
-					READ_OP(INPUT);
-					dcl.sv = (sm4_sv)(uint16_t)read32();
-					break;
-				case SM4_OPCODE_DCL_OUTPUT:
-					READ_OP(OUTPUT);
-					break;
-				case SM4_OPCODE_DCL_OUTPUT_SIV:
-				case SM4_OPCODE_DCL_OUTPUT_SGV:
-					READ_OP(OUTPUT);
-					dcl.sv = (sm4_sv)(uint16_t)read32();
-					break;
-				case SM4_OPCODE_DCL_INDEX_RANGE:
-					READ_OP_ANY;
-					check(dcl.op->file == SM4_FILE_INPUT ||
-						  dcl.op->file == SM4_FILE_OUTPUT);
-					dcl.num = read32();
-					break;
-				case SM4_OPCODE_DCL_TEMPS:
-					dcl.num = read32();
-					break;
-				case SM4_OPCODE_DCL_INDEXABLE_TEMP:
-					dcl.indexable_temp.index = read32();
-					dcl.indexable_temp.num = read32();
-					dcl.indexable_temp.comps = read32();
-					break;
-				case SM4_OPCODE_DCL_CONSTANT_BUFFER:
-					READ_OP(CONSTANT_BUFFER);
-					break;
-				case SM4_OPCODE_DCL_GS_INPUT_PRIMITIVE:
-				case SM4_OPCODE_DCL_GS_OUTPUT_PRIMITIVE_TOPOLOGY:
-					break;
-				case SM4_OPCODE_DCL_MAX_OUTPUT_VERTEX_COUNT:
-					dcl.num = read32();
-					break;
-				case SM4_OPCODE_DCL_GS_INSTANCE_COUNT:
-					dcl.num = read32();
-					break;
-				case SM4_OPCODE_DCL_INPUT_CONTROL_POINT_COUNT:
-				case SM4_OPCODE_DCL_OUTPUT_CONTROL_POINT_COUNT:
-				case SM4_OPCODE_DCL_TESS_DOMAIN:
-				case SM4_OPCODE_DCL_TESS_PARTITIONING:
-				case SM4_OPCODE_DCL_TESS_OUTPUT_PRIMITIVE:
-					break;
-				case SM4_OPCODE_DCL_HS_MAX_TESSFACTOR:
-					dcl.f32 = read32f();
-					break;
-				case SM4_OPCODE_DCL_HS_FORK_PHASE_INSTANCE_COUNT:
-					dcl.num = read32();
-					break;
-				case SM4_OPCODE_DCL_FUNCTION_BODY:
-					dcl.num = read32();
-					break;
-				case SM4_OPCODE_DCL_FUNCTION_TABLE:
-					dcl.function_table.id = read32();
-					dcl.function_table.num = read32();
-					dcl.data =
-						malloc(dcl.function_table.num * sizeof(uint32_t));
-					for (unsigned i = 0; i < dcl.function_table.num; ++i)
-						((uint32_t*)dcl.data)[i] = read32();
-					break;
-				case SM4_OPCODE_DCL_INTERFACE:
-					dcl.intf.id = read32();
-					dcl.intf.expected_function_table_length = read32();
-					{
-						uint32_t v = read32();
-						dcl.intf.table_length = v & 0xffff;
-						dcl.intf.array_length = v >> 16;
-					}
-					dcl.data = malloc(dcl.intf.table_length * sizeof(uint32_t));
-					for (unsigned i = 0; i < dcl.intf.table_length; ++i)
-						((uint32_t*)dcl.data)[i] = read32();
-					break;
-				case SM4_OPCODE_DCL_THREAD_GROUP:
-					dcl.thread_group_size[0] = read32();
-					dcl.thread_group_size[1] = read32();
-					dcl.thread_group_size[2] = read32();
-					break;
-				case SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_TYPED:
-					READ_OP(UNORDERED_ACCESS_VIEW);
-					read_token(&dcl.rrt);
-					break;
-				case SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_RAW:
-					READ_OP(UNORDERED_ACCESS_VIEW);
-					break;
-				case SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_STRUCTURED:
-					READ_OP(UNORDERED_ACCESS_VIEW);
-					dcl.structured.stride = read32();
-					break;
-				case SM4_OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_RAW:
-					READ_OP(THREAD_GROUP_SHARED_MEMORY);
-					dcl.num = read32();
-					break;
-				case SM4_OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_STRUCTURED:
-					READ_OP(THREAD_GROUP_SHARED_MEMORY);
-					dcl.structured.stride = read32();
-					dcl.structured.count = read32();
-					break;
-				case SM4_OPCODE_DCL_RESOURCE_RAW:
-					READ_OP(RESOURCE);
-					break;
-				case SM4_OPCODE_DCL_RESOURCE_STRUCTURED:
-					READ_OP(RESOURCE);
-					dcl.structured.stride = read32();
-					break;
-				case SM4_OPCODE_DCL_STREAM:
-					/* TODO: dcl_stream is undocumented: what is it? */
-					fail("Unhandled dcl_stream since it's undocumented");
-				default:
-					fail("Unhandled declaration");
-				}
+			check(tokens == limit, SM4_PARSE_LENGTH_MISMATCH);
+			tokens = next;
+			if (!visitor.visit_dcl(dcl))
+				return false;
+		}
+		else
+		{
+			sm4_insn insn;
+			(sm4_token_instruction&)insn = insntok;
 
-				check(tokens == insn_end);
-			}
-			else
+			sm4_token_instruction_extended exttok;
+			memcpy(&exttok, &insntok, sizeof(exttok));
+			while (exttok.extended)
 			{
-				sm4_insn& insn = *new sm4_insn;
-				program.insns.push_back(&insn);
-				(sm4_token_instruction&)insn = insntok;
-
-				sm4_token_instruction_extended exttok;
-				memcpy(&exttok, &insntok, sizeof(exttok));
-				while (exttok.extended)
+				check(tokens < limit, SM4_PARSE_LENGTH_MISMATCH);
+				check(insn.num_extended < SM4_MAX_EXTENDED_TOKENS,
+					  SM4_PARSE_TOO_MANY_EXTENDED);
+				read_token(&exttok);
+				memcpy(&insn.extended[insn.num_extended++], &exttok,
+					   sizeof(exttok));
+				if (exttok.type ==
+					SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_SAMPLE_CONTROLS)
 				{
-					read_token(&exttok);
-					if (exttok.type ==
-						SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_SAMPLE_CONTROLS)
-					{
-						insn.sample_offset[0] = exttok.sample_controls.offset_u;
-						insn.sample_offset[1] = exttok.sample_controls.offset_v;
-						insn.sample_offset[2] = exttok.sample_controls.offset_w;
-					}
-					else if (exttok.type ==
-							 SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_DIM)
-						insn.resource_target = exttok.resource_target.target;
-					else if (
-						exttok.type ==
-						SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_RETURN_TYPE)
-					{
-						insn.resource_return_type[0] =
-							exttok.resource_return_type.x;
-						insn.resource_return_type[1] =
-							exttok.resource_return_type.y;
-						insn.resource_return_type[2] =
-							exttok.resource_return_type.z;
-						insn.resource_return_type[3] =
-							exttok.resource_return_type.w;
-					}
+					insn.sample_offset[0] = exttok.sample_controls.offset_u;
+					insn.sample_offset[1] = exttok.sample_controls.offset_v;
+					insn.sample_offset[2] = exttok.sample_controls.offset_w;
 				}
-
-				switch (opcode)
+				else if (exttok.type ==
+						 SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_DIM)
+					insn.resource_target = exttok.resource_target.target;
+				else if (
+					exttok.type ==
+					SM4_TOKEN_INSTRUCTION_EXTENDED_TYPE_RESOURCE_RETURN_TYPE)
 				{
-				case SM4_OPCODE_INTERFACE_CALL:
-					insn.num = read32();
-					break;
-				default:
-					break;
+					insn.resource_return_type[0] =
+						exttok.resource_return_type.x;
+					insn.resource_return_type[1] =
+						exttok.resource_return_type.y;
+					insn.resource_return_type[2] =
+						exttok.resource_return_type.z;
+					insn.resource_return_type[3] =
+						exttok.resource_return_type.w;
 				}
+			}
 
-				unsigned op_num = 0;
-				while (tokens != insn_end)
-				{
-					check(tokens < insn_end);
-					check(op_num < SM4_MAX_OPS);
-					insn.ops[op_num].reset(new sm4_op);
-					read_op(&*insn.ops[op_num]);
-					++op_num;
-				}
-				insn.num_ops = op_num;
+			switch (opcode)
+			{
+			case SM4_OPCODE_INTERFACE_CALL:
+				check(tokens < limit, SM4_PARSE_LENGTH_MISMATCH);
+				insn.num = read32();
+				break;
+			default:
+				break;
+			}
+
+			unsigned op_num = 0;
+			while (tokens < limit)
+			{
+				check(op_num < SM4_MAX_OPS, SM4_PARSE_TOO_MANY_OPERANDS);
+				insn.ops[op_num] = alloc_op();
+				read_op(insn.ops[op_num]);
+				++op_num;
 			}
+			check(tokens == limit, SM4_PARSE_LENGTH_MISMATCH);
+			/* the function table reference */
+			check(opcode != SM4_OPCODE_INTERFACE_CALL || op_num,
+				  SM4_PARSE_BAD_OPERAND);
+			tokens = next;
+			insn.num_ops = op_num;
+			if (!visitor.visit_insn(insn))
+				return false;
 		}
+		return true;
+	}
+
+	void report(sm4_parse_error_code code, sm4_parse_error* error)
+	{
+		if (!error)
+			return;
+		error->code = code;
+		error->offset = insn_start ? (unsigned)(insn_start - program) : 0;
+		error->opcode = insn_opcode;
 	}
 
-	const char* parse()
+	const char* parse(sm4_parse_error* error)
 	{
 		try
 		{
 			do_parse();
+			report(SM4_PARSE_OK, error);
+			return 0;
+		}
+		catch (sm4_parse_error_code code)
+		{
+			report(code, error);
+			return sm4_parse_error_names[code];
+		}
+	}
+
+	const char* parse_at(unsigned offset, sm4_parse_error* error)
+	{
+		tokens += offset;
+		try
+		{
+			parse_one();
+			report(SM4_PARSE_OK, error);
 			return 0;
 		}
-		catch (const char* error)
+		catch (sm4_parse_error_code code)
 		{
-			return error;
+			report(code, error);
+			return sm4_parse_error_names[code];
 		}
 	}
 
@@ -466,11 +502,165 @@ struct sm4_parser
 	sm4_parser& operator=(const sm4_parser&);
 };
 
-sm4_program* sm4_parse(void* tokens, int size)
+const char* sm4_decode(const void* tokens, int size, sm4_visitor& visitor,
+						sm4_parse_error* error)
+{
+	if (size < 0)
+		size = 0;
+	sm4_parser parser(visitor, tokens, size);
+	return parser.parse(error);
+}
+
+static const char* scan_error(sm4_parse_error_code code, unsigned offset,
+							  unsigned opcode, sm4_parse_error* error)
+{
+	if (error)
+	{
+		error->code = code;
+		error->offset = offset;
+		error->opcode = opcode;
+	}
+	return code ? sm4_parse_error_names[code] : 0;
+}
+
+const char* sm4_scan(const void* p_tokens, int size, sm4_token_index& index,
+					 sm4_parse_error* error)
+{
+	const uint32_t* tokens = (const uint32_t*)p_tokens;
+	index.tokens = tokens;
+	index.length = 0;
+	index.offsets.clear();
+	index.opcodes.clear();
+
+	if (size < 2 * (int)sizeof(uint32_t))
+		return scan_error(SM4_PARSE_TRUNCATED, 0, SM4_OPCODE_COUNT, error);
+	uint32_t version = bswap_le32(tokens[0]);
+	memcpy(&index.version, &version, sizeof(version));
+	unsigned length = bswap_le32(tokens[1]);
+	if (length < 2 || length > (unsigned)size / sizeof(uint32_t))
+		return scan_error(SM4_PARSE_TRUNCATED, 0, SM4_OPCODE_COUNT, error);
+
+	/* instructions are at least two tokens long, most are longer */
+	index.offsets.reserve(length / 4);
+	index.opcodes.reserve(length / 4);
+	for (unsigned pos = 2; pos < length;)
+	{
+		sm4_token_instruction insntok;
+		uint32_t token = bswap_le32(tokens[pos]);
+		memcpy(&insntok, &token, sizeof(token));
+		if (insntok.opcode >= SM4_OPCODE_COUNT)
+			return scan_error(SM4_PARSE_BAD_OPCODE, pos, insntok.opcode, error);
+
+		unsigned insn_length = insntok.length;
+		/* the shortest one the decoder accepts: custom data has its length
+		 * in the next token, which counts itself and the opcode */
+		unsigned min_length = 1;
+		if (insntok.opcode == SM4_OPCODE_CUSTOMDATA)
+		{
+			if (pos + 1 >= length)
+				return scan_error(SM4_PARSE_BAD_LENGTH, pos, insntok.opcode,
+								  error);
+			insn_length = bswap_le32(tokens[pos + 1]);
+			min_length = 2;
+		}
+		if (insn_length < min_length || insn_length > length - pos)
+			return scan_error(SM4_PARSE_BAD_LENGTH, pos, insntok.opcode,
+							  error);
+
+		index.offsets.push_back(pos);
+		index.opcodes.push_back((uint16_t)insntok.opcode);
+		pos += insn_length;
+	}
+	index.length = length;
+	return scan_error(SM4_PARSE_OK, 0, SM4_OPCODE_COUNT, error);
+}
+
+const char* sm4_decode_one(const sm4_token_index& index, unsigned i,
+						   sm4_visitor& visitor, sm4_parse_error* error)
+{
+	if (i >= index.size())
+		return scan_error(SM4_PARSE_NO_SUCH_ENTRY, 0, SM4_OPCODE_COUNT,
+						  error);
+	sm4_parser parser(visitor, index.tokens,
+					  index.length * sizeof(uint32_t));
+	return parser.parse_at(index.offsets[i], error);
+}
+
+unsigned sm4_dcl::data_size() const
+{
+	switch (opcode)
+	{
+	case SM4_OPCODE_CUSTOMDATA:
+		return num;
+	case SM4_OPCODE_DCL_FUNCTION_TABLE:
+		return function_table.num;
+	case SM4_OPCODE_DCL_INTERFACE:
+		return intf.table_length;
+	default:
+		return 0;
+	}
+}
+
+/* copies the transient nodes reported by the decoder into the program */
+struct sm4_program_builder : public sm4_visitor
+{
+	sm4_program& program;
+
+	explicit sm4_program_builder(sm4_program& program) : program(program) {}
+
+	sm4_op* clone(const sm4_op* op)
+	{
+		if (!op)
+			return 0;
+		sm4_op* copy = program.arena->create<sm4_op>();
+		*copy = *op;
+		for (unsigned i = 0; i < op->num_indices; ++i)
+			copy->indices[i].reg = clone(op->indices[i].reg);
+		return copy;
+	}
+
+	virtual bool visit_version(const sm4_token_version& version)
+	{
+		program.version = version;
+		return true;
+	}
+
+	virtual bool visit_dcl(const sm4_dcl& dcl)
+	{
+		sm4_dcl* copy = program.arena->create<sm4_dcl>();
+		*copy = dcl;
+		copy->insn_num = (unsigned)program.insns.size();
+		copy->op = clone(dcl.op);
+		if (dcl.data)
+		{
+			size_t size = dcl.data_size() * sizeof(uint32_t);
+			copy->data = program.arena->alloc(size);
+			memcpy(copy->data, dcl.data, size);
+		}
+		program.dcls.push_back(copy);
+		return true;
+	}
+
+	virtual bool visit_insn(const sm4_insn& insn)
+	{
+		sm4_insn* copy = program.arena->create<sm4_insn>();
+		*copy = insn;
+		for (unsigned i = 0; i < insn.num_ops; ++i)
+			copy->ops[i] = clone(insn.ops[i]);
+		program.insns.push_back(copy);
+		return true;
+	}
+
+  private:
+	sm4_program_builder& operator=(const sm4_program_builder&);
+};
+
+sm4_program* sm4_parse(void* tokens, int size, sm4_arena* arena,
+					  sm4_parse_error* error)
 {
-	sm4_program* program = new sm4_program;
-	sm4_parser parser(*program, tokens, size);
-	if (!parser.parse())
+	sm4_program* program = new sm4_program(arena);
+	sm4_program_builder builder(*program);
+	if (!sm4_decode(tokens, size, builder, error))
 		return program;
 	delete program;
 	return 0;
@@ -600,3 +600,9 @@ const char* sm4_primitive_topology_names[] = {
 	"trianglelist_adj",
 	"trianglestrip_adj",
 };
+
+const unsigned sm4_primitive_name_count =
+	sizeof(sm4_primitive_names) / sizeof(sm4_primitive_names[0]);
+const unsigned sm4_primitive_topology_name_count =
+	sizeof(sm4_primitive_topology_names) /
+	sizeof(sm4_primitive_topology_names[0]);
@@ -0,0 +1,191 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "text_writer.h"
+#include <math.h>
+#include <new>
+#include <stdlib.h>
+
+text_names::text_names(const char* const* names, unsigned count)
+	: strs(count)
+{
+	for (unsigned i = 0; i < count; ++i)
+	{
+		strs[i].str = names[i];
+		strs[i].length = (unsigned)strlen(names[i]);
+	}
+}
+
+static void write_ostream(void* ctx, const char* data, size_t size)
+{
+	((std::ostream*)ctx)->write(data, size);
+}
+
+static void write_file(void* ctx, const char* data, size_t size)
+{
+	fwrite(data, 1, size, (FILE*)ctx);
+}
+
+text_writer::text_writer(size_t block_size) { init(0, 0, block_size); }
+
+text_writer::text_writer(sink_func sink, void* ctx, size_t block_size)
+{
+	init(sink, ctx, block_size);
+}
+
+text_writer::text_writer(std::ostream& out, size_t block_size)
+{
+	init(write_ostream, &out, block_size);
+}
+
+text_writer::text_writer(FILE* out, size_t block_size)
+{
+	init(write_file, out, block_size);
+}
+
+void text_writer::init(sink_func sink, void* ctx, size_t block_size)
+{
+	if (block_size < 64)
+		block_size = 64;
+	buf = (char*)malloc(block_size);
+	if (!buf)
+		throw std::bad_alloc();
+	cur = buf;
+	end = buf + block_size;
+	flushed = 0;
+	this->sink = sink;
+	this->ctx = ctx;
+}
+
+text_writer::~text_writer()
+{
+	flush();
+	free(buf);
+}
+
+void text_writer::flush()
+{
+	if (!sink || cur == buf)
+		return;
+	sink(ctx, buf, cur - buf);
+	flushed += cur - buf;
+	cur = buf;
+}
+
+void text_writer::make_room(size_t n)
+{
+	flush();
+	if ((size_t)(end - cur) >= n)
+		return;
+
+	size_t used = cur - buf;
+	size_t capacity = (end - buf) * 2;
+	if (capacity < used + n)
+		capacity = used + n;
+	char* p = (char*)realloc(buf, capacity);
+	if (!p)
+		throw std::bad_alloc();
+	buf = p;
+	cur = p + used;
+	end = p + capacity;
+}
+
+/* formats v backwards, ending at p, and returns the first digit */
+static char* format_uint(char* p, uint64_t v, unsigned base)
+{
+	do
+	{
+		*--p = "0123456789abcdef"[v % base];
+		v /= base;
+	} while (v);
+	return p;
+}
+
+void text_writer::write_uint(uint64_t v)
+{
+	char digits[20];
+	char* p = format_uint(digits + sizeof(digits), v, 10);
+	write(p, digits + sizeof(digits) - p);
+}
+
+void text_writer::write_int(int64_t v)
+{
+	if (v < 0)
+	{
+		put('-');
+		write_uint(0 - (uint64_t)v);
+	}
+	else
+		write_uint((uint64_t)v);
+}
+
+void text_writer::write_uint(uint64_t v, unsigned width, unsigned base)
+{
+	char digits[64];
+	char* p = format_uint(digits + sizeof(digits), v, base);
+	unsigned length = (unsigned)(digits + sizeof(digits) - p);
+	if (width > length)
+		spaces(width - length);
+	write(p, length);
+}
+
+void text_writer::write_float(double v)
+{
+	/* integers print the same with %g as with the integer formatting, as
+	 * long as they have at most 6 digits (the default stream precision) */
+	if (v > -1e6 && v < 1e6 && v == (double)(int)v && (v != 0 || !signbit(v)))
+	{
+		write_int((int)v);
+		return;
+	}
+	char s[32];
+	int length = snprintf(s, sizeof(s), "%g", v);
+	write(s, length);
+}
+
+void text_writer::write_right(const char* s, unsigned width)
+{
+	size_t length = strlen(s);
+	if (width > length)
+		spaces(width - (unsigned)length);
+	write(s, length);
+}
+
+void text_writer::write_left(const char* s, unsigned width)
+{
+	size_t length = strlen(s);
+	write(s, length);
+	if (width > length)
+		spaces(width - (unsigned)length);
+}
+
+void text_writer::spaces(unsigned n)
+{
+	if ((size_t)(end - cur) < n)
+		make_room(n);
+	memset(cur, ' ', n);
+	cur += n;
+}
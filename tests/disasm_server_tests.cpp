@@ -0,0 +1,182 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Checks of the disassembly server over its socket, with a handler that
+ * renders canned text instead of disassembling. Build it with
+ * tools/disasm_server.cpp and the sources of src/ and run it; the exit
+ * status is the number of failed checks. */
+
+#include "disasm_server.h"
+#include "le32.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+typedef SOCKET socket_t;
+#define poll WSAPoll
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int socket_t;
+#define closesocket close
+#endif
+
+static unsigned failures;
+
+#define CHECK(x)                                                             \
+	do                                                                       \
+	{                                                                        \
+		if (!(x))                                                            \
+		{                                                                    \
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #x);          \
+			++failures;                                                      \
+		}                                                                    \
+	} while (0)
+
+#define SOCKET_PATH "disasm_server_tests.sock"
+
+static socket_t connect_to_server()
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, SOCKET_PATH, sizeof(SOCKET_PATH));
+	socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+	CHECK(!connect(s, (sockaddr*)&addr, sizeof(addr)));
+	return s;
+}
+
+static void send_request(socket_t s, uint32_t id, uint32_t kind,
+						 const std::string& payload)
+{
+	uint32_t header[3];
+	header[0] = bswap_le32((uint32_t)(8 + payload.size()));
+	header[1] = bswap_le32(id);
+	header[2] = bswap_le32(kind);
+	std::string frame((const char*)header, sizeof(header));
+	frame += payload;
+	CHECK(send(s, frame.data(), (int)frame.size(), 0) == (int)frame.size());
+}
+
+static bool recv_all(socket_t s, void* data, size_t size)
+{
+	for (char* p = (char*)data; size;)
+	{
+		int n = (int)recv(s, p, (int)size, 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+/* reads the next response on s, if one comes within timeout_ms */
+static bool recv_response(socket_t s, int timeout_ms, uint32_t& id,
+						  std::string& text)
+{
+	pollfd p;
+	p.fd = s;
+	p.events = POLLIN;
+	p.revents = 0;
+	if (poll(&p, 1, timeout_ms) <= 0)
+		return false;
+	uint32_t header[4];
+	if (!recv_all(s, header, sizeof(header)))
+		return false;
+	id = bswap_le32(header[1]);
+	std::string rest(bswap_le32(header[0]) - 12, '\0');
+	if (!recv_all(s, &rest[0], rest.size()))
+		return false;
+	text = rest.substr(0, bswap_le32(header[3]));
+	return bswap_le32(header[2]) == 0;
+}
+
+/* a client that sends requests with large responses and never reads them
+ * holds up neither the workers nor the other clients */
+static void test_server_stalled_client()
+{
+	const std::string big(4 << 20, 'x');
+	disasm_server server(2);
+	CHECK(server.listen(SOCKET_PATH) == 0);
+	std::thread serving([&server, &big] {
+		server.run([&big](unsigned worker, const disasm_request& request,
+						  text_writer& out, std::ostream& err) {
+			(void)worker;
+			(void)err;
+			if (!strcmp(request.path, "big"))
+				out.write(big.data(), big.size());
+			else
+				out.write(request.path);
+			return true;
+		});
+	});
+
+	/* more requests than there are workers */
+	socket_t stalled = connect_to_server();
+	for (uint32_t id = 1; id <= 4; ++id)
+		send_request(stalled, id, DISASM_REQUEST_PATH, "big");
+
+	socket_t client = connect_to_server();
+	send_request(client, 5, DISASM_REQUEST_PATH, "small");
+	uint32_t id = 0;
+	std::string text;
+	CHECK(recv_response(client, 10000, id, text));
+	CHECK(id == 5 && text == "small");
+
+	/* the stalled client gets its responses once it reads */
+	for (unsigned i = 0; i < 4; ++i)
+	{
+		CHECK(recv_response(stalled, 10000, id, text));
+		CHECK(text == big);
+	}
+	closesocket(stalled);
+
+	send_request(client, 6, DISASM_REQUEST_STOP, std::string());
+	CHECK(recv_response(client, 10000, id, text));
+	CHECK(id == 6);
+	closesocket(client);
+	serving.join();
+}
+
+int main()
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	test_server_stalled_client();
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	if (failures)
+		fprintf(stderr, "%u checks failed\n", failures);
+	return (int)failures;
+}
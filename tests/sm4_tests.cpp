@@ -0,0 +1,628 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Checks of the SM4 library that need no compiler or GPU, over hand
+ * assembled programs. Build it with the sources of src/ and run it; the
+ * exit status is the number of failed checks. */
+
+#include "dxbc.h"
+#include "sm4.h"
+#include <stdio.h>
+#include <vector>
+
+static unsigned failures;
+
+#define CHECK(x)                                                             \
+	do                                                                       \
+	{                                                                        \
+		if (!(x))                                                            \
+		{                                                                    \
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #x);          \
+			++failures;                                                      \
+		}                                                                    \
+	} while (0)
+
+/* tokens of hand assembled programs */
+#define VERSION(type, major, minor) ((type) << 16 | (major) << 4 | (minor))
+#define INSN(opcode, length) ((opcode) | (length) << 24)
+/* a register with one index, written through mask or read through one
+ * component */
+#define DST(file, mask) (2 | (mask) << 4 | (file) << 12 | 1 << 20)
+#define SRC1(file, comp) (2 | 2 << 2 | (comp) << 4 | (file) << 12 | 1 << 20)
+#define IMM1 (1 | SM4_FILE_IMMEDIATE32 << 12)
+/* cb#[a + r][b + r].xyzw, both indices immediate plus relative */
+#define SRC_CB_REL (2 | 1 << 2 | 0xe4 << 4 | SM4_FILE_CONSTANT_BUFFER << 12 | \
+					2 << 20 | 3 << 22 | 3 << 25)
+
+/* any register: four components written through mask, read through a
+ * swizzle or one component, or none, with dims indices */
+#define MASK(file, mask, dims) (2 | (mask) << 4 | (file) << 12 | (dims) << 20)
+#define SWZ(file, swz, dims)                                                  \
+	(2 | 1 << 2 | (swz) << 4 | (file) << 12 | (dims) << 20)
+#define SEL(file, comp, dims)                                                 \
+	(2 | 2 << 2 | (comp) << 4 | (file) << 12 | (dims) << 20)
+#define NOCOMP(file, dims) ((file) << 12 | (dims) << 20)
+#define XYZW 0xe4
+/* first or second index immediate plus relative */
+#define REL0 (3 << 22)
+#define REL1 (3 << 25)
+
+static std::string text(const text_writer& out)
+{
+	return std::string(out.data(), out.size());
+}
+
+/* parses the tokens of a program, its length token filled in */
+static sm4_program* parse(std::vector<uint32_t>& tokens)
+{
+	tokens[1] = (uint32_t)tokens.size();
+	return sm4_parse(&tokens[0], (int)(tokens.size() * 4));
+}
+
+/* both back ends reject memory instructions that do not access a t#, u#
+ * or g# register, rather than indexing the register layout with them */
+static void test_exec_memory_operands()
+{
+	const uint32_t atomics[][7] = {
+		/* atomic_umin r1.x, r0.x, l(1) */
+		{INSN(SM4_OPCODE_ATOMIC_UMIN, 7), DST(SM4_FILE_TEMP, 1), 1,
+		 SRC1(SM4_FILE_TEMP, 0), 0, IMM1, 1},
+		/* atomic_umin u3.x, r0.x, l(1), u3 undeclared */
+		{INSN(SM4_OPCODE_ATOMIC_UMIN, 7),
+		 DST(SM4_FILE_UNORDERED_ACCESS_VIEW, 1), 3, SRC1(SM4_FILE_TEMP, 0),
+		 0, IMM1, 1},
+		/* atomic_umin g2.x, r0.x, l(1), g2 undeclared */
+		{INSN(SM4_OPCODE_ATOMIC_UMIN, 7),
+		 DST(SM4_FILE_THREAD_GROUP_SHARED_MEMORY, 1), 2,
+		 SRC1(SM4_FILE_TEMP, 0), 0, IMM1, 1},
+	};
+	for (unsigned i = 0; i < sizeof(atomics) / sizeof(atomics[0]); ++i)
+	{
+		std::vector<uint32_t> tokens;
+		tokens.push_back(VERSION(0, 5, 0));
+		tokens.push_back(0);
+		tokens.push_back(INSN(SM4_OPCODE_DCL_TEMPS, 2));
+		tokens.push_back(2);
+		tokens.insert(tokens.end(), atomics[i], atomics[i] + 7);
+		tokens.push_back(INSN(SM4_OPCODE_RET, 1));
+		sm4_program* program = parse(tokens);
+		CHECK(program != 0);
+		if (!program)
+			continue;
+
+		sm4_exec exec;
+		CHECK(sm4_exec_init(exec, *program) != 0);
+		CHECK(exec.error_insn == 0);
+		text_writer out;
+		unsigned insn = ~0u;
+		CHECK(sm4_translate_cpp(out, *program, "test", &insn) != 0);
+		CHECK(insn == 0);
+		delete program;
+	}
+}
+
+/* breaks outside of a loop or switch and continues outside of a loop are
+ * rejected by sm4_exec_init, at the instruction at fault, rather than
+ * leaving the interpreter without a frame to leave */
+static void test_exec_stray_breaks()
+{
+	const uint32_t leaves[][3] = {
+		{INSN(SM4_OPCODE_BREAK, 1)},
+		{INSN(SM4_OPCODE_BREAKC | 1 << 18, 3), SRC1(SM4_FILE_TEMP, 0), 0},
+		{INSN(SM4_OPCODE_CONTINUE, 1)},
+		{INSN(SM4_OPCODE_CONTINUEC | 1 << 18, 3), SRC1(SM4_FILE_TEMP, 0), 0},
+	};
+	for (unsigned i = 0; i < sizeof(leaves) / sizeof(leaves[0]); ++i)
+	{
+		unsigned length = leaves[i][0] >> 24;
+		bool is_break = i < 2;
+		for (unsigned where = 0; where < 3; ++where)
+		{
+			std::vector<uint32_t> tokens;
+			tokens.push_back(VERSION(0, 4, 0));
+			tokens.push_back(0);
+			tokens.push_back(INSN(SM4_OPCODE_DCL_TEMPS, 2));
+			tokens.push_back(1);
+			unsigned at = 0;
+			if (where == 1)
+			{
+				/* loop; call l0; break; endloop; ret; label l0; ... */
+				const uint32_t caller[] = {
+					INSN(SM4_OPCODE_LOOP, 1),
+					INSN(SM4_OPCODE_CALL, 3), NOCOMP(SM4_FILE_LABEL, 1), 0,
+					INSN(SM4_OPCODE_BREAK, 1),
+					INSN(SM4_OPCODE_ENDLOOP, 1),
+					INSN(SM4_OPCODE_RET, 1),
+					INSN(SM4_OPCODE_LABEL, 3), NOCOMP(SM4_FILE_LABEL, 1), 0,
+				};
+				tokens.insert(tokens.end(), caller,
+							  caller + sizeof(caller) / sizeof(caller[0]));
+				at = 6;
+			}
+			else if (where == 2)
+			{
+				/* switch r0.x; default; ...; endswitch, which continues
+				 * cannot leave */
+				if (is_break)
+					continue;
+				tokens.push_back(INSN(SM4_OPCODE_SWITCH, 3));
+				tokens.push_back(SRC1(SM4_FILE_TEMP, 0));
+				tokens.push_back(0);
+				tokens.push_back(INSN(SM4_OPCODE_DEFAULT, 1));
+				at = 2;
+			}
+			tokens.insert(tokens.end(), leaves[i], leaves[i] + length);
+			if (where == 2)
+				tokens.push_back(INSN(SM4_OPCODE_ENDSWITCH, 1));
+			tokens.push_back(INSN(SM4_OPCODE_RET, 1));
+			sm4_program* program = parse(tokens);
+			CHECK(program != 0);
+			if (!program)
+				continue;
+
+			sm4_exec exec;
+			const char* error = sm4_exec_init(exec, *program);
+			CHECK(error != 0);
+			if (error)
+				CHECK(std::string(error) ==
+					  (is_break ? "Break outside of a loop or switch"
+								: "Continue outside of a loop"));
+			CHECK(exec.error_insn == at);
+			delete program;
+		}
+	}
+}
+
+/* lanes that leave a loop after different numbers of iterations, and skip
+ * different ones, each count their own */
+static void test_exec_divergent_loop()
+{
+	const uint32_t loop[] = {
+		VERSION(0, 4, 0), 0,
+		/* dcl_input_ps constant v0.x */
+		INSN(SM4_OPCODE_DCL_INPUT_PS | 1 << 11, 3), MASK(SM4_FILE_INPUT, 1, 1),
+		0,
+		/* dcl_output o0.xy */
+		INSN(SM4_OPCODE_DCL_OUTPUT, 3), MASK(SM4_FILE_OUTPUT, 3, 1), 0,
+		/* dcl_temps 2 */
+		INSN(SM4_OPCODE_DCL_TEMPS, 2), 2,
+		INSN(SM4_OPCODE_LOOP, 1),
+		/* uge r1.x, r0.x, v0.x */
+		INSN(SM4_OPCODE_UGE, 7), DST(SM4_FILE_TEMP, 1), 1,
+		SRC1(SM4_FILE_TEMP, 0), 0, SRC1(SM4_FILE_INPUT, 0), 0,
+		/* breakc_nz r1.x */
+		INSN(SM4_OPCODE_BREAKC | 1 << 18, 3), SRC1(SM4_FILE_TEMP, 0), 1,
+		/* and r1.y, r0.x, l(1) */
+		INSN(SM4_OPCODE_AND, 7), DST(SM4_FILE_TEMP, 2), 1,
+		SRC1(SM4_FILE_TEMP, 0), 0, IMM1, 1,
+		/* iadd r0.x, r0.x, l(1) */
+		INSN(SM4_OPCODE_IADD, 7), DST(SM4_FILE_TEMP, 1), 0,
+		SRC1(SM4_FILE_TEMP, 0), 0, IMM1, 1,
+		/* continuec_nz r1.y */
+		INSN(SM4_OPCODE_CONTINUEC | 1 << 18, 3), SRC1(SM4_FILE_TEMP, 1), 1,
+		/* iadd r0.y, r0.y, l(1) */
+		INSN(SM4_OPCODE_IADD, 7), DST(SM4_FILE_TEMP, 2), 0,
+		SRC1(SM4_FILE_TEMP, 1), 0, IMM1, 1,
+		INSN(SM4_OPCODE_ENDLOOP, 1),
+		/* mov o0.xy, r0.xyxx */
+		INSN(SM4_OPCODE_MOV, 5), DST(SM4_FILE_OUTPUT, 3), 0,
+		SWZ(SM4_FILE_TEMP, 0x04, 1), 0,
+		INSN(SM4_OPCODE_RET, 1),
+	};
+	std::vector<uint32_t> tokens(loop, loop + sizeof(loop) / sizeof(loop[0]));
+	sm4_program* program = parse(tokens);
+	CHECK(program != 0);
+	if (!program)
+		return;
+
+	sm4_exec exec;
+	CHECK(sm4_exec_init(exec, *program) == 0);
+	sm4_exec_bindings bindings;
+	bindings.inputs.resize(1);
+	bindings.outputs.resize(1);
+	memset(&bindings.inputs[0], 0, sizeof(bindings.inputs[0]));
+	memset(&bindings.outputs[0], 0, sizeof(bindings.outputs[0]));
+	for (unsigned l = 0; l < SM4_EXEC_LANES; ++l)
+		bindings.inputs[0].c[0][l] = (l * 5) % 7;
+	sm4_exec_state state;
+	CHECK(sm4_exec_run(exec, bindings, state) == 0);
+	for (unsigned l = 0; l < SM4_EXEC_LANES; ++l)
+	{
+		/* all iterations, and the even ones */
+		uint32_t n = (l * 5) % 7;
+		CHECK(bindings.outputs[0].c[0][l] == n);
+		CHECK(bindings.outputs[0].c[1][l] == (n + 1) / 2);
+	}
+	delete program;
+}
+
+/* an operand whose relative index registers nest depth levels deep, with
+ * 2^(depth + 1) - 1 nodes */
+static void nested_operand(std::vector<uint32_t>& tokens, unsigned depth)
+{
+	if (!depth)
+	{
+		tokens.push_back(SRC1(SM4_FILE_TEMP, 0));
+		tokens.push_back(0);
+		return;
+	}
+	tokens.push_back(SRC_CB_REL);
+	tokens.push_back(0);
+	nested_operand(tokens, depth - 1);
+	tokens.push_back(1);
+	nested_operand(tokens, depth - 1);
+}
+
+/* flat programs and images print instructions with as many relative index
+ * registers as the parser reads, and images sharing operands between
+ * records are rejected */
+static void test_flat_expansion()
+{
+	std::vector<uint32_t> tokens;
+	tokens.push_back(VERSION(0, 4, 0));
+	tokens.push_back(0);
+	/* mov r0.xyzw, with a source of 31 nodes */
+	size_t mov = tokens.size();
+	tokens.push_back(0);
+	tokens.push_back(DST(SM4_FILE_TEMP, 0xf));
+	tokens.push_back(0);
+	nested_operand(tokens, 4);
+	tokens[mov] = INSN(SM4_OPCODE_MOV, (uint32_t)(tokens.size() - mov));
+	tokens.push_back(INSN(SM4_OPCODE_RET, 1));
+	sm4_program* program = parse(tokens);
+	CHECK(program != 0);
+	if (!program)
+		return;
+
+	text_writer parsed, flat_text, image_text;
+	parsed << *program;
+	sm4_flat_program flat;
+	sm4_flatten(*program, flat);
+	flat_text << flat;
+	CHECK(text(flat_text) == text(parsed));
+
+	std::pair<void*, size_t> bytes = sm4_image_assemble(flat);
+	CHECK(bytes.first != 0);
+	sm4_image image;
+	CHECK(image.init(bytes.first, bytes.second) == 0);
+	sm4_dump(image_text, image, sm4_dump_options());
+	CHECK(text(image_text) == text(parsed));
+
+	/* images of a host of the other byte order are refused */
+	sm4_image_header* header = (sm4_image_header*)bytes.first;
+	header->byte_order = 0x04030201u;
+	CHECK(image.init(bytes.first, bytes.second) != 0);
+	header->byte_order = SM4_IMAGE_BYTE_ORDER;
+	CHECK(image.init(bytes.first, bytes.second) == 0);
+
+	/* the second index of the source refers to the register of its first */
+	sm4_flat_op* ops = (sm4_flat_op*)image.ops;
+	uint32_t src = image.op_offsets[0] + 1;
+	ops[src].reg[1] = ops[src].reg[0];
+	CHECK(image.init(bytes.first, bytes.second) != 0);
+	free(bytes.first);
+	delete program;
+}
+
+/* sm4_scan and the decoder agree on the shortest custom data block */
+static void test_scan_customdata_length()
+{
+	for (uint32_t length = 0; length < 3; ++length)
+	{
+		std::vector<uint32_t> tokens;
+		tokens.push_back(VERSION(0, 4, 0));
+		tokens.push_back(0);
+		tokens.push_back(SM4_OPCODE_CUSTOMDATA);
+		tokens.push_back(length);
+		tokens.push_back(INSN(SM4_OPCODE_RET, 1));
+		tokens[1] = (uint32_t)tokens.size();
+		int size = (int)(tokens.size() * 4);
+
+		sm4_token_index index;
+		sm4_parse_error scan_error, parse_error;
+		const char* scanned = sm4_scan(&tokens[0], size, index, &scan_error);
+		sm4_program* program = sm4_parse(&tokens[0], size, 0, &parse_error);
+		CHECK(!scanned == (program != 0));
+		CHECK(!scanned == (length >= 2));
+		if (scanned && !program)
+		{
+			CHECK(scan_error.code == SM4_PARSE_BAD_LENGTH);
+			CHECK(scan_error.code == parse_error.code);
+			CHECK(scan_error.offset == 2 && parse_error.offset == 2);
+			CHECK(scan_error.opcode == parse_error.opcode);
+		}
+		delete program;
+	}
+}
+
+/* containers with more chunks than dxbc_view keeps in its table */
+static void test_dxbc_many_chunks()
+{
+	const unsigned num_chunks = DXBC_VIEW_MAX_CHUNKS + 6;
+	struct
+	{
+		dxbc_chunk_header header;
+		uint32_t index;
+	} chunks[num_chunks];
+	dxbc_chunk_header* pointers[num_chunks];
+	for (unsigned i = 0; i < num_chunks; ++i)
+	{
+		chunks[i].header.fourcc = bswap_le32(0x1000 + i);
+		chunks[i].header.size = bswap_le32(sizeof(uint32_t));
+		chunks[i].index = i;
+		pointers[i] = &chunks[i].header;
+	}
+	/* the first chunk with a FourCC wins, inside and past the table */
+	chunks[DXBC_VIEW_MAX_CHUNKS + 3].header.fourcc = bswap_le32(0x1000 + 3);
+	chunks[DXBC_VIEW_MAX_CHUNKS + 4].header.fourcc =
+		bswap_le32(0x1000 + DXBC_VIEW_MAX_CHUNKS + 1);
+
+	std::pair<void*, size_t> blob = dxbc_assemble(pointers, num_chunks);
+	CHECK(blob.first != 0);
+	dxbc_container* dxbc = dxbc_parse(blob.first, (int)blob.second);
+	CHECK(dxbc != 0);
+	if (dxbc)
+	{
+		CHECK(dxbc->chunks.size() == num_chunks);
+		for (unsigned i = 0; i < dxbc->chunks.size(); ++i)
+			CHECK(((uint32_t*)(dxbc->chunks[i] + 1))[0] == i);
+		const unsigned found[][2] = {
+			{0x1000 + 3, 3},
+			{0x1000 + DXBC_VIEW_MAX_CHUNKS - 1, DXBC_VIEW_MAX_CHUNKS - 1},
+			{0x1000 + DXBC_VIEW_MAX_CHUNKS + 1, DXBC_VIEW_MAX_CHUNKS + 1},
+			{0x1000 + DXBC_VIEW_MAX_CHUNKS + 5, DXBC_VIEW_MAX_CHUNKS + 5},
+		};
+		for (unsigned i = 0; i < sizeof(found) / sizeof(found[0]); ++i)
+		{
+			dxbc_chunk_header* chunk = dxbc->view.find(found[i][0]);
+			CHECK(chunk && ((uint32_t*)(chunk + 1))[0] == found[i][1]);
+		}
+		CHECK(!dxbc->view.find(0x1000 + DXBC_VIEW_MAX_CHUNKS + 3));
+		CHECK(!dxbc->view.find(FOURCC_SHDR));
+		delete dxbc;
+	}
+	size_t blob_size;
+	CHECK(dxbc_scan(blob.first, blob.second, 0, blob.second, &blob_size) == 0);
+	free(blob.first);
+}
+
+/* programs as fxc lays them out, length tokens left 0 */
+static const uint32_t ps_4_0_sample[] = {
+	VERSION(0, 4, 0), 0,
+	/* dcl_constantbuffer cb0[1], immediateIndexed */
+	INSN(SM4_OPCODE_DCL_CONSTANT_BUFFER, 4),
+	SWZ(SM4_FILE_CONSTANT_BUFFER, XYZW, 2), 0, 1,
+	/* dcl_sampler s0, mode_default */
+	INSN(SM4_OPCODE_DCL_SAMPLER, 3), NOCOMP(SM4_FILE_SAMPLER, 1), 0,
+	/* dcl_resource_texture2d (float,float,float,float) t0 */
+	INSN(SM4_OPCODE_DCL_RESOURCE | 3 << 11, 4), NOCOMP(SM4_FILE_RESOURCE, 1),
+	0, 0x5555,
+	/* dcl_input_ps linear v1.xy */
+	INSN(SM4_OPCODE_DCL_INPUT_PS | 2 << 11, 3), MASK(SM4_FILE_INPUT, 3, 1), 1,
+	/* dcl_output o0.xyzw */
+	INSN(SM4_OPCODE_DCL_OUTPUT, 3), MASK(SM4_FILE_OUTPUT, 0xf, 1), 0,
+	/* dcl_temps 1 */
+	INSN(SM4_OPCODE_DCL_TEMPS, 2), 1,
+	/* sample r0.xyzw, v1.xyxx, t0.xyzw, s0 */
+	INSN(SM4_OPCODE_SAMPLE, 9), MASK(SM4_FILE_TEMP, 0xf, 1), 0,
+	SWZ(SM4_FILE_INPUT, 0x04, 1), 1, SWZ(SM4_FILE_RESOURCE, XYZW, 1), 0,
+	NOCOMP(SM4_FILE_SAMPLER, 1), 0,
+	/* mul o0.xyzw, r0.xyzw, cb0[0].xyzw */
+	INSN(SM4_OPCODE_MUL, 8), MASK(SM4_FILE_OUTPUT, 0xf, 1), 0,
+	SWZ(SM4_FILE_TEMP, XYZW, 1), 0, SWZ(SM4_FILE_CONSTANT_BUFFER, XYZW, 2), 0,
+	0,
+	INSN(SM4_OPCODE_RET, 1),
+};
+
+static const uint32_t vs_4_0_transform[] = {
+	VERSION(1, 4, 0), 0,
+	/* dcl_constantbuffer cb0[4], immediateIndexed */
+	INSN(SM4_OPCODE_DCL_CONSTANT_BUFFER, 4),
+	SWZ(SM4_FILE_CONSTANT_BUFFER, XYZW, 2), 0, 4,
+	/* dcl_input v0.xyzw */
+	INSN(SM4_OPCODE_DCL_INPUT, 3), MASK(SM4_FILE_INPUT, 0xf, 1), 0,
+	/* dcl_output_siv o0.xyzw, position */
+	INSN(SM4_OPCODE_DCL_OUTPUT_SIV, 4), MASK(SM4_FILE_OUTPUT, 0xf, 1), 0, 1,
+	/* dcl_temps 1 */
+	INSN(SM4_OPCODE_DCL_TEMPS, 2), 1,
+	/* mul r0.xyzw, v0.yyyy, cb0[1].xyzw */
+	INSN(SM4_OPCODE_MUL, 8), MASK(SM4_FILE_TEMP, 0xf, 1), 0,
+	SWZ(SM4_FILE_INPUT, 0x55, 1), 0, SWZ(SM4_FILE_CONSTANT_BUFFER, XYZW, 2), 0,
+	1,
+	/* mad r0.xyzw, cb0[0].xyzw, v0.xxxx, r0.xyzw */
+	INSN(SM4_OPCODE_MAD, 10), MASK(SM4_FILE_TEMP, 0xf, 1), 0,
+	SWZ(SM4_FILE_CONSTANT_BUFFER, XYZW, 2), 0, 0, SWZ(SM4_FILE_INPUT, 0, 1), 0,
+	SWZ(SM4_FILE_TEMP, XYZW, 1), 0,
+	/* mad r0.xyzw, cb0[2].xyzw, v0.zzzz, r0.xyzw */
+	INSN(SM4_OPCODE_MAD, 10), MASK(SM4_FILE_TEMP, 0xf, 1), 0,
+	SWZ(SM4_FILE_CONSTANT_BUFFER, XYZW, 2), 0, 2, SWZ(SM4_FILE_INPUT, 0xaa, 1),
+	0, SWZ(SM4_FILE_TEMP, XYZW, 1), 0,
+	/* mad o0.xyzw, cb0[3].xyzw, v0.wwww, r0.xyzw */
+	INSN(SM4_OPCODE_MAD, 10), MASK(SM4_FILE_OUTPUT, 0xf, 1), 0,
+	SWZ(SM4_FILE_CONSTANT_BUFFER, XYZW, 2), 0, 3, SWZ(SM4_FILE_INPUT, 0xff, 1),
+	0, SWZ(SM4_FILE_TEMP, XYZW, 1), 0,
+	INSN(SM4_OPCODE_RET, 1),
+};
+
+static const uint32_t cs_5_0_histogram[] = {
+	VERSION(5, 5, 0), 0,
+	/* dcl_globalFlags refactoringAllowed */
+	INSN(SM4_OPCODE_DCL_GLOBAL_FLAGS | 1 << 11, 1),
+	/* dcl_uav_structured u0, 4 */
+	INSN(SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_STRUCTURED, 4),
+	NOCOMP(SM4_FILE_UNORDERED_ACCESS_VIEW, 1), 0, 4,
+	/* dcl_tgsm_raw g0, 64 */
+	INSN(SM4_OPCODE_DCL_THREAD_GROUP_SHARED_MEMORY_RAW, 4),
+	NOCOMP(SM4_FILE_THREAD_GROUP_SHARED_MEMORY, 1), 0, 64,
+	/* dcl_input vThreadID.x */
+	INSN(SM4_OPCODE_DCL_INPUT, 2), MASK(SM4_FILE_INPUT_THREAD_ID, 1, 0),
+	/* dcl_temps 1 */
+	INSN(SM4_OPCODE_DCL_TEMPS, 2), 1,
+	/* dcl_thread_group 64, 1, 1 */
+	INSN(SM4_OPCODE_DCL_THREAD_GROUP, 4), 64, 1, 1,
+	/* ishl r0.x, vThreadID.x, l(2) */
+	INSN(SM4_OPCODE_ISHL, 6), DST(SM4_FILE_TEMP, 1), 0,
+	SEL(SM4_FILE_INPUT_THREAD_ID, 0, 0), IMM1, 2,
+	/* atomic_iadd g0.x, r0.x, l(1) */
+	INSN(SM4_OPCODE_ATOMIC_IADD, 7),
+	DST(SM4_FILE_THREAD_GROUP_SHARED_MEMORY, 1), 0, SRC1(SM4_FILE_TEMP, 0), 0,
+	IMM1, 1,
+	/* sync_g_t */
+	INSN(SM4_OPCODE_SYNC | 3 << 11, 1),
+	/* store_structured u0.x, vThreadID.x, l(0), r0.x */
+	INSN(SM4_OPCODE_STORE_STRUCTURED, 8),
+	DST(SM4_FILE_UNORDERED_ACCESS_VIEW, 1), 0,
+	SEL(SM4_FILE_INPUT_THREAD_ID, 0, 0), IMM1, 0, SRC1(SM4_FILE_TEMP, 0), 0,
+	INSN(SM4_OPCODE_RET, 1),
+};
+
+static const uint32_t ps_5_0_lookup[] = {
+	VERSION(0, 5, 0), 0,
+	/* dcl_immediateConstantBuffer { { 1, 2, 3, 4 }, { 5, 6, 7, 8 } } */
+	SM4_OPCODE_CUSTOMDATA | 3 << 11, 10, 1, 2, 3, 4, 5, 6, 7, 8,
+	/* dcl_sampler s0, mode_default */
+	INSN(SM4_OPCODE_DCL_SAMPLER, 3), NOCOMP(SM4_FILE_SAMPLER, 1), 0,
+	/* dcl_resource_texture2d (float,float,float,float) t0 */
+	INSN(SM4_OPCODE_DCL_RESOURCE | 3 << 11, 4), NOCOMP(SM4_FILE_RESOURCE, 1),
+	0, 0x5555,
+	/* dcl_input_ps linear v0.xy */
+	INSN(SM4_OPCODE_DCL_INPUT_PS | 2 << 11, 3), MASK(SM4_FILE_INPUT, 3, 1), 0,
+	/* dcl_output o0.xyzw */
+	INSN(SM4_OPCODE_DCL_OUTPUT, 3), MASK(SM4_FILE_OUTPUT, 0xf, 1), 0,
+	/* dcl_temps 2 */
+	INSN(SM4_OPCODE_DCL_TEMPS, 2), 2,
+	/* dcl_indexableTemp x0[2], 4 */
+	INSN(SM4_OPCODE_DCL_INDEXABLE_TEMP, 4), 0, 2, 4,
+	/* sample_aoffimmi(1,-1,0) r0.xyzw, v0.xyxx, t0.xyzw, s0 */
+	INSN(SM4_OPCODE_SAMPLE, 10) | 1u << 31, 1 | 1 << 9 | 0xf << 13,
+	MASK(SM4_FILE_TEMP, 0xf, 1), 0, SWZ(SM4_FILE_INPUT, 0x04, 1), 0,
+	SWZ(SM4_FILE_RESOURCE, XYZW, 1), 0, NOCOMP(SM4_FILE_SAMPLER, 1), 0,
+	/* mov x0[1].xyzw, r0.xyzw */
+	INSN(SM4_OPCODE_MOV, 6), MASK(SM4_FILE_INDEXABLE_TEMP, 0xf, 2), 0, 1,
+	SWZ(SM4_FILE_TEMP, XYZW, 1), 0,
+	/* ftou r1.x, v0.x */
+	INSN(SM4_OPCODE_FTOU, 5), DST(SM4_FILE_TEMP, 1), 1,
+	SRC1(SM4_FILE_INPUT, 0), 0,
+	/* mov r0.xyzw, x0[r1.x + 0].xyzw */
+	INSN(SM4_OPCODE_MOV, 8), MASK(SM4_FILE_TEMP, 0xf, 1), 0,
+	SWZ(SM4_FILE_INDEXABLE_TEMP, XYZW, 2) | REL1, 0, 0,
+	SRC1(SM4_FILE_TEMP, 0), 1,
+	/* add o0.xyzw, -|r0.xyzw|, icb[r1.x + 0].xyzw */
+	INSN(SM4_OPCODE_ADD, 10), MASK(SM4_FILE_OUTPUT, 0xf, 1), 0,
+	SWZ(SM4_FILE_TEMP, XYZW, 1) | 1u << 31, 1 | 3 << 6, 0,
+	SWZ(SM4_FILE_IMMEDIATE_CONSTANT_BUFFER, XYZW, 1) | REL0, 0,
+	SRC1(SM4_FILE_TEMP, 0), 1,
+	INSN(SM4_OPCODE_RET, 1),
+};
+
+/* true if tokens parse, in which case encoding them gives them back */
+static bool round_trips(const std::vector<uint32_t>& tokens, bool& parsed)
+{
+	sm4_program* program =
+		sm4_parse((void*)&tokens[0], (int)(tokens.size() * 4));
+	parsed = program != 0;
+	if (!program)
+		return true;
+
+	unsigned num_tokens = 0;
+	bool same = !sm4_encode(*program, 0, num_tokens) &&
+				num_tokens == tokens.size();
+	if (same)
+	{
+		std::vector<uint32_t> encoded(num_tokens);
+		same = !sm4_encode(*program, &encoded[0], num_tokens) &&
+			   num_tokens == tokens.size() && encoded == tokens;
+	}
+	delete program;
+	return same;
+}
+
+/* sm4_encode gives back the token stream of every program that parses,
+ * the sample programs and random mutations of them alike */
+static void test_encode_round_trip()
+{
+	const struct
+	{
+		const uint32_t* tokens;
+		size_t size;
+	} programs[] = {
+		{ps_4_0_sample, sizeof(ps_4_0_sample)},
+		{vs_4_0_transform, sizeof(vs_4_0_transform)},
+		{cs_5_0_histogram, sizeof(cs_5_0_histogram)},
+		{ps_5_0_lookup, sizeof(ps_5_0_lookup)},
+	};
+	uint32_t seed = 0x2545f491;
+	unsigned num_parsed = 0;
+	for (unsigned i = 0; i < sizeof(programs) / sizeof(programs[0]); ++i)
+	{
+		std::vector<uint32_t> tokens(programs[i].tokens,
+									 programs[i].tokens + programs[i].size / 4);
+		tokens[1] = (uint32_t)tokens.size();
+		bool parsed;
+		CHECK(round_trips(tokens, parsed));
+		CHECK(parsed);
+
+		for (unsigned j = 0; j < 4000; ++j)
+		{
+			std::vector<uint32_t> mutated = tokens;
+			for (unsigned k = 0; k < 1 + j % 3; ++k)
+			{
+				/* xorshift32 */
+				seed ^= seed << 13;
+				seed ^= seed >> 17;
+				seed ^= seed << 5;
+				/* the version and length tokens are left alone */
+				uint32_t& token = mutated[2 + seed % (mutated.size() - 2)];
+				if (j & 4)
+					token ^= 1u << (seed >> 27);
+				else
+					token = seed >> (seed & 31);
+			}
+			if (!round_trips(mutated, parsed))
+			{
+				fprintf(stderr, "program %u, mutation %u\n", i, j);
+				CHECK(!"round trip");
+			}
+			num_parsed += parsed;
+		}
+	}
+	/* enough of the mutations are valid for the check to mean something */
+	CHECK(num_parsed > 1000);
+}
+
+int main()
+{
+	test_exec_memory_operands();
+	test_exec_stray_breaks();
+	test_exec_divergent_loop();
+	test_flat_expansion();
+	test_scan_customdata_length();
+	test_dxbc_many_chunks();
+	test_encode_round_trip();
+	if (failures)
+		fprintf(stderr, "%u checks failed\n", failures);
+	return (int)failures;
+}
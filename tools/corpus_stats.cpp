@@ -0,0 +1,387 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "corpus_stats.h"
+#include "dxbc.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* the rows and columns of the resource counters */
+static unsigned resource_types()
+{
+	return dxbc_shader_input_type_name_count + 1;
+}
+
+static unsigned resource_dimensions()
+{
+	return dxbc_shader_dimension_name_count + 1;
+}
+
+static unsigned resource_index(uint32_t type, uint32_t dimension)
+{
+	if (type >= dxbc_shader_input_type_name_count)
+		type = dxbc_shader_input_type_name_count;
+	if (dimension >= dxbc_shader_dimension_name_count)
+		dimension = dxbc_shader_dimension_name_count;
+	return type * resource_dimensions() + dimension;
+}
+
+corpus_stats::corpus_stats()
+	: files(0), shaders(0), failures(0), unbalanced(0),
+	  resources(resource_types() * resource_dimensions()),
+	  resource_shaders(resources.size())
+{
+	memset(insns, 0, sizeof(insns));
+	memset(dcls, 0, sizeof(dcls));
+	memset(loop_depths, 0, sizeof(loop_depths));
+}
+
+/* the resource bindings of the RDEF chunk, if it has any that fit in it */
+static void add_resources(const dxbc_view& view, corpus_stats& stats)
+{
+	dxbc_chunk_header* chunk = view.find(FOURCC_RDEF);
+	if (!chunk)
+		return;
+	size_t size = bswap_le32(chunk->size);
+	if (size < sizeof(dxbc_chunk_resource_definition) -
+				   sizeof(dxbc_chunk_header))
+		return;
+	const dxbc_chunk_resource_definition* rdef =
+		(const dxbc_chunk_resource_definition*)chunk;
+	/* offsets are from the end of the chunk header */
+	size_t count = bswap_le32(rdef->resource_binding_count);
+	size_t offset = bswap_le32(rdef->resource_binding_offset);
+	if (offset > size || count > (size - offset) / sizeof(dxbc_rdef_binding))
+		return;
+	const dxbc_rdef_binding* bindings =
+		(const dxbc_rdef_binding*)((const char*)(chunk + 1) + offset);
+
+	std::vector<bool> seen(stats.resources.size());
+	for (size_t i = 0; i < count; ++i)
+	{
+		unsigned k = resource_index(bswap_le32(bindings[i].input_type),
+									bswap_le32(bindings[i].dimension));
+		++stats.resources[k];
+		if (!seen[k])
+		{
+			seen[k] = true;
+			++stats.resource_shaders[k];
+		}
+	}
+}
+
+const char* corpus_stats::add(const void* data, size_t size,
+							  sm4_arena& arena)
+{
+	++files;
+	dxbc_view view;
+	const char* error = dxbc_check_size(size);
+	if (!error)
+		error = view.init(data, (int)size);
+	dxbc_chunk_header* sm4_chunk = 0;
+	if (!error && !(sm4_chunk = view.find_shader_bytecode()))
+		error = "No shader bytecode";
+	sm4_parse_error parse_error;
+	sm4_program* sm4 = 0;
+	if (!error)
+	{
+		sm4 = sm4_parse(sm4_chunk + 1, bswap_le32(sm4_chunk->size), &arena,
+						&parse_error);
+		if (!sm4)
+			error = sm4_parse_error_names[parse_error.code];
+	}
+	if (error)
+	{
+		++failures;
+		arena.reset();
+		return error;
+	}
+
+	++shaders;
+	uint32_t version;
+	memcpy(&version, &sm4->version, sizeof(version));
+	++versions[version & 0xffff00ff];
+	add_resources(view, *this);
+
+	bool seen[SM4_OPCODE_COUNT];
+	memset(seen, 0, sizeof(seen));
+	for (unsigned i = 0; i < sm4->dcls.size(); ++i)
+	{
+		unsigned opcode = sm4->dcls[i]->opcode;
+		++dcls[opcode].count;
+		if (!seen[opcode])
+		{
+			seen[opcode] = true;
+			++dcls[opcode].shaders;
+		}
+	}
+
+	std::vector<unsigned> depths;
+	if (sm4_loop_depths(*sm4, depths))
+	{
+		++unbalanced;
+		depths.assign(sm4->insns.size(), 0);
+	}
+	bool seen_in_loops[SM4_OPCODE_COUNT];
+	memset(seen, 0, sizeof(seen));
+	memset(seen_in_loops, 0, sizeof(seen_in_loops));
+	unsigned max_depth = 0;
+	for (unsigned i = 0; i < sm4->insns.size(); ++i)
+	{
+		unsigned opcode = sm4->insns[i]->opcode;
+		corpus_opcode_stats& s = insns[opcode];
+		++s.count;
+		s.weighted += pow((double)SM4_COST_LOOP_ITERATIONS, (double)depths[i]);
+		if (!seen[opcode])
+		{
+			seen[opcode] = true;
+			++s.shaders;
+		}
+		if (!depths[i])
+			continue;
+		++s.in_loops;
+		if (!seen_in_loops[opcode])
+		{
+			seen_in_loops[opcode] = true;
+			++s.shaders_in_loops;
+		}
+		if (depths[i] > max_depth)
+			max_depth = depths[i];
+	}
+	++loop_depths[max_depth < CORPUS_STATS_LOOP_DEPTHS
+					  ? max_depth
+					  : CORPUS_STATS_LOOP_DEPTHS];
+
+	delete sm4;
+	arena.reset();
+	return 0;
+}
+
+static void merge_opcode(corpus_opcode_stats& to,
+						 const corpus_opcode_stats& from)
+{
+	to.count += from.count;
+	to.shaders += from.shaders;
+	to.in_loops += from.in_loops;
+	to.shaders_in_loops += from.shaders_in_loops;
+	to.weighted += from.weighted;
+}
+
+void corpus_stats::merge(const corpus_stats& other)
+{
+	files += other.files;
+	shaders += other.shaders;
+	failures += other.failures;
+	unbalanced += other.unbalanced;
+	for (std::map<uint32_t, uint64_t>::const_iterator i =
+			 other.versions.begin();
+		 i != other.versions.end(); ++i)
+		versions[i->first] += i->second;
+	for (unsigned i = 0; i < SM4_OPCODE_COUNT; ++i)
+	{
+		merge_opcode(insns[i], other.insns[i]);
+		merge_opcode(dcls[i], other.dcls[i]);
+	}
+	for (unsigned k = 0; k < resources.size(); ++k)
+	{
+		resources[k] += other.resources[k];
+		resource_shaders[k] += other.resource_shaders[k];
+	}
+	for (unsigned i = 0; i <= CORPUS_STATS_LOOP_DEPTHS; ++i)
+		loop_depths[i] += other.loop_depths[i];
+}
+
+/* ps_5_0, or type6_5_0 for the types that have no prefix */
+static std::string version_name(uint32_t version)
+{
+	char buf[32];
+	unsigned type = version >> 16;
+	if (type < 6)
+		snprintf(buf, sizeof(buf), "%cs_%u_%u", "pvghdc"[type],
+				 (version >> 4) & 15, version & 15);
+	else
+		snprintf(buf, sizeof(buf), "type%u_%u_%u", type, (version >> 4) & 15,
+				 version & 15);
+	return buf;
+}
+
+/* "unknown" is a dimension of its own, so values without a name are
+ * "invalid" */
+static std::string resource_name(unsigned type, unsigned dimension)
+{
+	return std::string(type < dxbc_shader_input_type_name_count
+						   ? dxbc_shader_input_type_names[type]
+						   : "invalid") +
+		   ":" +
+		   (dimension < dxbc_shader_dimension_name_count
+				? dxbc_shader_dimension_names[dimension]
+				: "invalid");
+}
+
+static std::string loop_depth_name(unsigned depth)
+{
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%u", depth);
+	return depth < CORPUS_STATS_LOOP_DEPTHS ? buf : std::string(buf) + "+";
+}
+
+/* the corpus_opcode_stats fields a row has */
+enum
+{
+	COLUMN_COUNT = 1,
+	COLUMN_SHADERS = 2,
+	COLUMN_LOOPS = 4, /* in_loops, shaders_in_loops and weighted */
+};
+
+/* Walks every counter that is not zero, in the order of the output, with
+ * the columns it has; the CSV and JSON writers only format. */
+template <typename Emit>
+static void visit(const corpus_stats& stats, Emit& emit)
+{
+	const unsigned count = COLUMN_COUNT, shaders = COLUMN_SHADERS,
+				   all = COLUMN_COUNT | COLUMN_SHADERS | COLUMN_LOOPS;
+	corpus_opcode_stats s;
+	memset(&s, 0, sizeof(s));
+	s.count = stats.files;
+	emit("total", "files", s, count);
+	s.count = stats.shaders;
+	emit("total", "shaders", s, count);
+	s.count = stats.failures;
+	emit("total", "failures", s, count);
+	s.count = stats.unbalanced;
+	emit("total", "unbalanced", s, count);
+
+	for (std::map<uint32_t, uint64_t>::const_iterator i =
+			 stats.versions.begin();
+		 i != stats.versions.end(); ++i)
+	{
+		s.count = i->second;
+		emit("version", version_name(i->first), s, count);
+	}
+	for (unsigned i = 0; i < SM4_OPCODE_COUNT; ++i)
+		if (stats.insns[i].count)
+			emit("opcode", sm4_opcode_names[i], stats.insns[i], all);
+	for (unsigned i = 0; i < SM4_OPCODE_COUNT; ++i)
+		if (stats.dcls[i].count)
+			emit("dcl", sm4_opcode_names[i], stats.dcls[i], count | shaders);
+	for (unsigned t = 0; t < resource_types(); ++t)
+	{
+		for (unsigned d = 0; d < resource_dimensions(); ++d)
+		{
+			unsigned k = resource_index(t, d);
+			if (!stats.resources[k])
+				continue;
+			s.count = stats.resources[k];
+			s.shaders = stats.resource_shaders[k];
+			emit("resource", resource_name(t, d), s, count | shaders);
+		}
+	}
+	s.shaders = 0;
+	for (unsigned i = 0; i <= CORPUS_STATS_LOOP_DEPTHS; ++i)
+	{
+		if (!stats.loop_depths[i])
+			continue;
+		s.count = stats.loop_depths[i];
+		emit("max_loop_depth", loop_depth_name(i), s, count);
+	}
+}
+
+struct csv_writer
+{
+	std::ostream& out;
+
+	void operator()(const char* section, const std::string& name,
+					const corpus_opcode_stats& s, unsigned columns) const
+	{
+		char buf[128];
+		out << section << ',' << name << ',' << s.count << ',';
+		if (columns & COLUMN_SHADERS)
+			out << s.shaders;
+		out << ',';
+		if (columns & COLUMN_LOOPS)
+			out << s.in_loops << ',' << s.shaders_in_loops << ',';
+		else
+			out << ",,";
+		if (columns & COLUMN_LOOPS)
+		{
+			snprintf(buf, sizeof(buf), "%.0f", s.weighted);
+			out << buf;
+		}
+		out << '\n';
+	}
+};
+
+void corpus_stats::write_csv(std::ostream& out) const
+{
+	out << "section,name,count,shaders,in_loops,shaders_in_loops,weighted\n";
+	csv_writer writer = {out};
+	visit(*this, writer);
+}
+
+/* the names are all identifiers, versions and dimensions, which need no
+ * escaping */
+struct json_writer
+{
+	std::ostream& out;
+	std::string section;
+
+	void operator()(const char* next, const std::string& name,
+					const corpus_opcode_stats& s, unsigned columns)
+	{
+		if (section != next)
+		{
+			out << (section.empty() ? "{\n" : "\n\t},\n") << "\t\"" << next
+				<< "\": {\n";
+			section = next;
+		}
+		else
+			out << ",\n";
+		out << "\t\t\"" << name << "\": ";
+		if (columns == COLUMN_COUNT)
+		{
+			out << s.count;
+			return;
+		}
+		out << "{\"count\": " << s.count << ", \"shaders\": " << s.shaders;
+		if (columns & COLUMN_LOOPS)
+		{
+			char buf[64];
+			snprintf(buf, sizeof(buf), "%.0f", s.weighted);
+			out << ", \"in_loops\": " << s.in_loops
+				<< ", \"shaders_in_loops\": " << s.shaders_in_loops
+				<< ", \"weighted\": " << buf;
+		}
+		out << '}';
+	}
+};
+
+void corpus_stats::write_json(std::ostream& out) const
+{
+	json_writer writer = {out, std::string()};
+	visit(*this, writer);
+	out << "\n\t}\n}\n";
+}
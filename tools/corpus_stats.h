@@ -0,0 +1,92 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Aggregate statistics over a corpus of shaders */
+
+#ifndef CORPUS_STATS_H_
+#define CORPUS_STATS_H_
+
+#include "sm4.h"
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* shaders are counted by their deepest loop nesting up to this, deeper
+ * ones along with it */
+#define CORPUS_STATS_LOOP_DEPTHS 8
+
+struct corpus_opcode_stats
+{
+	uint64_t count;
+	uint64_t shaders; /* that have it at least once */
+	uint64_t in_loops;
+	uint64_t shaders_in_loops;
+	/* every instruction counts SM4_COST_LOOP_ITERATIONS to the power of
+	 * its loop nesting, as in sm4_estimate_cost */
+	double weighted;
+};
+
+/* Counters for any number of shaders; each worker fills one of its own
+ * and they are merged at the end, so that nothing is shared while the
+ * corpus is walked.
+ */
+struct corpus_stats
+{
+	uint64_t files;
+	uint64_t shaders; /* the files whose shader bytecode was parsed */
+	uint64_t failures;
+	/* shaders whose loops could not be matched, counted as if they had
+	 * none */
+	uint64_t unbalanced;
+	/* by sm4_token_version with the format bits cleared */
+	std::map<uint32_t, uint64_t> versions;
+	corpus_opcode_stats insns[SM4_OPCODE_COUNT];
+	/* declarations, by opcode; only count and shaders are used */
+	corpus_opcode_stats dcls[SM4_OPCODE_COUNT];
+	/* RDEF bindings, by D3D_SHADER_INPUT_TYPE and D3D_SRV_DIMENSION, in
+	 * rows of dxbc_shader_dimension_name_count + 1: the last row and
+	 * column count the values that have no name, which only corrupt
+	 * chunks have */
+	std::vector<uint64_t> resources;
+	std::vector<uint64_t> resource_shaders;
+	uint64_t loop_depths[CORPUS_STATS_LOOP_DEPTHS + 1];
+
+	corpus_stats();
+
+	/* counts a container; returns NULL on success, or an error message,
+	 * the file being counted as a failure. The arena is reset afterwards. */
+	const char* add(const void* data, size_t size, sm4_arena& arena);
+
+	void merge(const corpus_stats& other);
+
+	/* one row per counter that is not zero: section, name, count, shaders,
+	 * in_loops, shaders_in_loops, weighted */
+	void write_csv(std::ostream& out) const;
+	void write_json(std::ostream& out) const;
+};
+
+#endif /* CORPUS_STATS_H_ */
@@ -0,0 +1,182 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "disasm_cache.h"
+#include "dxbc.h"
+#include <atomic>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char cache_magic[] = "FXDIS-CACHE";
+
+disasm_cache::disasm_cache(const std::string& dir) : dir(dir) {}
+
+bool disasm_cache::open()
+{
+#ifdef _WIN32
+	if (_mkdir(dir.c_str()) && errno != EEXIST)
+		return false;
+#else
+	if (mkdir(dir.c_str(), 0777) && errno != EEXIST)
+		return false;
+#endif
+	return true;
+}
+
+bool disasm_cache::key(const void* blob, size_t size, char key[33])
+{
+	if (size < sizeof(dxbc_container_header))
+		return false;
+	const unsigned char* checksum =
+		(const unsigned char*)((const dxbc_container_header*)blob)->unk;
+	unsigned char any = 0;
+	for (unsigned i = 0; i < 16; ++i)
+	{
+		key[i * 2] = "0123456789abcdef"[checksum[i] >> 4];
+		key[i * 2 + 1] = "0123456789abcdef"[checksum[i] & 0xf];
+		any |= checksum[i];
+	}
+	key[32] = 0;
+	return any != 0;
+}
+
+bool disasm_cache::lookup(const char* key, size_t blob_size, std::string& text,
+						  disasm_summary* summary) const
+{
+	std::string path = dir + "/" + key;
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+
+	char magic[sizeof(cache_magic)];
+	unsigned version;
+	disasm_summary s;
+	unsigned long length;
+	bool ok = fscanf(f, "%11s %u %u %x %u %u %u %lu", magic, &version,
+					 &s.blob_size, &s.version, &s.num_chunks, &s.num_dcls,
+					 &s.num_insns, &length) == 8 &&
+			  fgetc(f) == '\n' && !strcmp(magic, cache_magic) &&
+			  version == FORMAT_VERSION && s.blob_size == blob_size;
+	/* the length is only trusted once the file is known to hold that much
+	 * text, so that a corrupt entry cannot make it allocate any amount */
+	long start = ok ? ftell(f) : -1, end = -1;
+	if (start >= 0 && !fseek(f, 0, SEEK_END))
+		end = ftell(f);
+	ok = ok && start >= 0 && end >= start &&
+		 (unsigned long)(end - start) == length && !fseek(f, start, SEEK_SET);
+	if (ok)
+	{
+		text.resize(length);
+		ok = fread(&text[0], 1, length, f) == length && fgetc(f) == EOF;
+	}
+	fclose(f);
+	if (ok && summary)
+		*summary = s;
+	return ok;
+}
+
+bool disasm_cache::store(const char* key, const disasm_summary& summary,
+						 const char* text, size_t length) const
+{
+	static std::atomic<unsigned> counter(0);
+	char suffix[64];
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = (int)getpid();
+#endif
+	snprintf(suffix, sizeof(suffix), ".tmp.%d.%u", pid, counter++);
+	std::string path = dir + "/" + key;
+	std::string tmp = path + suffix;
+
+	FILE* f = fopen(tmp.c_str(), "wb");
+	if (!f)
+		return false;
+	bool ok = fprintf(f, "%s %u %u %x %u %u %u %lu\n", cache_magic,
+					  (unsigned)FORMAT_VERSION, summary.blob_size,
+					  summary.version, summary.num_chunks, summary.num_dcls,
+					  summary.num_insns, (unsigned long)length) > 0 &&
+			  fwrite(text, 1, length, f) == length;
+	ok = !fclose(f) && ok;
+
+#ifdef _WIN32
+	ok = ok && MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = ok && !rename(tmp.c_str(), path.c_str());
+#endif
+	if (!ok)
+		remove(tmp.c_str());
+	return ok;
+}
+
+disasm_memory_cache::disasm_memory_cache(size_t capacity)
+	: size(0), capacity(capacity)
+{
+}
+
+bool disasm_memory_cache::lookup(const char* key, size_t blob_size,
+								 std::string& text) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unordered_map<std::string, entry>::const_iterator i =
+		entries.find(key);
+	if (i == entries.end() || i->second.blob_size != blob_size)
+		return false;
+	text = i->second.text;
+	return true;
+}
+
+void disasm_memory_cache::store(const char* key, size_t blob_size,
+								const char* text, size_t length)
+{
+	if (length > capacity)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	if (entries.count(key))
+		return;
+	while (size + length > capacity)
+	{
+		std::unordered_map<std::string, entry>::iterator oldest =
+			entries.find(order.front());
+		size -= oldest->second.text.size();
+		entries.erase(oldest);
+		order.pop_front();
+	}
+	entry& e = entries[key];
+	e.blob_size = blob_size;
+	e.text.assign(text, length);
+	order.push_back(key);
+	size += length;
+}
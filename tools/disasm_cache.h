@@ -0,0 +1,110 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* On-disk cache of rendered disassembly, shared between fxdis processes */
+
+#ifndef DISASM_CACHE_H_
+#define DISASM_CACHE_H_
+
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+/* parsed facts about a blob, stored next to its disassembly */
+struct disasm_summary
+{
+	uint32_t blob_size;
+	uint32_t version; /* raw sm4 version token, 0 without shader bytecode */
+	uint32_t num_chunks;
+	uint32_t num_dcls;
+	uint32_t num_insns;
+};
+
+/* Entries are named after the 128-bit checksum fxc stores in the DXBC
+ * header, so a blob that has been seen before costs one file read.
+ * An entry is written to a temporary file and renamed over its final name,
+ * so concurrent processes sharing the directory only ever see complete
+ * entries; whichever writes last wins, with identical contents.
+ * Each entry also records the blob size and a format version, and entries
+ * not matching them are treated as misses.
+ */
+struct disasm_cache
+{
+	/* bump when the output of the disassembler changes */
+	enum
+	{
+		FORMAT_VERSION = 4
+	};
+
+	explicit disasm_cache(const std::string& dir);
+
+	/* creates the directory if needed */
+	bool open();
+
+	/* computes the key of a DXBC blob; returns false for blobs without a
+	 * checksum, which must not be cached as they would all collide */
+	static bool key(const void* blob, size_t size, char key[33]);
+
+	/* summary, if not NULL, is filled in from the entry */
+	bool lookup(const char* key, size_t blob_size, std::string& text,
+				disasm_summary* summary = 0) const;
+	bool store(const char* key, const disasm_summary& summary,
+			   const char* text, size_t length) const;
+
+  private:
+	std::string dir;
+};
+
+/* Rendered disassembly kept in memory by a long-running fxdis, under the
+ * same keys as disasm_cache; once the texts add up to more than capacity
+ * bytes, the oldest entries are dropped first. Thread safe.
+ */
+struct disasm_memory_cache
+{
+	explicit disasm_memory_cache(size_t capacity);
+
+	bool lookup(const char* key, size_t blob_size, std::string& text) const;
+	void store(const char* key, size_t blob_size, const char* text,
+			   size_t length);
+
+  private:
+	struct entry
+	{
+		size_t blob_size;
+		std::string text;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<std::string, entry> entries;
+	std::deque<std::string> order; /* keys, oldest first */
+	size_t size;
+	size_t capacity;
+};
+
+#endif /* DISASM_CACHE_H_ */
@@ -0,0 +1,448 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "disasm_server.h"
+#include "le32.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <errno.h>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+typedef SOCKET socket_t;
+#define poll WSAPoll
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+/* writing to a client that went away must not kill the server */
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/* how often threads blocked on a socket check whether the server is
+ * stopping */
+#define POLL_INTERVAL_MS 200
+
+struct disasm_server::connection
+{
+	socket_t socket;
+
+	/* the requests read and not answered yet, and the bytes they hold:
+	 * their payloads until they are handled, then their responses until
+	 * those are sent */
+	std::mutex flight_mutex;
+	std::condition_variable flight_done;
+	unsigned in_flight;
+	size_t in_flight_size;
+
+	/* the responses the workers rendered, which the sender of the
+	 * connection writes out whole and in order, so that no worker ever
+	 * waits on a client */
+	std::deque<std::string> responses;
+	std::condition_variable responses_queued;
+	bool reading; /* the reader may still hand requests to the pool */
+
+	explicit connection(socket_t socket)
+		: socket(socket), in_flight(0), in_flight_size(0), reading(true)
+	{
+	}
+	~connection() { closesocket(socket); }
+};
+
+static bool interrupted()
+{
+#ifdef _WIN32
+	return false;
+#else
+	return errno == EINTR;
+#endif
+}
+
+/* waits until s can be read from, or the server is stopping */
+static bool wait_readable(socket_t s, const std::atomic<bool>& stopping)
+{
+	while (!stopping)
+	{
+		pollfd p;
+		p.fd = s;
+		p.events = POLLIN;
+		p.revents = 0;
+		int n = poll(&p, 1, POLL_INTERVAL_MS);
+		if (n > 0)
+			return true;
+		if (n < 0 && !interrupted())
+			return false;
+	}
+	return false;
+}
+
+static bool recv_all(socket_t s, void* data, size_t size,
+					 const std::atomic<bool>& stopping)
+{
+	char* p = (char*)data;
+	while (size)
+	{
+		if (!wait_readable(s, stopping))
+			return false;
+		int n = (int)recv(s, p, (int)std::min<size_t>(size, 1 << 30), 0);
+		if (n < 0 && interrupted())
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool send_all(socket_t s, const void* data, size_t size)
+{
+	const char* p = (const char*)data;
+	while (size)
+	{
+		int n = (int)send(s, p, (int)std::min<size_t>(size, 1 << 30),
+						  SEND_FLAGS);
+		if (n < 0 && interrupted())
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+/* waits until a request of size bytes may be read from c, or the server is
+ * stopping; a request is always let through when none is in flight, however
+ * large it is */
+static bool wait_for_room(disasm_server::connection& c, size_t size,
+						  const std::atomic<bool>& stopping)
+{
+	std::unique_lock<std::mutex> lock(c.flight_mutex);
+	while (c.in_flight &&
+		   (c.in_flight == DISASM_SERVER_MAX_IN_FLIGHT ||
+			c.in_flight_size + size > DISASM_SERVER_MAX_REQUEST))
+	{
+		if (stopping)
+			return false;
+		c.flight_done.wait_for(
+			lock, std::chrono::milliseconds(POLL_INTERVAL_MS));
+	}
+	++c.in_flight;
+	c.in_flight_size += size;
+	return true;
+}
+
+/* queues the response to a request of request_size bytes for the sender
+ * of c, the response taking the place of the request in the bytes in
+ * flight */
+static void respond(disasm_server::connection& c, uint32_t id,
+					uint32_t status, const char* text, size_t text_size,
+					const std::string& errors, size_t request_size)
+{
+	uint32_t header[4];
+	header[0] = bswap_le32((uint32_t)(12 + text_size + errors.size()));
+	header[1] = bswap_le32(id);
+	header[2] = bswap_le32(status);
+	header[3] = bswap_le32((uint32_t)text_size);
+	std::string frame;
+	frame.reserve(sizeof(header) + text_size + errors.size());
+	frame.append((const char*)header, sizeof(header));
+	frame.append(text, text_size);
+	frame.append(errors);
+
+	std::lock_guard<std::mutex> lock(c.flight_mutex);
+	c.in_flight_size = c.in_flight_size - request_size + frame.size();
+	c.responses.push_back(std::string());
+	c.responses.back().swap(frame);
+	c.responses_queued.notify_one();
+}
+
+/* only sockets are replaced by listen, never files that happen to be in
+ * the way */
+static bool is_socket(const char* path)
+{
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes != INVALID_FILE_ATTRIBUTES &&
+		   (attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+#else
+	struct stat st;
+	return !lstat(path, &st) && S_ISSOCK(st.st_mode);
+#endif
+}
+
+disasm_server::disasm_server(unsigned num_threads)
+	: pool(num_threads), current(0), listener(0), listening(false),
+	  num_senders(0), stop_id(0), stop_size(0), stopping(false)
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	for (unsigned i = 0; i < pool.size(); ++i)
+		writers.push_back(std::unique_ptr<text_writer>(new text_writer));
+}
+
+disasm_server::~disasm_server()
+{
+	if (listening)
+	{
+		closesocket((socket_t)listener);
+		remove(socket_path.c_str());
+	}
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+const char* disasm_server::listen(const char* path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	size_t length = strlen(path);
+	if (length >= sizeof(addr.sun_path))
+		return "Socket path is too long";
+	memcpy(addr.sun_path, path, length + 1);
+
+	socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET)
+		return "Could not create socket";
+	if (bind(s, (sockaddr*)&addr, sizeof(addr)))
+	{
+		/* nobody accepting on the socket means its server is dead */
+		socket_t probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool alive = probe != INVALID_SOCKET &&
+					 !connect(probe, (sockaddr*)&addr, sizeof(addr));
+		if (probe != INVALID_SOCKET)
+			closesocket(probe);
+		if (alive || !is_socket(path) || remove(path) ||
+			bind(s, (sockaddr*)&addr, sizeof(addr)))
+		{
+			closesocket(s);
+			return alive ? "Socket is in use by another server"
+						 : "Could not bind socket";
+		}
+	}
+	if (::listen(s, SOMAXCONN))
+	{
+		closesocket(s);
+		remove(path);
+		return "Could not listen on socket";
+	}
+
+	listener = (uintptr_t)s;
+	listening = true;
+	socket_path = path;
+	return 0;
+}
+
+void disasm_server::run(const handler& h)
+{
+	current = &h;
+	while (!stopping)
+	{
+		pollfd p;
+		p.fd = (socket_t)listener;
+		p.events = POLLIN;
+		p.revents = 0;
+		if (poll(&p, 1, POLL_INTERVAL_MS) <= 0)
+			continue;
+		socket_t s = accept((socket_t)listener, 0, 0);
+		if (s == INVALID_SOCKET)
+			continue;
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+		int on = 1;
+		setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+		std::shared_ptr<connection> c(new connection(s));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			readers.push_back(c);
+			++num_senders;
+		}
+		std::thread(&disasm_server::read_requests, this, c).detach();
+		std::thread(&disasm_server::send_responses, this, c).detach();
+	}
+
+	/* the readers give up within POLL_INTERVAL_MS, after which no more
+	 * tasks can be submitted */
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		readers_done.wait(lock, [this] { return readers.empty(); });
+	}
+	pool.wait();
+	if (stop_connection)
+	{
+		respond(*stop_connection, stop_id, 0, "", 0, std::string(),
+				stop_size);
+		stop_connection.reset();
+	}
+
+	/* the senders are done once their clients have every response, or
+	 * have gone away */
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		senders_done.wait(lock, [this] { return !num_senders; });
+	}
+	current = 0;
+}
+
+void disasm_server::read_requests(std::shared_ptr<connection> c)
+{
+	for (;;)
+	{
+		uint32_t header[3];
+		if (!recv_all(c->socket, header, sizeof(header), stopping))
+			break;
+		uint32_t size = bswap_le32(header[0]);
+		uint32_t id = bswap_le32(header[1]);
+		uint32_t kind = bswap_le32(header[2]);
+		if (size < 8 || size - 8 > DISASM_SERVER_MAX_REQUEST)
+			break;
+		size -= 8;
+		if (!wait_for_room(*c, size, stopping))
+			break;
+
+		/* words, so that blobs are aligned for the parsers */
+		std::shared_ptr<std::vector<uint32_t>> payload(
+			new std::vector<uint32_t>((size + 3) / 4));
+		if (!recv_all(c->socket, payload->data(), size, stopping))
+			break;
+
+		/* the stop request stays in flight until it is answered, which
+		 * keeps the sender of its connection around */
+		if (kind == DISASM_REQUEST_STOP)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stop_connection)
+				respond(*c, id, 0, "", 0, std::string(), size);
+			else
+			{
+				stop_connection = c;
+				stop_id = id;
+				stop_size = size;
+			}
+			stopping = true;
+			break;
+		}
+		submit(c, id, kind, payload, size);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(c->flight_mutex);
+		c->reading = false;
+		c->responses_queued.notify_one();
+	}
+
+	/* notified under the lock, as run may return and the server go away
+	 * as soon as it is released */
+	std::lock_guard<std::mutex> lock(mutex);
+	readers.erase(std::find(readers.begin(), readers.end(), c));
+	readers_done.notify_all();
+}
+
+void disasm_server::submit(const std::shared_ptr<connection>& c, uint32_t id,
+						   uint32_t kind,
+						   std::shared_ptr<std::vector<uint32_t>> payload,
+						   size_t size)
+{
+	pool.submit([this, c, id, kind, payload, size](unsigned worker) {
+		text_writer& out = *writers[worker];
+		std::ostringstream err;
+		out.clear();
+		bool ok = false;
+		std::string path;
+		disasm_request request;
+		request.kind = kind;
+		request.path = "blob";
+		request.data = payload->data();
+		request.size = size;
+		if (kind == DISASM_REQUEST_PATH)
+		{
+			path.assign((const char*)payload->data(), size);
+			request.path = path.c_str();
+			request.data = 0;
+			request.size = 0;
+		}
+		if (kind == DISASM_REQUEST_BLOB || kind == DISASM_REQUEST_PATH)
+			ok = (*current)(worker, request, out, err);
+		else
+			err << "Unknown request kind: " << kind << "\n";
+		respond(*c, id, ok ? 0 : 1, out.data(), out.size(), err.str(), size);
+	});
+}
+
+void disasm_server::send_responses(std::shared_ptr<connection> c)
+{
+	bool failed = false;
+	for (;;)
+	{
+		std::string frame;
+		{
+			std::unique_lock<std::mutex> lock(c->flight_mutex);
+			c->responses_queued.wait(lock, [&c] {
+				return !c->responses.empty() ||
+					   (!c->reading && !c->in_flight);
+			});
+			if (c->responses.empty())
+				break;
+			frame.swap(c->responses.front());
+			c->responses.pop_front();
+		}
+		/* a client that went away is noticed by the reader, so the
+		 * failure is not reported; the responses still to come are
+		 * dropped, which keeps making room for the reader */
+		if (!failed)
+			failed = !send_all(c->socket, frame.data(), frame.size());
+
+		std::lock_guard<std::mutex> lock(c->flight_mutex);
+		--c->in_flight;
+		c->in_flight_size -= frame.size();
+		c->flight_done.notify_one();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	--num_senders;
+	senders_done.notify_all();
+}
@@ -0,0 +1,148 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Long-running disassembly server behind the daemon mode of fxdis */
+
+#ifndef DISASM_SERVER_H_
+#define DISASM_SERVER_H_
+
+#include "text_writer.h"
+#include "work_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Clients talk to the server over a Unix domain socket, in frames whose
+ * integers are all little endian:
+ *
+ *   request:  u32 size, u32 id, u32 kind, payload
+ *   response: u32 size, u32 id, u32 status, u32 text size, text, errors
+ *
+ * where size counts the bytes following it. The payload of a request is a
+ * DXBC blob or the path of a file, as told by its kind. A client may send
+ * any number of requests without waiting for the responses: they are
+ * handled in parallel, and each response is sent as soon as it is ready,
+ * tagged with the id the client gave its request. The status is 0 on
+ * success, and the errors are what the command line would print to stderr.
+ * A stop request makes the server stop reading requests; it is answered
+ * once the requests already read have been.
+ * Requests larger than DISASM_SERVER_MAX_REQUEST bytes get the connection
+ * closed. The server stops reading from a connection that has
+ * DISASM_SERVER_MAX_IN_FLIGHT requests waiting for their responses to be
+ * sent, or DISASM_SERVER_MAX_REQUEST bytes of them and of the responses
+ * rendered but not sent, until some have gone out, so clients sending more
+ * than that must read the responses as they go. A client that does not
+ * read only holds up its own connection: responses are sent by a thread
+ * of each connection, never by the workers.
+ */
+enum disasm_request_kind
+{
+	DISASM_REQUEST_BLOB,
+	DISASM_REQUEST_PATH,
+	DISASM_REQUEST_STOP,
+
+	DISASM_REQUEST_COUNT
+};
+
+#define DISASM_SERVER_MAX_REQUEST (256u << 20)
+#define DISASM_SERVER_MAX_IN_FLIGHT 64
+
+struct disasm_request
+{
+	unsigned kind;
+	const char* path; /* the file, or "blob" */
+	/* the blob, 4-byte aligned, for blob requests */
+	const void* data;
+	size_t size;
+};
+
+/* The worker pool, and the per-worker text writers the responses are
+ * rendered into, live as long as the server, so that the memory warmed up
+ * by a request serves the next ones; handlers are expected to keep their
+ * own per-worker state (parser arenas) the same way.
+ */
+class disasm_server
+{
+  public:
+	/* renders request into out, reporting problems to err; called on the
+	 * given worker of the pool, concurrently with the other workers */
+	typedef std::function<bool(unsigned worker, const disasm_request& request,
+							   text_writer& out, std::ostream& err)>
+		handler;
+
+	explicit disasm_server(unsigned num_threads = 0);
+	~disasm_server();
+
+	unsigned size() const { return pool.size(); }
+
+	/* binds a socket at path, replacing the one a dead server may have
+	 * left there; returns 0 or an error message */
+	const char* listen(const char* path);
+
+	/* serves requests until one asks to stop, and returns once every
+	 * response has been sent or its client has gone away */
+	void run(const handler& h);
+
+	struct connection;
+
+  private:
+	void read_requests(std::shared_ptr<connection> c);
+	void send_responses(std::shared_ptr<connection> c);
+	void submit(const std::shared_ptr<connection>& c, uint32_t id,
+				uint32_t kind, std::shared_ptr<std::vector<uint32_t>> payload,
+				size_t size);
+
+	work_pool pool;
+	std::vector<std::unique_ptr<text_writer>> writers;
+	const handler* current;
+	std::string socket_path;
+	uintptr_t listener; /* a SOCKET on Windows */
+	bool listening;
+
+	/* the connections being read from, the number of them still sending
+	 * responses, and the stop request */
+	std::mutex mutex;
+	std::condition_variable readers_done;
+	std::vector<std::shared_ptr<connection>> readers;
+	std::condition_variable senders_done;
+	unsigned num_senders;
+	std::shared_ptr<connection> stop_connection;
+	uint32_t stop_id;
+	size_t stop_size;
+	std::atomic<bool> stopping;
+
+	disasm_server(const disasm_server&);
+	disasm_server& operator=(const disasm_server&);
+};
+
+#endif /* DISASM_SERVER_H_ */
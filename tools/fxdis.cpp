@@ -24,10 +24,31 @@
  *
  **************************************************************************/
 
+#include "corpus_stats.h"
+#include "disasm_cache.h"
+#include "disasm_server.h"
 #include "dxbc.h"
+#include "mapped_file.h"
+#include "shader_index.h"
 #include "sm4.h"
+#include "work_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <ctype.h>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 void usage()
 {
@@ -38,67 +59,1570 @@ void usage()
 	std::cerr << "Latest version available from "
 				 "http://cgit.freedesktop.org/mesa/mesa/\n";
 	std::cerr << "\n";
-	std::cerr << "Usage: fxdis FILE\n";
+	std::cerr << "Usage: fxdis [-b] [-g] [-p] [-v] FILE\n";
+	std::cerr << "       fxdis -t [-v] FILE\n";
+	std::cerr << "       fxdis [-b] [-g] [-p] [-v] [-j THREADS] [-l LISTFILE] "
+				 "[-c CACHEDIR] FILE|DIRECTORY...\n";
+	std::cerr << "       fxdis -s|-x OUTDIR [-b] [-g] [-p] [-v] [-l LISTFILE] "
+				 "[-c CACHEDIR] FILE|DIRECTORY...\n";
+	std::cerr << "       fxdis -V [-j THREADS] [-l LISTFILE] "
+				 "FILE|DIRECTORY...\n";
+	std::cerr << "       fxdis -e [-j THREADS] [-l LISTFILE] "
+				 "FILE|DIRECTORY...\n";
+	std::cerr << "       fxdis -d [-j THREADS] OLD NEW\n";
+	std::cerr << "       fxdis -a csv|json [-j THREADS] [-l LISTFILE] "
+				 "FILE|DIRECTORY...\n";
+	std::cerr << "       fxdis -i INDEX [-j THREADS] [-l LISTFILE] "
+				 "FILE|DIRECTORY...\n";
+	std::cerr << "       fxdis -q INDEX [QUERY...]\n";
+	std::cerr << "       fxdis -D SOCKET [-b] [-g] [-p] [-t] [-v] [-j THREADS] "
+				 "[-c CACHEDIR]\n";
+	std::cerr << "\n";
+	std::cerr << "With more than one input, directories or a list file (one "
+				 "path per line),\n";
+	std::cerr << "all files are disassembled in parallel and printed in input "
+				 "order, each one\n";
+	std::cerr << "preceded by a \"// FILE\" line. Directories are walked "
+				 "recursively in sorted\n";
+	std::cerr << "order. THREADS defaults to the number of CPU cores.\n";
+	std::cerr << "\n";
+	std::cerr << "With -c, disassembly is cached in CACHEDIR under the checksum "
+				 "of each blob,\n";
+	std::cerr << "which may be shared by concurrent fxdis processes.\n";
+	std::cerr << "\n";
+	std::cerr << "With -s, the inputs may be arbitrary files (archives, "
+				 "executables, dumps)\n";
+	std::cerr << "of any size: every DXBC container embedded in them is "
+				 "disassembled, preceded\n";
+	std::cerr << "by a \"// BLOB FILE +OFFSET\" line. With -x, the "
+				 "containers are written to\n";
+	std::cerr << "OUTDIR as FILE.OFFSET.dxbc instead. OFFSET is in hex, "
+				 "8 digits or more.\n";
+	std::cerr << "\n";
+	std::cerr << "With -b, the parsed program is also written next to each "
+				 "input as FILE.sm4b\n";
+	std::cerr << "(FILE.OFFSET.sm4b with -s), in the memory mappable "
+				 "sm4_image format.\n";
+	std::cerr << "\n";
+	std::cerr << "With -v, containers whose checksum does not match are "
+				 "reported instead of\n";
+	std::cerr << "disassembled. With -V, the checksums of all inputs are "
+				 "only verified, and\n";
+	std::cerr << "the bad ones printed.\n";
+	std::cerr << "\n";
+	std::cerr << "With -g, the basic blocks of each program are listed after "
+				 "it, with their\n";
+	std::cerr << "successors, predecessors, immediate dominator and "
+				 "post-dominator.\n";
+	std::cerr << "With -p, every instruction is followed by the number of "
+				 "temp registers and\n";
+	std::cerr << "components live across it, and every block by the temps "
+				 "live on entry.\n";
+	std::cerr << "\n";
+	std::cerr << "With -e, a static estimate of the cost of each shader is "
+				 "printed instead, as\n";
+	std::cerr << "CSV with a row per file: the weighted costs of its ALU, "
+				 "transcendental,\n";
+	std::cerr << "sample, load/store, atomic and flow control instructions, "
+				 "every loop being\n";
+	std::cerr << "assumed to run " << SM4_COST_LOOP_ITERATIONS
+			  << " times, and the instruction count of the STAT chunk.\n";
+	std::cerr << "\n";
+	std::cerr << "With -t, the program is translated to C++ instead: a "
+				 "function named after\n";
+	std::cerr << "the file, running it with every register an array of "
+				 "lanes, which compiles\n";
+	std::cerr << "with any C++ compiler.\n";
+	std::cerr << "\n";
+	std::cerr << "With -d, the shaders of OLD and NEW, two files or two "
+				 "directories whose files\n";
+	std::cerr << "are paired by relative path, are compared instead: the "
+				 "declarations only one\n";
+	std::cerr << "of them has and the instructions removed (-), inserted (+) "
+				 "or changed (< >)\n";
+	std::cerr << "are listed for every pair that differs, after a \"// DIFF "
+				 "FILE\" line in\n";
+	std::cerr << "directory mode. The exit status is 0 only when nothing "
+				 "differs.\n";
+	std::cerr << "\n";
+	std::cerr << "With -a, statistics over all inputs are printed instead, "
+				 "as CSV or JSON:\n";
+	std::cerr << "shader models, declarations, RDEF resource types and "
+				 "dimensions, the deepest\n";
+	std::cerr << "loop nesting, and for every opcode the instructions and "
+				 "shaders using it, in\n";
+	std::cerr << "loops or not, with a count weighted by "
+			  << SM4_COST_LOOP_ITERATIONS
+			  << " to the power of the loop nesting.\n";
+	std::cerr << "\n";
+	std::cerr << "With -i, the inputs are added to the shader index INDEX, "
+				 "created if need be;\n";
+	std::cerr << "shaders already in it are skipped. Paths that changed, can "
+				 "no longer be read\n";
+	std::cerr << "or are gone from an input directory have their shaders "
+				 "dropped, so that\n";
+	std::cerr << "indexing the same directories again keeps INDEX up to "
+				 "date, as long as it\n";
+	std::cerr << "is done from the same working directory. With -q, the "
+				 "paths of the shaders\n";
+	std::cerr << "in INDEX matching QUERY are printed, or without a QUERY every "
+				 "term with its\n";
+	std::cerr << "number of shaders. Terms are opcode and declaration names, "
+				 "resource\n";
+	std::cerr << "declarations with their target (dcl_resource_texturecube), "
+				 "file:NAME for\n";
+	std::cerr << "register files, in:, out: and patch:SEMANTIC, and "
+				 "flag:NAME for global\n";
+	std::cerr << "flags; they combine with AND, OR, NOT and parentheses, as "
+				 "in\n";
+	std::cerr << "    fxdis -q INDEX \"deriv_rtx AND (dcl_resource_texturecube "
+				 "OR NOT in:TEXCOORD)\"\n";
+	std::cerr << "\n";
+	std::cerr << "With -D, fxdis keeps running as a server on the Unix domain "
+				 "socket SOCKET,\n";
+	std::cerr << "disassembling the blobs and files its clients send until "
+				 "one asks it to stop,\n";
+	std::cerr << "with the recent disassembly kept in memory; the protocol is "
+				 "described in\n";
+	std::cerr << "tools/disasm_server.h.\n";
 	std::cerr << std::endl;
 }
 
-int main(int argc, char** argv)
+static bool open_file(const char* path, mapped_file& file, std::ostream& err)
 {
-	if (argc < 2)
+	if (!file.open(path))
 	{
-		usage();
-		return EXIT_FAILURE;
+		err << "Could not open file: " << path << "\n";
+		return false;
+	}
+
+	if (file.size < sizeof(dxbc_container_header))
+	{
+		err << "File is too small!\n";
+		return false;
+	}
+	return true;
+}
+
+static bool write_file(const std::string& path, const void* data, size_t size)
+{
+	FILE* f = fopen(path.c_str(), "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(data, 1, size, f) == size;
+	return fclose(f) == 0 && ok;
+}
+
+/* flattens the program, with its control flow links and labels, into a
+ * sm4_image that other tools can map instead of parsing the disassembly */
+static bool write_image(sm4_program& program, const std::string& path,
+						std::ostream& err)
+{
+	sm4_link_cf_insns(program);
+	sm4_find_labels(program);
+	sm4_flat_program flat;
+	sm4_flatten(program, flat);
+	std::pair<void*, size_t> image = sm4_image_assemble(flat);
+	bool ok = image.first && write_file(path, image.first, image.second);
+	free(image.first);
+	if (!ok)
+		err << "Could not write file: " << path << "\n";
+	return ok;
+}
+
+/* what is done with every blob besides disassembling it */
+struct disasm_options
+{
+	const disasm_cache* cache;
+	/* looked up before the cache, and filled from it */
+	disasm_memory_cache* memory_cache;
+	bool write_images; /* FILE.sm4b, or FILE.OFFSET.sm4b in scan mode */
+	/* blobs whose checksum does not match are reported and not
+	 * disassembled, even when they are in the cache */
+	bool verify;
+	bool dump_cfg; /* the control flow graph follows the program */
+	/* the program is annotated with the temps live at every instruction */
+	bool dump_liveness;
+	/* C++ source running the program is written instead of the
+	 * disassembly */
+	bool translate;
+
+	disasm_options()
+		: cache(0), memory_cache(0), write_images(false), verify(false), dump_cfg(false),
+		  dump_liveness(false), translate(false)
+	{
+	}
+};
+
+/* the name of the function translated from the blob at path: its file
+ * name, made an identifier */
+static std::string function_name(const char* path)
+{
+	const char* base = path;
+	for (const char* p = path; *p; ++p)
+		if (*p == '/' || *p == '\\')
+			base = p + 1;
+	std::string name;
+	for (const char* p = base; *p && *p != '.' && *p != ' '; ++p)
+		name += isalnum((unsigned char)*p) ? *p : '_';
+	if (name.empty() || isdigit((unsigned char)name[0]))
+		name = "shader_" + name;
+	return name;
+}
+
+/* with an arena, the program is parsed into it and the arena is reset
+ * afterwards, so that its memory can be reused for the next file; with an
+ * image_path, the parsed program is also written there as a sm4_image */
+static bool render(const char* path, const void* data, size_t size,
+				   text_writer& out, std::ostream& err, sm4_arena* arena,
+				   disasm_summary& summary, const char* image_path,
+				   const disasm_options& options)
+{
+	bool ok = true;
+	memset(&summary, 0, sizeof(summary));
+	summary.blob_size = (uint32_t)size;
+
+	/* the parsers only ever read, so they work on the mapped pages directly */
+	const char* parse_error = dxbc_check_size(size);
+	dxbc_container* dxbc =
+		parse_error ? 0 : dxbc_parse(data, (int)size, 0, &parse_error);
+	if (!dxbc)
+	{
+		err << path << ": " << parse_error << "\n";
+		return false;
+	}
+	summary.num_chunks = (uint32_t)dxbc->chunks.size();
+	/* a malformed chunk condemns the whole blob, which in scan mode is
+	 * most likely not a container at all */
+	unsigned chunk;
+	const char* dump_error =
+		options.translate ? 0 : dxbc_dump(out, *dxbc, &chunk);
+	if (dump_error)
+	{
+		err << path << ": " << dump_error << " in chunk " << chunk << "\n";
+		delete dxbc;
+		return false;
+	}
+	dxbc_chunk_header* sm4_chunk = dxbc->view.find_shader_bytecode();
+	if (sm4_chunk)
+	{
+		sm4_parse_error error;
+		sm4_program* sm4 = sm4_parse(
+			sm4_chunk + 1, bswap_le32(sm4_chunk->size), arena, &error);
+		if (sm4)
+		{
+			memcpy(&summary.version, &sm4->version, sizeof(summary.version));
+			summary.num_dcls = (uint32_t)sm4->dcls.size();
+			summary.num_insns = (uint32_t)sm4->insns.size();
+			if (options.translate)
+			{
+				unsigned insn;
+				const char* error = sm4_translate_cpp(
+					out, *sm4, function_name(path).c_str(), &insn);
+				if (error)
+				{
+					err << path << ": " << error << " at instruction "
+						<< insn << "\n";
+					ok = false;
+				}
+			}
+			else if (options.dump_cfg || options.dump_liveness)
+			{
+				sm4_cfg cfg;
+				sm4_liveness liveness;
+				const char* error = sm4_build_cfg(*sm4, cfg);
+				if (!error && options.dump_liveness)
+					error = sm4_compute_liveness(*sm4, cfg, liveness);
+				if (error)
+				{
+					out << *sm4;
+					err << path << ": " << error << "\n";
+					ok = false;
+				}
+				else
+				{
+					if (options.dump_liveness)
+						sm4_dump(out, *sm4, cfg, liveness, sm4_dump_options());
+					else
+						out << *sm4;
+					if (options.dump_cfg)
+						sm4_dump(out, cfg);
+				}
+			}
+			else
+				out << *sm4;
+			if (image_path && !write_image(*sm4, image_path, err))
+				ok = false;
+			delete sm4;
+		}
+		else
+		{
+			err << path << ": " << sm4_parse_error_names[error.code]
+				<< " at token " << error.offset;
+			if (error.opcode < SM4_OPCODE_COUNT)
+				err << " (" << sm4_opcode_names[error.opcode] << ")";
+			err << "\n";
+			ok = false;
+		}
+		if (arena)
+			arena->reset();
+	}
+	delete dxbc;
+	return ok;
+}
+
+static bool disassemble_blob(const char* path, const void* data, size_t size,
+							 text_writer& out, std::ostream& err,
+							 sm4_arena* arena, const disasm_options& options,
+							 const char* image_path)
+{
+	if (options.verify)
+	{
+		dxbc_view view;
+		const char* error = dxbc_check_size(size);
+		if (!error)
+			error = view.init(data, (int)size, DXBC_PARSE_VERIFY_CHECKSUM);
+		if (error)
+		{
+			err << path << ": " << error << "\n";
+			return false;
+		}
+	}
+
+	disasm_summary summary;
+	char key[33];
+	const disasm_cache* cache = options.cache;
+	disasm_memory_cache* memory_cache = options.memory_cache;
+	/* the caches only hold the plain disassembly */
+	if (options.dump_cfg || options.dump_liveness || options.translate)
+		cache = 0, memory_cache = 0;
+	if ((!cache && !memory_cache) || !disasm_cache::key(data, size, key))
+		return render(path, data, size, out, err, arena, summary, image_path,
+					  options);
+
+	/* the image needs the parsed program, so a cache hit is no use */
+	std::string text;
+	if (!image_path && memory_cache && memory_cache->lookup(key, size, text))
+	{
+		out.write(text.data(), text.size());
+		return true;
+	}
+	if (!image_path && cache && cache->lookup(key, size, text))
+	{
+		if (memory_cache)
+			memory_cache->store(key, size, text.data(), text.size());
+		out.write(text.data(), text.size());
+		return true;
 	}
 
-	std::vector<char> data;
-	FILE* pFile = NULL;
-#ifdef _MSC_VER
-	fopen_s(&pFile, argv[1], "rb");
+	/* failures are not cached, so that they get reported every time */
+	text_writer rendered;
+	bool ok =
+		render(path, data, size, rendered, err, arena, summary, image_path,
+			   options);
+	if (ok && cache)
+		cache->store(key, summary, rendered.data(), rendered.size());
+	if (ok && memory_cache)
+		memory_cache->store(key, size, rendered.data(), rendered.size());
+	out.write(rendered.data(), rendered.size());
+	return ok;
+}
+
+/* the image of FILE goes to FILE.sm4b */
+#define IMAGE_SUFFIX ".sm4b"
+
+static bool disassemble(const char* path, text_writer& out, std::ostream& err,
+						sm4_arena* arena, const disasm_options& options)
+{
+	mapped_file file;
+	if (!open_file(path, file, err))
+		return false;
+	std::string image_path = std::string(path) + IMAGE_SUFFIX;
+	return disassemble_blob(path, file.data, file.size, out, err, arena,
+							options,
+							options.write_images ? image_path.c_str() : 0);
+}
+
+static std::string base_name(const char* path)
+{
+	const char* name = path;
+	for (const char* p = path; *p; ++p)
+		if (*p == '/' || *p == '\\')
+			name = p + 1;
+	return name;
+}
+
+/* scan mode looks at this much of the input at a time, and drops the pages
+ * it is done with before moving on, so that the memory used stays constant
+ * however large the input is */
+#define SCAN_WINDOW (64 << 20)
+
+/* Disassembles, or with extract_dir writes out, every DXBC container
+ * embedded anywhere in the file. Only one container is held in memory at a
+ * time, besides the window being scanned. The images of the containers go
+ * to FILE.OFFSET.sm4b. */
+static bool scan(const char* path, const char* extract_dir, text_writer& out,
+				 std::ostream& err, sm4_arena* arena,
+				 const disasm_options& options)
+{
+	mapped_file file;
+	if (!file.open(path, MAPPED_FILE_SEQUENTIAL))
+	{
+		err << "Could not open file: " << path << "\n";
+		return false;
+	}
+
+	bool ok = true;
+	std::vector<uint32_t> aligned;
+	size_t pos = 0, dropped = 0;
+	while (pos < file.size)
+	{
+		size_t window_end = std::min(file.size, pos + (size_t)SCAN_WINDOW);
+		size_t hit, blob_size;
+		while ((hit = dxbc_scan(file.data, file.size, pos, window_end,
+								&blob_size)) < window_end)
+		{
+			const void* blob = (const char*)file.data + hit;
+			/* the same hex offset names the files and heads the output */
+			char offset[32];
+			snprintf(offset, sizeof(offset), ".%08llx", (unsigned long long)hit);
+			if (extract_dir)
+			{
+				std::string name = std::string(extract_dir) + "/" +
+								   base_name(path) + offset + ".dxbc";
+				if (write_file(name, blob, blob_size))
+					out << name.c_str() << '\n';
+				else
+				{
+					err << "Could not write file: " << name << "\n";
+					ok = false;
+				}
+			}
+			else
+			{
+				out << "// BLOB " << path << " +" << offset + 1
+					<< " (" << (unsigned long long)blob_size << " bytes)\n";
+				/* the parsers want whole tokens */
+				if ((uintptr_t)blob & 3)
+				{
+					aligned.resize((blob_size + 3) / 4);
+					memcpy(aligned.data(), blob, blob_size);
+					blob = aligned.data();
+				}
+				std::string image_path =
+					std::string(path) + offset + IMAGE_SUFFIX;
+				if (!disassemble_blob(
+						path, blob, blob_size, out, err, arena, options,
+						options.write_images ? image_path.c_str() : 0))
+					ok = false;
+			}
+			out.flush();
+			pos = hit + blob_size;
+		}
+		/* a container may have taken us past the window */
+		pos = std::max(pos, window_end);
+		file.advise(dropped, pos - dropped, MAPPED_FILE_DONTNEED);
+		dropped = pos;
+	}
+	return ok;
+}
+
+static bool is_directory(const std::string& path)
+{
+#ifdef _WIN32
+	DWORD attrs = GetFileAttributesA(path.c_str());
+	return attrs != INVALID_FILE_ATTRIBUTES &&
+		   (attrs & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat st;
+	return !stat(path.c_str(), &st) && S_ISDIR(st.st_mode);
+#endif
+}
+
+#ifdef _WIN32
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+/* appends all files below path, sorted by name so that the order (and hence
+ * the output) does not depend on the file system */
+static void collect_directory(const std::string& path,
+							  std::vector<std::string>& files)
+{
+	std::vector<std::string> names;
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE find = FindFirstFileA((path + "\\*").c_str(), &fd);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do
+		names.push_back(fd.cFileName);
+	while (FindNextFileA(find, &fd));
+	FindClose(find);
 #else
-	pFile = fopen(argv[1], "rb");
+	DIR* dir = opendir(path.c_str());
+	if (!dir)
+		return;
+	while (struct dirent* ent = readdir(dir))
+		names.push_back(ent->d_name);
+	closedir(dir);
 #endif
-	if (!pFile)
+	std::sort(names.begin(), names.end());
+	for (unsigned i = 0; i < names.size(); ++i)
 	{
-		printf("Could not open file: %s\n", argv[1]);
+		if (names[i] == "." || names[i] == "..")
+			continue;
+		std::string child = path + PATH_SEPARATOR + names[i];
+		if (is_directory(child))
+			collect_directory(child, files);
+		else
+			files.push_back(child);
+	}
+}
+
+static void collect_input(const std::string& path,
+						  std::vector<std::string>& files)
+{
+	if (is_directory(path))
+		collect_directory(path, files);
+	else
+		files.push_back(path);
+}
+
+static bool read_list_file(const char* path, std::vector<std::string>& files)
+{
+	std::ifstream list(path);
+	if (!list)
+		return false;
+	std::string line;
+	while (std::getline(list, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (!line.empty())
+			collect_input(line, files);
+	}
+	return true;
+}
+
+/* at most this many results are held waiting for an earlier one */
+#define ORDERED_OUTPUT_WINDOW 1024
+
+/* Collects the per-file results and writes them out strictly in input order,
+ * as soon as every earlier file has been written. Whichever worker completes
+ * the missing slot does the writing, so no extra thread is needed. Callers
+ * wait for room before submitting each file, so that a slow file holds back
+ * at most ORDERED_OUTPUT_WINDOW results rather than the rest of the batch. */
+struct ordered_output
+{
+	struct slot
+	{
+		bool ready;
+		std::string out;
+		std::string err;
+	};
+
+	std::mutex mutex;
+	std::condition_variable room;
+	std::vector<slot> slots;
+	unsigned next;
+
+	explicit ordered_output(unsigned count) : slots(count), next(0)
+	{
+		for (unsigned i = 0; i < count; ++i)
+			slots[i].ready = false;
+	}
+
+	/* blocks until the result of index may be rendered */
+	void wait_for_room(unsigned index)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		room.wait(lock, [&] { return index < next + ORDERED_OUTPUT_WINDOW; });
+	}
+
+	void complete(unsigned index, std::string& out, std::string& err)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		slots[index].out.swap(out);
+		slots[index].err.swap(err);
+		slots[index].ready = true;
+		unsigned first = next;
+		while (next < slots.size() && slots[next].ready)
+		{
+			slot& s = slots[next++];
+			std::cout.write(s.out.data(), s.out.size());
+			std::cerr.write(s.err.data(), s.err.size());
+			std::string().swap(s.out);
+			std::string().swap(s.err);
+		}
+		if (next != first)
+			room.notify_all();
+	}
+};
+
+static int disassemble_batch(const std::vector<std::string>& files,
+							 unsigned num_threads,
+							 const disasm_options& options)
+{
+	ordered_output output((unsigned)files.size());
+	std::atomic<unsigned> failures(0);
+	{
+		work_pool pool(num_threads);
+		std::vector<std::unique_ptr<sm4_arena>> arenas;
+		std::vector<std::unique_ptr<text_writer>> writers;
+		for (unsigned i = 0; i < pool.size(); ++i)
+		{
+			arenas.push_back(std::unique_ptr<sm4_arena>(new sm4_arena));
+			writers.push_back(std::unique_ptr<text_writer>(new text_writer));
+		}
+
+		for (unsigned i = 0; i < files.size(); ++i)
+		{
+			output.wait_for_room(i);
+			pool.submit([&, i](unsigned worker) {
+				text_writer& out = *writers[worker];
+				std::ostringstream err;
+				out.clear();
+				out << "// FILE " << files[i].c_str() << '\n';
+				if (!disassemble(files[i].c_str(), out, err,
+								 arenas[worker].get(), options))
+					++failures;
+				std::string out_str(out.data(), out.size());
+				std::string err_str = err.str();
+				output.complete(i, out_str, err_str);
+			});
+		}
+		pool.wait();
+	}
+	std::cout.flush();
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* verify-only mode checksums this many files per task, so that the SIMD
+ * lanes always have enough containers to work on */
+#define VERIFY_BATCH 64
+
+/* Checks the checksum of every file, printing those that are wrong or not
+ * containers at all, in input order. */
+static int verify_batch(const std::vector<std::string>& files,
+						unsigned num_threads)
+{
+	unsigned num_batches =
+		(unsigned)((files.size() + VERIFY_BATCH - 1) / VERIFY_BATCH);
+	ordered_output output(num_batches);
+	std::atomic<unsigned> failures(0);
+	std::atomic<unsigned long long> bytes(0);
+	{
+		work_pool pool(num_threads);
+		for (unsigned b = 0; b < num_batches; ++b)
+		{
+			output.wait_for_room(b);
+			pool.submit([&, b](unsigned) {
+				unsigned first = b * VERIFY_BATCH;
+				unsigned count = std::min((unsigned)files.size() - first,
+										  (unsigned)VERIFY_BATCH);
+				mapped_file mapped[VERIFY_BATCH];
+				const char* errors[VERIFY_BATCH];
+				const void* data[VERIFY_BATCH];
+				size_t sizes[VERIFY_BATCH];
+				uint32_t checksums[VERIFY_BATCH][4];
+				unsigned num_blobs = 0;
+				unsigned blob_file[VERIFY_BATCH];
+				unsigned long long batch_bytes = 0;
+
+				for (unsigned i = 0; i < count; ++i)
+				{
+					mapped_file& file = mapped[i];
+					errors[i] = 0;
+					if (!file.open(files[first + i].c_str(),
+								   MAPPED_FILE_SEQUENTIAL))
+					{
+						errors[i] = "Could not open file";
+						continue;
+					}
+					const dxbc_container_header* header =
+						(const dxbc_container_header*)file.data;
+					if (file.size < sizeof(dxbc_container_header) ||
+						bswap_le32(header->fourcc) != FOURCC_DXBC)
+						errors[i] = "Not a DXBC container";
+					else if (bswap_le32(header->total_size) > file.size)
+						errors[i] = "Container is truncated";
+					else
+					{
+						data[num_blobs] = file.data;
+						sizes[num_blobs] = bswap_le32(header->total_size);
+						blob_file[num_blobs++] = i;
+						batch_bytes += file.size;
+					}
+				}
+
+				/* the zeroed checksum of a container too small to have one
+				 * would match a zeroed header */
+				bool valid[VERIFY_BATCH];
+				dxbc_checksum_multi(num_blobs, data, sizes, checksums, valid);
+				for (unsigned i = 0; i < num_blobs; ++i)
+				{
+					const dxbc_container_header* header =
+						(const dxbc_container_header*)data[i];
+					if (!valid[i] ||
+						memcmp(checksums[i], header->unk, sizeof(header->unk)))
+						errors[blob_file[i]] = "Checksum mismatch";
+				}
+
+				std::string out_str;
+				for (unsigned i = 0; i < count; ++i)
+				{
+					if (!errors[i])
+						continue;
+					out_str += files[first + i] + ": " + errors[i] + "\n";
+					++failures;
+				}
+				bytes += batch_bytes;
+				std::string err_str;
+				output.complete(b, out_str, err_str);
+			});
+		}
+		pool.wait();
+	}
+	std::cout.flush();
+	std::cerr << (unsigned)files.size() << " files, " << bytes.load()
+			  << " bytes verified, " << failures.load() << " bad\n";
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* quoted if need be, for the CSV output */
+static void append_csv_field(std::string& out, const std::string& field)
+{
+	if (field.find_first_of(",\"\r\n") == std::string::npos)
+	{
+		out += field;
+		return;
+	}
+	out += '"';
+	for (unsigned i = 0; i < field.size(); ++i)
+	{
+		if (field[i] == '"')
+			out += '"';
+		out += field[i];
+	}
+	out += '"';
+}
+
+/* appends the CSV row of one file, or returns an error message */
+static const char* estimate_file(const std::string& path, sm4_arena& arena,
+								 std::string& out)
+{
+	mapped_file file;
+	if (!file.open(path.c_str()))
+		return "Could not open file";
+	dxbc_view view;
+	const char* error = dxbc_check_size(file.size);
+	if (!error)
+		error = view.init(file.data, (int)file.size);
+	if (error)
+		return error;
+	dxbc_chunk_header* sm4_chunk = view.find_shader_bytecode();
+	if (!sm4_chunk)
+		return "No shader bytecode";
+	sm4_parse_error parse_error;
+	sm4_program* sm4 = sm4_parse(sm4_chunk + 1, bswap_le32(sm4_chunk->size),
+								 &arena, &parse_error);
+	if (!sm4)
+	{
+		arena.reset();
+		return sm4_parse_error_names[parse_error.code];
+	}
+
+	sm4_cost_estimate estimate;
+	error = sm4_estimate_cost(*sm4, estimate);
+	if (!error)
+	{
+		/* what the compiler thought, for comparison */
+		dxbc_chunk_header* stat = view.find(FOURCC_STAT);
+		long long stat_insns = -1;
+		if (stat && bswap_le32(stat->size) >= sizeof(uint32_t))
+			stat_insns = bswap_le32(
+				static_cast<dxbc_chunk_statistics*>(stat)->instruction_count);
+
+		unsigned num_insns = 0;
+		for (unsigned u = SM4_COST_NONE + 1; u < SM4_COST_UNIT_COUNT; ++u)
+			num_insns += estimate.insns[u];
+		char buf[64];
+		append_csv_field(out, path);
+		snprintf(buf, sizeof(buf), ",%cs_%u_%u,%u",
+				 sm4->version.type < 6 ? "pvghdc"[sm4->version.type] : '?',
+				 (unsigned)sm4->version.major, (unsigned)sm4->version.minor,
+				 num_insns);
+		out += buf;
+		for (unsigned u = SM4_COST_NONE + 1; u < SM4_COST_UNIT_COUNT; ++u)
+		{
+			snprintf(buf, sizeof(buf), ",%.0f", estimate.cost[u]);
+			out += buf;
+		}
+		snprintf(buf, sizeof(buf), ",%.0f,%u,", estimate.total,
+				 estimate.max_loop_depth);
+		out += buf;
+		if (stat_insns >= 0)
+		{
+			snprintf(buf, sizeof(buf), "%lld", stat_insns);
+			out += buf;
+		}
+		out += '\n';
+	}
+	delete sm4;
+	arena.reset();
+	return error;
+}
+
+/* Estimates the cost of every file, printing a CSV table with a row per
+ * file in input order; the files that cannot be estimated are reported on
+ * stderr instead. */
+static int estimate_batch(const std::vector<std::string>& files,
+						  unsigned num_threads)
+{
+	std::cout << "file,type,instructions";
+	for (unsigned u = SM4_COST_NONE + 1; u < SM4_COST_UNIT_COUNT; ++u)
+		std::cout << ',' << sm4_cost_unit_names[u];
+	std::cout << ",total,max_loop_depth,stat_instructions\n";
+
+	ordered_output output((unsigned)files.size());
+	std::atomic<unsigned> failures(0);
+	{
+		work_pool pool(num_threads);
+		std::vector<std::unique_ptr<sm4_arena>> arenas;
+		for (unsigned i = 0; i < pool.size(); ++i)
+			arenas.push_back(std::unique_ptr<sm4_arena>(new sm4_arena));
+
+		for (unsigned i = 0; i < files.size(); ++i)
+		{
+			output.wait_for_room(i);
+			pool.submit([&, i](unsigned worker) {
+				std::string out_str, err_str;
+				const char* error =
+					estimate_file(files[i], *arenas[worker], out_str);
+				if (error)
+				{
+					err_str = files[i] + ": " + error + "\n";
+					++failures;
+				}
+				output.complete(i, out_str, err_str);
+			});
+		}
+		pool.wait();
+	}
+	std::cout.flush();
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* parses the shader of a file into the arena, or returns NULL with
+ * *error set */
+static sm4_program* parse_shader(const mapped_file& file, sm4_arena& arena,
+								 const char** error)
+{
+	dxbc_view view;
+	*error = dxbc_check_size(file.size);
+	if (!*error)
+		*error = view.init(file.data, (int)file.size);
+	if (*error)
+		return 0;
+	dxbc_chunk_header* sm4_chunk = view.find_shader_bytecode();
+	if (!sm4_chunk)
+	{
+		*error = "No shader bytecode";
+		return 0;
+	}
+	sm4_parse_error parse_error;
+	sm4_program* sm4 = sm4_parse(sm4_chunk + 1, bswap_le32(sm4_chunk->size),
+								 &arena, &parse_error);
+	if (!sm4)
+		*error = sm4_parse_error_names[parse_error.code];
+	return sm4;
+}
+
+/* the shader bytecode chunk of a file, or an empty range */
+static std::pair<const char*, size_t> shader_bytes(const mapped_file& file)
+{
+	dxbc_view view;
+	if (dxbc_check_size(file.size) || view.init(file.data, (int)file.size))
+		return std::make_pair((const char*)0, (size_t)0);
+	dxbc_chunk_header* sm4_chunk = view.find_shader_bytecode();
+	if (!sm4_chunk)
+		return std::make_pair((const char*)0, (size_t)0);
+	return std::make_pair((const char*)(sm4_chunk + 1),
+						  (size_t)bswap_le32(sm4_chunk->size));
+}
+
+/* Compares the shaders of two files, writing out what differs after the
+ * header, if any; identical bytecode is not even parsed. Returns NULL on
+ * success, or an error message with *failed_path set to the file at
+ * fault. */
+static const char* diff_files(const std::string& old_path,
+							  const std::string& new_path,
+							  const std::string* header, sm4_arena& arena,
+							  text_writer& out, bool* differ,
+							  const std::string** failed_path)
+{
+	*differ = false;
+	mapped_file old_file, new_file;
+	*failed_path = &old_path;
+	if (!old_file.open(old_path.c_str()))
+		return "Could not open file";
+	*failed_path = &new_path;
+	if (!new_file.open(new_path.c_str()))
+		return "Could not open file";
+
+	std::pair<const char*, size_t> old_bytes = shader_bytes(old_file);
+	std::pair<const char*, size_t> new_bytes = shader_bytes(new_file);
+	if (old_bytes.first && new_bytes.first &&
+		old_bytes.second == new_bytes.second &&
+		!memcmp(old_bytes.first, new_bytes.first, old_bytes.second))
+		return 0;
+
+	const char* error;
+	*failed_path = &old_path;
+	sm4_program* old_sm4 = parse_shader(old_file, arena, &error);
+	sm4_program* new_sm4 = 0;
+	if (old_sm4)
+	{
+		*failed_path = &new_path;
+		new_sm4 = parse_shader(new_file, arena, &error);
+	}
+	if (new_sm4)
+	{
+		sm4_program_diff diff;
+		sm4_diff_programs(*old_sm4, *new_sm4, diff);
+		*differ = !diff.empty();
+		if (*differ)
+		{
+			if (header)
+				out << "// DIFF " << header->c_str() << '\n';
+			sm4_dump(out, *old_sm4, *new_sm4, diff);
+		}
+	}
+	delete old_sm4;
+	delete new_sm4;
+	arena.reset();
+	return new_sm4 ? 0 : error;
+}
+
+/* the files below root, relative to it, sorted */
+static void collect_relative(const std::string& root,
+							 std::vector<std::string>& names)
+{
+	std::vector<std::string> files;
+	collect_directory(root, files);
+	for (unsigned i = 0; i < files.size(); ++i)
+		names.push_back(files[i].substr(root.size() + 1));
+	std::sort(names.begin(), names.end());
+}
+
+/* Compares two files, or every pair of files with the same relative path
+ * in two directories, in parallel, printing the pairs that differ and the
+ * files only one of the directories has in order. */
+static int diff_batch(const std::string& old_root, const std::string& new_root,
+					  unsigned num_threads)
+{
+	std::vector<std::string> old_paths, new_paths, names;
+	std::string removed, added;
+	bool directories = is_directory(old_root) && is_directory(new_root);
+	if (directories)
+	{
+		std::vector<std::string> old_names, new_names;
+		collect_relative(old_root, old_names);
+		collect_relative(new_root, new_names);
+		const char separator = old_root.find('\\') != std::string::npos &&
+									   old_root.find('/') == std::string::npos
+								   ? '\\'
+								   : '/';
+		unsigned i = 0, j = 0;
+		while (i < old_names.size() || j < new_names.size())
+		{
+			if (j == new_names.size() ||
+				(i < old_names.size() && old_names[i] < new_names[j]))
+				removed += "// REMOVED " + old_names[i++] + "\n";
+			else if (i == old_names.size() || new_names[j] < old_names[i])
+				added += "// ADDED " + new_names[j++] + "\n";
+			else
+			{
+				old_paths.push_back(old_root + separator + old_names[i]);
+				new_paths.push_back(new_root + separator + new_names[j]);
+				names.push_back(old_names[i]);
+				++i, ++j;
+			}
+		}
+	}
+	else
+	{
+		old_paths.push_back(old_root);
+		new_paths.push_back(new_root);
+	}
+
+	ordered_output output((unsigned)old_paths.size());
+	std::atomic<unsigned> failures(0), differences(0);
+	{
+		work_pool pool(num_threads);
+		std::vector<std::unique_ptr<sm4_arena>> arenas;
+		std::vector<std::unique_ptr<text_writer>> writers;
+		for (unsigned i = 0; i < pool.size(); ++i)
+		{
+			arenas.push_back(std::unique_ptr<sm4_arena>(new sm4_arena));
+			writers.push_back(std::unique_ptr<text_writer>(new text_writer));
+		}
+
+		for (unsigned i = 0; i < old_paths.size(); ++i)
+		{
+			output.wait_for_room(i);
+			pool.submit([&, i](unsigned worker) {
+				text_writer& out = *writers[worker];
+				out.clear();
+				bool differ;
+				const std::string* failed_path;
+				const char* error = diff_files(
+					old_paths[i], new_paths[i], directories ? &names[i] : 0,
+					*arenas[worker], out, &differ, &failed_path);
+				std::string out_str(out.data(), out.size()), err_str;
+				if (error)
+				{
+					err_str = *failed_path + ": " + error + "\n";
+					++failures;
+				}
+				else if (differ)
+					++differences;
+				output.complete(i, out_str, err_str);
+			});
+		}
+		pool.wait();
+	}
+	std::cout << removed << added;
+	std::cout.flush();
+	if (directories)
+	{
+		std::cerr << (unsigned)old_paths.size() << " pairs compared, "
+				  << differences.load() << " differ, "
+				  << (unsigned)std::count(removed.begin(), removed.end(), '\n')
+				  << " removed, "
+				  << (unsigned)std::count(added.begin(), added.end(), '\n')
+				  << " added\n";
+	}
+	return failures || differences || !removed.empty() || !added.empty()
+			   ? EXIT_FAILURE
+			   : EXIT_SUCCESS;
+}
+
+/* Gathers statistics over every file, each worker counting into a
+ * corpus_stats of its own, which are merged once all files are done; the
+ * files that cannot be counted are reported on stderr in input order. */
+static int stats_batch(const std::vector<std::string>& files,
+					   unsigned num_threads, bool json)
+{
+	ordered_output output((unsigned)files.size());
+	std::atomic<unsigned> failures(0);
+	corpus_stats total;
+	{
+		work_pool pool(num_threads);
+		std::vector<std::unique_ptr<sm4_arena>> arenas;
+		std::vector<std::unique_ptr<corpus_stats>> stats;
+		for (unsigned i = 0; i < pool.size(); ++i)
+		{
+			arenas.push_back(std::unique_ptr<sm4_arena>(new sm4_arena));
+			stats.push_back(std::unique_ptr<corpus_stats>(new corpus_stats));
+		}
+
+		for (unsigned i = 0; i < files.size(); ++i)
+		{
+			output.wait_for_room(i);
+			pool.submit([&, i](unsigned worker) {
+				std::string out_str, err_str;
+				corpus_stats& s = *stats[worker];
+				mapped_file file;
+				const char* error = 0;
+				if (file.open(files[i].c_str(), MAPPED_FILE_SEQUENTIAL))
+					error = s.add(file.data, file.size, *arenas[worker]);
+				else
+				{
+					error = "Could not open file";
+					++s.files;
+					++s.failures;
+				}
+				if (error)
+				{
+					err_str = files[i] + ": " + error + "\n";
+					++failures;
+				}
+				output.complete(i, out_str, err_str);
+			});
+		}
+		pool.wait();
+		for (unsigned i = 0; i < stats.size(); ++i)
+			total.merge(*stats[i]);
+	}
+	if (json)
+		total.write_json(std::cout);
+	else
+		total.write_csv(std::cout);
+	std::cout.flush();
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Adds every file to the index, parsing them in parallel but numbering
+ * them in input order, so that the same inputs always give the same index;
+ * whichever worker completes the next file in order adds it and those
+ * after it that are done, like ordered_output.
+ * The index follows the files it is given: the old document of a file that
+ * changed, cannot be read any more, or is gone from one of the directories
+ * given, is dropped. */
+static int index_batch(const std::string& index_path,
+					   const std::vector<std::string>& files,
+					   const std::vector<std::string>& directories,
+					   unsigned num_threads)
+{
+	shader_index_builder builder;
+	{
+		mapped_file existing;
+		if (existing.open(index_path.c_str(), MAPPED_FILE_NORMAL))
+		{
+			shader_index index;
+			const char* error = index.init(existing.data, existing.size);
+			if (!error)
+				error = builder.load(index);
+			if (error)
+			{
+				std::cerr << index_path << ": " << error << "\n";
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	unsigned num_indexed = builder.num_docs();
+
+	struct slot
+	{
+		bool ready;
+		bool known;
+		uint32_t checksum[4];
+		std::vector<std::string> terms;
+		const char* error;
+	};
+	std::mutex mutex;
+	/* as in ordered_output, so that a slow file only holds back the terms
+	 * of ORDERED_OUTPUT_WINDOW others */
+	std::condition_variable room;
+	std::vector<slot> slots(files.size());
+	for (unsigned i = 0; i < files.size(); ++i)
+		slots[i].ready = false;
+	unsigned next = 0, num_known = 0, num_dropped = 0, failures = 0;
+	/* files whose shader was already indexed under another path, which may
+	 * be dropped later on */
+	std::vector<unsigned> duplicates;
+	{
+		work_pool pool(num_threads);
+		std::vector<std::unique_ptr<sm4_arena>> arenas;
+		for (unsigned i = 0; i < pool.size(); ++i)
+			arenas.push_back(std::unique_ptr<sm4_arena>(new sm4_arena));
+
+		for (unsigned i = 0; i < files.size(); ++i)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				room.wait(lock,
+						  [&] { return i < next + ORDERED_OUTPUT_WINDOW; });
+			}
+			pool.submit([&, i](unsigned worker) {
+				slot& s = slots[i];
+				s.known = false;
+				mapped_file file;
+				s.error = file.open(files[i].c_str())
+							  ? shader_index_checksum(file.data, file.size,
+													  s.checksum)
+							  : "Could not open file";
+				if (!s.error)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					s.known = builder.contains(s.checksum);
+				}
+				if (!s.error && !s.known)
+					s.error = shader_index_terms(file.data, file.size,
+												 *arenas[worker], s.terms);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				s.ready = true;
+				unsigned first = next;
+				while (next < slots.size() && slots[next].ready)
+				{
+					slot& done = slots[next];
+					const std::string& path = files[next];
+					std::map<std::string, uint32_t>::const_iterator old =
+						builder.paths.find(path);
+					if (old != builder.paths.end() &&
+						(done.error ||
+						 memcmp(builder.docs[old->second].checksum,
+								done.checksum, sizeof(done.checksum))))
+					{
+						builder.drop(path);
+						++num_dropped;
+					}
+					if (done.error)
+					{
+						std::cerr << path << ": " << done.error << "\n";
+						++failures;
+					}
+					else if (done.known ||
+							 !builder.add(done.checksum, path, done.terms))
+						duplicates.push_back(next);
+					std::vector<std::string>().swap(done.terms);
+					++next;
+				}
+				if (next != first)
+					room.notify_all();
+			});
+		}
+		pool.wait();
+	}
+
+	std::set<std::string> seen(files.begin(), files.end());
+	for (unsigned i = 0; i < directories.size(); ++i)
+	{
+		std::string prefix = directories[i] + PATH_SEPARATOR;
+		std::map<std::string, uint32_t>::const_iterator it =
+			builder.paths.lower_bound(prefix);
+		while (it != builder.paths.end() &&
+			   !it->first.compare(0, prefix.size(), prefix))
+		{
+			std::string path = (it++)->first;
+			if (!seen.count(path))
+			{
+				builder.drop(path);
+				++num_dropped;
+			}
+		}
+	}
+
+	sm4_arena arena;
+	for (unsigned i = 0; i < duplicates.size(); ++i)
+	{
+		slot& s = slots[duplicates[i]];
+		const std::string& path = files[duplicates[i]];
+		if (builder.contains(s.checksum))
+		{
+			++num_known;
+			continue;
+		}
+		mapped_file file;
+		const char* error =
+			file.open(path.c_str())
+				? shader_index_terms(file.data, file.size, arena, s.terms)
+				: "Could not open file";
+		if (error)
+		{
+			std::cerr << path << ": " << error << "\n";
+			++failures;
+		}
+		else
+			builder.add(s.checksum, path, s.terms);
+		std::vector<std::string>().swap(s.terms);
+	}
+
+	bool ok = builder.write(index_path);
+	if (!ok)
+		std::cerr << "Could not write file: " << index_path << "\n";
+	std::cerr << (unsigned)files.size() << " files, "
+			  << builder.num_docs() + num_dropped - num_indexed
+			  << " added, " << num_known << " already indexed, "
+			  << num_dropped << " dropped, " << failures << " failed; "
+			  << builder.num_docs() << " shaders, " << builder.num_terms()
+			  << " terms\n";
+	return ok && !failures ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Prints the paths of the shaders matching the query, or every term of the
+ * index without one; the exit status tells whether anything matched, as
+ * with grep. */
+static int query_batch(const std::string& index_path,
+					   const std::vector<std::string>& words)
+{
+	mapped_file file;
+	if (!file.open(index_path.c_str(), MAPPED_FILE_NORMAL))
+	{
+		std::cerr << "Could not open file: " << index_path << "\n";
+		return EXIT_FAILURE;
+	}
+	shader_index index;
+	const char* error = index.init(file.data, file.size);
+	if (error)
+	{
+		std::cerr << index_path << ": " << error << "\n";
 		return EXIT_FAILURE;
 	}
 
-	fseek(pFile, 0, SEEK_END);
-	uint32_t nFileSize = ftell(pFile);
-	fseek(pFile, 0, SEEK_SET);
+	text_writer out(std::cout);
+	if (words.empty())
+	{
+		for (unsigned i = 0; i < index.num_terms; ++i)
+			out << index.name(index.terms[i]) << ' ' << index.terms[i].count
+				<< '\n';
+		return index.num_terms ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
-	if (nFileSize < sizeof(dxbc_container_header))
+	std::string expression;
+	for (unsigned i = 0; i < words.size(); ++i)
+		expression += (i ? " " : "") + words[i];
+	std::vector<uint32_t> docs;
+	error = index.query(expression.c_str(), docs);
+	if (error)
 	{
-		printf("File is too small!\n");
+		std::cerr << error << "\n";
 		return EXIT_FAILURE;
 	}
+	for (unsigned i = 0; i < docs.size(); ++i)
+		out << index.path(docs[i]) << '\n';
+	out.flush();
+	std::cerr << (unsigned)docs.size() << " of " << index.num_docs
+			  << " shaders match\n";
+	return docs.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* the server keeps this much recently rendered disassembly in memory */
+#define SERVER_MEMORY_CACHE (64u << 20)
+
+/* Serves disassembly requests on socket_path until a client asks to stop;
+ * the parser arenas of the workers, like the memory cache, are kept from
+ * one request to the next. */
+static int serve(const char* socket_path, unsigned num_threads,
+				 disasm_options options)
+{
+	disasm_memory_cache memory_cache(SERVER_MEMORY_CACHE);
+	options.memory_cache = &memory_cache;
 
-	data.resize(nFileSize);
-	if (fread(&data[0], 1, nFileSize, pFile) != nFileSize)
+	disasm_server server(num_threads);
+	const char* error = server.listen(socket_path);
+	if (error)
 	{
-		printf("Failed reading file!\n");
+		std::cerr << socket_path << ": " << error << "\n";
 		return EXIT_FAILURE;
 	}
-	fclose(pFile);
+	std::vector<std::unique_ptr<sm4_arena>> arenas;
+	for (unsigned i = 0; i < server.size(); ++i)
+		arenas.push_back(std::unique_ptr<sm4_arena>(new sm4_arena));
+
+	server.run([&](unsigned worker, const disasm_request& request,
+				   text_writer& out, std::ostream& err) {
+		if (request.kind == DISASM_REQUEST_PATH)
+			return disassemble(request.path, out, err, arenas[worker].get(),
+							   options);
+		if (request.size < sizeof(dxbc_container_header))
+		{
+			err << "Blob is too small!\n";
+			return false;
+		}
+		return disassemble_blob(request.path, request.data, request.size, out,
+								err, arenas[worker].get(), options, 0);
+	});
+	return EXIT_SUCCESS;
+}
 
-	dxbc_container* dxbc = dxbc_parse(&data[0], data.size());
-	if (dxbc)
+int main(int argc, char** argv)
+{
+	std::vector<std::string> files, inputs;
+	unsigned num_threads = 0;
+	bool batch = false;
+	bool scan_mode = false;
+	disasm_options options;
+	bool verify_only = false;
+	bool estimate_only = false;
+	bool diff_only = false;
+	const char* stats_format = 0;
+	const char* index_path = 0;
+	const char* query_path = 0;
+	const char* socket_path = 0;
+	const char* extract_dir = 0;
+	std::unique_ptr<disasm_cache> cache;
+
+	for (int i = 1; i < argc; ++i)
 	{
-		std::cout << *dxbc;
-		dxbc_chunk_header* sm4_chunk =
-			dxbc_find_shader_bytecode(&data[0], data.size());
-		if (sm4_chunk)
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
 		{
-			sm4_program* sm4 =
-				sm4_parse(sm4_chunk + 1, bswap_le32(sm4_chunk->size));
-			if (sm4)
+			num_threads = (unsigned)atoi(argv[++i]);
+			batch = true;
+		}
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+		{
+			if (!read_list_file(argv[++i], files))
 			{
-				std::cout << *sm4;
-				delete sm4;
+				std::cerr << "Could not open list file: " << argv[i] << "\n";
+				return EXIT_FAILURE;
 			}
+			batch = true;
+		}
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+		{
+			cache.reset(new disasm_cache(argv[++i]));
+			if (!cache->open())
+			{
+				std::cerr << "Could not create cache directory: " << argv[i]
+						  << "\n";
+				return EXIT_FAILURE;
+			}
+			options.cache = cache.get();
+		}
+		else if (!strcmp(argv[i], "-b"))
+			options.write_images = true;
+		else if (!strcmp(argv[i], "-s"))
+			scan_mode = true;
+		else if (!strcmp(argv[i], "-v"))
+			options.verify = true;
+		else if (!strcmp(argv[i], "-g"))
+			options.dump_cfg = true;
+		else if (!strcmp(argv[i], "-p"))
+			options.dump_liveness = true;
+		else if (!strcmp(argv[i], "-t"))
+			options.translate = true;
+		else if (!strcmp(argv[i], "-V"))
+			verify_only = true;
+		else if (!strcmp(argv[i], "-e"))
+			estimate_only = true;
+		else if (!strcmp(argv[i], "-d"))
+			diff_only = true;
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+			index_path = argv[++i];
+		else if (!strcmp(argv[i], "-q") && i + 1 < argc)
+			query_path = argv[++i];
+		else if (!strcmp(argv[i], "-D") && i + 1 < argc)
+			socket_path = argv[++i];
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+		{
+			stats_format = argv[++i];
+			if (strcmp(stats_format, "csv") && strcmp(stats_format, "json"))
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+		}
+		else if (!strcmp(argv[i], "-x") && i + 1 < argc)
+		{
+			extract_dir = argv[++i];
+			scan_mode = true;
+		}
+		else if (argv[i][0] == '-' && argv[i][1])
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		else
+		{
+			/* diff mode pairs the inputs up as they are, and queries are
+			 * made of them */
+			inputs.push_back(argv[i]);
+			if (diff_only || query_path)
+				continue;
+			if (is_directory(argv[i]))
+				batch = true;
+			collect_input(argv[i], files);
 		}
-		delete dxbc;
 	}
 
-	return EXIT_SUCCESS;
+	if (diff_only)
+	{
+		if (inputs.size() != 2)
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		return diff_batch(inputs[0], inputs[1], num_threads);
+	}
+
+	if (verify_only)
+	{
+		if (files.empty())
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		return verify_batch(files, num_threads);
+	}
+
+	if (query_path)
+		return query_batch(query_path, inputs);
+
+	if (socket_path)
+	{
+		if (!inputs.empty())
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		return serve(socket_path, num_threads, options);
+	}
+
+	if (index_path)
+	{
+		if (files.empty())
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		std::vector<std::string> directories;
+		for (unsigned i = 0; i < inputs.size(); ++i)
+			if (is_directory(inputs[i]))
+				directories.push_back(inputs[i]);
+		return index_batch(index_path, files, directories, num_threads);
+	}
+
+	if (stats_format)
+	{
+		if (files.empty())
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		return stats_batch(files, num_threads,
+						   !strcmp(stats_format, "json"));
+	}
+
+	if (estimate_only)
+	{
+		if (files.empty())
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		return estimate_batch(files, num_threads);
+	}
+
+	if (scan_mode)
+	{
+		if (files.empty())
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		/* the inputs are expected to be large, so they are gone through one
+		 * at a time rather than in parallel */
+		text_writer out(std::cout);
+		sm4_arena arena;
+		bool ok = true;
+		for (unsigned i = 0; i < files.size(); ++i)
+			if (!scan(files[i].c_str(), extract_dir, out, std::cerr, &arena,
+					  options))
+				ok = false;
+		out.flush();
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (files.size() > 1)
+		batch = true;
+
+	if (!batch)
+	{
+		if (files.empty())
+		{
+			usage();
+			return EXIT_FAILURE;
+		}
+		text_writer out(std::cout);
+		return disassemble(files[0].c_str(), out, std::cout, 0, options)
+				   ? EXIT_SUCCESS
+				   : EXIT_FAILURE;
+	}
+
+	return disassemble_batch(files, num_threads, options);
 }
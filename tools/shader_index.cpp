@@ -0,0 +1,660 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "shader_index.h"
+#include "dxbc.h"
+#include <algorithm>
+#include <atomic>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(shader_index_header) == 16 + 8 * SHADER_INDEX_SECTION_COUNT,
+			  "the index layout changed");
+static_assert(sizeof(shader_index_doc) == 20, "the index layout changed");
+static_assert(sizeof(shader_index_term) == 16, "the index layout changed");
+
+static const size_t section_record_sizes[SHADER_INDEX_SECTION_COUNT] = {
+	sizeof(shader_index_doc), sizeof(shader_index_term), sizeof(uint8_t),
+	sizeof(char),
+};
+
+static size_t align8(size_t size) { return (size + 7) & ~(size_t)7; }
+
+/* names of the dcl_global_flags bits, as the disassembly prints them */
+static const char* global_flag_names[] = {
+	"refactoringAllowed",
+	"enableDoublePrecisionFloatOps",
+	"forceEarlyDepthStencil",
+	"enableRawAndStructuredBuffers",
+};
+
+static void add_op_files(const sm4_op& op, bool files[SM4_FILE_COUNT])
+{
+	files[op.file] = true;
+	for (unsigned i = 0; i < op.num_indices && i < 3; ++i)
+		if (op.indices[i].reg)
+			add_op_files(*op.indices[i].reg, files);
+}
+
+/* the semantics of a signature chunk whose elements and names lie within
+ * it */
+static void add_semantics(const dxbc_chunk_signature* sig, const char* prefix,
+						  std::vector<std::string>& terms)
+{
+	if (!sig)
+		return;
+	size_t size = bswap_le32(sig->size);
+	if (size < 2 * sizeof(uint32_t))
+		return;
+	size_t count = bswap_le32(sig->count);
+	if (count > (size - 2 * sizeof(uint32_t)) / sizeof(sig->elements[0]))
+		return;
+	/* offsets are from the end of the chunk header */
+	const char* base = (const char*)&sig->count;
+	for (size_t i = 0; i < count; ++i)
+	{
+		size_t offset = bswap_le32(sig->elements[i].name_offset);
+		if (offset >= size)
+			continue;
+		const char* name = base + offset;
+		const char* end = (const char*)memchr(name, 0, size - offset);
+		if (!end)
+			continue;
+		std::string term = prefix;
+		for (const char* p = name; p != end; ++p)
+			term += (char)toupper((unsigned char)*p);
+		terms.push_back(term);
+	}
+}
+
+const char* shader_index_checksum(const void* data, size_t size,
+								  uint32_t checksum[4])
+{
+	const dxbc_container_header* header = (const dxbc_container_header*)data;
+	if (size < sizeof(*header) || bswap_le32(header->fourcc) != FOURCC_DXBC)
+		return "Not a DXBC container";
+	size_t total_size = bswap_le32(header->total_size);
+	if (total_size > size)
+		return "Container is truncated";
+	memcpy(checksum, header->unk, sizeof(header->unk));
+	if (!(checksum[0] | checksum[1] | checksum[2] | checksum[3]) &&
+		!dxbc_checksum(data, total_size, checksum))
+		return "Container has no checksum";
+	return 0;
+}
+
+const char* shader_index_terms(const void* data, size_t size,
+							   sm4_arena& arena,
+							   std::vector<std::string>& terms)
+{
+	terms.clear();
+	dxbc_view view;
+	const char* error = dxbc_check_size(size);
+	if (!error)
+		error = view.init(data, (int)size);
+	if (error)
+		return error;
+	dxbc_chunk_header* sm4_chunk = view.find_shader_bytecode();
+	if (!sm4_chunk)
+		return "No shader bytecode";
+	sm4_parse_error parse_error;
+	sm4_program* sm4 = sm4_parse(sm4_chunk + 1, bswap_le32(sm4_chunk->size),
+								 &arena, &parse_error);
+	if (!sm4)
+	{
+		arena.reset();
+		return sm4_parse_error_names[parse_error.code];
+	}
+
+	bool opcodes[SM4_OPCODE_COUNT], files[SM4_FILE_COUNT];
+	memset(opcodes, 0, sizeof(opcodes));
+	memset(files, 0, sizeof(files));
+	for (unsigned i = 0; i < sm4->dcls.size(); ++i)
+	{
+		const sm4_dcl& dcl = *sm4->dcls[i];
+		opcodes[dcl.opcode] = true;
+		if (dcl.op)
+			add_op_files(*dcl.op, files);
+		if (dcl.opcode == SM4_OPCODE_DCL_RESOURCE ||
+			dcl.opcode == SM4_OPCODE_DCL_UNORDERED_ACCESS_VIEW_TYPED)
+		{
+			/* both have the target in the same bits */
+			unsigned target = dcl.dcl_resource.target;
+			terms.push_back(std::string(sm4_opcode_names[dcl.opcode]) + "_" +
+							(target < SM4_TARGET_COUNT
+								 ? sm4_target_names[target]
+								 : "unknown"));
+		}
+		else if (dcl.opcode == SM4_OPCODE_DCL_GLOBAL_FLAGS)
+		{
+			unsigned bits[] = {
+				dcl.dcl_global_flags.allow_refactoring,
+				dcl.dcl_global_flags.fp64,
+				dcl.dcl_global_flags.early_depth_stencil,
+				dcl.dcl_global_flags.enable_raw_and_structured_in_non_cs,
+			};
+			for (unsigned b = 0; b < 4; ++b)
+				if (bits[b])
+					terms.push_back(std::string("flag:") +
+									global_flag_names[b]);
+		}
+	}
+	for (unsigned i = 0; i < sm4->insns.size(); ++i)
+	{
+		const sm4_insn& insn = *sm4->insns[i];
+		opcodes[insn.opcode] = true;
+		for (unsigned j = 0; j < insn.num_ops && j < SM4_MAX_OPS; ++j)
+			if (insn.ops[j])
+				add_op_files(*insn.ops[j], files);
+	}
+	delete sm4;
+	arena.reset();
+
+	for (unsigned i = 0; i < SM4_OPCODE_COUNT; ++i)
+		if (opcodes[i])
+			terms.push_back(sm4_opcode_names[i]);
+	for (unsigned i = 0; i < SM4_FILE_COUNT; ++i)
+		if (files[i])
+			terms.push_back(std::string("file:") + sm4_file_names[i]);
+	add_semantics(view.find_signature(DXBC_FIND_INPUT_SIGNATURE), "in:",
+				  terms);
+	add_semantics(view.find_signature(DXBC_FIND_OUTPUT_SIGNATURE), "out:",
+				  terms);
+	add_semantics(view.find_signature(DXBC_FIND_PATCH_SIGNATURE), "patch:",
+				  terms);
+
+	std::sort(terms.begin(), terms.end());
+	terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+	return 0;
+}
+
+const char* shader_index::init(const void* data, size_t size)
+{
+	const shader_index_header& header = *(const shader_index_header*)data;
+	if (size < sizeof(header))
+		return "Index is too small";
+	if (header.magic != SHADER_INDEX_MAGIC)
+		return "Not a shader index";
+	if (header.format_version != SHADER_INDEX_FORMAT_VERSION)
+		return "Unsupported index format version";
+	if (header.size > size)
+		return "Index is truncated";
+	for (unsigned i = 0; i < SHADER_INDEX_SECTION_COUNT; ++i)
+	{
+		size_t offset = header.sections[i].offset;
+		size_t count = header.sections[i].count;
+		if (offset & (sizeof(uint32_t) - 1) || offset > header.size ||
+			count > (header.size - offset) / section_record_sizes[i])
+			return "Index section out of bounds";
+	}
+
+	const char* base = (const char*)data;
+	docs = (const shader_index_doc*)(base +
+									 header.sections[SHADER_INDEX_DOCS].offset);
+	num_docs = header.sections[SHADER_INDEX_DOCS].count;
+	terms = (const shader_index_term*)(base +
+									   header.sections[SHADER_INDEX_TERMS]
+										   .offset);
+	num_terms = header.sections[SHADER_INDEX_TERMS].count;
+	postings = (const uint8_t*)(base +
+								header.sections[SHADER_INDEX_POSTINGS].offset);
+	postings_size = header.sections[SHADER_INDEX_POSTINGS].count;
+	strings = base + header.sections[SHADER_INDEX_STRINGS].offset;
+	strings_size = header.sections[SHADER_INDEX_STRINGS].count;
+
+	/* every string ends before the last NUL */
+	if (strings_size && strings[strings_size - 1])
+		return "Index strings are not terminated";
+	for (unsigned i = 0; i < num_docs; ++i)
+		if (docs[i].path >= strings_size)
+			return "Document path out of bounds";
+	for (unsigned i = 0; i < num_terms; ++i)
+	{
+		const shader_index_term& term = terms[i];
+		if (term.name >= strings_size || term.postings > postings_size ||
+			term.size > postings_size - term.postings ||
+			term.count > num_docs)
+			return "Term out of bounds";
+		if (i && strcmp(name(terms[i - 1]), name(term)) >= 0)
+			return "Terms are not sorted";
+	}
+	return 0;
+}
+
+struct term_less
+{
+	const shader_index& index;
+
+	bool operator()(const shader_index_term& term, const char* name) const
+	{
+		return strcmp(index.name(term), name) < 0;
+	}
+};
+
+const shader_index_term* shader_index::find(const char* name) const
+{
+	term_less less = {*this};
+	const shader_index_term* end = terms + num_terms;
+	const shader_index_term* term = std::lower_bound(terms, end, name, less);
+	return term != end && !strcmp(this->name(*term), name) ? term : 0;
+}
+
+bool shader_index::decode(const shader_index_term& term,
+						  std::vector<uint32_t>& out) const
+{
+	const uint8_t* p = postings + term.postings;
+	const uint8_t* end = p + term.size;
+	uint64_t doc = (uint64_t)-1;
+	for (unsigned i = 0; i < term.count; ++i)
+	{
+		uint64_t delta = 0;
+		for (unsigned shift = 0;; shift += 7)
+		{
+			if (p == end || shift > 28)
+				return false;
+			uint8_t byte = *p++;
+			delta |= (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+		doc += delta + 1;
+		if (doc >= num_docs)
+			return false;
+		out.push_back((uint32_t)doc);
+	}
+	return p == end;
+}
+
+/* the expression is taken apart into names, operators and parentheses
+ * as it is parsed; every level leaves the documents it matches in order */
+struct query_parser
+{
+	const shader_index& index;
+	const char* p;
+	std::string token;
+	const char* error;
+
+	query_parser(const shader_index& index, const char* expression)
+		: index(index), p(expression), error(0)
+	{
+		next();
+	}
+
+	static bool is_name_char(char c)
+	{
+		return isalnum((unsigned char)c) || c == '_' || c == ':' || c == '.' ||
+			   c == '-';
+	}
+
+	void next()
+	{
+		while (isspace((unsigned char)*p))
+			++p;
+		token.clear();
+		if (!*p)
+			return;
+		if (strchr("()&|!", *p))
+		{
+			token = *p++;
+			/* && and || read the same */
+			if ((token == "&" || token == "|") && *p == token[0])
+				++p;
+			return;
+		}
+		while (is_name_char(*p))
+			token += *p++;
+		if (token.empty())
+		{
+			error = "Unexpected character in query";
+			token = "";
+		}
+	}
+
+	bool is_and() const { return token == "AND" || token == "&"; }
+	bool is_or() const { return token == "OR" || token == "|"; }
+	bool is_not() const { return token == "NOT" || token == "!"; }
+
+	/* a factor can start here, with the AND left out */
+	bool is_factor() const
+	{
+		return !token.empty() && !is_and() && !is_or() && token != ")";
+	}
+
+	void expression(std::vector<uint32_t>& docs)
+	{
+		conjunction(docs);
+		while (!error && is_or())
+		{
+			next();
+			std::vector<uint32_t> rhs, both;
+			conjunction(rhs);
+			std::set_union(docs.begin(), docs.end(), rhs.begin(), rhs.end(),
+						   std::back_inserter(both));
+			docs.swap(both);
+		}
+	}
+
+	void conjunction(std::vector<uint32_t>& docs)
+	{
+		factor(docs);
+		while (!error && (is_and() || is_factor()))
+		{
+			if (is_and())
+				next();
+			std::vector<uint32_t> rhs, both;
+			factor(rhs);
+			std::set_intersection(docs.begin(), docs.end(), rhs.begin(),
+								  rhs.end(), std::back_inserter(both));
+			docs.swap(both);
+		}
+	}
+
+	void factor(std::vector<uint32_t>& docs)
+	{
+		docs.clear();
+		if (error)
+			return;
+		if (is_not())
+		{
+			next();
+			std::vector<uint32_t> negated;
+			factor(negated);
+			unsigned j = 0;
+			for (uint32_t d = 0; d < index.num_docs; ++d)
+			{
+				if (j < negated.size() && negated[j] == d)
+					++j;
+				else
+					docs.push_back(d);
+			}
+		}
+		else if (token == "(")
+		{
+			next();
+			expression(docs);
+			if (!error && token != ")")
+				error = "Missing ) in query";
+			next();
+		}
+		else if (is_factor())
+		{
+			term(docs);
+			next();
+		}
+		else
+			error = "Missing term in query";
+	}
+
+	void term(std::vector<uint32_t>& docs)
+	{
+		std::string name = token;
+		if (!name.compare(0, 11, "SM4_OPCODE_"))
+		{
+			name.erase(0, 11);
+			for (unsigned i = 0; i < name.size(); ++i)
+				name[i] = (char)tolower((unsigned char)name[i]);
+		}
+		size_t colon = name.find(':');
+		if (colon != std::string::npos && name.compare(0, colon, "file") &&
+			name.compare(0, colon, "flag"))
+		{
+			for (size_t i = colon + 1; i < name.size(); ++i)
+				name[i] = (char)toupper((unsigned char)name[i]);
+		}
+		const shader_index_term* t = index.find(name.c_str());
+		if (t && !index.decode(*t, docs))
+			error = "Corrupt index postings";
+	}
+};
+
+const char* shader_index::query(const char* expression,
+								std::vector<uint32_t>& docs) const
+{
+	query_parser parser(*this, expression);
+	parser.expression(docs);
+	if (!parser.error && !parser.token.empty())
+		parser.error = "Unexpected token in query";
+	if (parser.error)
+		docs.clear();
+	return parser.error;
+}
+
+static std::pair<uint64_t, uint64_t> checksum_key(const uint32_t checksum[4])
+{
+	return std::make_pair((uint64_t)checksum[0] << 32 | checksum[1],
+						  (uint64_t)checksum[2] << 32 | checksum[3]);
+}
+
+const char* shader_index_builder::load(const shader_index& index)
+{
+	unsigned first = (unsigned)docs.size();
+	for (unsigned i = 0; i < index.num_docs; ++i)
+	{
+		doc d;
+		memcpy(d.checksum, index.docs[i].checksum, sizeof(d.checksum));
+		d.path = index.path(i);
+		d.dropped = false;
+		paths[d.path] = (uint32_t)docs.size();
+		docs.push_back(d);
+		checksums.insert(checksum_key(d.checksum));
+	}
+	std::vector<uint32_t> decoded;
+	for (unsigned i = 0; i < index.num_terms; ++i)
+	{
+		decoded.clear();
+		if (!index.decode(index.terms[i], decoded))
+			return "Corrupt index postings";
+		std::vector<uint32_t>& list = postings[index.name(index.terms[i])];
+		for (unsigned j = 0; j < decoded.size(); ++j)
+			list.push_back(first + decoded[j]);
+	}
+	return 0;
+}
+
+bool shader_index_builder::contains(const uint32_t checksum[4]) const
+{
+	return checksums.count(checksum_key(checksum)) != 0;
+}
+
+bool shader_index_builder::add(const uint32_t checksum[4],
+							   const std::string& path,
+							   const std::vector<std::string>& terms)
+{
+	if (!checksums.insert(checksum_key(checksum)).second)
+		return false;
+	uint32_t number = (uint32_t)docs.size();
+	doc d;
+	memcpy(d.checksum, checksum, sizeof(d.checksum));
+	d.path = path;
+	d.dropped = false;
+	paths[path] = number;
+	docs.push_back(d);
+	for (unsigned i = 0; i < terms.size(); ++i)
+		postings[terms[i]].push_back(number);
+	return true;
+}
+
+bool shader_index_builder::drop(const std::string& path)
+{
+	std::map<std::string, uint32_t>::iterator i = paths.find(path);
+	if (i == paths.end())
+		return false;
+	doc& d = docs[i->second];
+	d.dropped = true;
+	checksums.erase(checksum_key(d.checksum));
+	paths.erase(i);
+	return true;
+}
+
+unsigned shader_index_builder::num_terms() const
+{
+	unsigned count = 0;
+	for (std::map<std::string, std::vector<uint32_t> >::const_iterator i =
+			 postings.begin();
+		 i != postings.end(); ++i)
+		for (unsigned j = 0; j < i->second.size(); ++j)
+			if (!docs[i->second[j]].dropped)
+			{
+				++count;
+				break;
+			}
+	return count;
+}
+
+std::pair<void*, size_t> shader_index_builder::assemble() const
+{
+	/* the documents left are numbered anew, in the same order */
+	std::vector<uint32_t> numbers(docs.size());
+	std::vector<shader_index_doc> out_docs;
+	std::vector<shader_index_term> out_terms;
+	std::vector<uint8_t> out_postings;
+	std::string strings;
+	for (unsigned i = 0; i < docs.size(); ++i)
+	{
+		if (docs[i].dropped)
+			continue;
+		numbers[i] = (uint32_t)out_docs.size();
+		shader_index_doc d;
+		memcpy(d.checksum, docs[i].checksum, sizeof(d.checksum));
+		d.path = (uint32_t)strings.size();
+		out_docs.push_back(d);
+		strings += docs[i].path;
+		strings += '\0';
+	}
+	/* std::map keeps the names in strcmp order */
+	for (std::map<std::string, std::vector<uint32_t> >::const_iterator i =
+			 postings.begin();
+		 i != postings.end(); ++i)
+	{
+		shader_index_term term;
+		term.postings = (uint32_t)out_postings.size();
+		term.count = 0;
+		uint32_t previous = (uint32_t)-1;
+		for (unsigned j = 0; j < i->second.size(); ++j)
+		{
+			if (docs[i->second[j]].dropped)
+				continue;
+			++term.count;
+			uint32_t number = numbers[i->second[j]];
+			uint32_t delta = number - previous - 1;
+			previous = number;
+			while (delta >= 0x80)
+			{
+				out_postings.push_back((uint8_t)(delta | 0x80));
+				delta >>= 7;
+			}
+			out_postings.push_back((uint8_t)delta);
+		}
+		/* terms only dropped documents had go */
+		if (!term.count)
+			continue;
+		term.name = (uint32_t)strings.size();
+		strings += i->first;
+		strings += '\0';
+		term.size = (uint32_t)out_postings.size() - term.postings;
+		out_terms.push_back(term);
+	}
+
+	struct
+	{
+		const void* data;
+		size_t count;
+	} sections[SHADER_INDEX_SECTION_COUNT] = {
+		{out_docs.data(), out_docs.size()},
+		{out_terms.data(), out_terms.size()},
+		{out_postings.data(), out_postings.size()},
+		{strings.data(), strings.size()},
+	};
+
+	size_t size = sizeof(shader_index_header);
+	for (unsigned i = 0; i < SHADER_INDEX_SECTION_COUNT; ++i)
+		size = align8(size) + sections[i].count * section_record_sizes[i];
+	size = align8(size);
+	if (size > 0xffffffffu)
+		return std::make_pair((void*)0, (size_t)0);
+
+	/* zeroed, so that the padding between sections is deterministic */
+	char* index = (char*)calloc(1, size);
+	if (!index)
+		return std::make_pair((void*)0, (size_t)0);
+
+	shader_index_header& header = *(shader_index_header*)index;
+	header.magic = SHADER_INDEX_MAGIC;
+	header.format_version = SHADER_INDEX_FORMAT_VERSION;
+	header.size = (uint32_t)size;
+
+	size_t offset = sizeof(shader_index_header);
+	for (unsigned i = 0; i < SHADER_INDEX_SECTION_COUNT; ++i)
+	{
+		offset = align8(offset);
+		size_t bytes = sections[i].count * section_record_sizes[i];
+		header.sections[i].offset = (uint32_t)offset;
+		header.sections[i].count = (uint32_t)sections[i].count;
+		if (bytes)
+			memcpy(index + offset, sections[i].data, bytes);
+		offset += bytes;
+	}
+	return std::make_pair((void*)index, size);
+}
+
+bool shader_index_builder::write(const std::string& path) const
+{
+	std::pair<void*, size_t> index = assemble();
+	if (!index.first)
+		return false;
+
+	static std::atomic<unsigned> counter(0);
+	char suffix[64];
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = (int)getpid();
+#endif
+	snprintf(suffix, sizeof(suffix), ".tmp.%d.%u", pid, counter++);
+	std::string tmp = path + suffix;
+
+	FILE* f = fopen(tmp.c_str(), "wb");
+	bool ok = f && fwrite(index.first, 1, index.second, f) == index.second;
+	if (f)
+		ok = !fclose(f) && ok;
+	free(index.first);
+
+#ifdef _WIN32
+	ok = ok && MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = ok && !rename(tmp.c_str(), path.c_str());
+#endif
+	if (!ok)
+		remove(tmp.c_str());
+	return ok;
+}
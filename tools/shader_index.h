@@ -0,0 +1,195 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Persistent inverted index over a shader corpus, answering boolean queries
+ * on what the shaders use without parsing them again */
+
+#ifndef SHADER_INDEX_H_
+#define SHADER_INDEX_H_
+
+#include "sm4.h"
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Every shader is indexed under terms named like the disassembly:
+ *   opcodes and declarations            deriv_rtx, dcl_indexableTemp
+ *   resource and typed UAV targets      dcl_resource_texturecube
+ *   register files                      file:temp, file:input_thread_id
+ *   signature semantics, upper case     in:TEXCOORD, out:SV_TARGET,
+ *                                       patch:SV_TESSFACTOR
+ *   dcl_global_flags bits               flag:refactoringAllowed
+ * Shaders are identified by the checksum in their container header,
+ * computed for containers that lack one, so a blob that is already
+ * indexed, under whatever path, is not indexed again.
+ */
+
+#define SHADER_INDEX_MAGIC 0x58444953u /* "SIDX" */
+#define SHADER_INDEX_FORMAT_VERSION 1
+
+enum shader_index_section
+{
+	SHADER_INDEX_DOCS,	   /* shader_index_doc, by document number */
+	SHADER_INDEX_TERMS,	   /* shader_index_term, sorted by name */
+	SHADER_INDEX_POSTINGS, /* uint8_t */
+	SHADER_INDEX_STRINGS,  /* char, NUL-terminated names and paths */
+
+	SHADER_INDEX_SECTION_COUNT
+};
+
+struct shader_index_header
+{
+	uint32_t magic;
+	uint32_t format_version;
+	uint32_t size; /* of the whole index, in bytes */
+	uint32_t unused;
+	struct
+	{
+		uint32_t offset; /* in bytes, from the start of the index */
+		uint32_t count;	 /* in records */
+	} sections[SHADER_INDEX_SECTION_COUNT];
+};
+
+struct shader_index_doc
+{
+	uint32_t checksum[4];
+	uint32_t path; /* offset in the strings */
+};
+
+/* The documents having a term are stored in increasing order, each as its
+ * difference from the previous one (from -1 for the first), in LEB128:
+ * seven bits a byte, the high bit set on all bytes but the last. */
+struct shader_index_term
+{
+	uint32_t name; /* offset in the strings */
+	uint32_t postings; /* offset in the postings */
+	uint32_t size;	 /* of the postings, in bytes */
+	uint32_t count;	 /* of documents */
+};
+
+/* the checksum identifying a container; returns NULL on success, or an
+ * error message */
+const char* shader_index_checksum(const void* data, size_t size,
+								  uint32_t checksum[4]);
+
+/* the terms a container is indexed under, sorted; returns NULL on success,
+ * or an error message. The arena is reset afterwards. */
+const char* shader_index_terms(const void* data, size_t size,
+							   sm4_arena& arena,
+							   std::vector<std::string>& terms);
+
+/* Non-owning view of an index, typically memory mapped. init() checks the
+ * header, that every section lies within the index and that the strings
+ * and postings referred to do, once; the postings themselves are checked
+ * as they are decoded.
+ */
+struct shader_index
+{
+	const shader_index_doc* docs;
+	unsigned num_docs;
+	const shader_index_term* terms;
+	unsigned num_terms;
+	const uint8_t* postings;
+	unsigned postings_size;
+	const char* strings;
+	unsigned strings_size;
+
+	shader_index() { memset(this, 0, sizeof(*this)); }
+
+	/* returns NULL on success, or a description of what is wrong */
+	const char* init(const void* data, size_t size);
+
+	const char* path(unsigned doc) const { return strings + docs[doc].path; }
+	const char* name(const shader_index_term& term) const
+	{
+		return strings + term.name;
+	}
+
+	/* NULL if no shader has the term */
+	const shader_index_term* find(const char* name) const;
+
+	/* appends the documents having the term; returns false if its
+	 * postings are corrupt */
+	bool decode(const shader_index_term& term,
+				std::vector<uint32_t>& docs) const;
+
+	/* Evaluates an expression of terms combined with AND, OR and NOT (or
+	 * &, | and !), in decreasing order of precedence, and parentheses;
+	 * terms next to each other are ANDed. Terms may also be written as
+	 * the SM4_OPCODE_ enumerators. Fills docs with the matching documents,
+	 * in order; returns NULL on success, or an error message. */
+	const char* query(const char* expression,
+					  std::vector<uint32_t>& docs) const;
+};
+
+/* Collects documents and their terms in memory, starting empty or from an
+ * existing index, and lays them out as a new index. Dropped documents keep
+ * their number until then, and are left out of the new index. */
+struct shader_index_builder
+{
+	struct doc
+	{
+		uint32_t checksum[4];
+		std::string path;
+		bool dropped;
+	};
+
+	std::vector<doc> docs;
+	std::map<std::string, std::vector<uint32_t> > postings;
+	/* the number in docs of the document of every path still there */
+	std::map<std::string, uint32_t> paths;
+
+	/* returns NULL on success, or an error message if the postings of the
+	 * index are corrupt */
+	const char* load(const shader_index& index);
+
+	bool contains(const uint32_t checksum[4]) const;
+
+	/* returns false, adding nothing, if the checksum is already there */
+	bool add(const uint32_t checksum[4], const std::string& path,
+			 const std::vector<std::string>& terms);
+
+	/* drops the document of path; returns false if it has none */
+	bool drop(const std::string& path);
+
+	/* the documents and terms the new index will have */
+	unsigned num_docs() const { return (unsigned)paths.size(); }
+	unsigned num_terms() const;
+
+	/* returns a malloc()ed index the caller frees, and its size */
+	std::pair<void*, size_t> assemble() const;
+
+	/* writes the index to a temporary file renamed over path, so that
+	 * readers only ever see a complete index */
+	bool write(const std::string& path) const;
+
+  private:
+	std::set<std::pair<uint64_t, uint64_t> > checksums;
+};
+
+#endif /* SHADER_INDEX_H_ */
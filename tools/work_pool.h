@@ -0,0 +1,176 @@
+/**************************************************************************
+ *
+ * Copyright 2026 The fxdis-ng authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/* Work-stealing thread pool used by the batch modes of the fxdis tool */
+
+#ifndef WORK_POOL_H_
+#define WORK_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Each worker owns a deque of tasks. Tasks are handed out round-robin, a
+ * worker pops its own tasks from the front (oldest first, so completion
+ * order roughly follows submission order) and steals from the back of the
+ * other workers' deques when it runs dry.
+ * Tasks receive the index of the worker running them, so that callers can
+ * keep per-worker state (scratch buffers, counters) without locking.
+ */
+class work_pool
+{
+  public:
+	typedef std::function<void(unsigned worker)> task;
+
+	explicit work_pool(unsigned num_threads = 0)
+		: next_queue(0), queued(0), pending(0), quit(false)
+	{
+		if (!num_threads)
+			num_threads = std::thread::hardware_concurrency();
+		if (!num_threads)
+			num_threads = 1;
+		for (unsigned i = 0; i < num_threads; ++i)
+			queues.push_back(std::unique_ptr<queue>(new queue));
+		for (unsigned i = 0; i < num_threads; ++i)
+			threads.push_back(std::thread(&work_pool::run, this, i));
+	}
+
+	~work_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(idle_mutex);
+			quit = true;
+		}
+		idle_cond.notify_all();
+		for (unsigned i = 0; i < threads.size(); ++i)
+			threads[i].join();
+	}
+
+	unsigned size() const { return (unsigned)threads.size(); }
+
+	void submit(const task& t)
+	{
+		queue& q = *queues[next_queue++ % queues.size()];
+		/* count the task before it becomes visible, so that a worker
+		 * popping it right away never underflows the counters */
+		{
+			std::lock_guard<std::mutex> lock(idle_mutex);
+			++queued;
+			++pending;
+		}
+		{
+			std::lock_guard<std::mutex> lock(q.mutex);
+			q.tasks.push_back(t);
+		}
+		idle_cond.notify_one();
+	}
+
+	/* blocks until every task submitted so far has finished */
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(idle_mutex);
+		done_cond.wait(lock, [this] { return pending == 0; });
+	}
+
+  private:
+	struct queue
+	{
+		std::mutex mutex;
+		std::deque<task> tasks;
+	};
+
+	bool pop(unsigned worker, task& t)
+	{
+		{
+			queue& own = *queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				t.swap(own.tasks.front());
+				own.tasks.pop_front();
+				return true;
+			}
+		}
+		for (unsigned i = 1; i < queues.size(); ++i)
+		{
+			queue& victim = *queues[(worker + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				t.swap(victim.tasks.back());
+				victim.tasks.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(unsigned worker)
+	{
+		for (;;)
+		{
+			task t;
+			if (pop(worker, t))
+			{
+				{
+					std::lock_guard<std::mutex> lock(idle_mutex);
+					--queued;
+				}
+				t(worker);
+				std::lock_guard<std::mutex> lock(idle_mutex);
+				if (!--pending)
+					done_cond.notify_all();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(idle_mutex);
+			idle_cond.wait(lock, [this] { return quit || queued > 0; });
+			if (quit && !queued)
+				return;
+		}
+	}
+
+	std::vector<std::unique_ptr<queue>> queues;
+	std::vector<std::thread> threads;
+	std::atomic<unsigned> next_queue;
+
+	std::mutex idle_mutex;
+	std::condition_variable idle_cond;
+	std::condition_variable done_cond;
+	unsigned queued;  /* sitting in a deque */
+	unsigned pending; /* queued or running */
+	bool quit;
+
+	work_pool(const work_pool&);
+	work_pool& operator=(const work_pool&);
+};
+
+#endif /* WORK_POOL_H_ */